@@ -1065,6 +1065,20 @@ draw_collect_pipeline_statistics(struct draw_context *draw,
    draw->collect_statistics = enable;
 }
 
+/**
+ * Get the number of vertices referenced by indexed draws, and the number
+ * of them which were actually fetched and shaded, since the context was
+ * created.  The difference is the work saved by the vertex cache.
+ */
+void
+draw_get_vertex_cache_stats(struct draw_context *draw,
+                            uint64_t *referenced,
+                            uint64_t *shaded)
+{
+   *referenced = draw->pt.vcache.referenced;
+   *shaded = draw->pt.vcache.shaded;
+}
+
 /**
  * Computes clipper invocation statistics.
  *
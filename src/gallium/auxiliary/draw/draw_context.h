@@ -280,6 +280,10 @@ void draw_set_force_passthrough( struct draw_context *draw,
 void draw_collect_pipeline_statistics(struct draw_context *draw,
                                       boolean enable);
 
+void draw_get_vertex_cache_stats(struct draw_context *draw,
+                                 uint64_t *referenced,
+                                 uint64_t *shaded);
+
 /*******************************************************************************
  * Draw pipeline 
  */
@@ -209,6 +209,12 @@ struct draw_context
          float (*planes)[DRAW_TOTAL_CLIP_PLANES][4]; 
       } user;
 
+      /* Vertices referenced by indexed draws, and actually shaded */
+      struct {
+         uint64_t referenced;
+         uint64_t shaded;
+      } vcache;
+
       boolean test_fse;         /* enable FSE even though its not correct (eg for softpipe) */
       boolean no_fse;           /* disable FSE even when it is correct */
    } pt;
@@ -39,6 +39,7 @@ struct draw_pt_middle_end;
 struct draw_context;
 struct draw_prim_info;
 struct draw_vertex_info;
+struct vertex_header;
 
 
 #define PT_SHADE      0x1
@@ -47,6 +48,32 @@ struct draw_vertex_info;
 #define PT_MAX_MIDDLE 0x8
 
 
+/* One piece of a draw call, as handed from the front end to the middle
+ * end.  Used when the vertices of several pieces are shaded concurrently.
+ */
+struct draw_pt_chunk {
+   boolean linear_fetch;      /**< fetch fetch_start .. + fetch_count */
+   unsigned fetch_start;
+   const unsigned *fetch_elts;
+   unsigned fetch_count;
+
+   const ushort *draw_elts;   /**< NULL for linear draws */
+   unsigned draw_count;
+   unsigned prim_flags;
+
+   /* Filled in by middle->shade_chunk() */
+   struct vertex_header *verts;
+   unsigned clipped;
+
+   /* Owned by the front end */
+   unsigned *fetch_storage;
+   unsigned fetch_storage_size;
+   ushort *draw_storage;
+   unsigned draw_storage_size;
+   boolean done;
+};
+
+
 /* The "front end" - prepare sets of fetch, draw elements for the
  * middle end.
  *
@@ -124,6 +151,18 @@ struct draw_pt_middle_end {
 
    int (*get_max_vertex_count)( struct draw_pt_middle_end * );
 
+   /* Optional, split version of the run functions.  shade_chunk() fetches
+    * and vertex shades a chunk and may be called from any thread, for
+    * several chunks at once.  finish_chunk() runs the rest of the
+    * pipeline and must be called from the draw thread, in the order the
+    * chunks were generated.
+    */
+   void (*shade_chunk)( struct draw_pt_middle_end *,
+                        struct draw_pt_chunk *chunk );
+
+   void (*finish_chunk)( struct draw_pt_middle_end *,
+                         struct draw_pt_chunk *chunk );
+
    void (*finish)( struct draw_pt_middle_end * );
    void (*destroy)( struct draw_pt_middle_end * );
 };
@@ -132,7 +171,6 @@ struct draw_pt_middle_end {
 /* The "back end" - supplied by the driver, defined in draw_vbuf.h.
  */
 struct vbuf_render;
-struct vertex_header;
 
 
 /* Frontends: 
@@ -242,6 +280,16 @@ struct pt_post_vs *draw_pt_post_vs_create( struct draw_context *draw );
 void draw_pt_post_vs_destroy( struct pt_post_vs *pvs );
 
 
+/*******************************************************************************
+ * Batched trivial reject and face culling of clipped triangles:
+ */
+unsigned draw_pt_cull_triangles( struct draw_context *draw,
+                                 const struct draw_vertex_info *vert_info,
+                                 const struct draw_prim_info *prim_info,
+                                 ushort *elts,
+                                 boolean *need_clip );
+
+
 /*******************************************************************************
  * Utils: 
  */
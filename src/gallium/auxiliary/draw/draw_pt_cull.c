@@ -0,0 +1,285 @@
+/**************************************************************************
+ *
+ * Copyright 2016 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * \file
+ * Batched trivial rejection and face culling of triangles.
+ *
+ * Once a single vertex of a chunk is outside a clip plane the whole chunk
+ * goes through the per-primitive pipeline, one prim_header at a time.
+ * For geometry that mostly lies outside the view volume, or where half of
+ * the triangles face away, the majority of that work ends with the clip
+ * stage rejecting the triangle or the cull stage dropping it.  Here the
+ * same two tests are done over all the triangles of the chunk up front,
+ * four triangles at a time when SSE is available, and only the survivors
+ * are handed on as a triangle list.
+ *
+ * The results must match what the clip and cull stages would decide:
+ * triangles are rejected only when all three vertices are outside the same
+ * plane, and faces are only culled for triangles which the clipper would
+ * pass through untouched, using the same window coordinate determinant as
+ * draw_pipe_cull.c.  Triangles which do cross a clip plane, including the
+ * near plane, are still clipped one at a time by draw_pipe_clip.c.
+ */
+
+#include "pipe/p_config.h"
+#include "pipe/p_defines.h"
+#include "util/u_debug.h"
+#include "util/u_math.h"
+#include "util/u_sse.h"
+#include "draw/draw_context.h"
+#include "draw/draw_private.h"
+#include "draw/draw_pt.h"
+
+
+/**
+ * Same decision as cull_tri(), given the sign of the determinant.
+ */
+static inline boolean
+face_culled(boolean zero, boolean ccw, unsigned cull_face, unsigned front_ccw)
+{
+   unsigned face;
+
+   if (zero)
+      return TRUE;
+
+   face = (ccw == front_ccw) ? PIPE_FACE_FRONT : PIPE_FACE_BACK;
+   return (face & cull_face) != 0;
+}
+
+
+/**
+ * Write the vertex indices of the triangles of all the primitives of a
+ * triangle list, strip or fan to elts, in the same order as
+ * draw_pt_decompose.h hands them to the pipeline.
+ *
+ * \return number of triangles
+ */
+static unsigned
+decompose_triangles(struct draw_context *draw,
+                    const struct draw_prim_info *prim_info,
+                    unsigned max_index,
+                    ushort *elts)
+{
+   const boolean last_vertex_last =
+      !(draw->rasterizer->flatshade &&
+        draw->rasterizer->flatshade_first);
+   unsigned num_tris = 0;
+   unsigned start, p, i;
+
+#define GET_ELT(idx) \
+   (prim_info->linear ? start + (idx) : \
+    MIN2(prim_info->elts[start + (idx)], max_index))
+
+#define EMIT_TRI(i0, i1, i2) \
+   do { \
+      elts[num_tris * 3 + 0] = (ushort) (i0); \
+      elts[num_tris * 3 + 1] = (ushort) (i1); \
+      elts[num_tris * 3 + 2] = (ushort) (i2); \
+      num_tris++; \
+   } while (0)
+
+   for (start = p = 0;
+        p < prim_info->primitive_count;
+        start += prim_info->primitive_lengths[p], p++) {
+      const unsigned count = prim_info->primitive_lengths[p];
+
+      switch (prim_info->prim) {
+      case PIPE_PRIM_TRIANGLES:
+         for (i = 0; i + 2 < count; i += 3)
+            EMIT_TRI(GET_ELT(i), GET_ELT(i + 1), GET_ELT(i + 2));
+         break;
+
+      case PIPE_PRIM_TRIANGLE_STRIP:
+         for (i = 0; i + 2 < count; i++) {
+            if (!(i & 1))
+               EMIT_TRI(GET_ELT(i), GET_ELT(i + 1), GET_ELT(i + 2));
+            else if (last_vertex_last)
+               EMIT_TRI(GET_ELT(i + 1), GET_ELT(i), GET_ELT(i + 2));
+            else
+               EMIT_TRI(GET_ELT(i), GET_ELT(i + 2), GET_ELT(i + 1));
+         }
+         break;
+
+      case PIPE_PRIM_TRIANGLE_FAN:
+         for (i = 0; i + 2 < count; i++) {
+            if (last_vertex_last)
+               EMIT_TRI(GET_ELT(0), GET_ELT(i + 1), GET_ELT(i + 2));
+            else
+               EMIT_TRI(GET_ELT(i + 1), GET_ELT(i + 2), GET_ELT(0));
+         }
+         break;
+
+      default:
+         assert(0);
+         break;
+      }
+   }
+
+#undef EMIT_TRI
+#undef GET_ELT
+
+   return num_tris;
+}
+
+
+/**
+ * Turn the triangles of a triangle list, strip or fan into a triangle
+ * list, dropping the ones which the clip and cull stages would throw away.
+ *
+ * \param elts  receives the indices of the surviving triangles, must have
+ *              room for 3 * prim_info->count entries
+ * \param need_clip  returns whether any surviving triangle has a vertex
+ *                   outside a clip plane
+ * \return number of indices written to elts
+ */
+unsigned
+draw_pt_cull_triangles(struct draw_context *draw,
+                       const struct draw_vertex_info *vert_info,
+                       const struct draw_prim_info *prim_info,
+                       ushort *elts,
+                       boolean *need_clip)
+{
+   const char *verts = (const char *)vert_info->verts;
+   const unsigned stride = vert_info->stride;
+   const unsigned max_index = vert_info->count - 1;
+   const unsigned pos = draw_current_shader_position_output(draw);
+   const unsigned cull_face = draw->rasterizer->cull_face;
+   const unsigned front_ccw = draw->rasterizer->front_ccw;
+   unsigned num_tris;
+   unsigned clip_or = 0;
+   unsigned count = 0;
+   unsigned i = 0;
+
+   /* The survivors are compacted in place, never overtaking the triangle
+    * being read.
+    */
+   num_tris = decompose_triangles(draw, prim_info, max_index, elts);
+
+#define GET_ELT(idx) (elts[idx])
+
+#define GET_VERT(elt) \
+   ((const struct vertex_header *)(verts + (elt) * stride))
+
+#if defined(PIPE_ARCH_SSE)
+   for (; i + 4 <= num_tris; i += 4) {
+      const struct vertex_header *v[4][3];
+      unsigned idx[4][3];
+      unsigned and_mask[4];
+      unsigned or_mask[4];
+      int zero_bits = 0;
+      int ccw_bits = 0;
+      unsigned j, k;
+
+      for (j = 0; j < 4; j++) {
+         for (k = 0; k < 3; k++) {
+            idx[j][k] = GET_ELT((i + j) * 3 + k);
+            v[j][k] = GET_VERT(idx[j][k]);
+         }
+         and_mask[j] = v[j][0]->clipmask & v[j][1]->clipmask & v[j][2]->clipmask;
+         or_mask[j] = v[j][0]->clipmask | v[j][1]->clipmask | v[j][2]->clipmask;
+      }
+
+      if (cull_face != PIPE_FACE_NONE) {
+         /* edge vectors: e = v0 - v2, f = v1 - v2, det = cross(e,f).z */
+         __m128 x2 = _mm_setr_ps(v[0][2]->data[pos][0], v[1][2]->data[pos][0],
+                                 v[2][2]->data[pos][0], v[3][2]->data[pos][0]);
+         __m128 y2 = _mm_setr_ps(v[0][2]->data[pos][1], v[1][2]->data[pos][1],
+                                 v[2][2]->data[pos][1], v[3][2]->data[pos][1]);
+         __m128 ex = _mm_sub_ps(_mm_setr_ps(v[0][0]->data[pos][0],
+                                            v[1][0]->data[pos][0],
+                                            v[2][0]->data[pos][0],
+                                            v[3][0]->data[pos][0]), x2);
+         __m128 ey = _mm_sub_ps(_mm_setr_ps(v[0][0]->data[pos][1],
+                                            v[1][0]->data[pos][1],
+                                            v[2][0]->data[pos][1],
+                                            v[3][0]->data[pos][1]), y2);
+         __m128 fx = _mm_sub_ps(_mm_setr_ps(v[0][1]->data[pos][0],
+                                            v[1][1]->data[pos][0],
+                                            v[2][1]->data[pos][0],
+                                            v[3][1]->data[pos][0]), x2);
+         __m128 fy = _mm_sub_ps(_mm_setr_ps(v[0][1]->data[pos][1],
+                                            v[1][1]->data[pos][1],
+                                            v[2][1]->data[pos][1],
+                                            v[3][1]->data[pos][1]), y2);
+         __m128 det = _mm_sub_ps(_mm_mul_ps(ex, fy), _mm_mul_ps(ey, fx));
+
+         zero_bits = _mm_movemask_ps(_mm_cmpeq_ps(det, _mm_setzero_ps()));
+         ccw_bits = _mm_movemask_ps(_mm_cmplt_ps(det, _mm_setzero_ps()));
+      }
+
+      for (j = 0; j < 4; j++) {
+         if (and_mask[j])
+            continue;
+
+         if (cull_face != PIPE_FACE_NONE && or_mask[j] == 0 &&
+             face_culled((zero_bits >> j) & 1, (ccw_bits >> j) & 1,
+                         cull_face, front_ccw))
+            continue;
+
+         clip_or |= or_mask[j];
+         elts[count++] = idx[j][0];
+         elts[count++] = idx[j][1];
+         elts[count++] = idx[j][2];
+      }
+   }
+#endif
+
+   for (; i < num_tris; i++) {
+      const unsigned i0 = GET_ELT(i * 3 + 0);
+      const unsigned i1 = GET_ELT(i * 3 + 1);
+      const unsigned i2 = GET_ELT(i * 3 + 2);
+      const struct vertex_header *v0 = GET_VERT(i0);
+      const struct vertex_header *v1 = GET_VERT(i1);
+      const struct vertex_header *v2 = GET_VERT(i2);
+      const unsigned or_mask = v0->clipmask | v1->clipmask | v2->clipmask;
+
+      if (v0->clipmask & v1->clipmask & v2->clipmask)
+         continue;
+
+      if (cull_face != PIPE_FACE_NONE && or_mask == 0) {
+         const float ex = v0->data[pos][0] - v2->data[pos][0];
+         const float ey = v0->data[pos][1] - v2->data[pos][1];
+         const float fx = v1->data[pos][0] - v2->data[pos][0];
+         const float fy = v1->data[pos][1] - v2->data[pos][1];
+         const float det = ex * fy - ey * fx;
+
+         if (face_culled(det == 0, det < 0, cull_face, front_ccw))
+            continue;
+      }
+
+      clip_or |= or_mask;
+      elts[count++] = i0;
+      elts[count++] = i1;
+      elts[count++] = i2;
+   }
+
+#undef GET_ELT
+#undef GET_VERT
+
+   *need_clip = clip_or != 0;
+   return count;
+}
@@ -39,6 +39,9 @@
 #include "gallivm/lp_bld_init.h"
 
 
+DEBUG_GET_ONCE_BOOL_OPTION(draw_no_batch_cull, "DRAW_NO_BATCH_CULL", FALSE)
+
+
 struct llvm_middle_end {
    struct draw_pt_middle_end base;
    struct draw_context *draw;
@@ -53,6 +56,11 @@ struct llvm_middle_end {
    unsigned vertex_size;
    unsigned input_prim;
    unsigned opt;
+   boolean batch_cull;
+
+   /** Scratch space for the triangles surviving llvm_pipeline_cull() */
+   ushort *cull_elts;
+   unsigned cull_elts_size;
 
    struct draw_llvm *llvm;
    struct draw_llvm_variant *current_variant;
@@ -336,46 +344,30 @@ emit(struct pt_emit *emit,
 }
 
 
-static void
-llvm_pipeline_generic(struct draw_pt_middle_end *middle,
-                      const struct draw_fetch_info *fetch_info,
-                      const struct draw_prim_info *in_prim_info)
+/**
+ * Fetch and vertex shade the vertices of one chunk.
+ * This only reads the draw state and may run concurrently for several
+ * chunks.  Returns the verts, to be freed by the caller, or NULL.
+ */
+static struct vertex_header *
+llvm_pipeline_shade(struct llvm_middle_end *fpme,
+                    const struct draw_fetch_info *fetch_info,
+                    unsigned *clipped)
 {
-   struct llvm_middle_end *fpme = llvm_middle_end(middle);
    struct draw_context *draw = fpme->draw;
-   struct draw_geometry_shader *gshader = draw->gs.geometry_shader;
-   struct draw_prim_info gs_prim_info;
-   struct draw_vertex_info llvm_vert_info;
-   struct draw_vertex_info gs_vert_info;
-   struct draw_vertex_info *vert_info;
-   struct draw_prim_info ia_prim_info;
-   struct draw_vertex_info ia_vert_info;
-   const struct draw_prim_info *prim_info = in_prim_info;
-   boolean free_prim_info = FALSE;
-   unsigned opt = fpme->opt;
-   unsigned clipped = 0;
+   struct vertex_header *verts;
 
-   llvm_vert_info.count = fetch_info->count;
-   llvm_vert_info.vertex_size = fpme->vertex_size;
-   llvm_vert_info.stride = fpme->vertex_size;
-   llvm_vert_info.verts = (struct vertex_header *)
+   verts = (struct vertex_header *)
       MALLOC(fpme->vertex_size *
              align(fetch_info->count, lp_native_vector_width / 32));
-   if (!llvm_vert_info.verts) {
+   if (!verts) {
       assert(0);
-      return;
-   }
-
-   if (draw->collect_statistics) {
-      draw->statistics.ia_vertices += prim_info->count;
-      draw->statistics.ia_primitives +=
-         u_decomposed_prims_for_vertices(prim_info->prim, prim_info->count);
-      draw->statistics.vs_invocations += fetch_info->count;
+      return NULL;
    }
 
    if (fetch_info->linear)
-      clipped = fpme->current_variant->jit_func( &fpme->llvm->jit_context,
-                                       llvm_vert_info.verts,
+      *clipped = fpme->current_variant->jit_func( &fpme->llvm->jit_context,
+                                       verts,
                                        draw->pt.user.vbuffer,
                                        fetch_info->start,
                                        fetch_info->count,
@@ -385,8 +377,8 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
                                        draw->start_index,
                                        draw->start_instance);
    else
-      clipped = fpme->current_variant->jit_func_elts( &fpme->llvm->jit_context,
-                                            llvm_vert_info.verts,
+      *clipped = fpme->current_variant->jit_func_elts( &fpme->llvm->jit_context,
+                                            verts,
                                             draw->pt.user.vbuffer,
                                             fetch_info->elts,
                                             draw->pt.user.eltMax,
@@ -397,9 +389,108 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
                                             draw->pt.user.eltBias,
                                             draw->start_instance);
 
-   /* Finished with fetch and vs:
-    */
-   fetch_info = NULL;
+   return verts;
+}
+
+
+/**
+ * Drop the triangles of clipped triangle primitives which the clip and
+ * cull stages would throw away anyway, rather than feeding them through
+ * the pipeline one at a time.  The survivors are drawn as a triangle list.
+ * When none of them crosses a clip plane and nothing else needs the
+ * pipeline they take the emit path instead.
+ *
+ * \return TRUE if the primitives have been drawn
+ */
+static boolean
+llvm_pipeline_cull(struct llvm_middle_end *fpme,
+                   const struct draw_vertex_info *vert_info,
+                   const struct draw_prim_info *prim_info,
+                   unsigned opt)
+{
+   struct draw_context *draw = fpme->draw;
+   struct draw_prim_info cull_prim_info;
+   boolean need_clip;
+   unsigned count, size;
+
+   if (!fpme->batch_cull ||
+       (prim_info->prim != PIPE_PRIM_TRIANGLES &&
+        prim_info->prim != PIPE_PRIM_TRIANGLE_STRIP &&
+        prim_info->prim != PIPE_PRIM_TRIANGLE_FAN) ||
+       vert_info->count > 0xffff ||
+       !(draw->clip_xy || draw->clip_z || draw->clip_user))
+      return FALSE;
+
+   /* Strips and fans have up to one triangle per vertex */
+   size = MAX2(prim_info->count, 1) * 3;
+   if (size > fpme->cull_elts_size) {
+      FREE(fpme->cull_elts);
+      fpme->cull_elts = MALLOC(size * sizeof(ushort));
+      if (!fpme->cull_elts) {
+         fpme->cull_elts_size = 0;
+         return FALSE;
+      }
+      fpme->cull_elts_size = size;
+   }
+
+   count = draw_pt_cull_triangles(draw, vert_info, prim_info,
+                                  fpme->cull_elts, &need_clip);
+
+   if (count) {
+      cull_prim_info = *prim_info;
+      cull_prim_info.prim = PIPE_PRIM_TRIANGLES;
+      cull_prim_info.linear = FALSE;
+      cull_prim_info.start = 0;
+      cull_prim_info.elts = fpme->cull_elts;
+      cull_prim_info.count = count;
+      cull_prim_info.primitive_lengths = &count;
+      cull_prim_info.primitive_count = 1;
+
+      if (need_clip || (opt & PT_PIPELINE))
+         draw_pipeline_run(draw, vert_info, &cull_prim_info);
+      else
+         draw_pt_emit(fpme->emit, vert_info, &cull_prim_info);
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Run the rest of the pipeline on the shaded vertices of one chunk.
+ * Takes ownership of verts.
+ */
+static void
+llvm_pipeline_finish(struct llvm_middle_end *fpme,
+                     struct vertex_header *verts,
+                     unsigned fetch_count,
+                     unsigned clipped,
+                     const struct draw_prim_info *in_prim_info)
+{
+   struct draw_context *draw = fpme->draw;
+   struct draw_geometry_shader *gshader = draw->gs.geometry_shader;
+   struct draw_prim_info gs_prim_info;
+   struct draw_vertex_info llvm_vert_info;
+   struct draw_vertex_info gs_vert_info;
+   struct draw_vertex_info *vert_info;
+   struct draw_prim_info ia_prim_info;
+   struct draw_vertex_info ia_vert_info;
+   const struct draw_prim_info *prim_info = in_prim_info;
+   boolean free_prim_info = FALSE;
+   unsigned opt = fpme->opt;
+
+   llvm_vert_info.count = fetch_count;
+   llvm_vert_info.vertex_size = fpme->vertex_size;
+   llvm_vert_info.stride = fpme->vertex_size;
+   llvm_vert_info.verts = verts;
+
+   if (draw->collect_statistics) {
+      draw->statistics.ia_vertices += prim_info->count;
+      draw->statistics.ia_primitives +=
+         u_decomposed_prims_for_vertices(prim_info->prim, prim_info->count);
+      draw->statistics.vs_invocations += fetch_count;
+   }
+
    vert_info = &llvm_vert_info;
 
    if ((opt & PT_SHADE) && gshader) {
@@ -459,7 +550,11 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
 
       /* Do we need to run the pipeline? Now will come here if clipped
        */
-      if (opt & PT_PIPELINE) {
+      if (clipped && llvm_pipeline_cull(fpme, vert_info, prim_info,
+                                        fpme->opt)) {
+         /* drawn already */
+      }
+      else if (opt & PT_PIPELINE) {
          pipeline( fpme, vert_info, prim_info );
       }
       else {
@@ -473,6 +568,23 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
 }
 
 
+static void
+llvm_pipeline_generic(struct draw_pt_middle_end *middle,
+                      const struct draw_fetch_info *fetch_info,
+                      const struct draw_prim_info *prim_info)
+{
+   struct llvm_middle_end *fpme = llvm_middle_end(middle);
+   struct vertex_header *verts;
+   unsigned clipped = 0;
+
+   verts = llvm_pipeline_shade(fpme, fetch_info, &clipped);
+   if (!verts)
+      return;
+
+   llvm_pipeline_finish(fpme, verts, fetch_info->count, clipped, prim_info);
+}
+
+
 static inline unsigned
 prim_type(unsigned prim, unsigned flags)
 {
@@ -573,6 +685,48 @@ llvm_middle_end_linear_run_elts(struct draw_pt_middle_end *middle,
 }
 
 
+static void
+llvm_middle_end_shade_chunk(struct draw_pt_middle_end *middle,
+                            struct draw_pt_chunk *chunk)
+{
+   struct llvm_middle_end *fpme = llvm_middle_end(middle);
+   struct draw_fetch_info fetch_info;
+
+   fetch_info.linear = chunk->linear_fetch;
+   fetch_info.start = chunk->fetch_start;
+   fetch_info.elts = chunk->fetch_elts;
+   fetch_info.count = chunk->fetch_count;
+
+   chunk->clipped = 0;
+   chunk->verts = llvm_pipeline_shade(fpme, &fetch_info, &chunk->clipped);
+}
+
+
+static void
+llvm_middle_end_finish_chunk(struct draw_pt_middle_end *middle,
+                             struct draw_pt_chunk *chunk)
+{
+   struct llvm_middle_end *fpme = llvm_middle_end(middle);
+   struct draw_prim_info prim_info;
+
+   if (!chunk->verts)
+      return;
+
+   prim_info.linear = chunk->draw_elts == NULL;
+   prim_info.start = 0;
+   prim_info.count = chunk->draw_count;
+   prim_info.elts = chunk->draw_elts;
+   prim_info.prim = prim_type(fpme->input_prim, chunk->prim_flags);
+   prim_info.flags = chunk->prim_flags;
+   prim_info.primitive_count = 1;
+   prim_info.primitive_lengths = &chunk->draw_count;
+
+   llvm_pipeline_finish(fpme, chunk->verts, chunk->fetch_count,
+                        chunk->clipped, &prim_info);
+   chunk->verts = NULL;
+}
+
+
 static void
 llvm_middle_end_finish(struct draw_pt_middle_end *middle)
 {
@@ -597,6 +751,7 @@ llvm_middle_end_destroy(struct draw_pt_middle_end *middle)
    if (fpme->post_vs)
       draw_pt_post_vs_destroy( fpme->post_vs );
 
+   FREE(fpme->cull_elts);
    FREE(middle);
 }
 
@@ -618,10 +773,13 @@ draw_pt_fetch_pipeline_or_emit_llvm(struct draw_context *draw)
    fpme->base.run             = llvm_middle_end_run;
    fpme->base.run_linear      = llvm_middle_end_linear_run;
    fpme->base.run_linear_elts = llvm_middle_end_linear_run_elts;
+   fpme->base.shade_chunk     = llvm_middle_end_shade_chunk;
+   fpme->base.finish_chunk    = llvm_middle_end_finish_chunk;
    fpme->base.finish          = llvm_middle_end_finish;
    fpme->base.destroy         = llvm_middle_end_destroy;
 
    fpme->draw = draw;
+   fpme->batch_cull = !debug_get_option_draw_no_batch_cull();
 
    fpme->fetch = draw_pt_fetch_create( draw );
    if (!fpme->fetch)
@@ -23,6 +23,10 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include "os/os_thread.h"
+#include "util/u_atomic.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_debug.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
 
@@ -30,12 +34,24 @@
 #include "draw/draw_private.h"
 #include "draw/draw_pt.h"
 
-#define SEGMENT_SIZE 1024
-#define MAP_SIZE     256
+/* Max and default number of vertices per segment.  The vertex cache
+ * holds all the vertices of a segment, so this also sets the window
+ * within which repeated indices are shaded only once.
+ */
+#define SEGMENT_SIZE 4096
+#define DEFAULT_SEGMENT_SIZE 1024
+
+/* Hash table of the vertex cache, twice the max segment size */
+#define MAP_ORDER    13
+#define MAP_SIZE     (1 << MAP_ORDER)
 
 /* The largest possible index withing an index buffer */
 #define MAX_ELT_IDX 0xffffffff
 
+/* Max number of chunks shaded concurrently, and of threads shading them */
+#define MAX_CHUNKS   32
+#define MAX_THREADS  16
+
 struct vsplit_frontend {
    struct draw_pt_front_end base;
    struct draw_context *draw;
@@ -53,22 +69,319 @@ struct vsplit_frontend {
    ushort identity_draw_elts[SEGMENT_SIZE];
 
    struct {
-      /* map a fetch element to a draw element */
+      /* map a fetch element to a draw element, open addressing */
       unsigned fetches[MAP_SIZE];
       ushort draws[MAP_SIZE];
-      boolean has_max_fetch;
+      /* entries are valid when their stamp matches the segment's */
+      unsigned stamps[MAP_SIZE];
+      unsigned stamp;
 
       ushort num_fetch_elts;
       ushort num_draw_elts;
    } cache;
+
+   unsigned cache_size;   /**< max segment size, DRAW_VERTEX_CACHE_SIZE */
+
+   /* split the draw into segments and run them */
+   void (*run_segments)(struct draw_pt_front_end *frontend,
+                        unsigned start, unsigned count);
+
+   /*
+    * Segments queued for concurrent vertex shading.  The queue is flushed
+    * whenever it is full and at the end of each run, so user pointers stay
+    * valid while the chunks are in flight.
+    */
+   boolean batch;
+   struct draw_pt_chunk chunks[MAX_CHUNKS];
+   unsigned num_chunks;
+   unsigned max_chunks;
+
+   struct {
+      unsigned num_threads;   /**< not counting the draw thread */
+      boolean started;
+      boolean exit;
+      int next_chunk;
+      pipe_thread threads[MAX_THREADS];
+      pipe_semaphore work_ready;
+      pipe_semaphore work_done;
+      pipe_mutex mutex;
+      pipe_condvar chunk_done;
+   } pool;
 };
 
 
+/**
+ * Shade queued chunks until there are none left to claim.
+ */
+static void
+vsplit_shade_chunks(struct vsplit_frontend *vsplit)
+{
+   for (;;) {
+      unsigned i = p_atomic_inc_return(&vsplit->pool.next_chunk) - 1;
+      struct draw_pt_chunk *chunk;
+
+      if (i >= vsplit->num_chunks)
+         break;
+
+      chunk = &vsplit->chunks[i];
+      vsplit->middle->shade_chunk(vsplit->middle, chunk);
+
+      pipe_mutex_lock(vsplit->pool.mutex);
+      chunk->done = TRUE;
+      pipe_condvar_broadcast(vsplit->pool.chunk_done);
+      pipe_mutex_unlock(vsplit->pool.mutex);
+   }
+}
+
+
+static PIPE_THREAD_ROUTINE(vsplit_thread_func, init_data)
+{
+   struct vsplit_frontend *vsplit = (struct vsplit_frontend *) init_data;
+
+   pipe_thread_setname("draw:vs");
+
+   for (;;) {
+      pipe_semaphore_wait(&vsplit->pool.work_ready);
+      if (vsplit->pool.exit)
+         break;
+
+      vsplit_shade_chunks(vsplit);
+
+      pipe_semaphore_signal(&vsplit->pool.work_done);
+   }
+
+   return 0;
+}
+
+
+static boolean
+vsplit_start_threads(struct vsplit_frontend *vsplit)
+{
+   unsigned i;
+
+   if (vsplit->pool.started)
+      return TRUE;
+
+   pipe_semaphore_init(&vsplit->pool.work_ready, 0);
+   pipe_semaphore_init(&vsplit->pool.work_done, 0);
+   pipe_mutex_init(vsplit->pool.mutex);
+   pipe_condvar_init(vsplit->pool.chunk_done);
+
+   for (i = 0; i < vsplit->pool.num_threads; i++) {
+      vsplit->pool.threads[i] = pipe_thread_create(vsplit_thread_func, vsplit);
+      if (!vsplit->pool.threads[i])
+         break;
+   }
+   vsplit->pool.num_threads = i;
+   vsplit->pool.started = TRUE;
+
+   return vsplit->pool.num_threads > 0;
+}
+
+
+static void
+vsplit_stop_threads(struct vsplit_frontend *vsplit)
+{
+   unsigned i;
+
+   if (!vsplit->pool.started)
+      return;
+
+   vsplit->pool.exit = TRUE;
+   for (i = 0; i < vsplit->pool.num_threads; i++)
+      pipe_semaphore_signal(&vsplit->pool.work_ready);
+   for (i = 0; i < vsplit->pool.num_threads; i++)
+      pipe_thread_wait(vsplit->pool.threads[i]);
+
+   pipe_semaphore_destroy(&vsplit->pool.work_ready);
+   pipe_semaphore_destroy(&vsplit->pool.work_done);
+   pipe_mutex_destroy(vsplit->pool.mutex);
+   pipe_condvar_destroy(vsplit->pool.chunk_done);
+   vsplit->pool.started = FALSE;
+}
+
+
+/**
+ * Shade all the queued chunks, concurrently when there are several, and
+ * pass them down the rest of the pipeline in order.
+ */
+static void
+vsplit_flush_chunks(struct vsplit_frontend *vsplit)
+{
+   struct draw_pt_middle_end *middle = vsplit->middle;
+   const unsigned num_chunks = vsplit->num_chunks;
+   boolean parallel = FALSE;
+   unsigned i;
+
+   if (!num_chunks)
+      return;
+
+   if (num_chunks > 1 && vsplit_start_threads(vsplit)) {
+      for (i = 0; i < num_chunks; i++)
+         vsplit->chunks[i].done = FALSE;
+      vsplit->pool.next_chunk = 0;
+
+      for (i = 0; i < vsplit->pool.num_threads; i++)
+         pipe_semaphore_signal(&vsplit->pool.work_ready);
+      parallel = TRUE;
+   }
+
+   for (i = 0; i < num_chunks; i++) {
+      struct draw_pt_chunk *chunk = &vsplit->chunks[i];
+
+      if (parallel) {
+         /* help out until this chunk has been shaded */
+         pipe_mutex_lock(vsplit->pool.mutex);
+         while (!chunk->done) {
+            if (vsplit->pool.next_chunk < (int) num_chunks) {
+               pipe_mutex_unlock(vsplit->pool.mutex);
+               vsplit_shade_chunks(vsplit);
+               pipe_mutex_lock(vsplit->pool.mutex);
+            }
+            else {
+               pipe_condvar_wait(vsplit->pool.chunk_done, vsplit->pool.mutex);
+            }
+         }
+         pipe_mutex_unlock(vsplit->pool.mutex);
+      }
+      else {
+         middle->shade_chunk(middle, chunk);
+      }
+
+      middle->finish_chunk(middle, chunk);
+   }
+
+   if (parallel) {
+      for (i = 0; i < vsplit->pool.num_threads; i++)
+         pipe_semaphore_wait(&vsplit->pool.work_done);
+   }
+
+   vsplit->num_chunks = 0;
+}
+
+
+static struct draw_pt_chunk *
+vsplit_add_chunk(struct vsplit_frontend *vsplit,
+                 unsigned fetch_count, unsigned draw_count, unsigned flags)
+{
+   struct draw_pt_chunk *chunk;
+
+   if (vsplit->num_chunks == vsplit->max_chunks)
+      vsplit_flush_chunks(vsplit);
+
+   chunk = &vsplit->chunks[vsplit->num_chunks];
+
+   if (chunk->fetch_storage_size < fetch_count) {
+      FREE(chunk->fetch_storage);
+      chunk->fetch_storage = MALLOC(fetch_count * sizeof(unsigned));
+      chunk->fetch_storage_size = chunk->fetch_storage ? fetch_count : 0;
+   }
+   if (chunk->draw_storage_size < draw_count) {
+      FREE(chunk->draw_storage);
+      chunk->draw_storage = MALLOC(draw_count * sizeof(ushort));
+      chunk->draw_storage_size = chunk->draw_storage ? draw_count : 0;
+   }
+   if (chunk->fetch_storage_size < fetch_count ||
+       chunk->draw_storage_size < draw_count) {
+      /* out of memory, keep the order when running the segment directly */
+      vsplit_flush_chunks(vsplit);
+      return NULL;
+   }
+
+   chunk->linear_fetch = FALSE;
+   chunk->fetch_start = 0;
+   chunk->fetch_elts = NULL;
+   chunk->fetch_count = fetch_count;
+   chunk->draw_elts = NULL;
+   chunk->draw_count = draw_count;
+   chunk->prim_flags = flags;
+   chunk->verts = NULL;
+   chunk->clipped = 0;
+
+   vsplit->num_chunks++;
+   return chunk;
+}
+
+
+/*
+ * Wrappers around the middle end run functions, which queue the segment
+ * as a chunk when batching.
+ */
+static void
+vsplit_middle_run(struct vsplit_frontend *vsplit,
+                  const unsigned *fetch_elts, unsigned fetch_count,
+                  const ushort *draw_elts, unsigned draw_count,
+                  unsigned flags)
+{
+   struct draw_pt_chunk *chunk = NULL;
+
+   if (vsplit->batch)
+      chunk = vsplit_add_chunk(vsplit, fetch_count, draw_count, flags);
+
+   if (!chunk) {
+      vsplit->middle->run(vsplit->middle, fetch_elts, fetch_count,
+                          draw_elts, draw_count, flags);
+      return;
+   }
+
+   memcpy(chunk->fetch_storage, fetch_elts, fetch_count * sizeof(unsigned));
+   memcpy(chunk->draw_storage, draw_elts, draw_count * sizeof(ushort));
+   chunk->fetch_elts = chunk->fetch_storage;
+   chunk->draw_elts = chunk->draw_storage;
+}
+
+static void
+vsplit_middle_run_linear(struct vsplit_frontend *vsplit,
+                         unsigned start, unsigned count, unsigned flags)
+{
+   struct draw_pt_chunk *chunk = NULL;
+
+   if (vsplit->batch)
+      chunk = vsplit_add_chunk(vsplit, 0, 0, flags);
+
+   if (!chunk) {
+      vsplit->middle->run_linear(vsplit->middle, start, count, flags);
+      return;
+   }
+
+   chunk->linear_fetch = TRUE;
+   chunk->fetch_start = start;
+   chunk->fetch_count = count;
+   chunk->draw_count = count;
+}
+
+static boolean
+vsplit_middle_run_linear_elts(struct vsplit_frontend *vsplit,
+                              unsigned start, unsigned count,
+                              const ushort *draw_elts, unsigned draw_count,
+                              unsigned flags)
+{
+   struct draw_pt_chunk *chunk = NULL;
+
+   if (vsplit->batch)
+      chunk = vsplit_add_chunk(vsplit, 0, draw_count, flags);
+
+   if (!chunk) {
+      return vsplit->middle->run_linear_elts(vsplit->middle, start, count,
+                                             draw_elts, draw_count, flags);
+   }
+
+   memcpy(chunk->draw_storage, draw_elts, draw_count * sizeof(ushort));
+   chunk->linear_fetch = TRUE;
+   chunk->fetch_start = start;
+   chunk->fetch_count = count;
+   chunk->draw_elts = chunk->draw_storage;
+   return TRUE;
+}
+
+
 static void
 vsplit_clear_cache(struct vsplit_frontend *vsplit)
 {
-   memset(vsplit->cache.fetches, 0xff, sizeof(vsplit->cache.fetches));
-   vsplit->cache.has_max_fetch = FALSE;
+   if (++vsplit->cache.stamp == 0) {
+      memset(vsplit->cache.stamps, 0, sizeof(vsplit->cache.stamps));
+      vsplit->cache.stamp = 1;
+   }
    vsplit->cache.num_fetch_elts = 0;
    vsplit->cache.num_draw_elts = 0;
 }
@@ -76,25 +389,37 @@ vsplit_clear_cache(struct vsplit_frontend *vsplit)
 static void
 vsplit_flush_cache(struct vsplit_frontend *vsplit, unsigned flags)
 {
-   vsplit->middle->run(vsplit->middle,
+   vsplit->draw->pt.vcache.referenced += vsplit->cache.num_draw_elts;
+   vsplit->draw->pt.vcache.shaded += vsplit->cache.num_fetch_elts;
+
+   vsplit_middle_run(vsplit,
          vsplit->fetch_elts, vsplit->cache.num_fetch_elts,
          vsplit->draw_elts, vsplit->cache.num_draw_elts, flags);
 }
 
 /**
  * Add a fetch element and add it to the draw elements.
+ *
+ * The table has room for twice the elements of a segment so the linear
+ * probing always ends, and every repeated element of the segment is
+ * found.
  */
 static inline void
 vsplit_add_cache(struct vsplit_frontend *vsplit, unsigned fetch, unsigned ofbias)
 {
+   const unsigned stamp = vsplit->cache.stamp;
    unsigned hash;
 
-   hash = fetch % MAP_SIZE;
+   hash = (fetch * 2654435761u) >> (32 - MAP_ORDER);
+   while (vsplit->cache.stamps[hash] == stamp &&
+          vsplit->cache.fetches[hash] != fetch)
+      hash = (hash + 1) & (MAP_SIZE - 1);
 
    /* If the value isn't in the cache or it's an overflow due to the
     * element bias */
-   if (vsplit->cache.fetches[hash] != fetch || ofbias) {
+   if (vsplit->cache.stamps[hash] != stamp || ofbias) {
       /* update cache */
+      vsplit->cache.stamps[hash] = stamp;
       vsplit->cache.fetches[hash] = fetch;
       vsplit->cache.draws[hash] = vsplit->cache.num_fetch_elts;
 
@@ -198,16 +523,7 @@ vsplit_add_cache_uint(struct vsplit_frontend *vsplit, const uint *elts,
                       unsigned start, unsigned fetch, int elt_bias)
 {
    struct draw_context *draw = vsplit->draw;
-   unsigned raw_elem_idx = start + fetch + elt_bias;
    VSPLIT_CREATE_IDX(elts, start, fetch, elt_bias);
-
-   /* special care for DRAW_MAX_FETCH_IDX */
-   if (raw_elem_idx == DRAW_MAX_FETCH_IDX && !vsplit->cache.has_max_fetch) {
-      unsigned hash = fetch % MAP_SIZE;
-      vsplit->cache.fetches[hash] = raw_elem_idx - 1; /* force update */
-      vsplit->cache.has_max_fetch = TRUE;
-   }
-
    vsplit_add_cache(vsplit, elt_idx, ofbias);
 }
 
@@ -231,6 +547,17 @@ vsplit_add_cache_uint(struct vsplit_frontend *vsplit, const uint *elts,
 #include "draw_pt_vsplit_tmp.h"
 
 
+static void
+vsplit_run(struct draw_pt_front_end *frontend,
+           unsigned start, unsigned count)
+{
+   struct vsplit_frontend *vsplit = (struct vsplit_frontend *) frontend;
+
+   vsplit->run_segments(frontend, start, count);
+   vsplit_flush_chunks(vsplit);
+}
+
+
 static void vsplit_prepare(struct draw_pt_front_end *frontend,
                            unsigned in_prim,
                            struct draw_pt_middle_end *middle,
@@ -240,16 +567,16 @@ static void vsplit_prepare(struct draw_pt_front_end *frontend,
 
    switch (vsplit->draw->pt.user.eltSize) {
    case 0:
-      vsplit->base.run = vsplit_run_linear;
+      vsplit->run_segments = vsplit_run_linear;
       break;
    case 1:
-      vsplit->base.run = vsplit_run_ubyte;
+      vsplit->run_segments = vsplit_run_ubyte;
       break;
    case 2:
-      vsplit->base.run = vsplit_run_ushort;
+      vsplit->run_segments = vsplit_run_ushort;
       break;
    case 4:
-      vsplit->base.run = vsplit_run_uint;
+      vsplit->run_segments = vsplit_run_uint;
       break;
    default:
       assert(0);
@@ -262,7 +589,9 @@ static void vsplit_prepare(struct draw_pt_front_end *frontend,
    vsplit->middle = middle;
    middle->prepare(middle, vsplit->prim, opt, &vsplit->max_vertices);
 
-   vsplit->segment_size = MIN2(SEGMENT_SIZE, vsplit->max_vertices);
+   vsplit->batch = middle->shade_chunk && vsplit->pool.num_threads > 0;
+
+   vsplit->segment_size = MIN2(vsplit->cache_size, vsplit->max_vertices);
 }
 
 
@@ -279,6 +608,16 @@ static void vsplit_flush(struct draw_pt_front_end *frontend, unsigned flags)
 
 static void vsplit_destroy(struct draw_pt_front_end *frontend)
 {
+   struct vsplit_frontend *vsplit = (struct vsplit_frontend *) frontend;
+   unsigned i;
+
+   vsplit_stop_threads(vsplit);
+
+   for (i = 0; i < MAX_CHUNKS; i++) {
+      FREE(vsplit->chunks[i].fetch_storage);
+      FREE(vsplit->chunks[i].draw_storage);
+   }
+
    FREE(frontend);
 }
 
@@ -292,7 +631,7 @@ struct draw_pt_front_end *draw_pt_vsplit(struct draw_context *draw)
       return NULL;
 
    vsplit->base.prepare = vsplit_prepare;
-   vsplit->base.run     = NULL;
+   vsplit->base.run     = vsplit_run;
    vsplit->base.flush   = vsplit_flush;
    vsplit->base.destroy = vsplit_destroy;
    vsplit->draw = draw;
@@ -300,5 +639,18 @@ struct draw_pt_front_end *draw_pt_vsplit(struct draw_context *draw)
    for (i = 0; i < SEGMENT_SIZE; i++)
       vsplit->identity_draw_elts[i] = i;
 
+   vsplit->cache.stamp = 1;
+   vsplit->cache_size = debug_get_num_option("DRAW_VERTEX_CACHE_SIZE",
+                                             DEFAULT_SEGMENT_SIZE);
+   vsplit->cache_size = CLAMP(vsplit->cache_size, 16, SEGMENT_SIZE);
+
+   /* The draw thread shades vertices too */
+   util_cpu_detect();
+   vsplit->pool.num_threads =
+      debug_get_num_option("DRAW_NUM_THREADS", util_cpu_caps.nr_cpus);
+   vsplit->pool.num_threads =
+      MIN2(MAX2(vsplit->pool.num_threads, 1), MAX_THREADS + 1) - 1;
+   vsplit->max_chunks = MIN2(2 * (vsplit->pool.num_threads + 1), MAX_CHUNKS);
+
    return &vsplit->base;
 }
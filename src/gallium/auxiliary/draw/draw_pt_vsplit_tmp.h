@@ -118,9 +118,12 @@ CONCAT(vsplit_primitive_, ELT_TYPE)(struct vsplit_frontend *vsplit,
       draw_elts = vsplit->draw_elts;
    }
 
-   return vsplit->middle->run_linear_elts(vsplit->middle,
-                                          fetch_start, fetch_count,
-                                          draw_elts, icount, 0x0);
+   draw->pt.vcache.referenced += icount;
+   draw->pt.vcache.shaded += fetch_count;
+
+   return vsplit_middle_run_linear_elts(vsplit,
+                                        fetch_start, fetch_count,
+                                        draw_elts, icount, 0x0);
 }
 
 /**
@@ -237,7 +240,7 @@ vsplit_segment_simple_linear(struct vsplit_frontend *vsplit, unsigned flags,
                              unsigned istart, unsigned icount)
 {
    assert(icount <= vsplit->max_vertices);
-   vsplit->middle->run_linear(vsplit->middle, istart, icount, flags);
+   vsplit_middle_run_linear(vsplit, istart, icount, flags);
 }
 
 static void
@@ -257,11 +260,11 @@ vsplit_segment_loop_linear(struct vsplit_frontend *vsplit, unsigned flags,
          vsplit->fetch_elts[nr] = istart + nr;
       vsplit->fetch_elts[nr++] = i0;
 
-      vsplit->middle->run(vsplit->middle, vsplit->fetch_elts, nr,
+      vsplit_middle_run(vsplit, vsplit->fetch_elts, nr,
             vsplit->identity_draw_elts, nr, flags);
    }
    else {
-      vsplit->middle->run_linear(vsplit->middle, istart, icount, flags);
+      vsplit_middle_run_linear(vsplit, istart, icount, flags);
    }
 }
 
@@ -280,11 +283,11 @@ vsplit_segment_fan_linear(struct vsplit_frontend *vsplit, unsigned flags,
       for (i = 1 ; i < icount; i++)
          vsplit->fetch_elts[nr++] = istart + i;
 
-      vsplit->middle->run(vsplit->middle, vsplit->fetch_elts, nr,
+      vsplit_middle_run(vsplit, vsplit->fetch_elts, nr,
             vsplit->identity_draw_elts, nr, flags);
    }
    else {
-      vsplit->middle->run_linear(vsplit->middle, istart, icount, flags);
+      vsplit_middle_run_linear(vsplit, istart, icount, flags);
    }
 }
 
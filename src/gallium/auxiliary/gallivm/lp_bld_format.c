@@ -38,16 +38,16 @@ lp_build_format_cache_type(struct gallivm_state *gallivm)
 
    elem_types[LP_BUILD_FORMAT_CACHE_MEMBER_DATA] =
          LLVMArrayType(LLVMInt32TypeInContext(gallivm->context),
-                       LP_BUILD_FORMAT_CACHE_SIZE * 16);
+                       LP_BUILD_FORMAT_CACHE_MAX_SIZE * 16);
    elem_types[LP_BUILD_FORMAT_CACHE_MEMBER_TAGS] =
          LLVMArrayType(LLVMInt64TypeInContext(gallivm->context),
-                       LP_BUILD_FORMAT_CACHE_SIZE);
-#if LP_BUILD_FORMAT_CACHE_DEBUG
+                       LP_BUILD_FORMAT_CACHE_MAX_SIZE);
    elem_types[LP_BUILD_FORMAT_CACHE_MEMBER_ACCESS_TOTAL] =
          LLVMInt64TypeInContext(gallivm->context);
    elem_types[LP_BUILD_FORMAT_CACHE_MEMBER_ACCESS_MISS] =
          LLVMInt64TypeInContext(gallivm->context);
-#endif
+   elem_types[LP_BUILD_FORMAT_CACHE_MEMBER_MASK] =
+         LLVMInt32TypeInContext(gallivm->context);
 
    s = LLVMStructTypeInContext(gallivm->context, elem_types,
                                LP_BUILD_FORMAT_CACHE_MEMBER_COUNT, 0);
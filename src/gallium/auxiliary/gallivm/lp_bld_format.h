@@ -44,37 +44,36 @@ struct lp_type;
 struct lp_build_context;
 
 
-#define LP_BUILD_FORMAT_CACHE_DEBUG 0
 /*
  * Block cache
  *
  * Optional block cache to be used when unpacking big pixel blocks.
- * Must be a power of 2
+ * The number of blocks in use is cache_mask + 1, a power of 2 chosen at
+ * run time, up to LP_BUILD_FORMAT_CACHE_MAX_SIZE.
  */
 
 #define LP_BUILD_FORMAT_CACHE_SIZE 128
+#define LP_BUILD_FORMAT_CACHE_MAX_SIZE 1024
 
 /*
  * Note: cache_data needs 16 byte alignment.
  */
 struct lp_build_format_cache
 {
-   PIPE_ALIGN_VAR(16) uint32_t cache_data[LP_BUILD_FORMAT_CACHE_SIZE][4][4];
-   uint64_t cache_tags[LP_BUILD_FORMAT_CACHE_SIZE];
-#if LP_BUILD_FORMAT_CACHE_DEBUG
+   PIPE_ALIGN_VAR(16) uint32_t cache_data[LP_BUILD_FORMAT_CACHE_MAX_SIZE][4][4];
+   uint64_t cache_tags[LP_BUILD_FORMAT_CACHE_MAX_SIZE];
    uint64_t cache_access_total;
    uint64_t cache_access_miss;
-#endif
+   uint32_t cache_mask;
 };
 
 
 enum {
    LP_BUILD_FORMAT_CACHE_MEMBER_DATA = 0,
    LP_BUILD_FORMAT_CACHE_MEMBER_TAGS,
-#if LP_BUILD_FORMAT_CACHE_DEBUG
    LP_BUILD_FORMAT_CACHE_MEMBER_ACCESS_TOTAL,
    LP_BUILD_FORMAT_CACHE_MEMBER_ACCESS_MISS,
-#endif
+   LP_BUILD_FORMAT_CACHE_MEMBER_MASK,
    LP_BUILD_FORMAT_CACHE_MEMBER_COUNT
 };
 
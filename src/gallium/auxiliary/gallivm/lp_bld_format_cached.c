@@ -45,13 +45,16 @@
  * are restricted to formats which are 4x4 block based, and the decoded
  * texels must fit into 4x8 bits.
  * The cache is direct mapped so hitrates aren't all that great and cache
- * thrashing could happen.
+ * thrashing could happen.  Its size is picked by the driver at run time
+ * (the generated code reads the index mask from the cache).  Accesses and
+ * misses are counted there too, but only if the driver asked for it with
+ * gallivm_state::format_cache_counters, as that costs a load and a store
+ * per fetch.
  *
  * @author Roland Scheidegger <sroland@vmware.com>
  */
 
 
-#if LP_BUILD_FORMAT_CACHE_DEBUG
 static void
 update_cache_access(struct gallivm_state *gallivm,
                     LLVMValueRef ptr,
@@ -71,7 +74,19 @@ update_cache_access(struct gallivm_state *gallivm,
                                                                    count, 0), "");
    LLVMBuildStore(builder, cache_access, member_ptr);
 }
-#endif
+
+
+static LLVMValueRef
+lookup_cache_mask(struct gallivm_state *gallivm,
+                  LLVMValueRef ptr)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMValueRef member_ptr;
+
+   member_ptr = lp_build_struct_get_ptr(gallivm, ptr,
+                                        LP_BUILD_FORMAT_CACHE_MEMBER_MASK, "");
+   return LLVMBuildLoad(builder, member_ptr, "cache_mask");
+}
 
 
 static void
@@ -282,7 +297,7 @@ lp_build_fetch_cached_texels(struct gallivm_state *gallivm,
    /* TODO: not ideal with 32bit pointers... */
 
    low_bit = util_logbase2(format_desc->block.bits / 8);
-   log2size = util_logbase2(LP_BUILD_FORMAT_CACHE_SIZE);
+   log2size = util_logbase2(LP_BUILD_FORMAT_CACHE_MAX_SIZE);
    addr = LLVMBuildPtrToInt(builder, base_ptr, i64t, "");
    ptr_addrtrunc = LLVMBuildPtrToInt(builder, base_ptr, i32t, "");
    ptr_addrtrunc = lp_build_broadcast_scalar(&bld32, ptr_addrtrunc);
@@ -291,7 +306,8 @@ lp_build_fetch_cached_texels(struct gallivm_state *gallivm,
    ptr_addrtrunc = LLVMBuildAdd(builder, offset, ptr_addrtrunc, "");
    ptr_addrtrunc = LLVMBuildLShr(builder, ptr_addrtrunc,
                                  lp_build_const_int_vec(gallivm, type, low_bit), "");
-   /* This only really makes sense for size 64,128,256 */
+   /* Fold with shifts for the largest size, the actual size is masked
+      off below */
    hash_index = ptr_addrtrunc;
    ptr_addrtrunc = LLVMBuildLShr(builder, ptr_addrtrunc,
                                  lp_build_const_int_vec(gallivm, type, 2*log2size), "");
@@ -300,7 +316,8 @@ lp_build_fetch_cached_texels(struct gallivm_state *gallivm,
                        lp_build_const_int_vec(gallivm, type, log2size), "");
    hash_index = LLVMBuildXor(builder, hash_index, tmp, "");
 
-   hash_mask = lp_build_const_int_vec(gallivm, type, LP_BUILD_FORMAT_CACHE_SIZE - 1);
+   hash_mask = lookup_cache_mask(gallivm, cache);
+   hash_mask = lp_build_broadcast_scalar(&bld32, hash_mask);
    hash_index = LLVMBuildAnd(builder, hash_index, hash_mask, "");
    ij_index = LLVMBuildShl(builder, i, lp_build_const_int_vec(gallivm, type, 2), "");
    ij_index = LLVMBuildAdd(builder, ij_index, j, "");
@@ -330,10 +347,10 @@ lp_build_fetch_cached_texels(struct gallivm_state *gallivm,
             ptr_addrx = LLVMBuildIntToPtr(builder, addrx,
                                           LLVMPointerType(i8t, 0), "");
             update_cached_block(gallivm, format_desc, ptr_addrx, hash_indexx, cache);
-#if LP_BUILD_FORMAT_CACHE_DEBUG
-            update_cache_access(gallivm, cache, 1,
-                                LP_BUILD_FORMAT_CACHE_MEMBER_ACCESS_MISS);
-#endif
+            if (gallivm->format_cache_counters) {
+               update_cache_access(gallivm, cache, 1,
+                                   LP_BUILD_FORMAT_CACHE_MEMBER_ACCESS_MISS);
+            }
          }
          lp_build_endif(&if_ctx);
 
@@ -356,19 +373,19 @@ lp_build_fetch_cached_texels(struct gallivm_state *gallivm,
       {
          tmp = LLVMBuildIntToPtr(builder, addr, LLVMPointerType(i8t, 0), "");
          update_cached_block(gallivm, format_desc, tmp, hash_index, cache);
-#if LP_BUILD_FORMAT_CACHE_DEBUG
-         update_cache_access(gallivm, cache, 1,
-                             LP_BUILD_FORMAT_CACHE_MEMBER_ACCESS_MISS);
-#endif
+         if (gallivm->format_cache_counters) {
+            update_cache_access(gallivm, cache, 1,
+                                LP_BUILD_FORMAT_CACHE_MEMBER_ACCESS_MISS);
+         }
       }
       lp_build_endif(&if_ctx);
 
       color = lookup_cached_pixel(gallivm, cache, block_index);
    }
-#if LP_BUILD_FORMAT_CACHE_DEBUG
-   update_cache_access(gallivm, cache, n,
-                       LP_BUILD_FORMAT_CACHE_MEMBER_ACCESS_TOTAL);
-#endif
+   if (gallivm->format_cache_counters) {
+      update_cache_access(gallivm, cache, n,
+                          LP_BUILD_FORMAT_CACHE_MEMBER_ACCESS_TOTAL);
+   }
    return LLVMBuildBitCast(builder, color, LLVMVectorType(i8t, n * 4), "");
 }
 
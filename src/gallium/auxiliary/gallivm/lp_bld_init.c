@@ -32,6 +32,7 @@
 #include "util/u_debug.h"
 #include "util/u_memory.h"
 #include "util/simple_list.h"
+#include "util/mesa-sha1.h"
 #include "os/os_time.h"
 #include "lp_bld.h"
 #include "lp_bld_debug.h"
@@ -56,6 +57,13 @@
 void LLVMLinkInMCJIT();
 #endif
 
+/* MCJIT object caching needs LLVM 3.6 */
+#if HAVE_LLVM >= 0x0306
+#  define USE_OBJECT_CACHE 1
+#else
+#  define USE_OBJECT_CACHE 0
+#endif
+
 #ifdef DEBUG
 unsigned gallivm_debug = 0;
 
@@ -80,6 +88,12 @@ static boolean gallivm_initialized = FALSE;
 
 unsigned lp_native_vector_width;
 
+/**
+ * Directory where generated machine code is cached across runs, or NULL
+ * if caching is disabled.  Set with the GALLIVM_CACHE_DIR env var.
+ */
+static const char *gallivm_cache_dir = NULL;
+
 
 /*
  * Optimization values are:
@@ -145,7 +159,18 @@ create_pass_manager(struct gallivm_state *gallivm)
    LLVMSetDataLayout(gallivm->module, "");
 #endif
 
-   if ((gallivm_debug & GALLIVM_DEBUG_NO_OPT) == 0) {
+   return TRUE;
+}
+
+
+/**
+ * Install the optimization passes.  This is deferred until the module is
+ * compiled so that gallivm_state::no_opt can be set after creation.
+ */
+static void
+add_optimization_passes(struct gallivm_state *gallivm)
+{
+   if ((gallivm_debug & GALLIVM_DEBUG_NO_OPT) == 0 && !gallivm->no_opt) {
       /* These are the passes currently listed in llvm-c/Transforms/Scalar.h,
        * but there are more on SVN.
        * TODO: Add more passes.
@@ -165,8 +190,6 @@ create_pass_manager(struct gallivm_state *gallivm)
        */
       LLVMAddPromoteMemoryToRegisterPass(gallivm->passmgr);
    }
-
-   return TRUE;
 }
 
 
@@ -199,6 +222,11 @@ gallivm_free_ir(struct gallivm_state *gallivm)
    if (gallivm->builder)
       LLVMDisposeBuilder(gallivm->builder);
 
+   /* The object cache must outlive the engine */
+   if (gallivm->cache) {
+      lp_free_object_cache(gallivm->cache);
+   }
+
    /* The LLVMContext should be owned by the parent of gallivm. */
 
    gallivm->engine = NULL;
@@ -207,6 +235,7 @@ gallivm_free_ir(struct gallivm_state *gallivm)
    gallivm->passmgr = NULL;
    gallivm->context = NULL;
    gallivm->builder = NULL;
+   gallivm->cache = NULL;
 }
 
 
@@ -233,7 +262,7 @@ init_gallivm_engine(struct gallivm_state *gallivm)
       char *error = NULL;
       int ret;
 
-      if (gallivm_debug & GALLIVM_DEBUG_NO_OPT) {
+      if ((gallivm_debug & GALLIVM_DEBUG_NO_OPT) || gallivm->no_opt) {
          optlevel = None;
       }
       else {
@@ -427,6 +456,7 @@ lp_build_init(void)
        */
       util_cpu_caps.has_avx = 0;
       util_cpu_caps.has_avx2 = 0;
+      util_cpu_caps.has_avx512f = 0;
       util_cpu_caps.has_f16c = 0;
    }
 
@@ -452,6 +482,15 @@ lp_build_init(void)
    }
 #endif
 
+#if USE_OBJECT_CACHE
+   gallivm_cache_dir = debug_get_option("GALLIVM_CACHE_DIR", NULL);
+   if (gallivm_cache_dir && !lp_init_object_cache_dir(gallivm_cache_dir)) {
+      debug_printf("gallivm: could not create cache directory %s\n",
+                   gallivm_cache_dir);
+      gallivm_cache_dir = NULL;
+   }
+#endif
+
    gallivm_initialized = TRUE;
 
 #if 0
@@ -462,6 +501,7 @@ lp_build_init(void)
    util_cpu_caps.has_sse4_2 = 0;
    util_cpu_caps.has_avx = 0;
    util_cpu_caps.has_avx2 = 0;
+   util_cpu_caps.has_avx512f = 0;
    util_cpu_caps.has_f16c = 0;
 #endif
 
@@ -527,15 +567,90 @@ gallivm_verify_function(struct gallivm_state *gallivm,
 }
 
 
+#if USE_OBJECT_CACHE
+
+/**
+ * Compute the file name under which the machine code of the module is
+ * cached.
+ *
+ * The key covers everything that influences code generation: the
+ * unoptimized IR, the LLVM version, the host CPU and the features we
+ * detected/overrode for it, and the debug and optimization flags.  Shader
+ * variant keys, state and TGSI tokens are all reflected in the IR, so they
+ * need no special handling.  Note the IR may contain absolute addresses of
+ * driver functions and objects; those merely make the key differ from
+ * run to run, never produce stale code.
+ */
+static boolean
+get_cached_object_path(struct gallivm_state *gallivm,
+                       char *path, size_t size)
+{
+   struct mesa_sha1 *ctx;
+   struct util_cpu_caps caps;
+   unsigned version = HAVE_LLVM;
+   unsigned debug = gallivm_debug;
+   unsigned no_opt = gallivm->no_opt;
+   const char *cpu_name;
+   unsigned char sha1[20];
+   char sha1_str[41];
+   char *ir, *p;
+
+   ctx = _mesa_sha1_init();
+   if (!ctx)
+      return FALSE;
+
+   /* The number of CPUs doesn't affect the generated code */
+   caps = util_cpu_caps;
+   caps.nr_cpus = 0;
+
+   cpu_name = lp_get_host_cpu_name();
+
+   _mesa_sha1_update(ctx, &version, sizeof version);
+   _mesa_sha1_update(ctx, cpu_name, strlen(cpu_name));
+   _mesa_sha1_update(ctx, &caps, sizeof caps);
+   _mesa_sha1_update(ctx, &debug, sizeof debug);
+   _mesa_sha1_update(ctx, &no_opt, sizeof no_opt);
+   _mesa_sha1_update(ctx, &lp_native_vector_width,
+                     sizeof lp_native_vector_width);
+
+   /* Skip the module id, which is just a name */
+   ir = LLVMPrintModuleToString(gallivm->module);
+   p = ir;
+   while (*p == ';' || strncmp(p, "source_filename", 15) == 0) {
+      p = strchr(p, '\n');
+      if (!p) {
+         p = ir + strlen(ir);
+         break;
+      }
+      ++p;
+   }
+   _mesa_sha1_update(ctx, p, strlen(p));
+   LLVMDisposeMessage(ir);
+
+   _mesa_sha1_final(ctx, sha1);
+   _mesa_sha1_format(sha1_str, sha1);
+
+   util_snprintf(path, size, "%s/%s.o", gallivm_cache_dir, sha1_str);
+
+   return TRUE;
+}
+
+#endif /* USE_OBJECT_CACHE */
+
+
 /**
  * Compile a module.
  * This does IR optimization on all functions in the module.
+ *
+ * If GALLIVM_CACHE_DIR is set, machine code is looked up in/added to the
+ * on-disk cache, and the IR optimization is skipped on a hit.
  */
 void
 gallivm_compile_module(struct gallivm_state *gallivm)
 {
    LLVMValueRef func;
    int64_t time_begin = 0;
+   boolean cached = FALSE;
 
    assert(!gallivm->compiled);
 
@@ -547,9 +662,22 @@ gallivm_compile_module(struct gallivm_state *gallivm)
    if (gallivm_debug & GALLIVM_DEBUG_PERF)
       time_begin = os_time_get();
 
+#if USE_OBJECT_CACHE
+   if (gallivm_cache_dir) {
+      char path[1024];
+
+      if (get_cached_object_path(gallivm, path, sizeof path)) {
+         gallivm->cache = lp_create_object_cache(path, &cached);
+      }
+   }
+#endif
+
    /* Run optimization passes */
+   if (!cached) {
+      add_optimization_passes(gallivm);
+   }
    LLVMInitializeFunctionPassManager(gallivm->passmgr);
-   func = LLVMGetFirstFunction(gallivm->module);
+   func = cached ? NULL : LLVMGetFirstFunction(gallivm->module);
    while (func) {
       if (0) {
          debug_printf("optimizing func %s...\n", LLVMGetValueName(func));
@@ -572,8 +700,9 @@ gallivm_compile_module(struct gallivm_state *gallivm)
    if (gallivm_debug & GALLIVM_DEBUG_PERF) {
       int64_t time_end = os_time_get();
       int time_msec = (int)(time_end - time_begin) / 1000;
-      debug_printf("optimizing module %s took %d msec\n",
-                   lp_get_module_id(gallivm->module), time_msec);
+      debug_printf("optimizing module %s took %d msec%s\n",
+                   lp_get_module_id(gallivm->module), time_msec,
+                   cached ? " (cached)" : "");
    }
 
    /* Dump byte code to a file */
@@ -591,6 +720,13 @@ gallivm_compile_module(struct gallivm_state *gallivm)
 #endif
    assert(gallivm->engine);
 
+   /* Code is only generated when the first function pointer is requested,
+    * so it's not too late to attach the cache here.
+    */
+   if (gallivm->cache) {
+      lp_set_object_cache(gallivm->engine, gallivm->cache);
+   }
+
    ++gallivm->compiled;
 
    if (gallivm_debug & GALLIVM_DEBUG_ASM) {
@@ -46,7 +46,12 @@ struct gallivm_state
    LLVMBuilderRef builder;
    LLVMMCJITMemoryManagerRef memorymgr;
    struct lp_generated_code *code;
+   struct lp_object_cache *cache;
    unsigned compiled;
+   /** Favor compilation speed over code quality (set before compiling) */
+   boolean no_opt;
+   /** Count format cache accesses and misses in the generated code */
+   boolean format_cache_counters;
 };
 
 
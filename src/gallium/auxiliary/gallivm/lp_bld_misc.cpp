@@ -66,6 +66,12 @@
 #else
 #include <llvm/ExecutionEngine/SectionMemoryManager.h>
 #endif
+#if HAVE_LLVM >= 0x0306
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+#endif
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/Host.h>
 #include <llvm/Support/PrettyStackTrace.h>
@@ -532,6 +538,9 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
    MAttrs.push_back(util_cpu_caps.has_avx  ? "+avx"  : "-avx");
    MAttrs.push_back(util_cpu_caps.has_f16c ? "+f16c" : "-f16c");
    MAttrs.push_back(util_cpu_caps.has_avx2 ? "+avx2" : "-avx2");
+#if HAVE_LLVM >= 0x0308
+   MAttrs.push_back(util_cpu_caps.has_avx512f ? "+avx512f" : "-avx512f");
+#endif
 #endif
 
 #if defined(PIPE_ARCH_PPC)
@@ -633,3 +642,135 @@ lp_free_memory_manager(LLVMMCJITMemoryManagerRef memorymgr)
 {
    delete reinterpret_cast<BaseMemoryManager*>(memorymgr);
 }
+
+
+#if HAVE_LLVM >= 0x0306
+
+/**
+ * Object cache holding the machine code of a single module in a file.
+ *
+ * MCJIT asks the cache for an object before generating code for a module,
+ * and hands back the object it generated on a miss.  The objects are
+ * relocatable so they can be loaded again by another process.
+ */
+class ShaderObjectCache : public llvm::ObjectCache {
+
+   std::string Path;
+
+   public:
+
+      ShaderObjectCache(const char *path) : Path(path) {
+      }
+
+      bool exists() const {
+         return llvm::sys::fs::exists(Path);
+      }
+
+      virtual void notifyObjectCompiled(const llvm::Module *M,
+                                        llvm::MemoryBufferRef Obj) {
+         llvm::SmallString<128> TmpPath;
+         int FD;
+
+         /* Write to a temporary file and rename it, so that concurrent
+          * processes never see a partially written object.
+          */
+         if (llvm::sys::fs::createUniqueFile(Path + ".tmp%%%%%%", FD, TmpPath))
+            return;
+
+         {
+            llvm::raw_fd_ostream OS(FD, true);
+            OS << Obj.getBuffer();
+            OS.close();
+            if (OS.has_error()) {
+               OS.clear_error();
+               llvm::sys::fs::remove(TmpPath);
+               return;
+            }
+         }
+
+         if (llvm::sys::fs::rename(TmpPath, Path))
+            llvm::sys::fs::remove(TmpPath);
+      }
+
+      virtual std::unique_ptr<llvm::MemoryBuffer>
+      getObject(const llvm::Module *M) {
+         llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> Buffer =
+            llvm::MemoryBuffer::getFile(Path);
+         if (!Buffer)
+            return nullptr;
+         return std::move(*Buffer);
+      }
+};
+
+#endif
+
+
+/**
+ * Make sure the directory for cached objects exists.
+ */
+extern "C"
+boolean
+lp_init_object_cache_dir(const char *dir)
+{
+#if HAVE_LLVM >= 0x0306
+   return !llvm::sys::fs::create_directories(dir);
+#else
+   return FALSE;
+#endif
+}
+
+
+/**
+ * Create an object cache for one module, stored in the given file.
+ * \param exists  returns whether an object was already cached there
+ */
+extern "C"
+struct lp_object_cache *
+lp_create_object_cache(const char *path, boolean *exists)
+{
+#if HAVE_LLVM >= 0x0306
+   ShaderObjectCache *cache = new ShaderObjectCache(path);
+   *exists = cache->exists();
+   return (struct lp_object_cache *) cache;
+#else
+   *exists = FALSE;
+   return NULL;
+#endif
+}
+
+
+/**
+ * Have the execution engine look up/store its code in the given cache.
+ * The cache must outlive the engine.
+ */
+extern "C"
+void
+lp_set_object_cache(LLVMExecutionEngineRef engine,
+                    struct lp_object_cache *cache)
+{
+#if HAVE_LLVM >= 0x0306
+   llvm::unwrap(engine)->setObjectCache((ShaderObjectCache *) cache);
+#endif
+}
+
+
+extern "C"
+void
+lp_free_object_cache(struct lp_object_cache *cache)
+{
+#if HAVE_LLVM >= 0x0306
+   delete (ShaderObjectCache *) cache;
+#endif
+}
+
+
+/**
+ * Name of the host CPU, as used for code generation.
+ */
+extern "C"
+const char *
+lp_get_host_cpu_name(void)
+{
+   static const std::string name = llvm::sys::getHostCPUName().str();
+   return name.c_str();
+}
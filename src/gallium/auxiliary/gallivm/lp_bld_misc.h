@@ -40,6 +40,7 @@ extern "C" {
 
 
 struct lp_generated_code;
+struct lp_object_cache;
 
 extern void
 gallivm_init_llvm_targets(void);
@@ -70,6 +71,22 @@ lp_get_default_memory_manager();
 extern void
 lp_free_memory_manager(LLVMMCJITMemoryManagerRef memorymgr);
 
+extern boolean
+lp_init_object_cache_dir(const char *dir);
+
+extern struct lp_object_cache *
+lp_create_object_cache(const char *path, boolean *exists);
+
+extern void
+lp_set_object_cache(LLVMExecutionEngineRef engine,
+                    struct lp_object_cache *cache);
+
+extern void
+lp_free_object_cache(struct lp_object_cache *cache);
+
+extern const char *
+lp_get_host_cpu_name(void);
+
 #ifdef __cplusplus
 }
 #endif
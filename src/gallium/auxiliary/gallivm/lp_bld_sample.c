@@ -118,6 +118,7 @@ lp_sampler_static_texture_state(struct lp_static_texture_state *state,
    state->pot_height        = util_is_power_of_two(texture->height0);
    state->pot_depth         = util_is_power_of_two(texture->depth0);
    state->level_zero_only   = !view->u.tex.last_level;
+   state->tiled             = !!(texture->flags & LP_RESOURCE_FLAG_TILED);
 
    /*
     * the layer / element / level parameters are all either dynamic
@@ -196,6 +197,16 @@ lp_sampler_static_sampler_state(struct lp_static_sampler_state *state,
    }
 
    state->normalized_coords = sampler->normalized_coords;
+
+   /*
+    * Anisotropic filtering only makes a difference when minifying with a
+    * linear filter, don't let it cause recompiles otherwise.
+    */
+   if (sampler->max_anisotropy > 1 &&
+       state->min_img_filter == PIPE_TEX_FILTER_LINEAR &&
+       !state->min_max_lod_equal) {
+      state->aniso = MIN2(sampler->max_anisotropy, 16);
+   }
 }
 
 
@@ -2023,12 +2034,15 @@ lp_build_sample_partial_offset(struct lp_build_context *bld,
  * Compute the offset of a pixel block.
  *
  * x, y, z, y_stride, z_stride are vectors, and they refer to pixels.
+ * For tiled textures the offset is that of the texel itself, and the
+ * sub-block coordinates are zero.
  *
  * Returns the relative offset and i,j sub-block coordinates
  */
 void
 lp_build_sample_offset(struct lp_build_context *bld,
                        const struct util_format_description *format_desc,
+                       boolean tiled,
                        LLVMValueRef x,
                        LLVMValueRef y,
                        LLVMValueRef z,
@@ -2038,21 +2052,26 @@ lp_build_sample_offset(struct lp_build_context *bld,
                        LLVMValueRef *out_i,
                        LLVMValueRef *out_j)
 {
+   const unsigned tile_texels = tiled ? LP_TEXTURE_TILE_SIZE : 1;
    LLVMValueRef x_stride;
    LLVMValueRef offset;
 
+   assert(!tiled || (format_desc->block.width == 1 &&
+                     format_desc->block.height == 1));
+
    x_stride = lp_build_const_vec(bld->gallivm, bld->type,
-                                 format_desc->block.bits/8);
+                                 format_desc->block.bits/8 *
+                                 tile_texels * tile_texels);
 
    lp_build_sample_partial_offset(bld,
-                                  format_desc->block.width,
+                                  format_desc->block.width * tile_texels,
                                   x, x_stride,
                                   &offset, out_i);
 
    if (y && y_stride) {
       LLVMValueRef y_offset;
       lp_build_sample_partial_offset(bld,
-                                     format_desc->block.height,
+                                     format_desc->block.height * tile_texels,
                                      y, y_stride,
                                      &y_offset, out_j);
       offset = lp_build_add(bld, offset, y_offset);
@@ -2061,6 +2080,13 @@ lp_build_sample_offset(struct lp_build_context *bld,
       *out_j = bld->zero;
    }
 
+   if (tiled) {
+      offset = lp_build_sample_tile_offset(bld, format_desc, offset,
+                                           *out_i, *out_j);
+      *out_i = bld->zero;
+      *out_j = bld->zero;
+   }
+
    if (z && z_stride) {
       LLVMValueRef z_offset;
       LLVMValueRef k;
@@ -2073,3 +2099,62 @@ lp_build_sample_offset(struct lp_build_context *bld,
 
    *out_offset = offset;
 }
+
+
+/**
+ * Width of the pixel blocks in which texel offsets are computed.  For
+ * tiled textures these are the tiles, with the position inside the tile
+ * added by lp_build_sample_tile_offset() before fetching.
+ */
+unsigned
+lp_sample_block_width(const struct lp_build_sample_context *bld)
+{
+   if (bld->static_texture_state->tiled)
+      return LP_TEXTURE_TILE_SIZE;
+   return bld->format_desc->block.width;
+}
+
+
+unsigned
+lp_sample_block_height(const struct lp_build_sample_context *bld)
+{
+   if (bld->static_texture_state->tiled)
+      return LP_TEXTURE_TILE_SIZE;
+   return bld->format_desc->block.height;
+}
+
+
+/**
+ * Size in bytes of the pixel blocks of lp_sample_block_width().
+ */
+unsigned
+lp_sample_block_size(const struct lp_build_sample_context *bld)
+{
+   unsigned size = bld->format_desc->block.bits / 8;
+
+   if (bld->static_texture_state->tiled)
+      size *= LP_TEXTURE_TILE_SIZE * LP_TEXTURE_TILE_SIZE;
+   return size;
+}
+
+
+/**
+ * Add the position of a texel within its tile to the offset of the tile.
+ *
+ * \param i, j  texel coordinates within the tile
+ */
+LLVMValueRef
+lp_build_sample_tile_offset(struct lp_build_context *bld,
+                            const struct util_format_description *format_desc,
+                            LLVMValueRef offset,
+                            LLVMValueRef i,
+                            LLVMValueRef j)
+{
+   LLVMValueRef texel;
+
+   texel = lp_build_shl_imm(bld, j, util_logbase2(LP_TEXTURE_TILE_SIZE));
+   texel = lp_build_add(bld, texel, i);
+   texel = lp_build_mul_imm(bld, texel, format_desc->block.bits / 8);
+
+   return lp_build_add(bld, offset, texel);
+}
@@ -51,6 +51,16 @@ struct lp_type;
 struct lp_build_context;
 
 
+/**
+ * Textures may be stored in square tiles of this many texels instead of
+ * rows, which keeps the texels of a filter footprint close together.
+ * Drivers mark such textures with LP_RESOURCE_FLAG_TILED, the row stride
+ * is then the distance between rows of tiles.
+ */
+#define LP_TEXTURE_TILE_SIZE 4
+#define LP_RESOURCE_FLAG_TILED (PIPE_RESOURCE_FLAG_DRV_PRIV << 7)
+
+
 /**
  * Helper struct holding all derivatives needed for sampling
  */
@@ -129,6 +139,7 @@ struct lp_static_texture_state
    unsigned pot_height:1;
    unsigned pot_depth:1;
    unsigned level_zero_only:1;
+   unsigned tiled:1;         /**< stored in LP_TEXTURE_TILE_SIZE tiles */
 };
 
 
@@ -155,6 +166,7 @@ struct lp_static_sampler_state
    unsigned apply_min_lod:1;  /**< min_lod > 0 ? */
    unsigned apply_max_lod:1;  /**< max_lod < last_level ? */
    unsigned seamless_cube_map:1;
+   unsigned aniso:5;  /**< max anisotropy, 0 if disabled */
 
    /* Hacks */
    unsigned force_nearest_s:1;
@@ -572,6 +584,7 @@ lp_build_sample_partial_offset(struct lp_build_context *bld,
 void
 lp_build_sample_offset(struct lp_build_context *bld,
                        const struct util_format_description *format_desc,
+                       boolean tiled,
                        LLVMValueRef x,
                        LLVMValueRef y,
                        LLVMValueRef z,
@@ -582,6 +595,23 @@ lp_build_sample_offset(struct lp_build_context *bld,
                        LLVMValueRef *out_j);
 
 
+unsigned
+lp_sample_block_width(const struct lp_build_sample_context *bld);
+
+unsigned
+lp_sample_block_height(const struct lp_build_sample_context *bld);
+
+unsigned
+lp_sample_block_size(const struct lp_build_sample_context *bld);
+
+LLVMValueRef
+lp_build_sample_tile_offset(struct lp_build_context *bld,
+                            const struct util_format_description *format_desc,
+                            LLVMValueRef offset,
+                            LLVMValueRef i,
+                            LLVMValueRef j);
+
+
 void
 lp_build_sample_soa(const struct lp_static_texture_state *static_texture_state,
                     const struct lp_static_sampler_state *static_sampler_state,
@@ -674,11 +674,11 @@ lp_build_sample_image_nearest(struct lp_build_sample_context *bld,
    /* get pixel, row, image strides */
    x_stride = lp_build_const_vec(bld->gallivm,
                                  bld->int_coord_bld.type,
-                                 bld->format_desc->block.bits/8);
+                                 lp_sample_block_size(bld));
 
    /* Do texcoord wrapping, compute texel offset */
    lp_build_sample_wrap_nearest_int(bld,
-                                    bld->format_desc->block.width,
+                                    lp_sample_block_width(bld),
                                     s_ipart, s_float,
                                     width_vec, x_stride, offsets[0],
                                     bld->static_texture_state->pot_width,
@@ -688,7 +688,7 @@ lp_build_sample_image_nearest(struct lp_build_sample_context *bld,
    if (dims >= 2) {
       LLVMValueRef y_offset;
       lp_build_sample_wrap_nearest_int(bld,
-                                       bld->format_desc->block.height,
+                                       lp_sample_block_height(bld),
                                        t_ipart, t_float,
                                        height_vec, row_stride_vec, offsets[1],
                                        bld->static_texture_state->pot_height,
@@ -716,6 +716,12 @@ lp_build_sample_image_nearest(struct lp_build_sample_context *bld,
    if (mipoffsets) {
       offset = lp_build_add(&bld->int_coord_bld, offset, mipoffsets);
    }
+   if (bld->static_texture_state->tiled) {
+      offset = lp_build_sample_tile_offset(&bld->int_coord_bld,
+                                           bld->format_desc, offset,
+                                           x_subcoord, y_subcoord);
+      x_subcoord = y_subcoord = bld->int_coord_bld.zero;
+   }
 
    lp_build_sample_fetch_image_nearest(bld, data_ptr, offset,
                                        x_subcoord, y_subcoord,
@@ -798,6 +804,7 @@ lp_build_sample_image_nearest_afloat(struct lp_build_sample_context *bld,
     */
    lp_build_sample_offset(&bld->int_coord_bld,
                           bld->format_desc,
+                          bld->static_texture_state->tiled,
                           x_icoord, y_icoord,
                           z_icoord,
                           row_stride_vec, img_stride_vec,
@@ -999,6 +1006,39 @@ lp_build_sample_fetch_image_linear(struct lp_build_sample_context *bld,
    *colors = packed;
 }
 
+/**
+ * For tiled textures, move the positions of the neighbors within their
+ * tiles into their offsets.
+ */
+static void
+lp_build_sample_tile_offsets_linear(struct lp_build_sample_context *bld,
+                                    LLVMValueRef offset[2][2][2],
+                                    LLVMValueRef x_subcoord[2],
+                                    LLVMValueRef y_subcoord[2])
+{
+   const unsigned numk = 1 + (bld->dims >= 3);
+   unsigned i, j, k;
+
+   assert(bld->dims >= 2);
+
+   for (k = 0; k < numk; k++) {
+      for (j = 0; j < 2; j++) {
+         for (i = 0; i < 2; i++) {
+            offset[k][j][i] = lp_build_sample_tile_offset(&bld->int_coord_bld,
+                                                          bld->format_desc,
+                                                          offset[k][j][i],
+                                                          x_subcoord[i],
+                                                          y_subcoord[j]);
+         }
+      }
+   }
+   for (i = 0; i < 2; i++) {
+      x_subcoord[i] = bld->int_coord_bld.zero;
+      y_subcoord[i] = bld->int_coord_bld.zero;
+   }
+}
+
+
 /**
  * Sample a single texture image with (bi-)(tri-)linear sampling.
  * Return filtered color as two vectors of 16-bit fixed point values.
@@ -1117,13 +1157,13 @@ lp_build_sample_image_linear(struct lp_build_sample_context *bld,
 
    /* get pixel, row and image strides */
    x_stride = lp_build_const_vec(bld->gallivm, bld->int_coord_bld.type,
-                                 bld->format_desc->block.bits/8);
+                                 lp_sample_block_size(bld));
    y_stride = row_stride_vec;
    z_stride = img_stride_vec;
 
    /* do texcoord wrapping and compute texel offsets */
    lp_build_sample_wrap_linear_int(bld,
-                                   bld->format_desc->block.width,
+                                   lp_sample_block_width(bld),
                                    s_ipart, &s_fpart, s_float,
                                    width_vec, x_stride, offsets[0],
                                    bld->static_texture_state->pot_width,
@@ -1153,7 +1193,7 @@ lp_build_sample_image_linear(struct lp_build_sample_context *bld,
 
    if (dims >= 2) {
       lp_build_sample_wrap_linear_int(bld,
-                                      bld->format_desc->block.height,
+                                      lp_sample_block_height(bld),
                                       t_ipart, &t_fpart, t_float,
                                       height_vec, y_stride, offsets[1],
                                       bld->static_texture_state->pot_height,
@@ -1190,6 +1230,10 @@ lp_build_sample_image_linear(struct lp_build_sample_context *bld,
       }
    }
 
+   if (bld->static_texture_state->tiled) {
+      lp_build_sample_tile_offsets_linear(bld, offset, x_subcoord, y_subcoord);
+   }
+
    lp_build_sample_fetch_image_linear(bld, data_ptr, offset,
                                       x_subcoord, y_subcoord,
                                       s_fpart, t_fpart, r_fpart,
@@ -1282,7 +1326,7 @@ lp_build_sample_image_linear_afloat(struct lp_build_sample_context *bld,
    /* get pixel, row and image strides */
    x_stride = lp_build_const_vec(bld->gallivm,
                                  bld->int_coord_bld.type,
-                                 bld->format_desc->block.bits/8);
+                                 lp_sample_block_size(bld));
    y_stride = row_stride_vec;
    z_stride = img_stride_vec;
 
@@ -1292,11 +1336,11 @@ lp_build_sample_image_linear_afloat(struct lp_build_sample_context *bld,
     * and not enough precision anyway.
     */
    lp_build_sample_partial_offset(&bld->int_coord_bld,
-                                  bld->format_desc->block.width,
+                                  lp_sample_block_width(bld),
                                   x_icoord0, x_stride,
                                   &x_offset0, &x_subcoord[0]);
    lp_build_sample_partial_offset(&bld->int_coord_bld,
-                                  bld->format_desc->block.width,
+                                  lp_sample_block_width(bld),
                                   x_icoord1, x_stride,
                                   &x_offset1, &x_subcoord[1]);
 
@@ -1322,11 +1366,11 @@ lp_build_sample_image_linear_afloat(struct lp_build_sample_context *bld,
 
    if (dims >= 2) {
       lp_build_sample_partial_offset(&bld->int_coord_bld,
-                                     bld->format_desc->block.height,
+                                     lp_sample_block_height(bld),
                                      y_icoord0, y_stride,
                                      &y_offset0, &y_subcoord[0]);
       lp_build_sample_partial_offset(&bld->int_coord_bld,
-                                     bld->format_desc->block.height,
+                                     lp_sample_block_height(bld),
                                      y_icoord1, y_stride,
                                      &y_offset1, &y_subcoord[1]);
       for (z = 0; z < 2; z++) {
@@ -1359,6 +1403,10 @@ lp_build_sample_image_linear_afloat(struct lp_build_sample_context *bld,
       }
    }
 
+   if (bld->static_texture_state->tiled) {
+      lp_build_sample_tile_offsets_linear(bld, offset, x_subcoord, y_subcoord);
+   }
+
    lp_build_sample_fetch_image_linear(bld, data_ptr, offset,
                                       x_subcoord, y_subcoord,
                                       s_fpart, t_fpart, r_fpart,
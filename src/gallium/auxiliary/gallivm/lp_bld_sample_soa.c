@@ -138,6 +138,7 @@ lp_build_sample_texel_soa(struct lp_build_sample_context *bld,
    /* convert x,y,z coords to linear offset from start of texture, in bytes */
    lp_build_sample_offset(&bld->int_coord_bld,
                           bld->format_desc,
+                          bld->static_texture_state->tiled,
                           x, y, z, y_stride, z_stride,
                           &offset, &i, &j);
    if (mipoffsets) {
@@ -2273,6 +2274,201 @@ lp_build_sample_general(struct lp_build_sample_context *bld,
 }
 
 
+/**
+ * Compute the footprint of an anisotropic lookup.
+ *
+ * Following EXT_texture_filter_anisotropic, the pixel footprint is
+ * approximated by the texel space lengths of the x and y derivatives.
+ * The lookup is split into a number of probes along the longer of the
+ * two, each with a lod matching the shorter one.  The number of probes is
+ * limited both by the sampler's max anisotropy and by the length of the
+ * major axis in texels, so magnified lookups stay at a single probe.
+ *
+ * \param axis_out  returns the major axis (s, t) in normalized coords
+ * \param num_probes_out  returns the number of probes, as float
+ * \return lod for each of the probes, including the shader lod bias
+ */
+static LLVMValueRef
+lp_build_aniso_footprint(struct lp_build_sample_context *bld,
+                         unsigned texture_unit,
+                         LLVMValueRef s,
+                         LLVMValueRef t,
+                         const struct lp_derivatives *derivs, /* optional */
+                         LLVMValueRef lod_bias, /* optional */
+                         LLVMValueRef axis_out[2],
+                         LLVMValueRef *num_probes_out)
+{
+   struct gallivm_state *gallivm = bld->gallivm;
+   struct lp_build_context *coord_bld = &bld->coord_bld;
+   struct lp_build_context *int_size_bld = &bld->int_size_in_bld;
+   struct lp_build_context *float_size_bld = &bld->float_size_in_bld;
+   LLVMTypeRef i32t = LLVMInt32TypeInContext(gallivm->context);
+   LLVMValueRef dsdx, dsdy, dtdx, dtdy;
+   LLVMValueRef first_level, int_size, float_size, width, height;
+   LLVMValueRef xs, xt, ys, yt, px2, py2, pmax2, pmin2;
+   LLVMValueRef x_major, num_probes, max_probes, lod;
+
+   if (derivs) {
+      dsdx = derivs->ddx[0];
+      dtdx = derivs->ddx[1];
+      dsdy = derivs->ddy[0];
+      dtdy = derivs->ddy[1];
+   }
+   else {
+      /* ds/dx ds/dy dt/dx dt/dy per quad */
+      LLVMValueRef ddx_ddy = lp_build_packed_ddx_ddy_twocoord(coord_bld, s, t);
+      dsdx = lp_build_swizzle_scalar_aos(coord_bld, ddx_ddy, 0, 4);
+      dsdy = lp_build_swizzle_scalar_aos(coord_bld, ddx_ddy, 1, 4);
+      dtdx = lp_build_swizzle_scalar_aos(coord_bld, ddx_ddy, 2, 4);
+      dtdy = lp_build_swizzle_scalar_aos(coord_bld, ddx_ddy, 3, 4);
+   }
+
+   /* scale to texels of the base level, like lp_build_rho() does */
+   first_level = bld->dynamic_state->first_level(bld->dynamic_state, gallivm,
+                                                 bld->context_ptr, texture_unit);
+   first_level = lp_build_broadcast_scalar(int_size_bld, first_level);
+   int_size = lp_build_minify(int_size_bld, bld->int_size, first_level, TRUE);
+   float_size = lp_build_int_to_float(float_size_bld, int_size);
+   width = lp_build_extract_broadcast(gallivm, float_size_bld->type,
+                                      coord_bld->type, float_size,
+                                      LLVMConstInt(i32t, 0, 0));
+   height = lp_build_extract_broadcast(gallivm, float_size_bld->type,
+                                       coord_bld->type, float_size,
+                                       LLVMConstInt(i32t, 1, 0));
+
+   xs = lp_build_mul(coord_bld, dsdx, width);
+   xt = lp_build_mul(coord_bld, dtdx, height);
+   ys = lp_build_mul(coord_bld, dsdy, width);
+   yt = lp_build_mul(coord_bld, dtdy, height);
+   px2 = lp_build_add(coord_bld, lp_build_mul(coord_bld, xs, xs),
+                      lp_build_mul(coord_bld, xt, xt));
+   py2 = lp_build_add(coord_bld, lp_build_mul(coord_bld, ys, ys),
+                      lp_build_mul(coord_bld, yt, yt));
+
+   x_major = lp_build_cmp(coord_bld, PIPE_FUNC_GEQUAL, px2, py2);
+   pmax2 = lp_build_select(coord_bld, x_major, px2, py2);
+   pmin2 = lp_build_select(coord_bld, x_major, py2, px2);
+   axis_out[0] = lp_build_select(coord_bld, x_major, dsdx, dsdy);
+   axis_out[1] = lp_build_select(coord_bld, x_major, dtdx, dtdy);
+
+   /* N = min(ceil(Pmax / Pmin), ceil(Pmax), max_aniso), at least 1 */
+   pmin2 = lp_build_max(coord_bld, pmin2,
+                        lp_build_const_vec(gallivm, coord_bld->type, 1e-20F));
+   num_probes = lp_build_sqrt(coord_bld, lp_build_div(coord_bld, pmax2, pmin2));
+   num_probes = lp_build_min(coord_bld, num_probes,
+                             lp_build_sqrt(coord_bld, pmax2));
+   num_probes = lp_build_ceil(coord_bld, num_probes);
+   max_probes = lp_build_const_vec(gallivm, coord_bld->type,
+                                   (float)bld->static_sampler_state->aniso);
+   num_probes = lp_build_clamp(coord_bld, num_probes, coord_bld->one, max_probes);
+   *num_probes_out = num_probes;
+
+   /* lod = log2(Pmax / N) */
+   lod = lp_build_mul(coord_bld, lp_build_fast_log2(coord_bld, pmax2),
+                      lp_build_const_vec(gallivm, coord_bld->type, 0.5F));
+   lod = lp_build_sub(coord_bld, lod, lp_build_fast_log2(coord_bld, num_probes));
+
+   if (lod_bias) {
+      lod = lp_build_add(coord_bld, lod, lod_bias);
+   }
+
+   return lod;
+}
+
+
+/**
+ * Anisotropic sampling: average a number of ordinary lookups spaced evenly
+ * along the major axis of the footprint, as computed by
+ * lp_build_aniso_footprint().  The loop runs as many times as the largest
+ * probe count of the vector, lanes needing fewer probes skip the rest.
+ */
+static void
+lp_build_sample_aniso(struct lp_build_sample_context *bld,
+                      unsigned sampler_unit,
+                      const LLVMValueRef *coords,
+                      const LLVMValueRef *offsets,
+                      LLVMValueRef lod_positive,
+                      LLVMValueRef lod_fpart,
+                      LLVMValueRef ilevel0,
+                      LLVMValueRef ilevel1,
+                      const LLVMValueRef axis[2],
+                      LLVMValueRef num_probes,
+                      LLVMValueRef *colors_out)
+{
+   struct gallivm_state *gallivm = bld->gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_build_context *coord_bld = &bld->coord_bld;
+   struct lp_build_context *texel_bld = &bld->texel_bld;
+   struct lp_build_loop_state loop;
+   LLVMValueRef accum[4];
+   LLVMValueRef num_probes_int, max_probes, inv_probes;
+   unsigned chan, i;
+
+   for (chan = 0; chan < 4; ++chan) {
+      accum[chan] = lp_build_alloca(gallivm, texel_bld->vec_type, "aniso_accum");
+   }
+
+   num_probes_int = lp_build_itrunc(coord_bld, num_probes);
+   max_probes = LLVMBuildExtractElement(builder, num_probes_int,
+                                        lp_build_const_int32(gallivm, 0), "");
+   for (i = 1; i < coord_bld->type.length; ++i) {
+      LLVMValueRef elem;
+      elem = LLVMBuildExtractElement(builder, num_probes_int,
+                                     lp_build_const_int32(gallivm, i), "");
+      max_probes = lp_build_max(&bld->int_bld, max_probes, elem);
+   }
+
+   lp_build_loop_begin(&loop, gallivm, lp_build_const_int32(gallivm, 0));
+   {
+      LLVMValueRef probe_coords[5];
+      LLVMValueRef texels[4];
+      LLVMValueRef k, active, offset;
+
+      k = lp_build_int_to_float(coord_bld,
+                                lp_build_broadcast_scalar(&bld->int_coord_bld,
+                                                          loop.counter));
+      active = lp_build_cmp(coord_bld, PIPE_FUNC_LESS, k, num_probes);
+
+      /* probe k of N sits at (k + 0.5) / N - 0.5 along the axis */
+      offset = lp_build_add(coord_bld, k,
+                            lp_build_const_vec(gallivm, coord_bld->type, 0.5F));
+      offset = lp_build_div(coord_bld, offset, num_probes);
+      offset = lp_build_sub(coord_bld, offset,
+                            lp_build_const_vec(gallivm, coord_bld->type, 0.5F));
+
+      for (i = 0; i < 5; ++i) {
+         probe_coords[i] = coords[i];
+      }
+      probe_coords[0] = lp_build_add(coord_bld, coords[0],
+                                     lp_build_mul(coord_bld, axis[0], offset));
+      probe_coords[1] = lp_build_add(coord_bld, coords[1],
+                                     lp_build_mul(coord_bld, axis[1], offset));
+
+      lp_build_sample_general(bld, sampler_unit, FALSE,
+                              probe_coords, offsets,
+                              lod_positive, lod_fpart,
+                              ilevel0, ilevel1,
+                              texels);
+
+      for (chan = 0; chan < 4; ++chan) {
+         LLVMValueRef sum = LLVMBuildLoad(builder, accum[chan], "");
+         texels[chan] = lp_build_select(texel_bld, active, texels[chan],
+                                        texel_bld->zero);
+         sum = lp_build_add(texel_bld, sum, texels[chan]);
+         LLVMBuildStore(builder, sum, accum[chan]);
+      }
+   }
+   lp_build_loop_end_cond(&loop, max_probes, NULL, LLVMIntUGE);
+
+   inv_probes = lp_build_rcp(coord_bld, num_probes);
+   for (chan = 0; chan < 4; ++chan) {
+      colors_out[chan] = lp_build_mul(texel_bld,
+                                      LLVMBuildLoad(builder, accum[chan], ""),
+                                      inv_probes);
+   }
+}
+
+
 /**
  * Texel fetch function.
  * In contrast to general sampling there is no filtering, no coord minification,
@@ -2375,6 +2571,7 @@ lp_build_fetch_texel(struct lp_build_sample_context *bld,
 
    lp_build_sample_offset(int_coord_bld,
                           bld->format_desc,
+                          bld->static_texture_state->tiled,
                           x, y, z, row_stride_vec, img_stride_vec,
                           &offset, &i, &j);
 
@@ -2762,6 +2959,7 @@ lp_build_sample_soa_code(struct gallivm_state *gallivm,
    else {
       LLVMValueRef lod_fpart = NULL, lod_positive = NULL;
       LLVMValueRef ilevel0 = NULL, ilevel1 = NULL;
+      LLVMValueRef aniso_axis[2], aniso_probes = NULL;
       boolean use_aos;
 
       if (util_format_is_pure_integer(static_texture_state->format) &&
@@ -2828,6 +3026,26 @@ lp_build_sample_soa_code(struct gallivm_state *gallivm,
                       derived_sampler_state.wrap_r);
       }
 
+      if (derived_sampler_state.aniso > 1 &&
+          op_is_tex &&
+          lod_control != LP_SAMPLER_LOD_EXPLICIT &&
+          derived_sampler_state.normalized_coords &&
+          bld.texel_type.floating &&
+          (target == PIPE_TEXTURE_2D || target == PIPE_TEXTURE_2D_ARRAY)) {
+         /*
+          * Sample along the major axis of the footprint, with the lod of
+          * the minor axis. The lod is passed on as explicit lod, so the
+          * sampler lod bias and clamps still get applied.
+          */
+         explicit_lod = lp_build_aniso_footprint(&bld, texture_index,
+                                                 newcoords[0], newcoords[1],
+                                                 derivs, lod_bias,
+                                                 aniso_axis, &aniso_probes);
+         derivs = NULL;
+         lod_bias = NULL;
+         use_aos = FALSE;
+      }
+
       lp_build_sample_common(&bld, texture_index, sampler_index,
                              newcoords,
                              derivs, lod_bias, explicit_lod,
@@ -2858,6 +3076,15 @@ lp_build_sample_soa_code(struct gallivm_state *gallivm,
                                 texel_out);
          }
 
+         else if (aniso_probes) {
+            lp_build_sample_aniso(&bld, sampler_index,
+                                  newcoords, offsets,
+                                  lod_positive, lod_fpart,
+                                  ilevel0, ilevel1,
+                                  aniso_axis, aniso_probes,
+                                  texel_out);
+         }
+
          else {
             lp_build_sample_general(&bld, sampler_index,
                                     op_type == LP_SAMPLER_OP_GATHER,
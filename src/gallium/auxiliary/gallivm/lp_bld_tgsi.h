@@ -63,6 +63,7 @@ struct lp_build_mask_context;
 struct gallivm_state;
 struct lp_derivatives;
 struct lp_build_tgsi_gs_iface;
+struct lp_build_tgsi_cs_iface;
 
 
 enum lp_build_tex_modifier {
@@ -166,6 +167,12 @@ struct lp_bld_tgsi_system_values {
    LLVMValueRef prim_id;
    LLVMValueRef basevertex;
    LLVMValueRef invocation_id;
+
+   /* compute shaders: thread ids are vectors, the rest are scalars */
+   LLVMValueRef thread_id[3];
+   LLVMValueRef block_id[3];
+   LLVMValueRef block_size[3];
+   LLVMValueRef grid_size[3];
 };
 
 
@@ -233,7 +240,8 @@ lp_build_tgsi_soa(struct gallivm_state *gallivm,
                   LLVMValueRef thread_data_ptr,
                   struct lp_build_sampler_soa *sampler,
                   const struct tgsi_shader_info *info,
-                  const struct lp_build_tgsi_gs_iface *gs_iface);
+                  const struct lp_build_tgsi_gs_iface *gs_iface,
+                  const struct lp_build_tgsi_cs_iface *cs_iface);
 
 
 void
@@ -428,6 +436,31 @@ struct lp_build_tgsi_gs_iface
                        LLVMValueRef emitted_prims_vec);
 };
 
+/**
+ * Compute shader interface.
+ *
+ * RES[] buffers and the special TGSI_RESOURCE_INPUT resource are plain byte
+ * ranges, accesses outside of them are discarded.  TGSI_RESOURCE_GLOBAL is
+ * addressed with 32-bit handles whose meaning is up to the driver; global_ptr
+ * sets *in_bounds to an i1 telling whether a whole 32-bit word at the handle
+ * lies within a buffer, and other accesses are discarded too.
+ */
+struct lp_build_tgsi_cs_iface
+{
+   /** Instruction at which the kernel starts */
+   int pc;
+
+   void (*fetch_resource)(const struct lp_build_tgsi_cs_iface *cs_iface,
+                          struct lp_build_tgsi_context *bld_base,
+                          unsigned index,
+                          LLVMValueRef *base_ptr,
+                          LLVMValueRef *size);
+   LLVMValueRef (*global_ptr)(const struct lp_build_tgsi_cs_iface *cs_iface,
+                              struct lp_build_tgsi_context *bld_base,
+                              LLVMValueRef address,
+                              LLVMValueRef *in_bounds);
+};
+
 struct lp_build_tgsi_soa_context
 {
    struct lp_build_tgsi_context bld_base;
@@ -436,6 +469,7 @@ struct lp_build_tgsi_soa_context
    struct lp_build_context elem_bld;
 
    const struct lp_build_tgsi_gs_iface *gs_iface;
+   const struct lp_build_tgsi_cs_iface *cs_iface;
    LLVMValueRef emitted_prims_vec_ptr;
    LLVMValueRef total_emitted_vertices_vec_ptr;
    LLVMValueRef emitted_vertices_vec_ptr;
@@ -840,6 +840,12 @@ static void lp_exec_mask_endsub(struct lp_exec_mask *mask, int *pc)
 {
    struct function_ctx *ctx;
 
+   if (mask->function_stack_size == 1) {
+      /* end of a compute kernel, which is entered without a CAL */
+      *pc = -1;
+      return;
+   }
+
    assert(mask->function_stack_size > 1);
    assert(mask->function_stack_size <= LP_MAX_NUM_FUNCS);
 
@@ -1670,6 +1676,36 @@ emit_fetch_system_value(
       atype = TGSI_TYPE_UNSIGNED;
       break;
 
+   case TGSI_SEMANTIC_THREAD_ID:
+      res = swizzle < 3 ? bld->system_values.thread_id[swizzle] :
+                          bld_base->uint_bld.zero;
+      atype = TGSI_TYPE_UNSIGNED;
+      break;
+
+   case TGSI_SEMANTIC_BLOCK_ID:
+      res = swizzle < 3 ?
+         lp_build_broadcast_scalar(&bld_base->uint_bld,
+                                   bld->system_values.block_id[swizzle]) :
+         bld_base->uint_bld.zero;
+      atype = TGSI_TYPE_UNSIGNED;
+      break;
+
+   case TGSI_SEMANTIC_BLOCK_SIZE:
+      res = swizzle < 3 ?
+         lp_build_broadcast_scalar(&bld_base->uint_bld,
+                                   bld->system_values.block_size[swizzle]) :
+         bld_base->uint_bld.one;
+      atype = TGSI_TYPE_UNSIGNED;
+      break;
+
+   case TGSI_SEMANTIC_GRID_SIZE:
+      res = swizzle < 3 ?
+         lp_build_broadcast_scalar(&bld_base->uint_bld,
+                                   bld->system_values.grid_size[swizzle]) :
+         bld_base->uint_bld.one;
+      atype = TGSI_TYPE_UNSIGNED;
+      break;
+
    default:
       assert(!"unexpected semantic in emit_fetch_system_value");
       res = bld_base->base.zero;
@@ -2020,6 +2056,11 @@ emit_store(
    unsigned chan_index;
    struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
    enum tgsi_opcode_type dtype = tgsi_opcode_infer_dst_type(inst->Instruction.Opcode);
+
+   /* STORE writes to memory by itself */
+   if (info->num_dst && inst->Dst[0].Register.File == TGSI_FILE_RESOURCE)
+      return;
+
    if(info->num_dst) {
       LLVMValueRef pred[TGSI_NUM_CHANNELS];
 
@@ -3379,6 +3420,278 @@ mask_vec(struct lp_build_tgsi_context *bld_base)
                        exec_mask->exec_mask, "");
 }
 
+/**
+ * Kinds of compute shader memory accesses, see emit_memory_op().
+ */
+enum lp_memory_op {
+   LP_MEMORY_LOAD,
+   LP_MEMORY_STORE,
+   LP_MEMORY_ATOMIC,
+   LP_MEMORY_ATOMIC_CAS
+};
+
+/**
+ * Access one 32-bit word per active lane of the RES[] register at the
+ * given byte offsets.
+ *
+ * There is no vector gather/scatter to map this to, so every lane does
+ * its own scalar access, guarded by a branch.  That keeps inactive lanes
+ * and out of bounds offsets from touching memory, which matters since
+ * other threads may be writing the words next to ours.
+ *
+ * Returns the loaded, respectively the old value for atomics.
+ */
+static LLVMValueRef
+emit_memory_op(struct lp_build_tgsi_soa_context *bld,
+               enum lp_memory_op op,
+               unsigned atomic_op,
+               unsigned index,
+               LLVMValueRef offset,
+               LLVMValueRef value,
+               LLVMValueRef value2)
+{
+   struct lp_build_tgsi_context *bld_base = &bld->bld_base;
+   struct gallivm_state *gallivm = bld_base->base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_build_context *uint_bld = &bld_base->uint_bld;
+   const struct lp_build_tgsi_cs_iface *cs_iface = bld->cs_iface;
+   LLVMTypeRef i32_ptr_type =
+      LLVMPointerType(LLVMInt32TypeInContext(gallivm->context), 0);
+   LLVMValueRef base_ptr = NULL;
+   LLVMValueRef active = mask_vec(bld_base);
+   LLVMValueRef result;
+   unsigned i;
+
+   assert(cs_iface);
+
+   offset = LLVMBuildBitCast(builder, offset, uint_bld->vec_type, "");
+
+   if (index != TGSI_RESOURCE_GLOBAL) {
+      LLVMValueRef size, in_bounds, end;
+
+      cs_iface->fetch_resource(cs_iface, bld_base, index, &base_ptr, &size);
+
+      size = lp_build_broadcast_scalar(uint_bld, size);
+      end = lp_build_add(uint_bld, offset,
+                         lp_build_const_int_vec(gallivm, uint_bld->type, 4));
+      in_bounds = LLVMBuildAnd(builder,
+                               lp_build_cmp(uint_bld, PIPE_FUNC_LESS,
+                                            offset, size),
+                               lp_build_cmp(uint_bld, PIPE_FUNC_LEQUAL,
+                                            end, size), "");
+      active = LLVMBuildAnd(builder, active, in_bounds, "");
+   }
+
+   if (value)
+      value = LLVMBuildBitCast(builder, value, uint_bld->vec_type, "");
+   if (value2)
+      value2 = LLVMBuildBitCast(builder, value2, uint_bld->vec_type, "");
+
+   result = lp_build_alloca(gallivm, uint_bld->vec_type, "mem_result");
+
+   for (i = 0; i < uint_bld->type.length; i++) {
+      LLVMValueRef ii = lp_build_const_int32(gallivm, i);
+      LLVMValueRef lane_active, lane_offset, ptr;
+      struct lp_build_if_state if_ctx;
+
+      lane_active = LLVMBuildExtractElement(builder, active, ii, "");
+      lane_active = LLVMBuildICmp(builder, LLVMIntNE, lane_active,
+                                  lp_build_const_int32(gallivm, 0), "");
+      lane_offset = LLVMBuildExtractElement(builder, offset, ii, "");
+
+      /* Only computes the address, nothing is accessed before the branch */
+      if (base_ptr) {
+         ptr = LLVMBuildGEP(builder, base_ptr, &lane_offset, 1, "");
+      }
+      else {
+         LLVMValueRef lane_in_bounds;
+
+         ptr = cs_iface->global_ptr(cs_iface, bld_base, lane_offset,
+                                    &lane_in_bounds);
+         lane_active = LLVMBuildAnd(builder, lane_active, lane_in_bounds, "");
+      }
+      ptr = LLVMBuildBitCast(builder, ptr, i32_ptr_type, "");
+
+      lp_build_if(&if_ctx, gallivm, lane_active);
+      {
+         LLVMValueRef lane_value = NULL, old = NULL;
+
+         if (value)
+            lane_value = LLVMBuildExtractElement(builder, value, ii, "");
+
+         switch (op) {
+         case LP_MEMORY_LOAD:
+            old = LLVMBuildLoad(builder, ptr, "");
+            break;
+         case LP_MEMORY_STORE:
+            LLVMBuildStore(builder, lane_value, ptr);
+            break;
+#if HAVE_LLVM >= 0x0305
+         case LP_MEMORY_ATOMIC:
+            old = LLVMBuildAtomicRMW(builder, atomic_op, ptr, lane_value,
+                                     LLVMAtomicOrderingSequentiallyConsistent,
+                                     FALSE);
+            break;
+#endif
+#if HAVE_LLVM >= 0x0309
+         case LP_MEMORY_ATOMIC_CAS:
+            old = LLVMBuildAtomicCmpXchg(builder, ptr, lane_value,
+                     LLVMBuildExtractElement(builder, value2, ii, ""),
+                     LLVMAtomicOrderingSequentiallyConsistent,
+                     LLVMAtomicOrderingSequentiallyConsistent,
+                     FALSE);
+            old = LLVMBuildExtractValue(builder, old, 0, "");
+            break;
+#endif
+         default:
+            assert(0);
+            break;
+         }
+
+         if (old) {
+            LLVMValueRef res = LLVMBuildLoad(builder, result, "");
+            res = LLVMBuildInsertElement(builder, res, old, ii, "");
+            LLVMBuildStore(builder, res, result);
+         }
+      }
+      lp_build_endif(&if_ctx);
+   }
+
+   result = LLVMBuildLoad(builder, result, "");
+   return LLVMBuildBitCast(builder, result, bld_base->base.vec_type, "");
+}
+
+static void
+load_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+   const struct tgsi_full_instruction *inst = emit_data->inst;
+   struct lp_build_context *uint_bld = &bld_base->uint_bld;
+   LLVMValueRef offset;
+   unsigned chan;
+
+   assert(inst->Src[0].Register.File == TGSI_FILE_RESOURCE);
+   assert(!inst->Src[0].Register.Indirect);
+
+   offset = lp_build_emit_fetch(bld_base, inst, 1, TGSI_CHAN_X);
+   offset = LLVMBuildBitCast(bld_base->base.gallivm->builder, offset,
+                             uint_bld->vec_type, "");
+
+   TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan) {
+      LLVMValueRef chan_offset =
+         lp_build_add(uint_bld, offset,
+                      lp_build_const_int_vec(bld_base->base.gallivm,
+                                             uint_bld->type, chan * 4));
+      emit_data->output[chan] =
+         emit_memory_op(bld, LP_MEMORY_LOAD, 0,
+                        inst->Src[0].Register.Index, chan_offset,
+                        NULL, NULL);
+   }
+}
+
+static void
+store_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+   const struct tgsi_full_instruction *inst = emit_data->inst;
+   struct lp_build_context *uint_bld = &bld_base->uint_bld;
+   LLVMValueRef offset;
+   unsigned chan;
+
+   assert(inst->Dst[0].Register.File == TGSI_FILE_RESOURCE);
+   assert(!inst->Dst[0].Register.Indirect);
+
+   offset = lp_build_emit_fetch(bld_base, inst, 0, TGSI_CHAN_X);
+   offset = LLVMBuildBitCast(bld_base->base.gallivm->builder, offset,
+                             uint_bld->vec_type, "");
+
+   TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan) {
+      LLVMValueRef chan_offset =
+         lp_build_add(uint_bld, offset,
+                      lp_build_const_int_vec(bld_base->base.gallivm,
+                                             uint_bld->type, chan * 4));
+      emit_memory_op(bld, LP_MEMORY_STORE, 0,
+                     inst->Dst[0].Register.Index, chan_offset,
+                     lp_build_emit_fetch(bld_base, inst, 1, chan), NULL);
+   }
+}
+
+#if HAVE_LLVM >= 0x0305
+static void
+atomic_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+   const struct tgsi_full_instruction *inst = emit_data->inst;
+   LLVMValueRef offset, value, value2 = NULL;
+   enum lp_memory_op op = LP_MEMORY_ATOMIC;
+   LLVMAtomicRMWBinOp atomic_op = LLVMAtomicRMWBinOpAdd;
+   unsigned chan;
+
+   assert(inst->Src[0].Register.File == TGSI_FILE_RESOURCE);
+   assert(!inst->Src[0].Register.Indirect);
+
+   switch (inst->Instruction.Opcode) {
+   case TGSI_OPCODE_ATOMUADD:
+      atomic_op = LLVMAtomicRMWBinOpAdd;
+      break;
+   case TGSI_OPCODE_ATOMXCHG:
+      atomic_op = LLVMAtomicRMWBinOpXchg;
+      break;
+   case TGSI_OPCODE_ATOMAND:
+      atomic_op = LLVMAtomicRMWBinOpAnd;
+      break;
+   case TGSI_OPCODE_ATOMOR:
+      atomic_op = LLVMAtomicRMWBinOpOr;
+      break;
+   case TGSI_OPCODE_ATOMXOR:
+      atomic_op = LLVMAtomicRMWBinOpXor;
+      break;
+   case TGSI_OPCODE_ATOMUMIN:
+      atomic_op = LLVMAtomicRMWBinOpUMin;
+      break;
+   case TGSI_OPCODE_ATOMUMAX:
+      atomic_op = LLVMAtomicRMWBinOpUMax;
+      break;
+   case TGSI_OPCODE_ATOMIMIN:
+      atomic_op = LLVMAtomicRMWBinOpMin;
+      break;
+   case TGSI_OPCODE_ATOMIMAX:
+      atomic_op = LLVMAtomicRMWBinOpMax;
+      break;
+   case TGSI_OPCODE_ATOMCAS:
+      op = LP_MEMORY_ATOMIC_CAS;
+      break;
+   default:
+      assert(0);
+      break;
+   }
+
+   /* only the first component is operated on */
+   offset = lp_build_emit_fetch(bld_base, inst, 1, TGSI_CHAN_X);
+   value = lp_build_emit_fetch(bld_base, inst, 2, TGSI_CHAN_X);
+   if (op == LP_MEMORY_ATOMIC_CAS)
+      value2 = lp_build_emit_fetch(bld_base, inst, 3, TGSI_CHAN_X);
+
+   emit_data->output[TGSI_CHAN_X] =
+      emit_memory_op(bld, op, atomic_op, inst->Src[0].Register.Index,
+                     offset, value, value2);
+
+   TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan) {
+      if (chan != TGSI_CHAN_X)
+         emit_data->output[chan] = emit_data->output[TGSI_CHAN_X];
+   }
+}
+#endif
+
 static void
 increment_vec_ptr_by_mask(struct lp_build_tgsi_context * bld_base,
                           LLVMValueRef ptr,
@@ -3869,7 +4182,8 @@ lp_build_tgsi_soa(struct gallivm_state *gallivm,
                   LLVMValueRef thread_data_ptr,
                   struct lp_build_sampler_soa *sampler,
                   const struct tgsi_shader_info *info,
-                  const struct lp_build_tgsi_gs_iface *gs_iface)
+                  const struct lp_build_tgsi_gs_iface *gs_iface,
+                  const struct lp_build_tgsi_cs_iface *cs_iface)
 {
    struct lp_build_tgsi_soa_context bld;
 
@@ -4009,6 +4323,27 @@ lp_build_tgsi_soa(struct gallivm_state *gallivm,
                                 max_output_vertices);
    }
 
+   if (cs_iface) {
+      bld.cs_iface = cs_iface;
+      bld.bld_base.pc = cs_iface->pc;
+      bld.bld_base.op_actions[TGSI_OPCODE_LOAD].emit = load_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_STORE].emit = store_emit;
+#if HAVE_LLVM >= 0x0305
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMUADD].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMXCHG].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMAND].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMOR].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMXOR].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMUMIN].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMUMAX].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMIMIN].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMIMAX].emit = atomic_emit;
+#endif
+#if HAVE_LLVM >= 0x0309
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMCAS].emit = atomic_emit;
+#endif
+   }
+
    lp_exec_mask_init(&bld.exec_mask, &bld.bld_base.int_bld);
 
    bld.system_values = *system_values;
@@ -46,6 +46,10 @@
 #include <signal.h>
 #endif
 
+#if defined(HAVE_PTHREAD) && defined(PIPE_OS_LINUX)
+#include <sched.h>
+#endif
+
 
 /* pipe_thread
  */
@@ -96,6 +100,28 @@ static inline void pipe_thread_setname( const char *name )
    (void)name;
 }
 
+/**
+ * Restrict the calling thread to run on the given CPU only.
+ * Returns FALSE if that's not supported or failed.
+ */
+static inline boolean pipe_thread_setaffinity( unsigned cpu )
+{
+#if defined(HAVE_PTHREAD) && defined(PIPE_OS_LINUX) && \
+    !defined(PIPE_OS_ANDROID) && defined(CPU_SET)
+   cpu_set_t set;
+
+   if (cpu >= CPU_SETSIZE)
+      return FALSE;
+
+   CPU_ZERO(&set);
+   CPU_SET(cpu, &set);
+   return pthread_setaffinity_np(pthread_self(), sizeof set, &set) == 0;
+#else
+   (void)cpu;
+   return FALSE;
+#endif
+}
+
 
 /* pipe_mutex
  */
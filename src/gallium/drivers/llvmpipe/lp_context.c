@@ -30,6 +30,7 @@
  *    Keith Whitwell <keithw@vmware.com>
  */
 
+#include <inttypes.h>  /* for PRIu64 macro */
 #include "draw/draw_context.h"
 #include "draw/draw_vbuf.h"
 #include "pipe/p_defines.h"
@@ -39,11 +40,13 @@
 #include "util/simple_list.h"
 #include "lp_clear.h"
 #include "lp_context.h"
+#include "lp_debug.h"
 #include "lp_flush.h"
 #include "lp_perf.h"
 #include "lp_state.h"
 #include "lp_surface.h"
 #include "lp_query.h"
+#include "lp_rast.h"
 #include "lp_setup.h"
 
 /* This is only safe if there's just one concurrent context */
@@ -58,6 +61,16 @@ static void llvmpipe_destroy( struct pipe_context *pipe )
 
    lp_print_counters();
 
+   if ((LP_DEBUG & DEBUG_COUNTERS) && llvmpipe->draw) {
+      uint64_t referenced, shaded;
+
+      draw_get_vertex_cache_stats(llvmpipe->draw, &referenced, &shaded);
+      debug_printf("llvmpipe: indexed vertices referenced:  %9"PRIu64"\n",
+                   referenced);
+      debug_printf("llvmpipe: indexed vertices shaded:      %9"PRIu64"\n",
+                   shaded);
+   }
+
    if (llvmpipe->blitter) {
       util_blitter_destroy(llvmpipe->blitter);
    }
@@ -95,6 +108,14 @@ static void llvmpipe_destroy( struct pipe_context *pipe )
       pipe_resource_reference(&llvmpipe->vertex_buffer[i].buffer, NULL);
    }
 
+   for (i = 0; i < Elements(llvmpipe->cs_resources); i++) {
+      pipe_surface_reference(&llvmpipe->cs_resources[i], NULL);
+   }
+
+   for (i = 0; i < Elements(llvmpipe->cs_globals); i++) {
+      pipe_resource_reference(&llvmpipe->cs_globals[i], NULL);
+   }
+
    lp_delete_setup_variants(llvmpipe);
 
 #ifndef USE_GLOBAL_LLVM_CONTEXT
@@ -127,6 +148,24 @@ llvmpipe_render_condition ( struct pipe_context *pipe,
    llvmpipe->render_cond_cond = condition;
 }
 
+static void
+llvmpipe_get_sample_position(struct pipe_context *pipe,
+                             unsigned sample_count,
+                             unsigned sample_index,
+                             float *out_value)
+{
+   if (sample_count == LP_MAX_SAMPLES && sample_index < LP_MAX_SAMPLES) {
+      out_value[0] = 0.5f + (float)lp_sample_pos[sample_index][0] /
+                            LP_SAMPLE_POS_ONE;
+      out_value[1] = 0.5f + (float)lp_sample_pos[sample_index][1] /
+                            LP_SAMPLE_POS_ONE;
+   }
+   else {
+      out_value[0] = 0.5f;
+      out_value[1] = 0.5f;
+   }
+}
+
 struct pipe_context *
 llvmpipe_create_context(struct pipe_screen *screen, void *priv,
                         unsigned flags)
@@ -156,6 +195,7 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    llvmpipe->pipe.flush = do_flush;
 
    llvmpipe->pipe.render_condition = llvmpipe_render_condition;
+   llvmpipe->pipe.get_sample_position = llvmpipe_get_sample_position;
 
    llvmpipe_init_blend_funcs(llvmpipe);
    llvmpipe_init_clip_funcs(llvmpipe);
@@ -167,6 +207,7 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    llvmpipe_init_fs_funcs(llvmpipe);
    llvmpipe_init_vs_funcs(llvmpipe);
    llvmpipe_init_gs_funcs(llvmpipe);
+   llvmpipe_init_compute_funcs(llvmpipe);
    llvmpipe_init_rasterizer_funcs(llvmpipe);
    llvmpipe_init_context_resource_funcs( &llvmpipe->pipe );
    llvmpipe_init_surface_functions(llvmpipe);
@@ -48,6 +48,7 @@ struct draw_context;
 struct draw_stage;
 struct draw_vertex_shader;
 struct lp_fragment_shader;
+struct lp_compute_shader;
 struct lp_blend_state;
 struct lp_setup_context;
 struct lp_setup_variant;
@@ -67,6 +68,7 @@ struct llvmpipe_context {
    const struct lp_geometry_shader *gs;
    const struct lp_velems_state *velems;
    const struct lp_so_state *so;
+   struct lp_compute_shader *cs;
 
    /** Other rendering state */
    unsigned sample_mask;
@@ -85,6 +87,10 @@ struct llvmpipe_context {
    struct pipe_resource *mapped_vs_tex[PIPE_MAX_SHADER_SAMPLER_VIEWS];
    struct pipe_resource *mapped_gs_tex[PIPE_MAX_SHADER_SAMPLER_VIEWS];
 
+   /** Compute shader resources (RES[i]) and global buffers */
+   struct pipe_surface *cs_resources[LP_MAX_CS_RESOURCES];
+   struct pipe_resource *cs_globals[LP_MAX_CS_GLOBALS];
+
    unsigned num_samplers[PIPE_SHADER_TYPES];
    unsigned num_sampler_views[PIPE_SHADER_TYPES];
 
@@ -99,6 +105,9 @@ struct llvmpipe_context {
 
    unsigned active_occlusion_queries;
 
+   /** Number of active LP_QUERY_TEXTURE_CACHE_x queries */
+   unsigned active_tex_cache_queries;
+
    unsigned dirty; /**< Mask of LP_NEW_x flags */
 
    /** Mapped vertex buffers */
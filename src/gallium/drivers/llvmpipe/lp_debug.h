@@ -59,6 +59,9 @@ st_print_current(void);
 #define PERF_NO_BLEND       0x20  	/* disable blending */
 #define PERF_NO_DEPTH       0x40  	/* disable depth buffering entirely */
 #define PERF_NO_ALPHATEST   0x80  	/* disable alpha testing */
+#define PERF_NO_ZCULL       0x100 	/* disable hierarchical depth culling */
+#define PERF_NO_TEX_TILING  0x200 	/* store all textures in rows */
+#define PERF_NO_FUSED_TRI   0x400 	/* no fused rasterizer/shader code */
 
 
 extern int LP_PERF;
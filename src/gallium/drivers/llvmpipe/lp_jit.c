@@ -39,6 +39,7 @@
 #include "gallivm/lp_bld_format.h"
 #include "lp_context.h"
 #include "lp_jit.h"
+#include "lp_state_cs.h"
 
 
 static void
@@ -214,10 +215,27 @@ lp_jit_create_types(struct lp_fragment_shader_variant *lp)
       elem_types[LP_JIT_THREAD_DATA_COUNTER] = LLVMInt64TypeInContext(lc);
       elem_types[LP_JIT_THREAD_DATA_RASTER_STATE_VIEWPORT_INDEX] =
             LLVMInt32TypeInContext(lc);
+      elem_types[LP_JIT_THREAD_DATA_SAMPLE_MASK] = LLVMInt64TypeInContext(lc);
+      elem_types[LP_JIT_THREAD_DATA_COLOR_SAMPLE_STRIDE] =
+            LLVMArrayType(LLVMInt32TypeInContext(lc), PIPE_MAX_COLOR_BUFS);
+      elem_types[LP_JIT_THREAD_DATA_DEPTH_SAMPLE_STRIDE] =
+            LLVMInt32TypeInContext(lc);
 
       thread_data_type = LLVMStructTypeInContext(lc, elem_types,
                                                  Elements(elem_types), 0);
 
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_thread_data, sample_mask,
+                             gallivm->target, thread_data_type,
+                             LP_JIT_THREAD_DATA_SAMPLE_MASK);
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_thread_data, color_sample_stride,
+                             gallivm->target, thread_data_type,
+                             LP_JIT_THREAD_DATA_COLOR_SAMPLE_STRIDE);
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_thread_data, depth_sample_stride,
+                             gallivm->target, thread_data_type,
+                             LP_JIT_THREAD_DATA_DEPTH_SAMPLE_STRIDE);
+      LP_CHECK_STRUCT_SIZE(struct lp_jit_thread_data,
+                           gallivm->target, thread_data_type);
+
       lp->jit_thread_data_ptr_type = LLVMPointerType(thread_data_type, 0);
    }
 
@@ -247,3 +265,76 @@ lp_jit_init_types(struct lp_fragment_shader_variant *lp)
    if (!lp->jit_context_ptr_type)
       lp_jit_create_types(lp);
 }
+
+
+void
+lp_jit_init_cs_types(struct lp_compute_shader_variant *lp)
+{
+   struct gallivm_state *gallivm = lp->gallivm;
+   LLVMContextRef lc = gallivm->context;
+   LLVMTypeRef elem_types[LP_JIT_CS_CTX_COUNT];
+   LLVMTypeRef context_type;
+
+   if (lp->jit_context_ptr_type)
+      return;
+
+   elem_types[LP_JIT_CS_CTX_CONSTANTS] =
+      LLVMArrayType(LLVMPointerType(LLVMFloatTypeInContext(lc), 0),
+                    LP_MAX_TGSI_CONST_BUFFERS);
+   elem_types[LP_JIT_CS_CTX_NUM_CONSTANTS] =
+      LLVMArrayType(LLVMInt32TypeInContext(lc), LP_MAX_TGSI_CONST_BUFFERS);
+   elem_types[LP_JIT_CS_CTX_RESOURCES] =
+      LLVMArrayType(LLVMPointerType(LLVMInt8TypeInContext(lc), 0),
+                    LP_MAX_CS_RESOURCES);
+   elem_types[LP_JIT_CS_CTX_RESOURCE_SIZES] =
+      LLVMArrayType(LLVMInt32TypeInContext(lc), LP_MAX_CS_RESOURCES);
+   elem_types[LP_JIT_CS_CTX_GLOBALS] =
+      LLVMArrayType(LLVMPointerType(LLVMInt8TypeInContext(lc), 0),
+                    LP_MAX_CS_GLOBALS);
+   elem_types[LP_JIT_CS_CTX_GLOBAL_SIZES] =
+      LLVMArrayType(LLVMInt32TypeInContext(lc), LP_MAX_CS_GLOBALS);
+   elem_types[LP_JIT_CS_CTX_INPUT] =
+      LLVMPointerType(LLVMInt8TypeInContext(lc), 0);
+   elem_types[LP_JIT_CS_CTX_INPUT_SIZE] = LLVMInt32TypeInContext(lc);
+   elem_types[LP_JIT_CS_CTX_BLOCK_SIZE] =
+   elem_types[LP_JIT_CS_CTX_GRID_SIZE] =
+      LLVMArrayType(LLVMInt32TypeInContext(lc), 3);
+
+   context_type = LLVMStructTypeInContext(lc, elem_types,
+                                          Elements(elem_types), 0);
+
+   LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, constants,
+                          gallivm->target, context_type,
+                          LP_JIT_CS_CTX_CONSTANTS);
+   LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, num_constants,
+                          gallivm->target, context_type,
+                          LP_JIT_CS_CTX_NUM_CONSTANTS);
+   LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, resources,
+                          gallivm->target, context_type,
+                          LP_JIT_CS_CTX_RESOURCES);
+   LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, resource_sizes,
+                          gallivm->target, context_type,
+                          LP_JIT_CS_CTX_RESOURCE_SIZES);
+   LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, globals,
+                          gallivm->target, context_type,
+                          LP_JIT_CS_CTX_GLOBALS);
+   LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, global_sizes,
+                          gallivm->target, context_type,
+                          LP_JIT_CS_CTX_GLOBAL_SIZES);
+   LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, input,
+                          gallivm->target, context_type,
+                          LP_JIT_CS_CTX_INPUT);
+   LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, input_size,
+                          gallivm->target, context_type,
+                          LP_JIT_CS_CTX_INPUT_SIZE);
+   LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, block_size,
+                          gallivm->target, context_type,
+                          LP_JIT_CS_CTX_BLOCK_SIZE);
+   LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, grid_size,
+                          gallivm->target, context_type,
+                          LP_JIT_CS_CTX_GRID_SIZE);
+   LP_CHECK_STRUCT_SIZE(struct lp_jit_cs_context,
+                        gallivm->target, context_type);
+
+   lp->jit_context_ptr_type = LLVMPointerType(context_type, 0);
+}
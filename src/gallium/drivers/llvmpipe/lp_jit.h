@@ -40,11 +40,13 @@
 #include "gallivm/lp_bld_limits.h"
 
 #include "pipe/p_state.h"
+#include "lp_limits.h"
 #include "lp_texture.h"
 
 
 struct lp_build_format_cache;
 struct lp_fragment_shader_variant;
+struct lp_compute_shader_variant;
 struct llvmpipe_screen;
 
 
@@ -199,6 +201,14 @@ struct lp_jit_thread_data
    struct {
       uint32_t viewport_index;
    } raster_state;
+
+   /*
+    * Multisampling: per-sample coverage of the 4x4 stamp (16 bits per
+    * sample) and the byte offsets between the samples of each buffer.
+    */
+   uint64_t sample_mask;
+   uint32_t color_sample_stride[PIPE_MAX_COLOR_BUFS];
+   uint32_t depth_sample_stride;
 };
 
 
@@ -206,6 +216,9 @@ enum {
    LP_JIT_THREAD_DATA_CACHE = 0,
    LP_JIT_THREAD_DATA_COUNTER,
    LP_JIT_THREAD_DATA_RASTER_STATE_VIEWPORT_INDEX,
+   LP_JIT_THREAD_DATA_SAMPLE_MASK,
+   LP_JIT_THREAD_DATA_COLOR_SAMPLE_STRIDE,
+   LP_JIT_THREAD_DATA_DEPTH_SAMPLE_STRIDE,
    LP_JIT_THREAD_DATA_COUNT
 };
 
@@ -220,6 +233,20 @@ enum {
    lp_build_struct_get(_gallivm, _ptr, \
                        LP_JIT_THREAD_DATA_RASTER_STATE_VIEWPORT_INDEX, \
                        "raster_state.viewport_index")
+
+#define lp_jit_thread_data_sample_mask(_gallivm, _ptr) \
+   lp_build_struct_get(_gallivm, _ptr, LP_JIT_THREAD_DATA_SAMPLE_MASK, \
+                       "sample_mask")
+
+#define lp_jit_thread_data_color_sample_stride(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, \
+                           LP_JIT_THREAD_DATA_COLOR_SAMPLE_STRIDE, \
+                           "color_sample_stride")
+
+#define lp_jit_thread_data_depth_sample_stride(_gallivm, _ptr) \
+   lp_build_struct_get(_gallivm, _ptr, \
+                       LP_JIT_THREAD_DATA_DEPTH_SAMPLE_STRIDE, \
+                       "depth_sample_stride")
  
 /**
  * typedef for fragment shader function
@@ -254,6 +281,128 @@ typedef void
                     unsigned depth_stride);
 
 
+/**
+ * typedef for the fused rasterizer and fragment shader function of a
+ * triangle of three planes contained in a 16x16 block
+ *
+ * The parameters are the same as for lp_jit_frag_func, with x, y, color
+ * and depth referring to the 16x16 block, plus:
+ *
+ * @param block_mask    4x4 blocks of the 16x16 block which may be shaded
+ * @param planes        c, dcdx, dcdy of each plane, c at the block origin
+ * @return number of 4x4 blocks shaded
+ */
+typedef unsigned
+(*lp_jit_frag_tri16_func)(const struct lp_jit_context *context,
+                          uint32_t x,
+                          uint32_t y,
+                          uint32_t facing,
+                          const void *a0,
+                          const void *dadx,
+                          const void *dady,
+                          uint8_t **color,
+                          uint8_t *depth,
+                          uint32_t block_mask,
+                          struct lp_jit_thread_data *thread_data,
+                          unsigned *stride,
+                          unsigned depth_stride,
+                          const int32_t *planes);
+
+
+/**
+ * This structure is passed directly to the generated compute shader.
+ *
+ * Changes here must be reflected in the lp_jit_cs_context_* macros and
+ * lp_jit_init_cs_types function.
+ */
+struct lp_jit_cs_context
+{
+   const float *constants[LP_MAX_TGSI_CONST_BUFFERS];
+   int num_constants[LP_MAX_TGSI_CONST_BUFFERS];
+
+   /** RES[] buffers, and their sizes in bytes */
+   uint8_t *resources[LP_MAX_CS_RESOURCES];
+   uint32_t resource_sizes[LP_MAX_CS_RESOURCES];
+
+   /** Buffers mapped into TGSI_RESOURCE_GLOBAL, and their sizes in bytes */
+   uint8_t *globals[LP_MAX_CS_GLOBALS];
+   uint32_t global_sizes[LP_MAX_CS_GLOBALS];
+
+   /** Contents of TGSI_RESOURCE_INPUT */
+   const uint8_t *input;
+   uint32_t input_size;
+
+   uint32_t block_size[3];
+   uint32_t grid_size[3];
+};
+
+
+/**
+ * These enum values must match the position of the fields in the
+ * lp_jit_cs_context struct above.
+ */
+enum {
+   LP_JIT_CS_CTX_CONSTANTS = 0,
+   LP_JIT_CS_CTX_NUM_CONSTANTS,
+   LP_JIT_CS_CTX_RESOURCES,
+   LP_JIT_CS_CTX_RESOURCE_SIZES,
+   LP_JIT_CS_CTX_GLOBALS,
+   LP_JIT_CS_CTX_GLOBAL_SIZES,
+   LP_JIT_CS_CTX_INPUT,
+   LP_JIT_CS_CTX_INPUT_SIZE,
+   LP_JIT_CS_CTX_BLOCK_SIZE,
+   LP_JIT_CS_CTX_GRID_SIZE,
+   LP_JIT_CS_CTX_COUNT
+};
+
+
+#define lp_jit_cs_context_constants(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_CONSTANTS, "constants")
+
+#define lp_jit_cs_context_num_constants(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_NUM_CONSTANTS, "num_constants")
+
+#define lp_jit_cs_context_resources(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_RESOURCES, "resources")
+
+#define lp_jit_cs_context_resource_sizes(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_RESOURCE_SIZES, "resource_sizes")
+
+#define lp_jit_cs_context_globals(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_GLOBALS, "globals")
+
+#define lp_jit_cs_context_global_sizes(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_GLOBAL_SIZES, "global_sizes")
+
+#define lp_jit_cs_context_input(_gallivm, _ptr) \
+   lp_build_struct_get(_gallivm, _ptr, LP_JIT_CS_CTX_INPUT, "input")
+
+#define lp_jit_cs_context_input_size(_gallivm, _ptr) \
+   lp_build_struct_get(_gallivm, _ptr, LP_JIT_CS_CTX_INPUT_SIZE, "input_size")
+
+#define lp_jit_cs_context_block_size(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_BLOCK_SIZE, "block_size")
+
+#define lp_jit_cs_context_grid_size(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_GRID_SIZE, "grid_size")
+
+
+/**
+ * typedef for compute shader function, running all the threads of one
+ * block
+ *
+ * @param context       jit context
+ * @param block_x       block id x
+ * @param block_y       block id y
+ * @param block_z       block id z
+ */
+typedef void
+(*lp_jit_cs_func)(const struct lp_jit_cs_context *context,
+                  uint32_t block_x,
+                  uint32_t block_y,
+                  uint32_t block_z);
+
+
 void
 lp_jit_screen_cleanup(struct llvmpipe_screen *screen);
 
@@ -266,4 +415,8 @@ void
 lp_jit_init_types(struct lp_fragment_shader_variant *lp);
 
 
+void
+lp_jit_init_cs_types(struct lp_compute_shader_variant *lp);
+
+
 #endif /* LP_JIT_H */
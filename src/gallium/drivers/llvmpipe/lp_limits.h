@@ -61,7 +61,32 @@
 #define LP_MAX_WIDTH  (1 << (LP_MAX_TEXTURE_LEVELS - 1))
 
 
-#define LP_MAX_THREADS 16
+/**
+ * Number of samples per pixel of multisampled surfaces.  This is the only
+ * sample count other than one that is supported.
+ */
+#define LP_MAX_SAMPLES 4
+
+
+#define LP_MAX_THREADS 128
+
+/**
+ * Max number of threads compiling optimized fragment shader variants in the
+ * background.
+ */
+#define LP_MAX_COMPILE_THREADS 8
+
+
+/**
+ * Compute shader limits.  TGSI_RESOURCE_GLOBAL is addressed with 32-bit
+ * handles: the top bits select one of the bound global buffers and the
+ * low LP_CS_GLOBAL_OFFSET_BITS are the byte offset into it.
+ */
+#define LP_MAX_CS_RESOURCES 32
+#define LP_MAX_CS_GLOBALS 32
+#define LP_CS_GLOBAL_OFFSET_BITS 27
+#define LP_MAX_CS_INPUT_SIZE 4096
+#define LP_MAX_CS_THREADS_PER_BLOCK 1024
 
 
 /**
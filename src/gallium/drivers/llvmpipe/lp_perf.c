@@ -98,7 +98,18 @@ lp_print_counters(void)
       debug_printf("llvmpipe:   nr_empty_4x4:               %9u (%3.0f%% of %u)\n", lp_count.nr_empty_4, p1, total_4);
       debug_printf("llvmpipe:   nr_non_empty_4x4:           %9u (%3.0f%% of %u)\n", lp_count.nr_non_empty_4, p4, total_4);
 
+      p1 = 100.0 * (float) lp_count.nr_zcull_culled_64 / (float) lp_count.nr_zcull_tested_64;
+      p2 = 100.0 * (float) lp_count.nr_zcull_culled_16 / (float) lp_count.nr_zcull_tested_16;
+
+      debug_printf("llvmpipe: nr_zcull_culled_64x64:        %9u (%3.0f%% of %u)\n", lp_count.nr_zcull_culled_64, p1, lp_count.nr_zcull_tested_64);
+      debug_printf("llvmpipe: nr_zcull_culled_16x16:        %9u (%3.0f%% of %u)\n", lp_count.nr_zcull_culled_16, p2, lp_count.nr_zcull_tested_16);
+
+      debug_printf("llvmpipe: nr_fused_tri_16x16:           %9u\n", lp_count.nr_fused_16);
+      debug_printf("llvmpipe: nr_small_tris:                %9u\n", lp_count.nr_small_tris);
+      debug_printf("llvmpipe: nr_small_batches:             %9u\n", lp_count.nr_small_batches);
+
       debug_printf("llvmpipe: nr_color_tile_clear:          %9u\n", lp_count.nr_color_tile_clear);
+      debug_printf("llvmpipe: clear_bytes_avoided:          %9llu\n", (unsigned long long) lp_count.clear_bytes_avoided);
       debug_printf("llvmpipe: nr_color_tile_load:           %9u\n", lp_count.nr_color_tile_load);
       debug_printf("llvmpipe: nr_color_tile_store:          %9u\n", lp_count.nr_color_tile_store);
 
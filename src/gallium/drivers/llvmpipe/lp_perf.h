@@ -56,10 +56,18 @@ struct lp_counters
    unsigned nr_fully_covered_4;
    unsigned nr_partially_covered_4;
    unsigned nr_non_empty_4;
+   unsigned nr_zcull_tested_64;
+   unsigned nr_zcull_culled_64;
+   unsigned nr_zcull_tested_16;
+   unsigned nr_zcull_culled_16;
+   unsigned nr_fused_16;  /**< small triangles done by fused code */
+   unsigned nr_small_tris;  /**< binned as lp_rast_small_triangle */
+   unsigned nr_small_batches;  /**< LP_RAST_OP_TRIANGLE_SMALL commands */
    unsigned nr_llvm_compiles;
    int64_t llvm_compile_time;  /**< total, in microseconds */
 
    unsigned nr_color_tile_clear;
+   uint64_t clear_bytes_avoided;  /**< by deferred tile clears */
    unsigned nr_color_tile_load;
    unsigned nr_color_tile_store;
 };
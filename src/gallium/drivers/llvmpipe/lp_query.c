@@ -55,7 +55,9 @@ llvmpipe_create_query(struct pipe_context *pipe,
 {
    struct llvmpipe_query *pq;
 
-   assert(type < PIPE_QUERY_TYPES);
+   assert(type < PIPE_QUERY_TYPES ||
+          type == LP_QUERY_TEXTURE_CACHE_HITS ||
+          type == LP_QUERY_TEXTURE_CACHE_MISSES);
 
    pq = CALLOC_STRUCT( llvmpipe_query );
 
@@ -120,6 +122,8 @@ llvmpipe_get_query_result(struct pipe_context *pipe,
 
    switch (pq->type) {
    case PIPE_QUERY_OCCLUSION_COUNTER:
+   case LP_QUERY_TEXTURE_CACHE_HITS:
+   case LP_QUERY_TEXTURE_CACHE_MISSES:
       for (i = 0; i < num_threads; i++) {
          *result += pq->end[i];
       }
@@ -232,6 +236,13 @@ llvmpipe_begin_query(struct pipe_context *pipe, struct pipe_query *q)
       llvmpipe->active_occlusion_queries++;
       llvmpipe->dirty |= LP_NEW_OCCLUSION_QUERY;
       break;
+   case LP_QUERY_TEXTURE_CACHE_HITS:
+   case LP_QUERY_TEXTURE_CACHE_MISSES:
+      /* the fragment shaders only count texture cache accesses while
+       * such a query is active */
+      llvmpipe->active_tex_cache_queries++;
+      llvmpipe->dirty |= LP_NEW_TEX_CACHE_QUERY;
+      break;
    default:
       break;
    }
@@ -295,6 +306,12 @@ llvmpipe_end_query(struct pipe_context *pipe, struct pipe_query *q)
       llvmpipe->active_occlusion_queries--;
       llvmpipe->dirty |= LP_NEW_OCCLUSION_QUERY;
       break;
+   case LP_QUERY_TEXTURE_CACHE_HITS:
+   case LP_QUERY_TEXTURE_CACHE_MISSES:
+      assert(llvmpipe->active_tex_cache_queries);
+      llvmpipe->active_tex_cache_queries--;
+      llvmpipe->dirty |= LP_NEW_TEX_CACHE_QUERY;
+      break;
    default:
       break;
    }
@@ -320,6 +337,26 @@ llvmpipe_check_render_cond(struct llvmpipe_context *lp)
       return TRUE;
 }
 
+int
+llvmpipe_get_driver_query_info(struct pipe_screen *screen,
+                               unsigned index,
+                               struct pipe_driver_query_info *info)
+{
+   static const struct pipe_driver_query_info queries[] = {
+      {"texture-cache-hits", LP_QUERY_TEXTURE_CACHE_HITS, {0}},
+      {"texture-cache-misses", LP_QUERY_TEXTURE_CACHE_MISSES, {0}},
+   };
+
+   if (!info)
+      return Elements(queries);
+
+   if (index >= Elements(queries))
+      return 0;
+
+   *info = queries[index];
+   return 1;
+}
+
 void llvmpipe_init_query_funcs(struct llvmpipe_context *llvmpipe )
 {
    llvmpipe->pipe.create_query = llvmpipe_create_query;
@@ -35,12 +35,21 @@
 
 #include <limits.h>
 #include "os/os_thread.h"
+#include "pipe/p_defines.h"
 #include "lp_limits.h"
 
 
 struct llvmpipe_context;
 
 
+/**
+ * Driver specific queries: texels whose decoded s3tc block was found in,
+ * or had to be added to, the rasterizer threads' texture caches.
+ */
+#define LP_QUERY_TEXTURE_CACHE_HITS    (PIPE_QUERY_DRIVER_SPECIFIC + 0)
+#define LP_QUERY_TEXTURE_CACHE_MISSES  (PIPE_QUERY_DRIVER_SPECIFIC + 1)
+
+
 struct llvmpipe_query {
    uint64_t start[LP_MAX_THREADS];  /* start count value for each thread */
    uint64_t end[LP_MAX_THREADS];    /* end count value for each thread */
@@ -57,4 +66,9 @@ extern void llvmpipe_init_query_funcs(struct llvmpipe_context * );
 
 extern boolean llvmpipe_check_render_cond(struct llvmpipe_context *);
 
+extern int
+llvmpipe_get_driver_query_info(struct pipe_screen *screen,
+                               unsigned index,
+                               struct pipe_driver_query_info *info);
+
 #endif /* LP_QUERY_H */
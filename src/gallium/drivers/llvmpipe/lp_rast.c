@@ -26,6 +26,9 @@
  **************************************************************************/
 
 #include <limits.h>
+#include <stdio.h>
+#include "util/u_atomic.h"
+#include "util/u_cpu_detect.h"
 #include "util/u_memory.h"
 #include "util/u_math.h"
 #include "util/u_rect.h"
@@ -43,10 +46,12 @@
 #include "lp_query.h"
 #include "lp_rast.h"
 #include "lp_rast_priv.h"
+#include "lp_screen.h"
 #include "gallivm/lp_bld_format.h"
 #include "gallivm/lp_bld_debug.h"
 #include "lp_scene.h"
 #include "lp_tex_sample.h"
+#include "lp_trace.h"
 
 
 #ifdef DEBUG
@@ -56,6 +61,14 @@ const struct lp_rasterizer_task *jit_task = NULL;
 #endif
 
 
+const int lp_sample_pos[LP_MAX_SAMPLES][2] = {
+   { -2, -6 },
+   {  6, -2 },
+   { -6,  2 },
+   {  2,  6 }
+};
+
+
 /**
  * Begin rasterizing a scene.
  * Called once per scene by one thread.
@@ -69,16 +82,30 @@ lp_rast_begin( struct lp_rasterizer *rast,
    LP_DBG(DEBUG_RAST, "%s\n", __FUNCTION__);
 
    lp_scene_begin_rasterization( scene );
-   lp_scene_bin_iter_begin( scene );
+   lp_scene_bin_iter_begin( scene, MAX2(1, rast->num_threads),
+                            rast->pin_threads ? rast->thread_node : NULL );
 }
 
 
+/**
+ * Finish rasterizing a scene.
+ * Called once per scene by one thread, after all threads are done.
+ * Signalling the fence hands the scene back to the setup code, so the
+ * scene must not be touched anymore afterwards.
+ */
 static void
 lp_rast_end( struct lp_rasterizer *rast )
 {
-   lp_scene_end_rasterization( rast->curr_scene );
+   struct lp_scene *scene = rast->curr_scene;
+   struct lp_fence *fence = scene->fence;
+
+   lp_scene_end_rasterization( scene );
 
    rast->curr_scene = NULL;
+
+   if (fence) {
+      lp_fence_signal(fence);
+   }
 }
 
 
@@ -108,41 +135,55 @@ lp_rast_tile_begin(struct lp_rasterizer_task *task,
    task->thread_data.vis_counter = 0;
    task->ps_invocations = 0;
 
+   /* cleared by lp_rast_tile_end() */
+   assert(!task->clear_pending);
+
+   lp_rast_zcull_reset(task, LP_ZCULL_UNKNOWN);
+
    for (i = 0; i < task->scene->fb.nr_cbufs; i++) {
       if (task->scene->fb.cbufs[i]) {
          task->color_tiles[i] = scene->cbufs[i].map +
                                 scene->cbufs[i].stride * task->y +
                                 scene->cbufs[i].format_bytes * task->x;
+         task->thread_data.color_sample_stride[i] =
+            scene->nr_samples > 1 ? scene->cbufs[i].layer_stride : 0;
       }
    }
    if (task->scene->fb.zsbuf) {
       task->depth_tile = scene->zsbuf.map +
                          scene->zsbuf.stride * task->y +
                          scene->zsbuf.format_bytes * task->x;
+      task->thread_data.depth_sample_stride =
+         scene->nr_samples > 1 ? scene->zsbuf.layer_stride : 0;
    }
 }
 
 
 /**
- * Clear the rasterizer's current color tile.
- * This is a bin command called during bin processing.
- * Clear commands always clear all bound layers.
+ * Number of bytes written by a clear of the current tile of a buffer.
+ * Clears write all bound layers and samples.
  */
-static void
-lp_rast_clear_color(struct lp_rasterizer_task *task,
-                    const union lp_rast_cmd_arg arg)
+static inline uint64_t
+tile_clear_bytes(const struct lp_rasterizer_task *task, unsigned format_bytes)
 {
    const struct lp_scene *scene = task->scene;
-   unsigned cbuf = arg.clear_rb->cbuf;
-   union util_color uc;
-   enum pipe_format format;
 
-   /* we never bin clear commands for non-existing buffers */
-   assert(cbuf < scene->fb.nr_cbufs);
-   assert(scene->fb.cbufs[cbuf]);
+   return (uint64_t) format_bytes * task->width * task->height *
+          (scene->fb_max_layer + 1) * scene->nr_samples;
+}
+
 
-   format = scene->fb.cbufs[cbuf]->format;
-   uc = arg.clear_rb->color_val;
+/**
+ * Write a clear of the rasterizer's current color tile to memory.
+ */
+static void
+apply_clear_color(struct lp_rasterizer_task *task,
+                  unsigned cbuf,
+                  const struct lp_rast_clear_rb *clear_rb)
+{
+   const struct lp_scene *scene = task->scene;
+   enum pipe_format format = scene->fb.cbufs[cbuf]->format;
+   union util_color uc = clear_rb->color_val;
 
    /*
     * this is pretty rough since we have target format (bunch of bytes...) here.
@@ -161,8 +202,37 @@ lp_rast_clear_color(struct lp_rasterizer_task *task,
                  0,
                  task->width,
                  task->height,
-                 scene->fb_max_layer + 1,
+                 (scene->fb_max_layer + 1) * scene->nr_samples,
                  &uc);
+}
+
+
+/**
+ * Clear the rasterizer's current color tile.
+ * This is a bin command called during bin processing.
+ * Clear commands always clear all bound layers.
+ *
+ * The clear is only recorded here, see lp_rast_apply_clears().
+ */
+static void
+lp_rast_clear_color(struct lp_rasterizer_task *task,
+                    const union lp_rast_cmd_arg arg)
+{
+   const struct lp_scene *scene = task->scene;
+   unsigned cbuf = arg.clear_rb->cbuf;
+
+   /* we never bin clear commands for non-existing buffers */
+   assert(cbuf < scene->fb.nr_cbufs);
+   assert(scene->fb.cbufs[cbuf]);
+
+   if (task->pending_clear_color[cbuf]) {
+      /* the earlier clear is never written */
+      LP_COUNT_ADD(clear_bytes_avoided,
+                   tile_clear_bytes(task, scene->cbufs[cbuf].format_bytes));
+   }
+
+   task->pending_clear_color[cbuf] = arg.clear_rb;
+   task->clear_pending = TRUE;
 
    /* this will increase for each rb which probably doesn't mean much */
    LP_COUNT(nr_color_tile_clear);
@@ -170,17 +240,14 @@ lp_rast_clear_color(struct lp_rasterizer_task *task,
 
 
 /**
- * Clear the rasterizer's current z/stencil tile.
- * This is a bin command called during bin processing.
- * Clear commands always clear all bound layers.
+ * Write a clear of the rasterizer's current z/stencil tile to memory.
  */
 static void
-lp_rast_clear_zstencil(struct lp_rasterizer_task *task,
-                       const union lp_rast_cmd_arg arg)
+apply_clear_zstencil(struct lp_rasterizer_task *task,
+                     uint64_t clear_value64,
+                     uint64_t clear_mask64)
 {
    const struct lp_scene *scene = task->scene;
-   uint64_t clear_value64 = arg.clear_zstencil.value;
-   uint64_t clear_mask64 = arg.clear_zstencil.mask;
    uint32_t clear_value = (uint32_t) clear_value64;
    uint32_t clear_mask = (uint32_t) clear_mask64;
    const unsigned height = task->height;
@@ -204,7 +271,10 @@ lp_rast_clear_zstencil(struct lp_rasterizer_task *task,
 
       clear_value &= clear_mask;
 
-      for (layer = 0; layer <= scene->fb_max_layer; layer++) {
+      /* Multisampled buffers keep their samples in place of the layers */
+      for (layer = 0;
+           layer < (scene->fb_max_layer + 1) * scene->nr_samples;
+           layer++) {
          dst = dst_layer;
 
          switch (block_size) {
@@ -284,6 +354,100 @@ lp_rast_clear_zstencil(struct lp_rasterizer_task *task,
 }
 
 
+/**
+ * Clear the rasterizer's current z/stencil tile.
+ * This is a bin command called during bin processing.
+ * Clear commands always clear all bound layers.
+ *
+ * The clear is merged into the pending one, see lp_rast_apply_clears().
+ */
+static void
+lp_rast_clear_zstencil(struct lp_rasterizer_task *task,
+                       const union lp_rast_cmd_arg arg)
+{
+   const struct lp_scene *scene = task->scene;
+   uint64_t clear_value64 = arg.clear_zstencil.value;
+   uint64_t clear_mask64 = arg.clear_zstencil.mask;
+
+   if (!scene->fb.zsbuf)
+      return;
+
+   if (task->pending_clear_zs_mask) {
+      /* the two clears are written in one go */
+      LP_COUNT_ADD(clear_bytes_avoided,
+                   tile_clear_bytes(task, scene->zsbuf.format_bytes));
+   }
+
+   task->pending_clear_zs_value =
+      (task->pending_clear_zs_value & ~clear_mask64) |
+      (clear_value64 & clear_mask64);
+   task->pending_clear_zs_mask |= clear_mask64;
+   task->clear_pending = TRUE;
+
+   if (scene->zcull) {
+      float depth;
+
+      if (lp_scene_clear_depth(scene->fb.zsbuf->format,
+                               clear_value64, clear_mask64, &depth)) {
+         lp_rast_zcull_reset(task, depth);
+      }
+   }
+}
+
+
+/**
+ * Write all clears of the current tile which are still pending.
+ * Called before the first command which reads or writes the tile memory,
+ * and at the end of the tile.
+ */
+static void
+lp_rast_apply_clears(struct lp_rasterizer_task *task)
+{
+   unsigned i;
+
+   for (i = 0; i < task->scene->fb.nr_cbufs; i++) {
+      if (task->pending_clear_color[i]) {
+         apply_clear_color(task, i, task->pending_clear_color[i]);
+         task->pending_clear_color[i] = NULL;
+      }
+   }
+
+   if (task->pending_clear_zs_mask) {
+      apply_clear_zstencil(task, task->pending_clear_zs_value,
+                           task->pending_clear_zs_mask);
+      task->pending_clear_zs_value = 0;
+      task->pending_clear_zs_mask = 0;
+   }
+
+   task->clear_pending = FALSE;
+}
+
+
+/**
+ * Forget a pending clear of the color buffer when an opaque shade-tile
+ * command is about to overwrite all of it.  Opaque shaders are only
+ * used with a single color buffer and no depth/stencil test.
+ */
+static void
+lp_rast_drop_covered_clear(struct lp_rasterizer_task *task,
+                           const struct lp_rast_shader_inputs *inputs)
+{
+   const struct lp_scene *scene = task->scene;
+
+   if (!task->pending_clear_color[0] ||
+       inputs->disable ||
+       !task->state ||
+       !task->state->variant->opaque ||
+       scene->fb_max_layer != 0 ||
+       !lp_rast_all_samples_enabled(task))
+      return;
+
+   LP_COUNT_ADD(clear_bytes_avoided,
+                tile_clear_bytes(task, scene->cbufs[0].format_bytes));
+   task->pending_clear_color[0] = NULL;
+}
+
+
 
 /**
  * Run the shader on all blocks in a tile.  This is used when a tile is
@@ -299,7 +463,7 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
    const struct lp_rast_state *state;
    struct lp_fragment_shader_variant *variant;
    const unsigned tile_x = task->x, tile_y = task->y;
-   unsigned x, y;
+   unsigned x, y, bx, by;
 
    if (inputs->disable) {
       /* This command was partially binned and has been disabled */
@@ -315,53 +479,87 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
    }
    variant = state->variant;
 
-   /* render the whole 64x64 tile in 4x4 chunks */
-   for (y = 0; y < task->height; y += 4){
-      for (x = 0; x < task->width; x += 4) {
-         uint8_t *color[PIPE_MAX_COLOR_BUFS];
-         unsigned stride[PIPE_MAX_COLOR_BUFS];
-         uint8_t *depth = NULL;
-         unsigned depth_stride = 0;
-         unsigned i;
-
-         /* color buffer */
-         for (i = 0; i < scene->fb.nr_cbufs; i++){
-            if (scene->fb.cbufs[i]) {
-               stride[i] = scene->cbufs[i].stride;
-               color[i] = lp_rast_get_color_block_pointer(task, i, tile_x + x,
-                                                          tile_y + y, inputs->layer);
-            }
-            else {
-               stride[i] = 0;
-               color[i] = NULL;
-            }
+   if (lp_rast_zcull_reject(task, inputs, tile_x, tile_y, TILE_SIZE)) {
+      return;
+   }
+
+   /* render the whole 64x64 tile in 16x16 blocks of 4x4 chunks, skipping
+    * the blocks which are known to be hidden
+    */
+   for (by = 0; by < task->height; by += 16) {
+      for (bx = 0; bx < task->width; bx += 16) {
+         const unsigned x1 = MIN2(bx + 16, task->width);
+         const unsigned y1 = MIN2(by + 16, task->height);
+
+         if (lp_rast_zcull_reject(task, inputs, tile_x + bx, tile_y + by, 16)) {
+            continue;
          }
 
-         /* depth buffer */
-         if (scene->zsbuf.map) {
-            depth = lp_rast_get_depth_block_pointer(task, tile_x + x,
-                                                    tile_y + y, inputs->layer);
-            depth_stride = scene->zsbuf.stride;
+         if (!lp_rast_all_samples_enabled(task)) {
+            /* let the sample mask decide which samples are written */
+            for (y = by; y < y1; y += 4) {
+               for (x = bx; x < x1; x += 4) {
+                  lp_rast_shade_quads_ms_mask(task, inputs,
+                                              tile_x + x, tile_y + y, ~0ULL);
+               }
+            }
+            continue;
          }
 
-         /* Propagate non-interpolated raster state. */
-         task->thread_data.raster_state.viewport_index = inputs->viewport_index;
+         for (y = by; y < y1; y += 4) {
+            for (x = bx; x < x1; x += 4) {
+               uint8_t *color[PIPE_MAX_COLOR_BUFS];
+               unsigned stride[PIPE_MAX_COLOR_BUFS];
+               uint8_t *depth = NULL;
+               unsigned depth_stride = 0;
+               unsigned i;
+
+               /* color buffer */
+               for (i = 0; i < scene->fb.nr_cbufs; i++){
+                  if (scene->fb.cbufs[i]) {
+                     stride[i] = scene->cbufs[i].stride;
+                     color[i] = lp_rast_get_color_block_pointer(task, i,
+                                                                tile_x + x,
+                                                                tile_y + y,
+                                                                inputs->layer);
+                  }
+                  else {
+                     stride[i] = 0;
+                     color[i] = NULL;
+                  }
+               }
+
+               /* depth buffer */
+               if (scene->zsbuf.map) {
+                  depth = lp_rast_get_depth_block_pointer(task, tile_x + x,
+                                                          tile_y + y,
+                                                          inputs->layer);
+                  depth_stride = scene->zsbuf.stride;
+               }
 
-         /* run shader on 4x4 block */
-         BEGIN_JIT_CALL(state, task);
-         variant->jit_function[RAST_WHOLE]( &state->jit_context,
-                                            tile_x + x, tile_y + y,
-                                            inputs->frontfacing,
-                                            GET_A0(inputs),
-                                            GET_DADX(inputs),
-                                            GET_DADY(inputs),
-                                            color,
-                                            depth,
-                                            0xffff,
-                                            &task->thread_data,
-                                            stride,
-                                            depth_stride);
-         END_JIT_CALL();
+               /* Propagate non-interpolated raster state. */
+               task->thread_data.raster_state.viewport_index =
+                  inputs->viewport_index;
+
+               /* run shader on 4x4 block */
+               BEGIN_JIT_CALL(state, task);
+               variant->code->jit_function[RAST_WHOLE]( &state->jit_context,
+                                                  tile_x + x, tile_y + y,
+                                                  inputs->frontfacing,
+                                                  GET_A0(inputs),
+                                                  GET_DADX(inputs),
+                                                  GET_DADY(inputs),
+                                                  color,
+                                                  depth,
+                                                  0xffff,
+                                                  &task->thread_data,
+                                                  stride,
+                                                  depth_stride);
+               END_JIT_CALL();
+            }
+         }
+
+         lp_rast_zcull_update(task, inputs, tile_x + bx, tile_y + by);
       }
    }
 }
@@ -388,16 +586,14 @@ lp_rast_shade_tile_opaque(struct lp_rasterizer_task *task,
 
 
 /**
- * Compute shading for a 4x4 block of pixels inside a triangle.
- * This is a bin command called during bin processing.
- * \param x  X position of quad in window coords
- * \param y  Y position of quad in window coords
+ * Run the edge testing shader on a 4x4 block.
+ * \param mask  coverage of the pixels of the block
  */
-void
-lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
-                         const struct lp_rast_shader_inputs *inputs,
-                         unsigned x, unsigned y,
-                         unsigned mask)
+static void
+shade_quads(struct lp_rasterizer_task *task,
+            const struct lp_rast_shader_inputs *inputs,
+            unsigned x, unsigned y,
+            unsigned mask)
 {
    const struct lp_rast_state *state = task->state;
    struct lp_fragment_shader_variant *variant = state->variant;
@@ -454,7 +650,7 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
 
       /* run shader on 4x4 block */
       BEGIN_JIT_CALL(state, task);
-      variant->jit_function[RAST_EDGE_TEST](&state->jit_context,
+      variant->code->jit_function[RAST_EDGE_TEST](&state->jit_context,
                                             x, y,
                                             inputs->frontfacing,
                                             GET_A0(inputs),
@@ -471,6 +667,75 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
 }
 
 
+/**
+ * Compute shading for a 4x4 block of pixels inside a triangle.
+ * This is a bin command called during bin processing.
+ * \param x  X position of quad in window coords
+ * \param y  Y position of quad in window coords
+ */
+void
+lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
+                         const struct lp_rast_shader_inputs *inputs,
+                         unsigned x, unsigned y,
+                         unsigned mask)
+{
+   if (task->scene->nr_samples > 1) {
+      /* Pixel center coverage applies to all samples of the pixel */
+      uint64_t sample_mask = mask;
+      sample_mask |= sample_mask << 16;
+      sample_mask |= sample_mask << 32;
+      lp_rast_shade_quads_ms_mask(task, inputs, x, y, sample_mask);
+      return;
+   }
+
+   shade_quads(task, inputs, x, y, mask);
+}
+
+
+/**
+ * Compute shading for a 4x4 block of pixels with per-sample coverage.
+ * The shader runs once per pixel with any sample covered.
+ * \param sample_mask  16 bits of block coverage for each sample, sample 0
+ *                     in the low bits
+ */
+void
+lp_rast_shade_quads_ms_mask(struct lp_rasterizer_task *task,
+                            const struct lp_rast_shader_inputs *inputs,
+                            unsigned x, unsigned y,
+                            uint64_t sample_mask)
+{
+   const unsigned enabled = task->state->sample_mask;
+   unsigned s, mask = 0;
+
+   for (s = 0; s < LP_MAX_SAMPLES; s++) {
+      if (!(enabled & (1 << s)))
+         sample_mask &= ~(0xffffULL << (16 * s));
+      mask |= (sample_mask >> (16 * s)) & 0xffff;
+   }
+
+   if (mask) {
+      task->thread_data.sample_mask = sample_mask;
+      shade_quads(task, inputs, x, y, mask);
+   }
+}
+
+
+
+/**
+ * Current value of the texture cache counter of this thread which
+ * a LP_QUERY_TEXTURE_CACHE_x query measures.
+ */
+static uint64_t
+texture_cache_counter(const struct lp_rasterizer_task *task, unsigned type)
+{
+   const struct lp_build_format_cache *cache = task->thread_data.cache;
+
+   if (type == LP_QUERY_TEXTURE_CACHE_MISSES)
+      return cache->cache_access_miss;
+   else
+      return cache->cache_access_total - cache->cache_access_miss;
+}
+
 
 /**
  * Begin a new occlusion query.
@@ -491,6 +756,10 @@ lp_rast_begin_query(struct lp_rasterizer_task *task,
    case PIPE_QUERY_PIPELINE_STATISTICS:
       pq->start[task->thread_index] = task->ps_invocations;
       break;
+   case LP_QUERY_TEXTURE_CACHE_HITS:
+   case LP_QUERY_TEXTURE_CACHE_MISSES:
+      pq->start[task->thread_index] = texture_cache_counter(task, pq->type);
+      break;
    default:
       assert(0);
       break;
@@ -524,6 +793,12 @@ lp_rast_end_query(struct lp_rasterizer_task *task,
          task->ps_invocations - pq->start[task->thread_index];
       pq->start[task->thread_index] = 0;
       break;
+   case LP_QUERY_TEXTURE_CACHE_HITS:
+   case LP_QUERY_TEXTURE_CACHE_MISSES:
+      pq->end[task->thread_index] +=
+         texture_cache_counter(task, pq->type) - pq->start[task->thread_index];
+      pq->start[task->thread_index] = 0;
+      break;
    default:
       assert(0);
       break;
@@ -536,6 +811,10 @@ lp_rast_set_state(struct lp_rasterizer_task *task,
                   const union lp_rast_cmd_arg arg)
 {
    task->state = arg.state;
+
+   if (task->state->zcull & LP_ZCULL_INVALIDATE) {
+      lp_rast_zcull_reset(task, LP_ZCULL_UNKNOWN);
+   }
 }
 
 
@@ -548,6 +827,10 @@ lp_rast_tile_end(struct lp_rasterizer_task *task)
 {
    unsigned i;
 
+   if (task->clear_pending) {
+      lp_rast_apply_clears(task);
+   }
+
    for (i = 0; i < task->scene->num_active_queries; ++i) {
       lp_rast_end_query(task, lp_rast_arg_query(task->scene->active_queries[i]));
    }
@@ -589,10 +872,116 @@ static lp_rast_cmd_func dispatch[LP_RAST_OP_MAX] =
    lp_rast_triangle_32_8,
    lp_rast_triangle_32_3_4,
    lp_rast_triangle_32_3_16,
-   lp_rast_triangle_32_4_16
+   lp_rast_triangle_32_4_16,
+   lp_rast_triangle_ms_1,
+   lp_rast_triangle_ms_2,
+   lp_rast_triangle_ms_3,
+   lp_rast_triangle_ms_4,
+   lp_rast_triangle_ms_5,
+   lp_rast_triangle_ms_6,
+   lp_rast_triangle_ms_7,
+   lp_rast_triangle_ms_8,
+   lp_rast_triangle_small
 };
 
 
+/**
+ * Whether a bin command reads or writes the color or depth memory of the
+ * tile, which requires pending clears to be written first.
+ */
+static inline boolean
+cmd_accesses_tile(unsigned cmd)
+{
+   switch (cmd) {
+   case LP_RAST_OP_CLEAR_COLOR:
+   case LP_RAST_OP_CLEAR_ZSTENCIL:
+   case LP_RAST_OP_BEGIN_QUERY:
+   case LP_RAST_OP_END_QUERY:
+   case LP_RAST_OP_SET_STATE:
+      return FALSE;
+   default:
+      return TRUE;
+   }
+}
+
+
+static inline void
+do_rasterize_cmd(struct lp_rasterizer_task *task,
+                 unsigned cmd, const union lp_rast_cmd_arg arg)
+{
+   if (task->clear_pending && cmd_accesses_tile(cmd)) {
+      if (cmd == LP_RAST_OP_SHADE_TILE_OPAQUE) {
+         lp_rast_drop_covered_clear(task, arg.shade_tile);
+      }
+      lp_rast_apply_clears(task);
+   }
+
+   dispatch[cmd]( task, arg );
+}
+
+
+/**
+ * Record the commands run with the current shader variant in the timeline.
+ */
+static void
+trace_shade(struct lp_rasterizer_task *task,
+            int64_t start, int64_t end, unsigned commands)
+{
+   const struct lp_fragment_shader_variant *variant;
+
+   if (!commands || !task->state)
+      return;
+
+   variant = task->state->variant;
+   lp_trace_add(task->trace, LP_TRACE_SHADE, task->thread_index + 1,
+                start, end, variant->shader->no, variant->no, commands);
+}
+
+
+/**
+ * As do_rasterize_bin(), but records the bin and each run of commands
+ * between state changes in the timeline.
+ */
+static void
+do_rasterize_bin_traced(struct lp_rasterizer_task *task,
+                        const struct cmd_bin *bin,
+                        int x, int y)
+{
+   const struct cmd_block *block;
+   int64_t bin_start, start;
+   unsigned commands = 0, total = 0;
+   unsigned k;
+
+   bin_start = start = os_time_get_nano();
+
+   for (block = bin->head; block; block = block->next) {
+      for (k = 0; k < block->count; k++) {
+         const unsigned cmd = block->cmd[k];
+
+         if (cmd == LP_RAST_OP_SET_STATE && block->arg[k].state != task->state) {
+            int64_t now = os_time_get_nano();
+            trace_shade(task, start, now, commands);
+            start = now;
+            commands = 0;
+         }
+
+         do_rasterize_cmd(task, cmd, block->arg[k]);
+
+         if (cmd_accesses_tile(cmd))
+            commands++;
+         total++;
+      }
+   }
+
+   {
+      int64_t now = os_time_get_nano();
+      trace_shade(task, start, now, commands);
+      lp_trace_add(task->trace, LP_TRACE_BIN, task->thread_index + 1,
+                   bin_start, now, x, y, total);
+   }
+}
+
+
 static void
 do_rasterize_bin(struct lp_rasterizer_task *task,
                  const struct cmd_bin *bin,
@@ -604,9 +993,14 @@ do_rasterize_bin(struct lp_rasterizer_task *task,
    if (0)
       lp_debug_bin(bin, x, y);
 
+   if (task->trace) {
+      do_rasterize_bin_traced(task, bin, x, y);
+      return;
+   }
+
    for (block = bin->head; block; block = block->next) {
       for (k = 0; k < block->count; k++) {
-         dispatch[block->cmd[k]]( task, block->arg[k] );
+         do_rasterize_cmd(task, block->cmd[k], block->arg[k]);
       }
    }
 }
@@ -664,16 +1058,23 @@ rasterize_scene(struct lp_rasterizer_task *task,
                 struct lp_scene *scene)
 {
    task->scene = scene;
+   task->trace = llvmpipe_screen(scene->pipe->screen)->trace;
 
-   /* Clear the cache tags. This should not always be necessary but
-      simpler for now. */
 #if LP_USE_TEXTURE_CACHE
-   memset(task->thread_data.cache->cache_tags, 0,
-          sizeof(task->thread_data.cache->cache_tags));
-#if LP_BUILD_FORMAT_CACHE_DEBUG
-   task->thread_data.cache->cache_access_total = 0;
-   task->thread_data.cache->cache_access_miss = 0;
-#endif
+   {
+      struct llvmpipe_screen *screen = llvmpipe_screen(scene->pipe->screen);
+      unsigned generation = p_atomic_read(&screen->tex_cache_generation);
+
+      /* Drop the decoded blocks if any s3tc texture may have changed
+       * since they were cached.
+       */
+      if (task->tex_cache_generation != generation) {
+         struct lp_build_format_cache *cache = task->thread_data.cache;
+         memset(cache->cache_tags, 0,
+                (cache->cache_mask + 1) * sizeof(cache->cache_tags[0]));
+         task->tex_cache_generation = generation;
+      }
+   }
 #endif
 
    if (!task->rast->no_rast && !scene->discard) {
@@ -681,33 +1082,27 @@ rasterize_scene(struct lp_rasterizer_task *task,
       {
          struct cmd_bin *bin;
          int i, j;
+         int64_t start = task->trace ? os_time_get_nano() : 0;
+         unsigned bins = 0;
 
          assert(scene);
-         while ((bin = lp_scene_bin_iter_next(scene, &i, &j))) {
-            if (!is_empty_bin( bin ))
+         while ((bin = lp_scene_bin_iter_next(scene, task->thread_index,
+                                              &i, &j))) {
+            if (!is_empty_bin( bin )) {
                rasterize_bin(task, bin, i, j);
+               bins++;
+            }
          }
-      }
-   }
-
 
-#if LP_BUILD_FORMAT_CACHE_DEBUG
-   {
-      uint64_t total, miss;
-      total = task->thread_data.cache->cache_access_total;
-      miss = task->thread_data.cache->cache_access_miss;
-      if (total) {
-         debug_printf("thread %d cache access %llu miss %llu hit rate %f\n",
-                 task->thread_index, (long long unsigned)total,
-                 (long long unsigned)miss,
-                 (float)(total - miss)/(float)total);
+         if (task->trace) {
+            lp_trace_add(task->trace, LP_TRACE_RASTERIZE,
+                         task->thread_index + 1, start, os_time_get_nano(),
+                         scene->fence ? scene->fence->id : 0, bins, 0);
+         }
       }
    }
-#endif
 
-   if (scene->fence) {
-      lp_fence_signal(scene->fence);
-   }
+
 
    task->scene = NULL;
 }
@@ -757,20 +1152,48 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
 }
 
 
+/**
+ * Run func(data, thread_index) once on each rasterizer thread and wait for
+ * all of them to return.  Used for work that is not expressed as a scene,
+ * such as compute grids.
+ *
+ * The caller must make sure no scene is queued or being rasterized, i.e.
+ * hold the screen's rast_mutex and have waited on its last fence.
+ */
 void
-lp_rast_finish( struct lp_rasterizer *rast )
+lp_rast_run_job( struct lp_rasterizer *rast,
+                 lp_rast_job_func func,
+                 void *data )
 {
-   if (rast->num_threads == 0) {
-      /* nothing to do */
+   unsigned i;
+
+   if (rast->num_threads > 0)
+      rast->curr_job.fence = lp_fence_create(rast->num_threads);
+
+   if (rast->num_threads == 0 || !rast->curr_job.fence) {
+      /* Do all the work on this thread, with the same floating point
+       * state as the rasterizer threads.
+       */
+      unsigned fpstate = util_fpstate_get();
+
+      util_fpstate_set_denorms_to_zero(fpstate);
+      func(data, 0);
+      util_fpstate_set(fpstate);
+      return;
    }
-   else {
-      int i;
+   rast->curr_job.fence->issued = TRUE;
+   rast->curr_job.data = data;
+   rast->curr_job.func = func;
 
-      /* wait for work to complete */
-      for (i = 0; i < rast->num_threads; i++) {
-         pipe_semaphore_wait(&rast->tasks[i].work_done);
-      }
+   for (i = 0; i < rast->num_threads; i++) {
+      pipe_semaphore_signal(&rast->tasks[i].work_ready);
    }
+
+   lp_fence_wait(rast->curr_job.fence);
+
+   rast->curr_job.func = NULL;
+   rast->curr_job.data = NULL;
+   lp_fence_reference(&rast->curr_job.fence, NULL);
 }
 
 
@@ -779,7 +1202,7 @@ lp_rast_finish( struct lp_rasterizer *rast )
  * It's a simple loop:
  *   1. wait for work
  *   2. do work
- *   3. signal that we're done
+ *   3. signal the scene's fence once all threads are done
  */
 static PIPE_THREAD_ROUTINE( thread_function, init_data )
 {
@@ -792,6 +1215,12 @@ static PIPE_THREAD_ROUTINE( thread_function, init_data )
    util_snprintf(thread_name, sizeof thread_name, "llvmpipe-%u", task->thread_index);
    pipe_thread_setname(thread_name);
 
+   if (task->cpu >= 0) {
+      if (!pipe_thread_setaffinity(task->cpu))
+         debug_printf("llvmpipe: failed to pin thread %u to cpu %d\n",
+                      task->thread_index, task->cpu);
+   }
+
    /* Make sure that denorms are treated like zeros. This is 
     * the behavior required by D3D10. OpenGL doesn't care.
     */
@@ -807,6 +1236,12 @@ static PIPE_THREAD_ROUTINE( thread_function, init_data )
       if (rast->exit_flag)
          break;
 
+      if (rast->curr_job.func) {
+         rast->curr_job.func(rast->curr_job.data, task->thread_index);
+         lp_fence_signal(rast->curr_job.fence);
+         continue;
+      }
+
       if (task->thread_index == 0) {
          /* thread[0]:
           *  - get next scene to rasterize
@@ -831,17 +1266,12 @@ static PIPE_THREAD_ROUTINE( thread_function, init_data )
       /* wait for all threads to finish with this scene */
       pipe_barrier_wait( &rast->barrier );
 
-      /* XXX: shouldn't be necessary:
-       */
       if (task->thread_index == 0) {
          lp_rast_end( rast );
       }
 
-      /* signal done with work */
       if (debug)
          debug_printf("thread %d done working\n", task->thread_index);
-
-      pipe_semaphore_signal(&task->work_done);
    }
 
 #ifdef _WIN32
@@ -852,6 +1282,97 @@ static PIPE_THREAD_ROUTINE( thread_function, init_data )
 }
 
 
+/**
+ * Return the physical package (socket) a CPU belongs to, or 0 if unknown.
+ */
+static unsigned
+get_cpu_package(unsigned cpu)
+{
+   unsigned package = 0;
+#if defined(PIPE_OS_LINUX)
+   char path[128];
+   FILE *f;
+
+   util_snprintf(path, sizeof path,
+                 "/sys/devices/system/cpu/cpu%u/topology/physical_package_id",
+                 cpu);
+   f = fopen(path, "r");
+   if (f) {
+      if (fscanf(f, "%u", &package) != 1)
+         package = 0;
+      fclose(f);
+   }
+#else
+   (void) cpu;
+#endif
+   return package;
+}
+
+
+/**
+ * Pick the CPU each rasterizer thread will be pinned to.
+ *
+ * The CPUs are ordered by socket and the threads are spread evenly over
+ * that list, so that consecutive threads share a socket and every socket
+ * gets its fair share of threads.  The sockets actually used are numbered
+ * densely in rast->thread_node for the bin scheduler.
+ */
+static void
+assign_thread_cpus(struct lp_rasterizer *rast)
+{
+   const unsigned nr_cpus = MAX2(1, util_cpu_caps.nr_cpus);
+   unsigned nodes[LP_MAX_THREADS];
+   unsigned num_nodes = 0;
+   unsigned *cpus, *packages;
+   unsigned i, j;
+
+   cpus = MALLOC(nr_cpus * sizeof *cpus);
+   packages = MALLOC(nr_cpus * sizeof *packages);
+   if (!cpus || !packages) {
+      rast->pin_threads = FALSE;
+      goto out;
+   }
+
+   for (i = 0; i < nr_cpus; i++) {
+      packages[i] = get_cpu_package(i);
+      cpus[i] = i;
+   }
+
+   /* sort by socket, then by cpu number */
+   for (i = 1; i < nr_cpus; i++) {
+      unsigned cpu = cpus[i];
+      for (j = i; j > 0 && packages[cpus[j - 1]] > packages[cpu]; j--) {
+         cpus[j] = cpus[j - 1];
+      }
+      cpus[j] = cpu;
+   }
+
+   for (i = 0; i < rast->num_threads; i++) {
+      unsigned slot = rast->num_threads <= nr_cpus ?
+                      i * nr_cpus / rast->num_threads : i % nr_cpus;
+      unsigned cpu = cpus[slot];
+
+      rast->tasks[i].cpu = cpu;
+
+      for (j = 0; j < num_nodes; j++) {
+         if (nodes[j] == packages[cpu])
+            break;
+      }
+      if (j == num_nodes) {
+         nodes[num_nodes++] = packages[cpu];
+      }
+      rast->thread_node[i] = j;
+
+      LP_DBG(DEBUG_RAST, "thread %u: cpu %u, socket %u\n",
+             i, cpu, packages[cpu]);
+   }
+
+out:
+   FREE(cpus);
+   FREE(packages);
+}
+
+
 /**
  * Initialize semaphores and spawn the threads.
  */
@@ -880,6 +1401,7 @@ struct lp_rasterizer *
 lp_rast_create( unsigned num_threads )
 {
    struct lp_rasterizer *rast;
+   unsigned cache_size;
    unsigned i;
 
    rast = CALLOC_STRUCT(lp_rasterizer);
@@ -887,6 +1409,12 @@ lp_rast_create( unsigned num_threads )
       goto no_rast;
    }
 
+   /* number of decoded s3tc blocks each thread caches, a power of two */
+   cache_size = debug_get_num_option("LP_TEXTURE_CACHE_SIZE",
+                                     LP_BUILD_FORMAT_CACHE_SIZE);
+   cache_size = CLAMP(cache_size, 1, LP_BUILD_FORMAT_CACHE_MAX_SIZE);
+   cache_size = util_next_power_of_two(cache_size);
+
    rast->full_scenes = lp_scene_queue_create();
    if (!rast->full_scenes) {
       goto no_full_scenes;
@@ -896,17 +1424,25 @@ lp_rast_create( unsigned num_threads )
       struct lp_rasterizer_task *task = &rast->tasks[i];
       task->rast = rast;
       task->thread_index = i;
+      task->cpu = -1;
       task->thread_data.cache = align_malloc(sizeof(struct lp_build_format_cache),
                                              16);
       if (!task->thread_data.cache) {
          goto no_thread_data_cache;
       }
+      memset(task->thread_data.cache, 0, sizeof(struct lp_build_format_cache));
+      task->thread_data.cache->cache_mask = cache_size - 1;
    }
 
    rast->num_threads = num_threads;
 
    rast->no_rast = debug_get_bool_option("LP_NO_RAST", FALSE);
 
+   rast->pin_threads = debug_get_bool_option("LP_PIN_THREADS", FALSE);
+   if (rast->pin_threads && rast->num_threads) {
+      assign_thread_cpus(rast);
+   }
+
    create_rast_threads(rast);
 
    /* for synchronizing rasterization threads */
@@ -963,6 +1499,19 @@ void lp_rast_destroy( struct lp_rasterizer *rast )
       pipe_semaphore_destroy(&rast->tasks[i].work_done);
    }
    for (i = 0; i < MAX2(1, rast->num_threads); i++) {
+      if (LP_DEBUG & DEBUG_COUNTERS) {
+         const struct lp_build_format_cache *cache =
+            rast->tasks[i].thread_data.cache;
+         uint64_t total = cache->cache_access_total;
+         uint64_t miss = cache->cache_access_miss;
+         if (total) {
+            debug_printf("llvmpipe: thread %u texture cache access %llu "
+                         "miss %llu hit rate %f\n", i,
+                         (long long unsigned)total,
+                         (long long unsigned)miss,
+                         (float)(total - miss)/(float)total);
+         }
+      }
       align_free(rast->tasks[i].thread_data.cache);
    }
 
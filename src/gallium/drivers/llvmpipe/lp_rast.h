@@ -37,9 +37,12 @@
 #ifndef LP_RAST_H
 #define LP_RAST_H
 
+#include <float.h>
 #include "pipe/p_compiler.h"
+#include "util/u_math.h"
 #include "util/u_pack_color.h"
 #include "lp_jit.h"
+#include "lp_limits.h"
 
 
 struct lp_rasterizer;
@@ -70,6 +73,28 @@ struct cmd_bin;
 
 #define IMUL64(a, b) (((int64_t)(a)) * ((int64_t)(b)))
 
+/** Sample positions are in 1/LP_SAMPLE_POS_ONE pixel units */
+#define LP_SAMPLE_POS_ONE 16
+
+/**
+ * Positions of the samples of a multisampled pixel relative to the pixel
+ * center (the standard 4x rotated grid pattern).
+ */
+extern const int lp_sample_pos[LP_MAX_SAMPLES][2];
+
+
+/**
+ * Offset of an edge function (see struct lp_rast_plane) at the given sample
+ * position relative to its value at the pixel center.
+ * Scissor planes step by whole pixels and so get no offset.
+ */
+static inline int64_t
+lp_rast_plane_sample_offset(int32_t dcdx, int32_t dcdy, unsigned sample)
+{
+   return (IMUL64(-dcdx, lp_sample_pos[sample][0]) +
+           IMUL64(dcdy, lp_sample_pos[sample][1])) / LP_SAMPLE_POS_ONE;
+}
+
 struct lp_rasterizer_task;
 
 
@@ -88,9 +113,34 @@ struct lp_rast_state {
     * the tile color/z/stencil data somehow
      */
    struct lp_fragment_shader_variant *variant;
+
+   /* Samples which may be written, for multisampled framebuffers */
+   unsigned sample_mask;
+
+   /* LP_ZCULL_x flags of the shader variant */
+   unsigned zcull;
 };
 
 
+/**
+ * Hierarchical depth culling.
+ *
+ * The setup code (per tile) and the rasterizer (per 16x16 block) keep an
+ * upper bound of the depth values in the depth buffer, in depth units, so
+ * that the stored values are at most half a depth buffer ULP above it.
+ * Clears set the bound, and primitives fully covering a block with a
+ * LESS/LEQUAL depth test can only lower it.  Primitives whose depth range
+ * lies wholly behind the bound fail the depth test everywhere and are
+ * skipped.
+ */
+#define LP_ZCULL_TEST        0x1  /**< occluded blocks may be skipped */
+#define LP_ZCULL_UPDATE      0x2  /**< covered blocks lower the bound */
+#define LP_ZCULL_INVALIDATE  0x4  /**< depth writes may raise the bound */
+
+/** Bound of blocks whose depth values are not known */
+#define LP_ZCULL_UNKNOWN FLT_MAX
+
+
 /**
  * Coefficients necessary to run the shader at a given location.
  * First coefficient is position.
@@ -137,6 +187,34 @@ struct lp_rast_triangle {
 };
 
 
+/**
+ * A triangle contained in a 16x16 block of a tile.  The edge functions
+ * are relative to the upper left corner of the block, so they fit in 32
+ * bits and need no adjustment by the rasterizer.
+ */
+struct lp_rast_small_triangle {
+   int32_t plane[3][4];                 /* c, dcdx, dcdy, eo of each edge */
+
+   /* inputs for the shader, followed by a0, dadx, dady */
+   struct lp_rast_shader_inputs inputs;
+};
+
+
+/** Maximum number of triangles of one LP_RAST_OP_TRIANGLE_SMALL command */
+#define LP_RAST_SMALL_BATCH 8
+
+/**
+ * Small triangles binned one after another to the same tile with the same
+ * state, rasterized by a single command.
+ */
+struct lp_rast_small_batch {
+   unsigned count;
+   uint8_t x[LP_RAST_SMALL_BATCH];      /* position of the 16x16 block */
+   uint8_t y[LP_RAST_SMALL_BATCH];      /* within the tile */
+   const struct lp_rast_small_triangle *tri[LP_RAST_SMALL_BATCH];
+};
+
+
 struct lp_rast_clear_rb {
    union util_color color_val;
    unsigned cbuf;
@@ -146,6 +224,45 @@ struct lp_rast_clear_rb {
 #define GET_A0(inputs) ((float (*)[4])((inputs)+1))
 #define GET_DADX(inputs) ((float (*)[4])((char *)((inputs) + 1) + (inputs)->stride))
 #define GET_DADY(inputs) ((float (*)[4])((char *)((inputs) + 1) + 2 * (inputs)->stride))
+
+
+/**
+ * Conservative range of the interpolated depth of a primitive over the
+ * pixels [x, x + size) x [y, y + size).  The area is widened by a pixel on
+ * each side to cover sample positions, and the range by a margin for the
+ * rounding of the interpolation in the fragment shader.
+ */
+static inline void
+lp_rast_depth_range(const struct lp_rast_shader_inputs *inputs,
+                    int x, int y, int size,
+                    float *zmin, float *zmax)
+{
+   const float a0 = GET_A0(inputs)[0][2];
+   const float dzdx = GET_DADX(inputs)[0][2];
+   const float dzdy = GET_DADY(inputs)[0][2];
+   const float x0 = (float)(x - 1);
+   const float y0 = (float)(y - 1);
+   const float ex = dzdx * (float)(size + 1);
+   const float ey = dzdy * (float)(size + 1);
+   const float z0 = a0 + dzdx * x0 + dzdy * y0;
+   const float err = (fabsf(a0) + fabsf(dzdx * x0) + fabsf(dzdy * y0) +
+                      fabsf(ex) + fabsf(ey)) * (1.0f / (1 << 20));
+
+   *zmin = z0 + MIN2(ex, 0.0f) + MIN2(ey, 0.0f) - err;
+   *zmax = z0 + MAX2(ex, 0.0f) + MAX2(ey, 0.0f) + err;
+}
+
+
+/**
+ * Whether a primitive with the given depth range fails a LESS or LEQUAL
+ * depth test against all values under the bound.  Incoming depth values
+ * are clamped to 1.0 when converted to the depth buffer format.
+ */
+static inline boolean
+lp_rast_zcull_occluded(float zmin, float bound, float epsilon)
+{
+   return MIN2(zmin, 1.0f) - epsilon > bound;
+}
 #define GET_PLANES(tri) ((struct lp_rast_plane *)((char *)(&(tri)->inputs + 1) + 3 * (tri)->inputs.stride))
 
 
@@ -160,8 +277,17 @@ void
 lp_rast_queue_scene( struct lp_rasterizer *rast,
                      struct lp_scene *scene );
 
+
+/**
+ * A function run once by every rasterizer thread, see lp_rast_run_job().
+ */
+typedef void (*lp_rast_job_func)(void *data, unsigned thread_index);
+
 void
-lp_rast_finish( struct lp_rasterizer *rast );
+lp_rast_run_job( struct lp_rasterizer *rast,
+                 lp_rast_job_func func,
+                 void *data );
+
 
 
 union lp_rast_cmd_arg {
@@ -179,6 +305,7 @@ union lp_rast_cmd_arg {
    const struct lp_rast_state *state;
    struct lp_fence *fence;
    struct llvmpipe_query *query_obj;
+   struct lp_rast_small_batch *small_batch;
 };
 
 
@@ -218,6 +345,14 @@ lp_rast_arg_triangle_contained( const struct lp_rast_triangle *triangle,
    return arg;
 }
 
+static inline union lp_rast_cmd_arg
+lp_rast_arg_small_batch( struct lp_rast_small_batch *batch )
+{
+   union lp_rast_cmd_arg arg;
+   arg.small_batch = batch;
+   return arg;
+}
+
 static inline union lp_rast_cmd_arg
 lp_rast_arg_state( const struct lp_rast_state *state )
 {
@@ -296,8 +431,17 @@ lp_rast_arg_null( void )
 #define LP_RAST_OP_TRIANGLE_32_3_4   0x1a
 #define LP_RAST_OP_TRIANGLE_32_3_16  0x1b
 #define LP_RAST_OP_TRIANGLE_32_4_16  0x1c
-
-#define LP_RAST_OP_MAX               0x1d
+#define LP_RAST_OP_MS_TRIANGLE_1     0x1d
+#define LP_RAST_OP_MS_TRIANGLE_2     0x1e
+#define LP_RAST_OP_MS_TRIANGLE_3     0x1f
+#define LP_RAST_OP_MS_TRIANGLE_4     0x20
+#define LP_RAST_OP_MS_TRIANGLE_5     0x21
+#define LP_RAST_OP_MS_TRIANGLE_6     0x22
+#define LP_RAST_OP_MS_TRIANGLE_7     0x23
+#define LP_RAST_OP_MS_TRIANGLE_8     0x24
+#define LP_RAST_OP_TRIANGLE_SMALL    0x25
+
+#define LP_RAST_OP_MAX               0x26
 #define LP_RAST_OP_MASK              0xff
 
 void
@@ -37,6 +37,7 @@
 #include "lp_state.h"
 #include "lp_texture.h"
 #include "lp_limits.h"
+#include "lp_perf.h"
 
 
 #define TILE_VECTOR_HEIGHT 4
@@ -76,6 +77,9 @@ extern const struct lp_rasterizer_task *jit_task;
 struct lp_rasterizer;
 struct cmd_bin;
 
+/** Number of 16x16 blocks in a tile */
+#define LP_ZCULL_BLOCKS ((TILE_SIZE / 16) * (TILE_SIZE / 16))
+
 /**
  * Per-thread rasterization state
  */
@@ -91,14 +95,35 @@ struct lp_rasterizer_task
    uint8_t *color_tiles[PIPE_MAX_COLOR_BUFS];
    uint8_t *depth_tile;
 
+   /**
+    * Clears of the current tile which have not been written to memory yet.
+    * They are applied before the first command which touches the tile, or
+    * dropped when that command overwrites all of the tile anyway.
+    */
+   const struct lp_rast_clear_rb *pending_clear_color[PIPE_MAX_COLOR_BUFS];
+   uint64_t pending_clear_zs_value;
+   uint64_t pending_clear_zs_mask;  /**< zero if no z/stencil clear pending */
+   boolean clear_pending;           /**< any of the above */
+
+   /** Timeline of the current scene's screen, or NULL */
+   struct lp_trace *trace;
+
    /** "back" pointer */
    struct lp_rasterizer *rast;
 
    /** "my" index */
    unsigned thread_index;
 
+   /** CPU this thread is pinned to, or -1 */
+   int cpu;
+
+   /** Depth bound of each 16x16 block of the tile, see LP_ZCULL_x */
+   float zmax[LP_ZCULL_BLOCKS];
+
    /** Non-interpolated passthru state and occlude counter for visible pixels */
    struct lp_jit_thread_data thread_data;
+   /** llvmpipe_screen::tex_cache_generation the block cache is valid for */
+   unsigned tex_cache_generation;
    uint64_t ps_invocations;
    uint8_t ps_inv_multiplier;
 
@@ -123,12 +148,23 @@ struct lp_rasterizer
    /** The scene currently being rasterized by the threads */
    struct lp_scene *curr_scene;
 
+   /** Non-scene work handed to all the threads, see lp_rast_run_job() */
+   struct {
+      lp_rast_job_func func;
+      void *data;
+      struct lp_fence *fence;
+   } curr_job;
+
    /** A task object for each rasterization thread */
    struct lp_rasterizer_task tasks[LP_MAX_THREADS];
 
    unsigned num_threads;
    pipe_thread threads[LP_MAX_THREADS];
 
+   /** CPU socket of each thread, when threads are pinned */
+   unsigned thread_node[LP_MAX_THREADS];
+   boolean pin_threads;
+
    /** For synchronizing the rasterization threads */
    pipe_barrier barrier;
 };
@@ -140,6 +176,105 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
                          unsigned x, unsigned y,
                          unsigned mask);
 
+void
+lp_rast_shade_quads_ms_mask(struct lp_rasterizer_task *task,
+                            const struct lp_rast_shader_inputs *inputs,
+                            unsigned x, unsigned y,
+                            uint64_t sample_mask);
+
+
+/**
+ * Whether the current state's sample mask lets all samples of the
+ * framebuffer be written, so fully covered blocks can skip coverage tests.
+ */
+static inline boolean
+lp_rast_all_samples_enabled(const struct lp_rasterizer_task *task)
+{
+   const unsigned full_mask = (1 << task->scene->nr_samples) - 1;
+
+   return (task->state->sample_mask & full_mask) == full_mask;
+}
+
+
+/**
+ * Forget the depth bounds of all blocks of the tile.
+ */
+static inline void
+lp_rast_zcull_reset(struct lp_rasterizer_task *task, float zmax)
+{
+   unsigned i;
+
+   for (i = 0; i < LP_ZCULL_BLOCKS; i++) {
+      task->zmax[i] = zmax;
+   }
+}
+
+
+/**
+ * Whether the primitive is known to fail the depth test over the
+ * size x size area at window position (x, y), which must be 4-pixel
+ * aligned and lie within the current tile.
+ */
+static inline boolean
+lp_rast_zcull_reject(struct lp_rasterizer_task *task,
+                     const struct lp_rast_shader_inputs *inputs,
+                     unsigned x, unsigned y, unsigned size)
+{
+   const unsigned bx0 = (x - task->x) / 16;
+   const unsigned by0 = (y - task->y) / 16;
+   const unsigned bx1 = (x - task->x + size - 1) / 16;
+   const unsigned by1 = (y - task->y + size - 1) / 16;
+   float bound = 0.0f;
+   float zmin, zmax;
+   unsigned bx, by;
+
+   if (!(task->state->zcull & LP_ZCULL_TEST) || !task->scene->zcull)
+      return FALSE;
+
+   assert(bx1 < TILE_SIZE / 16 && by1 < TILE_SIZE / 16);
+
+   for (by = by0; by <= by1; by++) {
+      for (bx = bx0; bx <= bx1; bx++) {
+         bound = MAX2(bound, task->zmax[by * (TILE_SIZE / 16) + bx]);
+      }
+   }
+   if (bound == LP_ZCULL_UNKNOWN)
+      return FALSE;
+
+   LP_COUNT(nr_zcull_tested_16);
+   lp_rast_depth_range(inputs, x, y, size, &zmin, &zmax);
+   if (!lp_rast_zcull_occluded(zmin, bound, task->scene->zcull_epsilon))
+      return FALSE;
+
+   LP_COUNT(nr_zcull_culled_16);
+   return TRUE;
+}
+
+
+/**
+ * Lower the depth bound of the 16x16 block at window position (x, y)
+ * after the primitive has been shaded over all of it.
+ */
+static inline void
+lp_rast_zcull_update(struct lp_rasterizer_task *task,
+                     const struct lp_rast_shader_inputs *inputs,
+                     unsigned x, unsigned y)
+{
+   const unsigned i = ((y - task->y) / 16) * (TILE_SIZE / 16) +
+                      (x - task->x) / 16;
+   float zmin, zmax;
+
+   if (!(task->state->zcull & LP_ZCULL_UPDATE) || !task->scene->zcull ||
+       !lp_rast_all_samples_enabled(task))
+      return;
+
+   assert(((x - task->x) % 16) == 0 && ((y - task->y) % 16) == 0);
+
+   lp_rast_depth_range(inputs, x, y, 16, &zmin, &zmax);
+   /* The depth buffer may clamp negative values to zero */
+   task->zmax[i] = MIN2(task->zmax[i], MAX2(zmax, 0.0f));
+}
+
 
 /**
  * Get the pointer to a 4x4 color block (within a 64x64 tile).
@@ -236,6 +371,11 @@ lp_rast_shade_quads_all( struct lp_rasterizer_task *task,
    unsigned depth_stride = 0;
    unsigned i;
 
+   if (!lp_rast_all_samples_enabled(task)) {
+      lp_rast_shade_quads_ms_mask(task, inputs, x, y, ~0ULL);
+      return;
+   }
+
    /* color buffer */
    for (i = 0; i < scene->fb.nr_cbufs; i++) {
       if (scene->fb.cbufs[i]) {
@@ -268,7 +408,7 @@ lp_rast_shade_quads_all( struct lp_rasterizer_task *task,
 
       /* run shader on 4x4 block */
       BEGIN_JIT_CALL(state, task);
-      variant->jit_function[RAST_WHOLE]( &state->jit_context,
+      variant->code->jit_function[RAST_WHOLE]( &state->jit_context,
                                          x, y,
                                          inputs->frontfacing,
                                          GET_A0(inputs),
@@ -337,6 +477,27 @@ void lp_rast_triangle_32_3_16( struct lp_rasterizer_task *,
 void lp_rast_triangle_32_4_16( struct lp_rasterizer_task *, 
                             const union lp_rast_cmd_arg );
 
+
+void lp_rast_triangle_ms_1( struct lp_rasterizer_task *, 
+                            const union lp_rast_cmd_arg );
+void lp_rast_triangle_ms_2( struct lp_rasterizer_task *, 
+                            const union lp_rast_cmd_arg );
+void lp_rast_triangle_ms_3( struct lp_rasterizer_task *, 
+                            const union lp_rast_cmd_arg );
+void lp_rast_triangle_ms_4( struct lp_rasterizer_task *, 
+                            const union lp_rast_cmd_arg );
+void lp_rast_triangle_ms_5( struct lp_rasterizer_task *, 
+                            const union lp_rast_cmd_arg );
+void lp_rast_triangle_ms_6( struct lp_rasterizer_task *, 
+                            const union lp_rast_cmd_arg );
+void lp_rast_triangle_ms_7( struct lp_rasterizer_task *, 
+                            const union lp_rast_cmd_arg );
+void lp_rast_triangle_ms_8( struct lp_rasterizer_task *, 
+                            const union lp_rast_cmd_arg );
+
+void lp_rast_triangle_small( struct lp_rasterizer_task *,
+                             const union lp_rast_cmd_arg );
+
 void
 lp_rast_set_state(struct lp_rasterizer_task *task,
                   const union lp_rast_cmd_arg arg);
@@ -106,6 +106,40 @@ build_masks(int64_t c,
    *partmask |= build_mask_linear(c + cdiff, dcdx, dcdy);
 }
 
+
+/**
+ * Smallest offset of a plane's edge function at the sample positions,
+ * relative to the pixel center.
+ */
+static inline int64_t
+plane_sample_offset_min(const struct lp_rast_plane *plane)
+{
+   int64_t offset = lp_rast_plane_sample_offset(plane->dcdx, plane->dcdy, 0);
+   unsigned s;
+
+   for (s = 1; s < LP_MAX_SAMPLES; s++)
+      offset = MIN2(offset, lp_rast_plane_sample_offset(plane->dcdx,
+                                                        plane->dcdy, s));
+   return offset;
+}
+
+
+/**
+ * Largest offset of a plane's edge function at the sample positions,
+ * relative to the pixel center.
+ */
+static inline int64_t
+plane_sample_offset_max(const struct lp_rast_plane *plane)
+{
+   int64_t offset = lp_rast_plane_sample_offset(plane->dcdx, plane->dcdy, 0);
+   unsigned s;
+
+   for (s = 1; s < LP_MAX_SAMPLES; s++)
+      offset = MAX2(offset, lp_rast_plane_sample_offset(plane->dcdx,
+                                                        plane->dcdy, s));
+   return offset;
+}
+
 void
 lp_rast_triangle_3_16(struct lp_rasterizer_task *task,
                       const union lp_rast_cmd_arg arg)
@@ -133,13 +167,124 @@ lp_rast_triangle_4_16(struct lp_rasterizer_task *task,
    lp_rast_triangle_4(task, arg2);
 }
 
+/**
+ * Rasterize and shade a triangle of three planes within a 16x16 block with
+ * the fused code of the shader variant, if it has any.
+ * \param x, y  position of the 16x16 block in window coords
+ * \param planes  c, dcdx, dcdy of each edge, c relative to (x, y)
+ * \return FALSE if the triangle must be rasterized the usual way
+ */
+static boolean
+lp_rast_shade_16_fused(struct lp_rasterizer_task *task,
+                       const struct lp_rast_shader_inputs *inputs,
+                       const int32_t planes[3][3],
+                       int x, int y)
+{
+   const struct lp_rast_state *state = task->state;
+   const struct lp_scene *scene = task->scene;
+   struct lp_fragment_shader_variant *variant = state->variant;
+   lp_jit_frag_tri16_func tri16 = variant->code->jit_tri16;
+   uint8_t *color[PIPE_MAX_COLOR_BUFS];
+   unsigned stride[PIPE_MAX_COLOR_BUFS];
+   uint8_t *depth = NULL;
+   unsigned depth_stride = 0;
+   unsigned block_mask = 0;
+   unsigned nr, i, j;
+
+   if (!tri16 || !lp_rast_all_samples_enabled(task))
+      return FALSE;
+
+   assert(x % 4 == 0 && y % 4 == 0);
+
+   /* The block may extend beyond the framebuffer, like shade_quads() skip
+    * the 4x4 blocks which are outside.
+    */
+   for (j = 0; j < 4; j++) {
+      for (i = 0; i < 4; i++) {
+         if (((x + 4 * i) % TILE_SIZE) < task->width &&
+             ((y + 4 * j) % TILE_SIZE) < task->height)
+            block_mask |= 1 << (j * 4 + i);
+      }
+   }
+
+   for (i = 0; i < scene->fb.nr_cbufs; i++) {
+      if (scene->fb.cbufs[i]) {
+         stride[i] = scene->cbufs[i].stride;
+         color[i] = lp_rast_get_color_block_pointer(task, i, x, y,
+                                                    inputs->layer);
+      }
+      else {
+         stride[i] = 0;
+         color[i] = NULL;
+      }
+   }
+
+   if (scene->zsbuf.map) {
+      depth_stride = scene->zsbuf.stride;
+      depth = lp_rast_get_depth_block_pointer(task, x, y, inputs->layer);
+   }
+
+   /* Propagate non-interpolated raster state. */
+   task->thread_data.raster_state.viewport_index = inputs->viewport_index;
+
+   BEGIN_JIT_CALL(state, task);
+   nr = tri16(&state->jit_context,
+              x, y,
+              inputs->frontfacing,
+              GET_A0(inputs),
+              GET_DADX(inputs),
+              GET_DADY(inputs),
+              color,
+              depth,
+              block_mask,
+              &task->thread_data,
+              stride,
+              depth_stride,
+              &planes[0][0]);
+   END_JIT_CALL();
+
+   task->ps_invocations += nr * variant->ps_inv_multiplier;
+   LP_COUNT(nr_fused_16);
+   return TRUE;
+}
+
+
+static boolean
+lp_rast_triangle_32_3_16_fused(struct lp_rasterizer_task *task,
+                               const struct lp_rast_triangle *tri,
+                               int x, int y)
+{
+   const struct lp_rast_plane *plane = GET_PLANES(tri);
+   int32_t planes[3][3];
+   unsigned i;
+
+   for (i = 0; i < 3; i++) {
+      planes[i][0] = plane[i].c - plane[i].dcdx * x + plane[i].dcdy * y;
+      planes[i][1] = plane[i].dcdx;
+      planes[i][2] = plane[i].dcdy;
+   }
+
+   return lp_rast_shade_16_fused(task, &tri->inputs, planes, x, y);
+}
+
+
 #if !defined(PIPE_ARCH_SSE)
 
 void
 lp_rast_triangle_32_3_16(struct lp_rasterizer_task *task,
                          const union lp_rast_cmd_arg arg)
 {
+   const struct lp_rast_triangle *tri = arg.triangle.tri;
+   int x = (arg.triangle.plane_mask & 0xff) + task->x;
+   int y = (arg.triangle.plane_mask >> 8) + task->y;
    union lp_rast_cmd_arg arg2;
+
+   if (lp_rast_zcull_reject(task, &tri->inputs, x, y, 16))
+      return;
+
+   if (lp_rast_triangle_32_3_16_fused(task, tri, x, y))
+      return;
+
    arg2.triangle.tri = arg.triangle.tri;
    arg2.triangle.plane_mask = (1<<3)-1;
    lp_rast_triangle_32_3(task, arg2);
@@ -165,6 +310,26 @@ lp_rast_triangle_32_3_4(struct lp_rasterizer_task *task,
 #else
 #include <emmintrin.h>
 #include "util/u_sse.h"
+#include "util/u_cpu_detect.h"
+
+/*
+ * The AVX2 rasterizer is built whenever the compiler can target AVX2 on a
+ * per-function basis, and picked at runtime. Define LP_RAST_AVX2 to 0 to
+ * leave it out.
+ */
+#ifndef LP_RAST_AVX2
+#if defined(PIPE_ARCH_X86_64) && \
+    (defined(__clang__) || \
+     (defined(PIPE_CC_GCC) && (__GNUC__ * 100 + __GNUC_MINOR__) >= 409))
+#define LP_RAST_AVX2 1
+#else
+#define LP_RAST_AVX2 0
+#endif
+#endif
+
+#if LP_RAST_AVX2
+#include <immintrin.h>
+#endif
 
 
 static inline void
@@ -266,14 +431,78 @@ sign_bits4(const __m128i *cstep, int cdiff)
 #define NR_PLANES 3
 
 
+#if LP_RAST_AVX2
+
+/**
+ * Set up the edge values of the three planes for two rows of a 4x4 block,
+ * i.e. span8[p] = { c, c+dcdx, c+2dcdx, c+3dcdx, c+dcdy, ... } minus c,
+ * and the step down to the next two rows.
+ */
+__attribute__((target("avx2")))
+static inline void
+setup_spans_3_avx2(__m128i span_0, __m128i span_1, __m128i span_2,
+                   __m128i dcdy, __m256i span8[3], __m256i dcdy2[3])
+{
+   const __m128i span[3] = { span_0, span_1, span_2 };
+   unsigned p;
+
+   for (p = 0; p < 3; p++) {
+      __m128i dcdy_p;
+
+      switch (p) {
+      case 0:
+         dcdy_p = SCALAR_EPI32(dcdy, 0);
+         break;
+      case 1:
+         dcdy_p = SCALAR_EPI32(dcdy, 1);
+         break;
+      default:
+         dcdy_p = SCALAR_EPI32(dcdy, 2);
+         break;
+      }
+
+      span8[p] = _mm256_inserti128_si256(_mm256_castsi128_si256(span[p]),
+                                         _mm_add_epi32(span[p], dcdy_p), 1);
+      dcdy2[p] = _mm256_broadcastsi128_si256(_mm_slli_epi32(dcdy_p, 1));
+   }
+}
+
 
+/**
+ * Build the 16-bit outside mask of a 4x4 block, two rows per vector.
+ * cx holds the (adjusted) edge values of the three planes at the block
+ * origin.
+ */
+__attribute__((target("avx2")))
+static inline unsigned
+build_mask_3_avx2(__m128i cx, const __m256i span8[3], const __m256i dcdy2[3])
+{
+   __m256i c0_01 = _mm256_add_epi32(_mm256_broadcastsi128_si256(SCALAR_EPI32(cx, 0)), span8[0]);
+   __m256i c1_01 = _mm256_add_epi32(_mm256_broadcastsi128_si256(SCALAR_EPI32(cx, 1)), span8[1]);
+   __m256i c2_01 = _mm256_add_epi32(_mm256_broadcastsi128_si256(SCALAR_EPI32(cx, 2)), span8[2]);
 
+   __m256i c_01 = _mm256_or_si256(_mm256_or_si256(c0_01, c1_01), c2_01);
 
+   __m256i c0_23 = _mm256_add_epi32(c0_01, dcdy2[0]);
+   __m256i c1_23 = _mm256_add_epi32(c1_01, dcdy2[1]);
+   __m256i c2_23 = _mm256_add_epi32(c2_01, dcdy2[2]);
 
+   __m256i c_23 = _mm256_or_si256(_mm256_or_si256(c0_23, c1_23), c2_23);
 
-void
-lp_rast_triangle_32_3_16(struct lp_rasterizer_task *task,
-                      const union lp_rast_cmd_arg arg)
+   /* extract sign bits, row by row */
+   return _mm256_movemask_ps(_mm256_castsi256_ps(c_01)) |
+          (_mm256_movemask_ps(_mm256_castsi256_ps(c_23)) << 8);
+}
+
+
+/**
+ * AVX2 version of lp_rast_triangle_32_3_16(), evaluating the edge
+ * functions of two rows of a 4x4 block at once.
+ */
+__attribute__((target("avx2")))
+static void
+lp_rast_triangle_32_3_16_avx2(struct lp_rasterizer_task *task,
+                              const union lp_rast_cmd_arg arg)
 {
    const struct lp_rast_triangle *tri = arg.triangle.tri;
    const struct lp_rast_plane *plane = GET_PLANES(tri);
@@ -296,23 +525,162 @@ lp_rast_triangle_32_3_16(struct lp_rasterizer_task *task,
 
    __m128i dcdx2;
    __m128i dcdx3;
-   
-   __m128i span_0;                /* 0,dcdx,2dcdx,3dcdx for plane 0 */
-   __m128i span_1;                /* 0,dcdx,2dcdx,3dcdx for plane 1 */
-   __m128i span_2;                /* 0,dcdx,2dcdx,3dcdx for plane 2 */
+
+   __m128i span_0;
+   __m128i span_1;
+   __m128i span_2;
    __m128i unused;
-   
+
+   __m256i span8[3];
+   __m256i dcdy2[3];
+
    transpose4_epi32(&p0, &p1, &p2, &zero,
                     &c, &dcdx, &dcdy, &rej4);
 
-   /* Adjust dcdx;
-    */
    dcdx = _mm_sub_epi32(zero, dcdx);
 
    c = _mm_add_epi32(c, mm_mullo_epi32(dcdx, _mm_set1_epi32(x)));
    c = _mm_add_epi32(c, mm_mullo_epi32(dcdy, _mm_set1_epi32(y)));
    rej4 = _mm_slli_epi32(rej4, 2);
 
+   c = _mm_sub_epi32(c, _mm_set1_epi32(1));
+   rej4 = _mm_add_epi32(rej4, _mm_set1_epi32(1));
+
+   dcdx2 = _mm_add_epi32(dcdx, dcdx);
+   dcdx3 = _mm_add_epi32(dcdx2, dcdx);
+
+   transpose4_epi32(&zero, &dcdx, &dcdx2, &dcdx3,
+                    &span_0, &span_1, &span_2, &unused);
+
+   setup_spans_3_avx2(span_0, span_1, span_2, dcdy, span8, dcdy2);
+
+   for (i = 0; i < 4; i++) {
+      __m128i cx = c;
+
+      for (j = 0; j < 4; j++) {
+         __m128i c4rej = _mm_add_epi32(cx, rej4);
+         __m128i rej_masks = _mm_srai_epi32(c4rej, 31);
+
+         if (_mm_movemask_epi8(rej_masks) == 0) {
+            unsigned mask = build_mask_3_avx2(cx, span8, dcdy2);
+
+            out[nr].i = i;
+            out[nr].j = j;
+            out[nr].mask = mask;
+            if (mask != 0xffff)
+               nr++;
+         }
+         cx = _mm_add_epi32(cx, _mm_slli_epi32(dcdx, 2));
+      }
+
+      c = _mm_add_epi32(c, _mm_slli_epi32(dcdy, 2));
+   }
+
+   for (i = 0; i < nr; i++)
+      lp_rast_shade_quads_mask(task,
+                               &tri->inputs,
+                               x + 4 * out[i].j,
+                               y + 4 * out[i].i,
+                               0xffff & ~out[i].mask);
+}
+
+
+/**
+ * AVX2 version of lp_rast_triangle_32_3_4().
+ */
+__attribute__((target("avx2")))
+static void
+lp_rast_triangle_32_3_4_avx2(struct lp_rasterizer_task *task,
+                             const union lp_rast_cmd_arg arg)
+{
+   const struct lp_rast_triangle *tri = arg.triangle.tri;
+   const struct lp_rast_plane *plane = GET_PLANES(tri);
+   unsigned x = (arg.triangle.plane_mask & 0xff) + task->x;
+   unsigned y = (arg.triangle.plane_mask >> 8) + task->y;
+
+   __m128i p0 = lp_plane_to_m128i(&plane[0]); /* c, dcdx, dcdy, eo */
+   __m128i p1 = lp_plane_to_m128i(&plane[1]); /* c, dcdx, dcdy, eo */
+   __m128i p2 = lp_plane_to_m128i(&plane[2]); /* c, dcdx, dcdy, eo */
+   __m128i zero = _mm_setzero_si128();
+
+   __m128i c;
+   __m128i dcdx;
+   __m128i dcdy;
+
+   __m128i dcdx2;
+   __m128i dcdx3;
+
+   __m128i span_0;
+   __m128i span_1;
+   __m128i span_2;
+   __m128i unused;
+
+   __m256i span8[3];
+   __m256i dcdy2[3];
+   unsigned mask;
+
+   transpose4_epi32(&p0, &p1, &p2, &zero,
+                    &c, &dcdx, &dcdy, &unused);
+
+   dcdx = _mm_sub_epi32(zero, dcdx);
+
+   c = _mm_add_epi32(c, mm_mullo_epi32(dcdx, _mm_set1_epi32(x)));
+   c = _mm_add_epi32(c, mm_mullo_epi32(dcdy, _mm_set1_epi32(y)));
+
+   c = _mm_sub_epi32(c, _mm_set1_epi32(1));
+
+   dcdx2 = _mm_add_epi32(dcdx, dcdx);
+   dcdx3 = _mm_add_epi32(dcdx2, dcdx);
+
+   transpose4_epi32(&zero, &dcdx, &dcdx2, &dcdx3,
+                    &span_0, &span_1, &span_2, &unused);
+
+   setup_spans_3_avx2(span_0, span_1, span_2, dcdy, span8, dcdy2);
+
+   mask = build_mask_3_avx2(c, span8, dcdy2);
+
+   if (mask != 0xffff)
+      lp_rast_shade_quads_mask(task,
+                               &tri->inputs,
+                               x,
+                               y,
+                               0xffff & ~mask);
+}
+
+#endif /* LP_RAST_AVX2 */
+
+
+/**
+ * Rasterize and shade three planes over the 16x16 block at (x, y).
+ * \param c  edge function of each plane at (x, y)
+ * \param dcdx  negated x step of each plane
+ * \param dcdy  y step of each plane
+ * \param eo  one-pixel trivial reject offset of each plane
+ */
+static void
+triangle_3_16_sse(struct lp_rasterizer_task *task,
+                  const struct lp_rast_shader_inputs *inputs,
+                  __m128i c, __m128i dcdx, __m128i dcdy, __m128i eo,
+                  int x, int y)
+{
+   unsigned i, j;
+
+   struct { unsigned mask:16; unsigned i:8; unsigned j:8; } out[16];
+   unsigned nr = 0;
+
+   __m128i zero = _mm_setzero_si128();
+   __m128i rej4;
+
+   __m128i dcdx2;
+   __m128i dcdx3;
+   
+   __m128i span_0;                /* 0,dcdx,2dcdx,3dcdx for plane 0 */
+   __m128i span_1;                /* 0,dcdx,2dcdx,3dcdx for plane 1 */
+   __m128i span_2;                /* 0,dcdx,2dcdx,3dcdx for plane 2 */
+   __m128i unused;
+
+   rej4 = _mm_slli_epi32(eo, 2);
+
    /* Adjust so we can just check the sign bit (< 0 comparison), instead of having to do a less efficient <= 0 comparison */
    c = _mm_sub_epi32(c, _mm_set1_epi32(1));
    rej4 = _mm_add_epi32(rej4, _mm_set1_epi32(1));
@@ -375,7 +743,7 @@ lp_rast_triangle_32_3_16(struct lp_rasterizer_task *task,
 
    for (i = 0; i < nr; i++)
       lp_rast_shade_quads_mask(task,
-                               &tri->inputs,
+                               inputs,
                                x + 4 * out[i].j,
                                y + 4 * out[i].i,
                                0xffff & ~out[i].mask);
@@ -385,6 +753,51 @@ lp_rast_triangle_32_3_16(struct lp_rasterizer_task *task,
 
 
 
+void
+lp_rast_triangle_32_3_16(struct lp_rasterizer_task *task,
+                      const union lp_rast_cmd_arg arg)
+{
+   const struct lp_rast_triangle *tri = arg.triangle.tri;
+   const struct lp_rast_plane *plane = GET_PLANES(tri);
+   int x = (arg.triangle.plane_mask & 0xff) + task->x;
+   int y = (arg.triangle.plane_mask >> 8) + task->y;
+
+   __m128i p0 = lp_plane_to_m128i(&plane[0]); /* c, dcdx, dcdy, eo */
+   __m128i p1 = lp_plane_to_m128i(&plane[1]); /* c, dcdx, dcdy, eo */
+   __m128i p2 = lp_plane_to_m128i(&plane[2]); /* c, dcdx, dcdy, eo */
+   __m128i zero = _mm_setzero_si128();
+
+   __m128i c;
+   __m128i dcdx;
+   __m128i dcdy;
+   __m128i eo;
+
+   if (lp_rast_zcull_reject(task, &tri->inputs, x, y, 16))
+      return;
+
+   if (lp_rast_triangle_32_3_16_fused(task, tri, x, y))
+      return;
+
+#if LP_RAST_AVX2
+   if (util_cpu_caps.has_avx2) {
+      lp_rast_triangle_32_3_16_avx2(task, arg);
+      return;
+   }
+#endif
+   
+   transpose4_epi32(&p0, &p1, &p2, &zero,
+                    &c, &dcdx, &dcdy, &eo);
+
+   /* Adjust dcdx;
+    */
+   dcdx = _mm_sub_epi32(zero, dcdx);
+
+   c = _mm_add_epi32(c, mm_mullo_epi32(dcdx, _mm_set1_epi32(x)));
+   c = _mm_add_epi32(c, mm_mullo_epi32(dcdy, _mm_set1_epi32(y)));
+
+   triangle_3_16_sse(task, &tri->inputs, c, dcdx, dcdy, eo, x, y);
+}
+
 void
 lp_rast_triangle_32_3_4(struct lp_rasterizer_task *task,
                      const union lp_rast_cmd_arg arg)
@@ -411,6 +824,16 @@ lp_rast_triangle_32_3_4(struct lp_rasterizer_task *task,
    __m128i span_2;                /* 0,dcdx,2dcdx,3dcdx for plane 2 */
    __m128i unused;
 
+   if (lp_rast_zcull_reject(task, &tri->inputs, x, y, 4))
+      return;
+
+#if LP_RAST_AVX2
+   if (util_cpu_caps.has_avx2) {
+      lp_rast_triangle_32_3_4_avx2(task, arg);
+      return;
+   }
+#endif
+
    transpose4_epi32(&p0, &p1, &p2, &zero,
                     &c, &dcdx, &dcdy, &unused);
 
@@ -474,6 +897,116 @@ lp_rast_triangle_32_3_4(struct lp_rasterizer_task *task,
 #endif
 
 
+#if !defined(PIPE_ARCH_SSE)
+
+/**
+ * Rasterize and shade a small triangle over the 16x16 block at (x, y).
+ */
+static void
+triangle_small_16(struct lp_rasterizer_task *task,
+                  const struct lp_rast_small_triangle *tri,
+                  int x, int y)
+{
+   unsigned i, j, k, ix, iy;
+
+   for (j = 0; j < 4; j++) {
+      for (i = 0; i < 4; i++) {
+         int32_t c[3];
+         unsigned mask = 0;
+         boolean reject = FALSE;
+
+         for (k = 0; k < 3; k++) {
+            c[k] = (tri->plane[k][0] -
+                    tri->plane[k][1] * (int32_t)(4 * i) +
+                    tri->plane[k][2] * (int32_t)(4 * j));
+            if (c[k] + 4 * tri->plane[k][3] < 0)
+               reject = TRUE;
+         }
+
+         if (reject)
+            continue;
+
+         for (iy = 0; iy < 4; iy++) {
+            for (ix = 0; ix < 4; ix++) {
+               boolean inside = TRUE;
+
+               for (k = 0; k < 3; k++) {
+                  if (c[k] - tri->plane[k][1] * (int32_t)ix +
+                      tri->plane[k][2] * (int32_t)iy <= 0)
+                     inside = FALSE;
+               }
+
+               if (inside)
+                  mask |= 1 << (iy * 4 + ix);
+            }
+         }
+
+         if (mask)
+            lp_rast_shade_quads_mask(task, &tri->inputs,
+                                     x + 4 * i, y + 4 * j, mask);
+      }
+   }
+}
+
+#else
+
+static void
+triangle_small_16(struct lp_rasterizer_task *task,
+                  const struct lp_rast_small_triangle *tri,
+                  int x, int y)
+{
+   __m128i p0 = _mm_load_si128((const __m128i *)tri->plane[0]);
+   __m128i p1 = _mm_load_si128((const __m128i *)tri->plane[1]);
+   __m128i p2 = _mm_load_si128((const __m128i *)tri->plane[2]);
+   __m128i zero = _mm_setzero_si128();
+   __m128i c, dcdx, dcdy, eo;
+
+   transpose4_epi32(&p0, &p1, &p2, &zero,
+                    &c, &dcdx, &dcdy, &eo);
+
+   dcdx = _mm_sub_epi32(zero, dcdx);
+
+   triangle_3_16_sse(task, &tri->inputs, c, dcdx, dcdy, eo, x, y);
+}
+
+#endif
+
+
+/**
+ * Rasterize a batch of triangles, each contained in a 16x16 block of the
+ * tile.
+ */
+void
+lp_rast_triangle_small(struct lp_rasterizer_task *task,
+                       const union lp_rast_cmd_arg arg)
+{
+   const struct lp_rast_small_batch *batch = arg.small_batch;
+   unsigned n;
+
+   for (n = 0; n < batch->count; n++) {
+      const struct lp_rast_small_triangle *tri = batch->tri[n];
+      int x = batch->x[n] + task->x;
+      int y = batch->y[n] + task->y;
+      int32_t planes[3][3];
+      unsigned i;
+
+      if (lp_rast_zcull_reject(task, &tri->inputs, x, y, 16))
+         continue;
+
+      for (i = 0; i < 3; i++) {
+         planes[i][0] = tri->plane[i][0];
+         planes[i][1] = tri->plane[i][1];
+         planes[i][2] = tri->plane[i][2];
+      }
+
+      if (lp_rast_shade_16_fused(task, &tri->inputs, planes, x, y))
+         continue;
+
+      triangle_small_16(task, tri, x, y);
+   }
+}
+
+
 #define BUILD_MASKS(c, cdiff, dcdx, dcdy, omask, pmask) build_masks(c, cdiff, dcdx, dcdy, omask, pmask)
 #define BUILD_MASK_LINEAR(c, dcdx, dcdy) build_mask_linear(c, dcdx, dcdy)
 
@@ -556,3 +1089,46 @@ lp_rast_triangle_32_3_4(struct lp_rasterizer_task *task,
 #define NR_PLANES 8
 #include "lp_rast_tri_tmp.h"
 
+
+/*
+ * Multisampled variants, always evaluated with 64 bit arithmetic.
+ */
+#undef BUILD_MASKS
+#undef BUILD_MASK_LINEAR
+#define BUILD_MASKS(c, cdiff, dcdx, dcdy, omask, pmask) build_masks(c, cdiff, dcdx, dcdy, omask, pmask)
+#define BUILD_MASK_LINEAR(c, dcdx, dcdy) build_mask_linear(c, dcdx, dcdy)
+#define MULTISAMPLE
+
+#define TAG(x) x##_ms_1
+#define NR_PLANES 1
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_ms_2
+#define NR_PLANES 2
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_ms_3
+#define NR_PLANES 3
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_ms_4
+#define NR_PLANES 4
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_ms_5
+#define NR_PLANES 5
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_ms_6
+#define NR_PLANES 6
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_ms_7
+#define NR_PLANES 7
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_ms_8
+#define NR_PLANES 8
+#include "lp_rast_tri_tmp.h"
+
+#undef MULTISAMPLE
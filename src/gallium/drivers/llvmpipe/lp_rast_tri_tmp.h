@@ -27,8 +27,20 @@
 
 /*
  * Rasterization for binned triangles within a tile
+ *
+ * With MULTISAMPLE defined the coverage is evaluated at each sample position
+ * instead of the pixel center.  Blocks are rejected when no sample is inside
+ * and accepted when all samples are.
  */
 
+#ifdef MULTISAMPLE
+#define SAMPLE_OFFSET_MIN(p) plane_sample_offset_min(p)
+#define SAMPLE_OFFSET_MAX(p) plane_sample_offset_max(p)
+#else
+#define SAMPLE_OFFSET_MIN(p) 0
+#define SAMPLE_OFFSET_MAX(p) 0
+#endif
+
 
 
 /**
@@ -39,6 +51,35 @@
  * XXX: Need ways of dropping planes as we descend.
  * XXX: SIMD
  */
+#ifdef MULTISAMPLE
+static void
+TAG(do_block_4)(struct lp_rasterizer_task *task,
+                const struct lp_rast_triangle *tri,
+                const struct lp_rast_plane *plane,
+                int x, int y,
+                const int64_t *c)
+{
+   uint64_t mask = ~0ULL;
+   unsigned s;
+   int j;
+
+   for (j = 0; j < NR_PLANES; j++) {
+      for (s = 0; s < LP_MAX_SAMPLES; s++) {
+         int64_t offset = lp_rast_plane_sample_offset(plane[j].dcdx,
+                                                      plane[j].dcdy, s);
+         uint64_t sample_mask = BUILD_MASK_LINEAR(c[j] + offset - 1,
+                                                  -plane[j].dcdx,
+                                                  plane[j].dcdy);
+         mask &= ~(sample_mask << (16 * s));
+      }
+   }
+
+   /* Now pass to the shader:
+    */
+   if (mask)
+      lp_rast_shade_quads_ms_mask(task, &tri->inputs, x, y, mask);
+}
+#else
 static void
 TAG(do_block_4)(struct lp_rasterizer_task *task,
                 const struct lp_rast_triangle *tri,
@@ -60,6 +101,7 @@ TAG(do_block_4)(struct lp_rasterizer_task *task,
    if (mask)
       lp_rast_shade_quads_mask(task, &tri->inputs, x, y, mask);
 }
+#endif
 
 /**
  * Evaluate a 16x16 block of pixels to determine which 4x4 subblocks are in/out
@@ -81,9 +123,11 @@ TAG(do_block_16)(struct lp_rasterizer_task *task,
    for (j = 0; j < NR_PLANES; j++) {
       const int64_t dcdx = -IMUL64(plane[j].dcdx, 4);
       const int64_t dcdy = IMUL64(plane[j].dcdy, 4);
-      const int64_t cox = IMUL64(plane[j].eo, 4);
+      const int64_t cox = IMUL64(plane[j].eo, 4) +
+                          SAMPLE_OFFSET_MAX(&plane[j]);
       const int64_t ei = plane[j].dcdy - plane[j].dcdx - plane[j].eo;
-      const int64_t cio = IMUL64(ei, 4) - 1;
+      const int64_t cio = IMUL64(ei, 4) - 1 +
+                          SAMPLE_OFFSET_MIN(&plane[j]);
 
       BUILD_MASKS(c[j] + cox,
 		  cio - cox,
@@ -169,6 +213,10 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
       return;
    }
 
+   if (lp_rast_zcull_reject(task, &tri->inputs, x, y, TILE_SIZE)) {
+      return;
+   }
+
    outmask = 0;                 /* outside one or more trivial reject planes */
    partmask = 0;                /* outside one or more trivial accept planes */
 
@@ -181,9 +229,11 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
       {
          const int64_t dcdx = -IMUL64(plane[j].dcdx, 16);
          const int64_t dcdy = IMUL64(plane[j].dcdy, 16);
-         const int64_t cox = IMUL64(plane[j].eo, 16);
+         const int64_t cox = IMUL64(plane[j].eo, 16) +
+                             SAMPLE_OFFSET_MAX(&plane[j]);
          const int64_t ei = plane[j].dcdy - plane[j].dcdx - plane[j].eo;
-         const int64_t cio = IMUL64(ei, 16) - 1;
+         const int64_t cio = IMUL64(ei, 16) - 1 +
+                             SAMPLE_OFFSET_MIN(&plane[j]);
 
          BUILD_MASKS(c[j] + cox,
                      cio - cox,
@@ -229,6 +279,9 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
       partial_mask &= ~(1 << i);
 
       LP_COUNT(nr_partially_covered_16);
+      if (lp_rast_zcull_reject(task, &tri->inputs, px, py, 16))
+         continue;
+
       TAG(do_block_16)(task, tri, plane, px, py, cx);
    }
 
@@ -244,7 +297,11 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
       inmask &= ~(1 << i);
 
       LP_COUNT(nr_fully_covered_16);
+      if (lp_rast_zcull_reject(task, &tri->inputs, px, py, 16))
+         continue;
+
       block_full_16(task, tri, px, py);
+      lp_rast_zcull_update(task, &tri->inputs, px, py);
    }
 }
 
@@ -272,6 +329,9 @@ TRI_16(struct lp_rasterizer_task *task,
    x += task->x;
    y += task->y;
 
+   if (lp_rast_zcull_reject(task, &tri->inputs, x, y, 16))
+      return;
+
    for (j = 0; j < NR_PLANES; j++) {
       const int dcdx = -plane[j].dcdx * 4;
       const int dcdy = plane[j].dcdy * 4;
@@ -337,6 +397,9 @@ TRI_4(struct lp_rasterizer_task *task,
    const int y = task->y + (mask >> 8);
    unsigned j;
 
+   if (lp_rast_zcull_reject(task, &tri->inputs, x, y, 4))
+      return;
+
    /* Iterate over partials:
     */
    {
@@ -377,4 +440,6 @@ TRI_4(struct lp_rasterizer_task *task,
 #undef TRI_4
 #undef TRI_16
 #undef NR_PLANES
+#undef SAMPLE_OFFSET_MIN
+#undef SAMPLE_OFFSET_MAX
 
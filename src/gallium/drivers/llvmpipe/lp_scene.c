@@ -53,6 +53,7 @@ struct resource_ref {
 struct lp_scene *
 lp_scene_create( struct pipe_context *pipe )
 {
+   unsigned i;
    struct lp_scene *scene = CALLOC_STRUCT(lp_scene);
    if (!scene)
       return NULL;
@@ -62,7 +63,9 @@ lp_scene_create( struct pipe_context *pipe )
    scene->data.head =
       CALLOC_STRUCT(data_block);
 
-   pipe_mutex_init(scene->mutex);
+   for (i = 0; i < LP_MAX_THREADS; i++) {
+      pipe_mutex_init(scene->bin_queues[i].mutex);
+   }
 
 #ifdef DEBUG
    /* Do some scene limit sanity checks here */
@@ -89,8 +92,12 @@ lp_scene_create( struct pipe_context *pipe )
 void
 lp_scene_destroy(struct lp_scene *scene)
 {
+   unsigned i;
+
    lp_fence_reference(&scene->fence, NULL);
-   pipe_mutex_destroy(scene->mutex);
+   for (i = 0; i < LP_MAX_THREADS; i++) {
+      pipe_mutex_destroy(scene->bin_queues[i].mutex);
+   }
    assert(scene->data.head->next == NULL);
    FREE(scene->data.head);
    FREE(scene);
@@ -204,12 +211,13 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
 
 
 /**
- * Free all the temporary data in a scene.
+ * Unmap the framebuffer surfaces.
+ * Called by the rasterizer once all threads are done with the scene.
  */
 void
 lp_scene_end_rasterization(struct lp_scene *scene )
 {
-   int i, j;
+   int i;
 
    /* Unmap color buffers */
    for (i = 0; i < scene->fb.nr_cbufs; i++) {
@@ -232,6 +240,19 @@ lp_scene_end_rasterization(struct lp_scene *scene )
                               zsbuf->u.tex.first_layer);
       scene->zsbuf.map = NULL;
    }
+}
+
+
+/**
+ * Free all the temporary data in a scene so that it can be used for
+ * binning again.
+ * Called by the setup code, either once the scene's fence has signalled
+ * or for a scene which was never queued for rasterization.
+ */
+void
+lp_scene_reset(struct lp_scene *scene )
+{
+   int i, j;
 
    /* Reset all command lists:
     */
@@ -429,81 +450,226 @@ lp_scene_add_resource_reference(struct lp_scene *scene,
 
 /**
  * Does this scene have a reference to the given resource?
+ * Returns a mask of LP_REFERENCED_FOR_READ/WRITE: the scene's render
+ * targets are written, the resources it samples from are read.
  */
-boolean
+unsigned
 lp_scene_is_resource_referenced(const struct lp_scene *scene,
                                 const struct pipe_resource *resource)
 {
    const struct resource_ref *ref;
    int i;
 
+   for (i = 0; i < scene->fb.nr_cbufs; i++) {
+      if (scene->fb.cbufs[i] && scene->fb.cbufs[i]->texture == resource)
+         return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
+   }
+   if (scene->fb.zsbuf && scene->fb.zsbuf->texture == resource)
+      return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
+
    for (ref = scene->resources; ref; ref = ref->next) {
       for (i = 0; i < ref->count; i++)
          if (ref->resource[i] == resource)
-            return TRUE;
+            return LP_REFERENCED_FOR_READ;
    }
 
-   return FALSE;
+   return LP_UNREFERENCED;
 }
 
 
 
 
-/** advance curr_x,y to the next bin */
-static boolean
-next_bin(struct lp_scene *scene)
+/** Estimate the cost of rasterizing a bin by its number of commands */
+static unsigned
+bin_cost(const struct cmd_bin *bin)
 {
-   scene->curr_x++;
-   if (scene->curr_x >= scene->tiles_x) {
-      scene->curr_x = 0;
-      scene->curr_y++;
-   }
-   if (scene->curr_y >= scene->tiles_y) {
-      /* no more bins */
-      return FALSE;
+   const struct cmd_block *block;
+   unsigned cost = 0;
+
+   for (block = bin->head; block; block = block->next) {
+      cost += block->count;
    }
-   return TRUE;
+   return cost;
+}
+
+
+/** Sort bins by decreasing cost, in raster order among equal costs */
+static int
+compare_bin_cost(const void *a, const void *b)
+{
+   const struct lp_scene_bin_ref *ra = (const struct lp_scene_bin_ref *) a;
+   const struct lp_scene_bin_ref *rb = (const struct lp_scene_bin_ref *) b;
+
+   if (ra->cost != rb->cost)
+      return ra->cost > rb->cost ? -1 : 1;
+   if (ra->y != rb->y)
+      return ra->y < rb->y ? -1 : 1;
+   return ra->x < rb->x ? -1 : (ra->x > rb->x);
+}
+
+
+/** Group bins by queue, keeping the cost order within each queue */
+static int
+compare_bin_queue(const void *a, const void *b)
+{
+   const struct lp_scene_bin_ref *ra = (const struct lp_scene_bin_ref *) a;
+   const struct lp_scene_bin_ref *rb = (const struct lp_scene_bin_ref *) b;
+
+   if (ra->queue != rb->queue)
+      return ra->queue < rb->queue ? -1 : 1;
+   return compare_bin_cost(a, b);
 }
 
 
+/**
+ * Prepare the scene's bins for rasterization by num_queues threads.
+ *
+ * Non-empty bins are sorted by decreasing cost and each one is handed
+ * to the queue with the least total cost so far (longest processing time
+ * first), so that every thread starts with a roughly equal share of the
+ * work.  Whatever imbalance remains is evened out by work stealing in
+ * lp_scene_bin_iter_next().
+ *
+ * \param queue_nodes  CPU socket of each queue's thread, or NULL.  When
+ *                     there are several sockets, each one is given a
+ *                     horizontal band of the framebuffer so that a tile
+ *                     keeps being rendered on the same socket.
+ */
 void
-lp_scene_bin_iter_begin( struct lp_scene *scene )
+lp_scene_bin_iter_begin( struct lp_scene *scene, unsigned num_queues,
+                         const unsigned *queue_nodes )
 {
-   scene->curr_x = scene->curr_y = -1;
+   struct lp_scene_bin_ref *refs = scene->bin_refs;
+   unsigned load[LP_MAX_THREADS];
+   unsigned count[LP_MAX_THREADS];
+   unsigned num_refs = 0;
+   unsigned num_nodes = 1;
+   unsigned x, y, i, q;
+
+   assert(num_queues >= 1);
+   assert(num_queues <= LP_MAX_THREADS);
+
+   for (q = 0; q < num_queues; q++) {
+      scene->bin_queues[q].node = queue_nodes ? queue_nodes[q] : 0;
+      num_nodes = MAX2(num_nodes, scene->bin_queues[q].node + 1);
+   }
+
+   for (y = 0; y < scene->tiles_y; y++) {
+      for (x = 0; x < scene->tiles_x; x++) {
+         const struct cmd_bin *bin = lp_scene_get_bin(scene, x, y);
+         if (bin->head) {
+            refs[num_refs].x = x;
+            refs[num_refs].y = y;
+            refs[num_refs].cost = bin_cost(bin);
+            num_refs++;
+         }
+      }
+   }
+
+   scene->num_bin_queues = num_queues;
+
+   if (num_queues == 1) {
+      /* no one to share with, just keep raster order */
+      scene->bin_queues[0].head = 0;
+      scene->bin_queues[0].tail = num_refs;
+      return;
+   }
+
+   qsort(refs, num_refs, sizeof refs[0], compare_bin_cost);
+
+   memset(load, 0, sizeof load);
+   memset(count, 0, sizeof count);
+
+   for (i = 0; i < num_refs; i++) {
+      unsigned node = refs[i].y * num_nodes / scene->tiles_y;
+      unsigned best = ~0u;
+      for (q = 0; q < num_queues; q++) {
+         if (scene->bin_queues[q].node != node)
+            continue;
+         if (best == ~0u || load[q] < load[best])
+            best = q;
+      }
+      if (best == ~0u) {
+         /* no thread on that socket */
+         best = 0;
+         for (q = 1; q < num_queues; q++) {
+            if (load[q] < load[best])
+               best = q;
+         }
+      }
+      refs[i].queue = best;
+      load[best] += refs[i].cost;
+      count[best]++;
+   }
+
+   /* Lay the queues out contiguously in bin_refs, each one still
+    * sorted by decreasing cost.
+    */
+   qsort(refs, num_refs, sizeof refs[0], compare_bin_queue);
+
+   for (q = 0, i = 0; q < num_queues; q++) {
+      scene->bin_queues[q].head = i;
+      i += count[q];
+      scene->bin_queues[q].tail = i;
+   }
 }
 
 
 /**
- * Return pointer to next bin to be rendered.
- * The lp_scene::curr_x and ::curr_y fields will be advanced.
+ * Return pointer to next bin to be rendered by the thread owning the
+ * given queue, or NULL when there is no work left in the scene.
  * Multiple rendering threads will call this function to get a chunk
- * of work (a bin) to work on.
+ * of work (a bin) to work on.  A thread whose own queue is empty
+ * steals the cheapest remaining bin from another thread's queue,
+ * preferring threads on the same socket.
  */
 struct cmd_bin *
-lp_scene_bin_iter_next( struct lp_scene *scene , int *x, int *y)
+lp_scene_bin_iter_next( struct lp_scene *scene, unsigned queue,
+                        int *x, int *y )
 {
-   struct cmd_bin *bin = NULL;
+   const unsigned num_queues = scene->num_bin_queues;
+   const struct lp_scene_bin_ref *ref = NULL;
+   struct lp_scene_bin_queue *q = &scene->bin_queues[queue];
+   const unsigned node = q->node;
+   unsigned i, pass;
+
+   assert(queue < num_queues);
+
+   /* own queue first, from the head */
+   pipe_mutex_lock(q->mutex);
+   if (q->head < q->tail) {
+      ref = &scene->bin_refs[q->head++];
+   }
+   pipe_mutex_unlock(q->mutex);
 
-   pipe_mutex_lock(scene->mutex);
+   /* then try to steal from the other queues' tails, on our own socket
+    * first
+    */
+   for (pass = 0; !ref && pass < 2; pass++) {
+      for (i = 1; !ref && i < num_queues; i++) {
+         q = &scene->bin_queues[(queue + i) % num_queues];
 
-   if (scene->curr_x < 0) {
-      /* first bin */
-      scene->curr_x = 0;
-      scene->curr_y = 0;
-   }
-   else if (!next_bin(scene)) {
-      /* no more bins left */
-      goto end;
+         if ((q->node == node) != (pass == 0))
+            continue;
+
+         /* unlocked peek, the queues only ever shrink */
+         if (q->head >= q->tail)
+            continue;
+
+         pipe_mutex_lock(q->mutex);
+         if (q->head < q->tail) {
+            ref = &scene->bin_refs[--q->tail];
+         }
+         pipe_mutex_unlock(q->mutex);
+      }
    }
 
-   bin = lp_scene_get_bin(scene, scene->curr_x, scene->curr_y);
-   *x = scene->curr_x;
-   *y = scene->curr_y;
+   if (!ref)
+      return NULL;
 
-end:
-   /*printf("return bin %p at %d, %d\n", (void *) bin, *bin_x, *bin_y);*/
-   pipe_mutex_unlock(scene->mutex);
-   return bin;
+   *x = ref->x;
+   *y = ref->y;
+   return lp_scene_get_bin(scene, ref->x, ref->y);
 }
 
 
@@ -546,6 +712,80 @@ void lp_scene_begin_binning( struct lp_scene *scene,
       max_layer = MIN2(max_layer, zsbuf->u.tex.last_layer - zsbuf->u.tex.first_layer);
    }
    scene->fb_max_layer = max_layer;
+
+   scene->nr_samples = util_framebuffer_get_num_samples(fb);
+   assert(scene->nr_samples == 1 ||
+          (scene->nr_samples == LP_MAX_SAMPLES && max_layer == 0));
+
+   /*
+    * The depth bounds are kept per tile, not per layer, so layered
+    * rendering can't use them.
+    */
+   scene->zcull = fb->zsbuf && max_layer == 0 &&
+                  !(LP_PERF & PERF_NO_ZCULL);
+   scene->zcull_epsilon = 0.0f;
+   if (scene->zcull) {
+      const struct util_format_description *desc =
+         util_format_description(fb->zsbuf->format);
+      const struct util_format_channel_description *chan =
+         &desc->channel[desc->swizzle[0]];
+
+      /* Float depth gets a margin of a couple of mantissa bits below 1.0 */
+      scene->zcull_epsilon = 1.0f / (1 << 22);
+      if (chan->type == UTIL_FORMAT_TYPE_UNSIGNED && chan->size < 22) {
+         scene->zcull_epsilon = 1.0f / ((1 << chan->size) - 1);
+      }
+   }
+
+   for (i = 0; i < scene->tiles_x; i++) {
+      unsigned j;
+      for (j = 0; j < scene->tiles_y; j++) {
+         scene->tile[i][j].zmax = LP_ZCULL_UNKNOWN;
+      }
+   }
+}
+
+
+/**
+ * Get the depth value written by a LP_RAST_OP_CLEAR_ZSTENCIL command.
+ * Returns FALSE if the clear leaves depth untouched.
+ */
+boolean
+lp_scene_clear_depth(enum pipe_format format,
+                     uint64_t clear_value, uint64_t clear_mask,
+                     float *depth)
+{
+   const struct util_format_description *desc = util_format_description(format);
+   const uint64_t depth_mask = util_pack64_mask_z_stencil(format, ~0, 0);
+
+   if ((clear_mask & depth_mask) != depth_mask)
+      return FALSE;
+
+   desc->unpack_z_float(depth, 0, (const uint8_t *)&clear_value, 0, 1, 1);
+   return TRUE;
+}
+
+
+/**
+ * Reset the depth bounds of all tiles after a depth/stencil clear.
+ */
+void
+lp_scene_zcull_clear(struct lp_scene *scene,
+                     uint64_t clear_value, uint64_t clear_mask)
+{
+   float depth;
+   unsigned i, j;
+
+   if (!scene->zcull ||
+       !lp_scene_clear_depth(scene->fb.zsbuf->format,
+                             clear_value, clear_mask, &depth))
+      return;
+
+   for (i = 0; i < scene->tiles_x; i++) {
+      for (j = 0; j < scene->tiles_y; j++) {
+         scene->tile[i][j].zmax = depth;
+      }
+   }
 }
 
 
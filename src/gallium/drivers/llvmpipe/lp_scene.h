@@ -36,6 +36,7 @@
 #define LP_SCENE_H
 
 #include "os/os_thread.h"
+#include "lp_limits.h"
 #include "lp_rast.h"
 #include "lp_debug.h"
 
@@ -95,6 +96,7 @@ struct data_block {
  */
 struct cmd_bin {
    const struct lp_rast_state *last_state;       /* most recent state set in bin */
+   float zmax;            /* depth bound after the binned commands, see LP_ZCULL_x */
    struct cmd_block *head;
    struct cmd_block *tail;
 };
@@ -117,6 +119,30 @@ struct data_block_list {
 
 struct resource_ref;
 
+
+/**
+ * A non-empty bin waiting to be rasterized, along with an estimate of
+ * how expensive it will be (the number of commands in the bin).
+ */
+struct lp_scene_bin_ref {
+   unsigned short x, y;
+   unsigned short queue;  /**< thread queue the bin was assigned to */
+   unsigned cost;
+};
+
+
+/**
+ * Per-thread double-ended queue of bins for one scene.
+ * The owning thread takes bins from the head (most expensive first),
+ * idle threads steal bins from the tail.
+ */
+struct lp_scene_bin_queue {
+   pipe_mutex mutex;
+   unsigned head, tail;   /**< range of lp_scene::bin_refs still queued */
+   unsigned node;         /**< CPU socket of the owning thread */
+};
+
+
 /**
  * All bins and bin data are contained here.
  * Per-bin data goes into the 'tile' bins.
@@ -148,9 +174,20 @@ struct lp_scene {
    /* The amount of layers in the fb (minimum of all attachments) */
    unsigned fb_max_layer;
 
+   /* Samples per pixel of the fb.  Multisampled attachments have a single
+    * layer and keep their samples where the layers would be, so layer_stride
+    * above is also the stride between samples.
+    */
+   unsigned nr_samples;
+
    /** the framebuffer to render the scene into */
    struct pipe_framebuffer_state fb;
 
+   /** Whether hierarchical depth culling is possible, see LP_ZCULL_x */
+   boolean zcull;
+   /** One ULP of the depth buffer, in depth units */
+   float zcull_epsilon;
+
    /** list of resources referenced by the scene commands */
    struct resource_ref *resources;
 
@@ -167,14 +204,20 @@ struct lp_scene {
 
    boolean alloc_failed;
    boolean discard;
+
+   /** When binning started, for LP_TRACE */
+   int64_t setup_start;
+
    /**
     * Number of active tiles in each dimension.
     * This basically the framebuffer size divided by tile size
     */
    unsigned tiles_x, tiles_y;
 
-   int curr_x, curr_y;  /**< for iterating over bins */
-   pipe_mutex mutex;
+   /** Bins to rasterize, partitioned into one queue per thread */
+   struct lp_scene_bin_ref bin_refs[TILES_X * TILES_Y];
+   struct lp_scene_bin_queue bin_queues[LP_MAX_THREADS];
+   unsigned num_bin_queues;
 
    struct cmd_bin tile[TILES_X][TILES_Y];
    struct data_block_list data;
@@ -199,8 +242,8 @@ boolean lp_scene_add_resource_reference(struct lp_scene *scene,
                                         struct pipe_resource *resource,
                                         boolean initializing_scene);
 
-boolean lp_scene_is_resource_referenced(const struct lp_scene *scene,
-                                        const struct pipe_resource *resource );
+unsigned lp_scene_is_resource_referenced(const struct lp_scene *scene,
+                                         const struct pipe_resource *resource );
 
 
 /**
@@ -339,6 +382,8 @@ lp_scene_bin_cmd_with_state( struct lp_scene *scene,
 
    if (state != bin->last_state) {
       bin->last_state = state;
+      if (state->zcull & LP_ZCULL_INVALIDATE)
+         bin->zmax = LP_ZCULL_UNKNOWN;
       if (!lp_scene_bin_command(scene, x, y,
                                 LP_RAST_OP_SET_STATE,
                                 lp_rast_arg_state(state)))
@@ -379,13 +424,25 @@ lp_scene_get_num_bins( const struct lp_scene *scene )
 
 
 void
-lp_scene_bin_iter_begin( struct lp_scene *scene );
+lp_scene_bin_iter_begin( struct lp_scene *scene, unsigned num_queues,
+                         const unsigned *queue_nodes );
 
 struct cmd_bin *
-lp_scene_bin_iter_next( struct lp_scene *scene, int *x, int *y );
+lp_scene_bin_iter_next( struct lp_scene *scene, unsigned queue,
+                        int *x, int *y );
 
 
 
+boolean
+lp_scene_clear_depth(enum pipe_format format,
+                     uint64_t clear_value, uint64_t clear_mask,
+                     float *depth);
+
+void
+lp_scene_zcull_clear(struct lp_scene *scene,
+                     uint64_t clear_value, uint64_t clear_mask);
+
+
 /* Begin/end binning of a scene
  */
 void
@@ -405,6 +462,9 @@ lp_scene_begin_rasterization(struct lp_scene *scene);
 void
 lp_scene_end_rasterization(struct lp_scene *scene );
 
+void
+lp_scene_reset(struct lp_scene *scene );
+
 
 
 
@@ -46,8 +46,10 @@
 #include "lp_context.h"
 #include "lp_debug.h"
 #include "lp_public.h"
+#include "lp_query.h"
 #include "lp_limits.h"
 #include "lp_rast.h"
+#include "lp_trace.h"
 
 #include "state_tracker/sw_winsys.h"
 
@@ -81,6 +83,9 @@ static const struct debug_named_value lp_perf_flags[] = {
    { "no_blend",       PERF_NO_BLEND, NULL },
    { "no_depth",       PERF_NO_DEPTH, NULL },
    { "no_alphatest",   PERF_NO_ALPHATEST, NULL },
+   { "no_zcull",       PERF_NO_ZCULL, NULL },
+   { "no_tex_tiling",  PERF_NO_TEX_TILING, NULL },
+   { "no_fused_tri",   PERF_NO_FUSED_TRI, NULL },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -119,7 +124,7 @@ llvmpipe_get_param(struct pipe_screen *screen, enum pipe_cap param)
    case PIPE_CAP_MAX_STREAM_OUTPUT_BUFFERS:
       return PIPE_MAX_SO_BUFFERS;
    case PIPE_CAP_ANISOTROPIC_FILTER:
-      return 0;
+      return 1;
    case PIPE_CAP_POINT_SPRITE:
       return 1;
    case PIPE_CAP_MAX_RENDER_TARGETS:
@@ -210,7 +215,7 @@ llvmpipe_get_param(struct pipe_screen *screen, enum pipe_cap param)
    case PIPE_CAP_QUADS_FOLLOW_PROVOKING_VERTEX_CONVENTION:
       return 0;
    case PIPE_CAP_COMPUTE:
-      return 0;
+      return 1;
    case PIPE_CAP_USER_VERTEX_BUFFERS:
    case PIPE_CAP_USER_INDEX_BUFFERS:
       return 1;
@@ -338,11 +343,69 @@ llvmpipe_get_shader_param(struct pipe_screen *screen, unsigned shader, enum pipe
       default:
          return draw_get_shader_param(shader, param);
       }
+   case PIPE_SHADER_COMPUTE:
+      switch (param) {
+      case PIPE_SHADER_CAP_MAX_TEXTURE_SAMPLERS:
+      case PIPE_SHADER_CAP_MAX_SAMPLER_VIEWS:
+         return 0;
+      default:
+         return gallivm_get_shader_param(param);
+      }
    default:
       return 0;
    }
 }
 
+static int
+llvmpipe_get_compute_param(struct pipe_screen *_screen,
+                           enum pipe_compute_cap param,
+                           void *ret)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(_screen);
+
+#define RET(x) do {                  \
+   if (ret)                          \
+      memcpy(ret, x, sizeof(x));     \
+   return sizeof(x);                 \
+} while (0)
+
+   switch (param) {
+   case PIPE_COMPUTE_CAP_IR_TARGET:
+      if (ret)
+         strcpy(ret, "llvmpipe");
+      return strlen("llvmpipe") + 1;
+   case PIPE_COMPUTE_CAP_GRID_DIMENSION:
+      RET((uint64_t []) { 3 });
+   case PIPE_COMPUTE_CAP_MAX_GRID_SIZE:
+      RET(((uint64_t []) { 65535, 65535, 65535 }));
+   case PIPE_COMPUTE_CAP_MAX_BLOCK_SIZE:
+      RET(((uint64_t []) { 1024, 1024, 64 }));
+   case PIPE_COMPUTE_CAP_MAX_THREADS_PER_BLOCK:
+      RET((uint64_t []) { LP_MAX_CS_THREADS_PER_BLOCK });
+   case PIPE_COMPUTE_CAP_MAX_GLOBAL_SIZE:
+   case PIPE_COMPUTE_CAP_MAX_MEM_ALLOC_SIZE:
+      /* limited by the offset part of the global handles */
+      RET((uint64_t []) { 1ULL << LP_CS_GLOBAL_OFFSET_BITS });
+   case PIPE_COMPUTE_CAP_MAX_LOCAL_SIZE:
+   case PIPE_COMPUTE_CAP_MAX_PRIVATE_SIZE:
+      RET((uint64_t []) { 0 });
+   case PIPE_COMPUTE_CAP_MAX_INPUT_SIZE:
+      RET((uint64_t []) { LP_MAX_CS_INPUT_SIZE });
+   case PIPE_COMPUTE_CAP_MAX_CLOCK_FREQUENCY:
+      RET((uint32_t []) { 0 });
+   case PIPE_COMPUTE_CAP_MAX_COMPUTE_UNITS:
+      RET((uint32_t []) { MAX2(1, screen->num_threads) });
+   case PIPE_COMPUTE_CAP_IMAGES_SUPPORTED:
+      RET((uint32_t []) { 0 });
+   case PIPE_COMPUTE_CAP_SUBGROUP_SIZE:
+      RET((uint32_t []) { lp_native_vector_width / 32 });
+   default:
+      return 0;
+   }
+
+#undef RET
+}
+
 static float
 llvmpipe_get_paramf(struct pipe_screen *screen, enum pipe_capf param)
 {
@@ -356,7 +419,7 @@ llvmpipe_get_paramf(struct pipe_screen *screen, enum pipe_capf param)
    case PIPE_CAPF_MAX_POINT_WIDTH_AA:
       return 255.0; /* arbitrary */
    case PIPE_CAPF_MAX_TEXTURE_ANISOTROPY:
-      return 16.0; /* not actually signficant at this time */
+      return 16.0;
    case PIPE_CAPF_MAX_TEXTURE_LOD_BIAS:
       return 16.0; /* arbitrary */
    case PIPE_CAPF_GUARD_BAND_LEFT:
@@ -401,8 +464,18 @@ llvmpipe_is_format_supported( struct pipe_screen *_screen,
           target == PIPE_TEXTURE_CUBE ||
           target == PIPE_TEXTURE_CUBE_ARRAY);
 
-   if (sample_count > 1)
-      return FALSE;
+   /*
+    * Multisampled surfaces can only be rendered to and resolved, not
+    * sampled from.
+    */
+   if (sample_count > 1) {
+      if (sample_count != LP_MAX_SAMPLES)
+         return FALSE;
+      if (target != PIPE_TEXTURE_2D && target != PIPE_TEXTURE_RECT)
+         return FALSE;
+      if (bind & ~(PIPE_BIND_RENDER_TARGET | PIPE_BIND_DEPTH_STENCIL))
+         return FALSE;
+   }
 
    if (bind & PIPE_BIND_RENDER_TARGET) {
       if (format_desc->colorspace == UTIL_FORMAT_COLORSPACE_SRGB) {
@@ -495,6 +568,24 @@ llvmpipe_flush_frontbuffer(struct pipe_screen *_screen,
    struct llvmpipe_screen *screen = llvmpipe_screen(_screen);
    struct sw_winsys *winsys = screen->winsys;
    struct llvmpipe_resource *texture = llvmpipe_resource(resource);
+   struct lp_fence *fence = NULL;
+
+   /* Scenes are rasterized asynchronously, make sure the rasterizer is
+    * done with whatever was queued before presenting.
+    */
+   pipe_mutex_lock(screen->rast_mutex);
+   lp_fence_reference(&fence, screen->last_fence);
+   pipe_mutex_unlock(screen->rast_mutex);
+   if (fence) {
+      lp_fence_wait(fence);
+      lp_fence_reference(&fence, NULL);
+   }
+
+   if (screen->trace) {
+      int64_t now = os_time_get_nano();
+      lp_trace_add(screen->trace, LP_TRACE_FRAME, LP_TRACE_SETUP_THREAD,
+                   now, now, 0, 0, 0);
+   }
 
    assert(texture->dt);
    if (texture->dt)
@@ -507,9 +598,16 @@ llvmpipe_destroy_screen( struct pipe_screen *_screen )
    struct llvmpipe_screen *screen = llvmpipe_screen(_screen);
    struct sw_winsys *winsys = screen->winsys;
 
+   lp_fence_reference(&screen->last_fence, NULL);
+
    if (screen->rast)
       lp_rast_destroy(screen->rast);
 
+   /* after the rasterizer threads are gone */
+   lp_trace_destroy(screen->trace);
+
+   llvmpipe_destroy_fs_cache(screen);
+
    lp_jit_screen_cleanup(screen);
 
    if(winsys->destroy)
@@ -597,6 +695,7 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    screen->base.get_param = llvmpipe_get_param;
    screen->base.get_shader_param = llvmpipe_get_shader_param;
    screen->base.get_paramf = llvmpipe_get_paramf;
+   screen->base.get_compute_param = llvmpipe_get_compute_param;
    screen->base.is_format_supported = llvmpipe_is_format_supported;
 
    screen->base.context_create = llvmpipe_create_context;
@@ -605,6 +704,7 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    screen->base.fence_finish = llvmpipe_fence_finish;
 
    screen->base.get_timestamp = llvmpipe_get_timestamp;
+   screen->base.get_driver_query_info = llvmpipe_get_driver_query_info;
 
    llvmpipe_init_screen_resource_funcs(&screen->base);
 
@@ -621,8 +721,17 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
       FREE(screen);
       return NULL;
    }
+
+   if (!llvmpipe_init_fs_cache(screen)) {
+      lp_rast_destroy(screen->rast);
+      lp_jit_screen_cleanup(screen);
+      FREE(screen);
+      return NULL;
+   }
    pipe_mutex_init(screen->rast_mutex);
 
+   screen->trace = lp_trace_create();
+
    util_format_s3tc_init();
 
    return &screen->base;
@@ -41,6 +41,7 @@
 
 
 struct sw_winsys;
+struct lp_fs_cache;
 
 
 struct llvmpipe_screen
@@ -55,8 +56,22 @@ struct llvmpipe_screen
     */
    unsigned timestamp;
 
+   /* Increments whenever s3tc texture data may have changed, which
+    * invalidates the rasterizer threads' decoded block caches.
+    */
+   unsigned tex_cache_generation;
+
    struct lp_rasterizer *rast;
    pipe_mutex rast_mutex;
+
+   /** Fence of the last scene queued by any context, under rast_mutex */
+   struct lp_fence *last_fence;
+
+   /** Fragment shader code shared by all contexts */
+   struct lp_fs_cache *fs_cache;
+
+   /** Timeline recorded for LP_TRACE, or NULL */
+   struct lp_trace *trace;
 };
 
 
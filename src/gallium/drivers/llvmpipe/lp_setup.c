@@ -52,6 +52,7 @@
 #include "lp_setup_context.h"
 #include "lp_screen.h"
 #include "lp_state.h"
+#include "lp_trace.h"
 #include "state_tracker/sw_winsys.h"
 
 #include "draw/draw_context.h"
@@ -74,15 +75,22 @@ lp_setup_get_empty_scene(struct lp_setup_context *setup)
    setup->scene = setup->scenes[setup->scene_idx];
 
    if (setup->scene->fence) {
+      /* The scene was queued for rasterization earlier.  Wait for the
+       * rasterizer to be done with it before recycling it.
+       */
       if (LP_DEBUG & DEBUG_SETUP)
          debug_printf("%s: wait for scene %d\n",
                       __FUNCTION__, setup->scene->fence->id);
 
       lp_fence_wait(setup->scene->fence);
+      lp_scene_reset(setup->scene);
    }
 
    lp_scene_begin_binning(setup->scene, &setup->fb, setup->rasterizer_discard);
 
+   if (llvmpipe_screen(setup->pipe->screen)->trace)
+      setup->scene->setup_start = os_time_get_nano();
+
 }
 
 
@@ -164,23 +172,23 @@ lp_setup_rasterize_scene( struct lp_setup_context *setup )
    if (setup->last_fence)
       setup->last_fence->issued = TRUE;
 
-   pipe_mutex_lock(screen->rast_mutex);
+   if (screen->trace) {
+      lp_trace_add(screen->trace, LP_TRACE_SETUP, LP_TRACE_SETUP_THREAD,
+                   scene->setup_start, os_time_get_nano(),
+                   scene->fence ? scene->fence->id : 0, 0, 0);
+   }
 
-   /* FIXME: We enqueue the scene then wait on the rasterizer to finish.
-    * This means we never actually run any vertex stuff in parallel to
-    * rasterization (not in the same context at least) which is what the
-    * multiple scenes per setup is about - when we get a new empty scene
-    * any old one is already empty again because we waited here for
-    * raster tasks to be finished. Ideally, we shouldn't need to wait here
-    * and rely on fences elsewhere when waiting is necessary.
-    * Certainly, lp_scene_end_rasterization() would need to be deferred too
-    * and there's probably other bits why this doesn't actually work.
-    */
+   pipe_mutex_lock(screen->rast_mutex);
+   lp_fence_reference(&screen->last_fence, scene->fence);
    lp_rast_queue_scene(screen->rast, scene);
-   lp_rast_finish(screen->rast);
    pipe_mutex_unlock(screen->rast_mutex);
 
-   lp_scene_end_rasterization(setup->scene);
+   /* Don't wait for the rasterizer here: the scene belongs to the
+    * rasterizer threads until its fence signals, meanwhile we can go on
+    * running the vertex pipeline and binning into the next scene.
+    * lp_setup_get_empty_scene() waits on the fence before the scene gets
+    * reused, anything else needing the results waits on last_fence.
+    */
    lp_setup_reset( setup );
 
    LP_DBG(DEBUG_SETUP, "%s done \n", __FUNCTION__);
@@ -200,7 +208,7 @@ begin_binning( struct lp_setup_context *setup )
 
    /* Always create a fence:
     */
-   scene->fence = lp_fence_create(MAX2(1, setup->num_threads));
+   scene->fence = lp_fence_create(1);
    if (!scene->fence)
       return FALSE;
 
@@ -252,6 +260,8 @@ begin_binning( struct lp_setup_context *setup )
                                           setup->clear.zsmask));
          if (!ok)
             return FALSE;
+         lp_scene_zcull_clear(scene, setup->clear.zsvalue,
+                              setup->clear.zsmask);
       }
    }
 
@@ -341,7 +351,7 @@ set_scene_state( struct lp_setup_context *setup,
 
 fail:
    if (setup->scene) {
-      lp_scene_end_rasterization(setup->scene);
+      lp_scene_reset(setup->scene);
       setup->scene = NULL;
    }
 
@@ -505,6 +515,7 @@ lp_setup_try_clear_zs(struct lp_setup_context *setup,
                                    LP_RAST_OP_CLEAR_ZSTENCIL,
                                    lp_rast_arg_clearzs(zsvalue, zsmask)))
          return FALSE;
+      lp_scene_zcull_clear(scene, zsvalue, zsmask);
    }
    else {
       /* Put ourselves into the 'pre-clear' state, specifically to try
@@ -630,6 +641,7 @@ lp_setup_set_fs_variant( struct lp_setup_context *setup,
    /* FIXME: reference count */
 
    setup->fs.current.variant = variant;
+   setup->fs.current.zcull = variant ? variant->zcull : 0;
    setup->dirty |= LP_SETUP_NEW_FS;
 }
 
@@ -731,6 +743,26 @@ lp_setup_set_rasterizer_discard( struct lp_setup_context *setup,
    }
 }
 
+/**
+ * \param multisample  rasterize with per-sample coverage
+ * \param sample_mask  samples which may be written (only the low
+ *                     scene->nr_samples bits are meaningful)
+ */
+void
+lp_setup_set_multisample( struct lp_setup_context *setup,
+                          boolean multisample,
+                          unsigned sample_mask )
+{
+   LP_DBG(DEBUG_SETUP, "%s %d 0x%x\n", __FUNCTION__, multisample, sample_mask);
+
+   setup->multisample = multisample;
+
+   if (setup->fs.current.sample_mask != sample_mask) {
+      setup->fs.current.sample_mask = sample_mask;
+      setup->dirty |= LP_SETUP_NEW_FS;
+   }
+}
+
 void 
 lp_setup_set_vertex_info( struct lp_setup_context *setup,
                           struct vertex_info *vertex_info )
@@ -964,6 +996,7 @@ unsigned
 lp_setup_is_resource_referenced( const struct lp_setup_context *setup,
                                 const struct pipe_resource *texture )
 {
+   unsigned referenced = LP_UNREFERENCED;
    unsigned i;
 
    /* check the render targets */
@@ -975,14 +1008,19 @@ lp_setup_is_resource_referenced( const struct lp_setup_context *setup,
       return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
    }
 
-   /* check textures referenced by the scene */
+   /* check render targets and textures referenced by the scenes which
+    * haven't finished rasterizing yet
+    */
    for (i = 0; i < Elements(setup->scenes); i++) {
-      if (lp_scene_is_resource_referenced(setup->scenes[i], texture)) {
-         return LP_REFERENCED_FOR_READ;
-      }
+      struct lp_scene *scene = setup->scenes[i];
+
+      if (scene->fence && lp_fence_signalled(scene->fence))
+         continue;
+
+      referenced |= lp_scene_is_resource_referenced(scene, texture);
    }
 
-   return LP_UNREFERENCED;
+   return referenced;
 }
 
 
@@ -1277,12 +1315,15 @@ lp_setup_destroy( struct lp_setup_context *setup )
       pipe_resource_reference(&setup->constants[i].current.buffer, NULL);
    }
 
-   /* free the scenes in the 'empty' queue */
+   /* wait for the scenes still being rasterized and free them all */
    for (i = 0; i < Elements(setup->scenes); i++) {
       struct lp_scene *scene = setup->scenes[i];
 
-      if (scene->fence)
-         lp_fence_wait(scene->fence);
+      if (scene->fence) {
+         if (lp_fence_issued(scene->fence))
+            lp_fence_wait(scene->fence);
+         lp_scene_reset(scene);
+      }
 
       lp_scene_destroy(scene);
    }
@@ -1338,6 +1379,8 @@ lp_setup_create( struct pipe_context *pipe,
    setup->triangle = first_triangle;
    setup->line     = first_line;
    setup->point    = first_point;
+
+   setup->fs.current.sample_mask = ~0;
    
    setup->dirty = ~0;
 
@@ -1370,7 +1413,9 @@ lp_setup_begin_query(struct lp_setup_context *setup,
 
    if (!(pq->type == PIPE_QUERY_OCCLUSION_COUNTER ||
          pq->type == PIPE_QUERY_OCCLUSION_PREDICATE ||
-         pq->type == PIPE_QUERY_PIPELINE_STATISTICS))
+         pq->type == PIPE_QUERY_PIPELINE_STATISTICS ||
+         pq->type == LP_QUERY_TEXTURE_CACHE_HITS ||
+         pq->type == LP_QUERY_TEXTURE_CACHE_MISSES))
       return;
 
    /* init the query to its beginning state */
@@ -1421,7 +1466,9 @@ lp_setup_end_query(struct lp_setup_context *setup, struct llvmpipe_query *pq)
       if (pq->type == PIPE_QUERY_OCCLUSION_COUNTER ||
           pq->type == PIPE_QUERY_OCCLUSION_PREDICATE ||
           pq->type == PIPE_QUERY_PIPELINE_STATISTICS ||
-          pq->type == PIPE_QUERY_TIMESTAMP) {
+          pq->type == PIPE_QUERY_TIMESTAMP ||
+          pq->type == LP_QUERY_TEXTURE_CACHE_HITS ||
+          pq->type == LP_QUERY_TEXTURE_CACHE_MISSES) {
          if (pq->type == PIPE_QUERY_TIMESTAMP &&
                !(setup->scene->tiles_x | setup->scene->tiles_y)) {
             /*
@@ -1456,7 +1503,9 @@ fail:
     */
    if (pq->type == PIPE_QUERY_OCCLUSION_COUNTER ||
       pq->type == PIPE_QUERY_OCCLUSION_PREDICATE ||
-      pq->type == PIPE_QUERY_PIPELINE_STATISTICS) {
+      pq->type == PIPE_QUERY_PIPELINE_STATISTICS ||
+      pq->type == LP_QUERY_TEXTURE_CACHE_HITS ||
+      pq->type == LP_QUERY_TEXTURE_CACHE_MISSES) {
       unsigned i;
 
       /* remove from active binned query list */
@@ -54,9 +54,10 @@
 struct lp_setup_variant;
 
 
-/** Max number of scenes */
-/* XXX: make multiple scenes per context work, see lp_setup_rasterize_scene */
-#define MAX_SCENES 1
+/** Max number of scenes.  While one scene is being rasterized, the next
+ * one can be binned.
+ */
+#define MAX_SCENES 2
 
 
 
@@ -100,6 +101,7 @@ struct lp_setup_context
    boolean scissor_test;
    boolean point_size_per_vertex;
    boolean rasterizer_discard;
+   boolean multisample;
    unsigned cullmode;
    unsigned bottom_edge_rule;
    float pixel_offset;
@@ -564,6 +564,14 @@ try_setup_line( struct lp_setup_context *setup,
        */
       bbox.x1--;
       bbox.y1--;
+
+      /* Samples lie within half a pixel of the pixel centers */
+      if (setup->multisample) {
+         bbox.x0--;
+         bbox.y0--;
+         bbox.x1++;
+         bbox.y1++;
+      }
    }
 
    if (bbox.x1 < bbox.x0 ||
@@ -202,6 +202,19 @@ lp_rast_32_tri_tab[MAX_PLANES+1] = {
    LP_RAST_OP_TRIANGLE_32_8
 };
 
+static unsigned
+lp_rast_ms_tri_tab[MAX_PLANES+1] = {
+   0,               /* should be impossible */
+   LP_RAST_OP_MS_TRIANGLE_1,
+   LP_RAST_OP_MS_TRIANGLE_2,
+   LP_RAST_OP_MS_TRIANGLE_3,
+   LP_RAST_OP_MS_TRIANGLE_4,
+   LP_RAST_OP_MS_TRIANGLE_5,
+   LP_RAST_OP_MS_TRIANGLE_6,
+   LP_RAST_OP_MS_TRIANGLE_7,
+   LP_RAST_OP_MS_TRIANGLE_8
+};
+
 
 
 /**
@@ -254,6 +267,150 @@ lp_setup_whole_tile(struct lp_setup_context *setup,
 }
 
 
+/**
+ * Whether the primitive is known to fail the depth test over the
+ * size x size area at (x, y) of tile (tx, ty), according to the depth
+ * bound of the tile's bin.
+ */
+static boolean
+lp_setup_zcull(struct lp_setup_context *setup,
+               const struct lp_rast_shader_inputs *inputs,
+               int tx, int ty, int x, int y, int size)
+{
+   const struct lp_scene *scene = setup->scene;
+   const struct cmd_bin *bin;
+   float zmin, zmax;
+
+   if (!scene->zcull || !(setup->fs.stored->zcull & LP_ZCULL_TEST))
+      return FALSE;
+
+   bin = lp_scene_get_bin(setup->scene, tx, ty);
+   if (bin->zmax == LP_ZCULL_UNKNOWN)
+      return FALSE;
+
+   LP_COUNT(nr_zcull_tested_64);
+   lp_rast_depth_range(inputs, x, y, size, &zmin, &zmax);
+   if (!lp_rast_zcull_occluded(zmin, bin->zmax, scene->zcull_epsilon))
+      return FALSE;
+
+   LP_COUNT(nr_zcull_culled_64);
+   return TRUE;
+}
+
+
+/**
+ * Set up a triangle contained in a 16x16 block of a single tile, and add
+ * it to the tile's last batch of small triangles, or start a new one.
+ * Planes are computed relative to the block, in 32 bits.
+ */
+static boolean
+do_triangle_small(struct lp_setup_context *setup,
+                  const struct fixed_position *position,
+                  const float (*v0)[4],
+                  const float (*v1)[4],
+                  const float (*v2)[4],
+                  boolean frontfacing,
+                  const struct u_rect *bbox,
+                  unsigned layer)
+{
+   struct lp_scene *scene = setup->scene;
+   const struct lp_setup_variant_key *key = &setup->setup.variant->key;
+   unsigned input_array_sz = NUM_CHANNELS * (key->num_inputs + 1) * sizeof(float);
+   struct lp_rast_small_triangle *tri;
+   struct lp_rast_small_batch *batch;
+   const struct cmd_bin *bin;
+   int ix = bbox->x0 / TILE_SIZE;
+   int iy = bbox->y0 / TILE_SIZE;
+   /* Budge the 16x16 block inside the tile, as for LP_RAST_OP_TRIANGLE_3_16 */
+   unsigned px = MIN2(bbox->x0 & (TILE_SIZE - 1) & ~3, TILE_SIZE - 16);
+   unsigned py = MIN2(bbox->y0 & (TILE_SIZE - 1) & ~3, TILE_SIZE - 16);
+   int x = (ix * TILE_SIZE + px) << FIXED_ORDER;
+   int y = (iy * TILE_SIZE + py) << FIXED_ORDER;
+   int i;
+
+   tri = lp_scene_alloc_aligned(scene, sizeof *tri + 3 * input_array_sz, 16);
+   if (!tri)
+      return FALSE;
+
+   LP_COUNT(nr_tris);
+   LP_COUNT(nr_small_tris);
+
+   setup->setup.variant->jit_function( v0,
+				       v1,
+				       v2,
+				       frontfacing,
+				       GET_A0(&tri->inputs),
+				       GET_DADX(&tri->inputs),
+				       GET_DADY(&tri->inputs) );
+
+   tri->inputs.frontfacing = frontfacing;
+   tri->inputs.disable = FALSE;
+   tri->inputs.opaque = setup->fs.current.variant->opaque;
+   tri->inputs.stride = input_array_sz;
+   tri->inputs.layer = layer;
+   tri->inputs.viewport_index = 0;
+
+   for (i = 0; i < 3; i++) {
+      int j = (i + 1) % 3;
+      int32_t dcdx = position->y[i] - position->y[j];
+      int32_t dcdy = position->x[i] - position->x[j];
+      int32_t c = (dcdx * (position->x[i] - x) -
+                   dcdy * (position->y[i] - y));
+
+      /* Same fill convention as in do_triangle_ccw() */
+      if (dcdx < 0 ||
+          (dcdx == 0 && (setup->bottom_edge_rule == 0 ? dcdy > 0 : dcdy < 0)))
+         c++;
+
+      dcdx <<= FIXED_ORDER;
+      dcdy <<= FIXED_ORDER;
+
+      tri->plane[i][0] = c;
+      tri->plane[i][1] = dcdx;
+      tri->plane[i][2] = dcdy;
+      tri->plane[i][3] = (dcdx < 0 ? -dcdx : 0) + (dcdy > 0 ? dcdy : 0);
+   }
+
+   if (lp_setup_zcull(setup, &tri->inputs, ix, iy,
+                      bbox->x0, bbox->y0,
+                      MAX2(bbox->x1 - bbox->x0, bbox->y1 - bbox->y0) + 1))
+      return TRUE;
+
+   /* Append to the batch if it is still the last command of the bin, and
+    * no other state was set since.
+    */
+   bin = lp_scene_get_bin(scene, ix, iy);
+   if (bin->last_state == setup->fs.stored &&
+       bin->tail && bin->tail->count &&
+       bin->tail->cmd[bin->tail->count - 1] == LP_RAST_OP_TRIANGLE_SMALL) {
+      batch = bin->tail->arg[bin->tail->count - 1].small_batch;
+      if (batch->count < LP_RAST_SMALL_BATCH) {
+         batch->x[batch->count] = px;
+         batch->y[batch->count] = py;
+         batch->tri[batch->count] = tri;
+         batch->count++;
+         return TRUE;
+      }
+   }
+
+   batch = lp_scene_alloc(scene, sizeof *batch);
+   if (!batch)
+      return FALSE;
+
+   LP_COUNT(nr_small_batches);
+
+   batch->x[0] = px;
+   batch->y[0] = py;
+   batch->tri[0] = tri;
+   batch->count = 1;
+
+   return lp_scene_bin_cmd_with_state(scene, ix, iy,
+                                      setup->fs.stored,
+                                      LP_RAST_OP_TRIANGLE_SMALL,
+                                      lp_rast_arg_small_batch(batch));
+}
+
+
 /**
  * Do basic setup for triangle rasterization and determine which
  * framebuffer tiles are touched.  Put the triangle in the scene's
@@ -314,6 +471,14 @@ do_triangle_ccw(struct lp_setup_context *setup,
       /* Inclusive / exclusive depending upon adj (bottom-left or top-right) */
       bbox.y0 = (MIN3(position->y[0], position->y[1], position->y[2]) + adj) >> FIXED_ORDER;
       bbox.y1 = (MAX3(position->y[0], position->y[1], position->y[2]) - 1 + adj) >> FIXED_ORDER;
+
+      /* Samples lie within half a pixel of the pixel centers */
+      if (setup->multisample) {
+         bbox.x0--;
+         bbox.y0--;
+         bbox.x1++;
+         bbox.y1++;
+      }
    }
 
    if (bbox.x1 < bbox.x0 ||
@@ -329,6 +494,19 @@ do_triangle_ccw(struct lp_setup_context *setup,
       return TRUE;
    }
 
+   /* Triangles contained in a 16x16 block of a single tile, see
+    * lp_setup_bin_triangle().  This must look at the unclamped bounding
+    * box: the small triangle path evaluates the edges relative to the
+    * block in 32 bits, which overflows for vertices far off screen.
+    */
+   if (nr_planes == 3 &&
+       !setup->multisample &&
+       bbox.x0 >= 0 && bbox.y0 >= 0 &&
+       ((bbox.x0 ^ bbox.x1) | (bbox.y0 ^ bbox.y1)) < TILE_SIZE &&
+       ((bbox.x1 - (bbox.x0 & ~3)) | (bbox.y1 - (bbox.y0 & ~3))) < 16)
+      return do_triangle_small(setup, position, v0, v1, v2,
+                               frontfacing, &bbox, layer);
+
    /* Can safely discard negative regions, but need to keep hold of
     * information about when the triangle extends past screen
     * boundaries.  See trimmed_box in lp_setup_bin_triangle().
@@ -601,6 +779,33 @@ floor_pot(uint32_t n)
 }
 
 
+/**
+ * Lower the depth bound of tile (tx, ty) after binning a primitive which
+ * covers all of it.
+ */
+static void
+lp_setup_zcull_update(struct lp_setup_context *setup,
+                      const struct lp_rast_shader_inputs *inputs,
+                      int tx, int ty)
+{
+   struct lp_scene *scene = setup->scene;
+   const unsigned full_mask = (1 << scene->nr_samples) - 1;
+   struct cmd_bin *bin;
+   float zmin, zmax;
+
+   if (!scene->zcull ||
+       !(setup->fs.stored->zcull & LP_ZCULL_UPDATE) ||
+       (setup->fs.stored->sample_mask & full_mask) != full_mask)
+      return;
+
+   bin = lp_scene_get_bin(scene, tx, ty);
+   lp_rast_depth_range(inputs, tx * TILE_SIZE, ty * TILE_SIZE, TILE_SIZE,
+                       &zmin, &zmax);
+   /* The depth buffer may clamp negative values to zero */
+   bin->zmax = MIN2(bin->zmax, MAX2(zmax, 0.0f));
+}
+
+
 boolean
 lp_setup_bin_triangle( struct lp_setup_context *setup,
                        struct lp_rast_triangle *tri,
@@ -644,6 +849,19 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
       assert(iy0 == bbox->y1 / TILE_SIZE &&
 	     ix0 == bbox->x1 / TILE_SIZE);
 
+      if (lp_setup_zcull(setup, &tri->inputs, ix0, iy0,
+                         bbox->x0, bbox->y0,
+                         MAX2(bbox->x1 - bbox->x0, bbox->y1 - bbox->y0) + 1))
+         return TRUE;
+
+      if (setup->multisample) {
+         /* The small triangle rasterizers only test pixel centers */
+         return lp_scene_bin_cmd_with_state(
+            scene, ix0, iy0, setup->fs.stored,
+            lp_rast_ms_tri_tab[nr_planes],
+            lp_rast_arg_triangle(tri, (1<<nr_planes)-1));
+      }
+
       if (nr_planes == 3) {
          if (sz < 4)
          {
@@ -733,6 +951,24 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
                   plane[i].eo) << TILE_ORDER;
 
          eo[i] = plane[i].eo << TILE_ORDER;
+
+         if (setup->multisample) {
+            /* Reject tiles with no sample inside, accept tiles with all
+             * samples inside.
+             */
+            int64_t offset_min = 0, offset_max = 0;
+            unsigned s;
+
+            for (s = 0; s < LP_MAX_SAMPLES; s++) {
+               int64_t offset = lp_rast_plane_sample_offset(plane[i].dcdx,
+                                                            plane[i].dcdy, s);
+               offset_min = s ? MIN2(offset_min, offset) : offset;
+               offset_max = s ? MAX2(offset_max, offset) : offset;
+            }
+            ei[i] += offset_min;
+            eo[i] += offset_max;
+         }
+
          xstep[i] = -(((int64_t)plane[i].dcdx) << TILE_ORDER);
          ystep[i] = ((int64_t)plane[i].dcdy) << TILE_ORDER;
       }
@@ -770,18 +1006,27 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
                   break;  /* exiting triangle, all done with this row */
                LP_COUNT(nr_empty_64);
             }
+            else if (lp_setup_zcull(setup, &tri->inputs, x, y,
+                                    x * TILE_SIZE, y * TILE_SIZE,
+                                    TILE_SIZE)) {
+               /* hidden behind earlier rendering */
+               in = TRUE;
+            }
             else if (partial) {
                /* Not trivially accepted by at least one plane -
                 * rasterize/shade partial tile
                 */
                int count = util_bitcount(partial);
+               unsigned op = setup->multisample ?
+                             lp_rast_ms_tri_tab[count] :
+                             use_32bits ?
+                             lp_rast_32_tri_tab[count] :
+                             lp_rast_tri_tab[count];
                in = TRUE;
-               
+
                if (!lp_scene_bin_cmd_with_state( scene, x, y,
                                                  setup->fs.stored,
-                                                 use_32bits ?
-                                                 lp_rast_32_tri_tab[count] :
-                                                 lp_rast_tri_tab[count],
+                                                 op,
                                                  lp_rast_arg_triangle(tri, partial) ))
                   goto fail;
 
@@ -793,6 +1038,7 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
                in = TRUE;
                if (!lp_setup_whole_tile(setup, &tri->inputs, x, y))
                   goto fail;
+               lp_setup_zcull_update(setup, &tri->inputs, x, y);
             }
 
             /* Iterate cx values across the region: */
@@ -56,6 +56,7 @@
 #define LP_NEW_GS            0x10000
 #define LP_NEW_SO            0x20000
 #define LP_NEW_SO_BUFFERS    0x40000
+#define LP_NEW_TEX_CACHE_QUERY 0x80000
 
 
 
@@ -120,6 +121,9 @@ llvmpipe_init_vs_funcs(struct llvmpipe_context *llvmpipe);
 void
 llvmpipe_init_gs_funcs(struct llvmpipe_context *llvmpipe);
 
+void
+llvmpipe_init_compute_funcs(struct llvmpipe_context *llvmpipe);
+
 void
 llvmpipe_init_rasterizer_funcs(struct llvmpipe_context *llvmpipe);
 
@@ -0,0 +1,676 @@
+/**************************************************************************
+ *
+ * Copyright 2016 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * Compute shaders.
+ *
+ * Each kernel entry point is compiled into a function running all the
+ * invocations of one block, vector-width invocations at a time.  A grid is
+ * launched by handing its blocks out to the rasterizer threads, which pull
+ * them from a shared counter until none are left.
+ *
+ * Only memory resources are supported: RES[] bound as buffer surfaces, the
+ * INPUT resource and GLOBAL buffers.  Kernels using samplers, barriers or
+ * local/private memory are rejected at creation time.
+ */
+
+#include "pipe/p_defines.h"
+#include "util/u_atomic.h"
+#include "util/u_format.h"
+#include "util/u_inlines.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "os/os_time.h"
+#include "tgsi/tgsi_dump.h"
+#include "tgsi/tgsi_parse.h"
+#include "gallivm/lp_bld_arit.h"
+#include "gallivm/lp_bld_const.h"
+#include "gallivm/lp_bld_debug.h"
+#include "gallivm/lp_bld_flow.h"
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_logic.h"
+#include "gallivm/lp_bld_struct.h"
+#include "gallivm/lp_bld_tgsi.h"
+#include "gallivm/lp_bld_type.h"
+#include "lp_context.h"
+#include "lp_debug.h"
+#include "lp_fence.h"
+#include "lp_flush.h"
+#include "lp_perf.h"
+#include "lp_rast.h"
+#include "lp_screen.h"
+#include "lp_state.h"
+#include "lp_state_cs.h"
+#include "lp_texture.h"
+
+
+/**
+ * Memory resource callbacks for the TGSI translation, reading the
+ * pointers out of the lp_jit_cs_context.
+ */
+struct lp_cs_iface
+{
+   struct lp_build_tgsi_cs_iface base;
+
+   LLVMValueRef context_ptr;
+};
+
+
+static void
+cs_fetch_resource(const struct lp_build_tgsi_cs_iface *cs_iface,
+                  struct lp_build_tgsi_context *bld_base,
+                  unsigned index,
+                  LLVMValueRef *base_ptr,
+                  LLVMValueRef *size)
+{
+   const struct lp_cs_iface *iface = (const struct lp_cs_iface *)cs_iface;
+   struct gallivm_state *gallivm = bld_base->base.gallivm;
+
+   if (index == TGSI_RESOURCE_INPUT) {
+      *base_ptr = lp_jit_cs_context_input(gallivm, iface->context_ptr);
+      *size = lp_jit_cs_context_input_size(gallivm, iface->context_ptr);
+   }
+   else if (index < LP_MAX_CS_RESOURCES) {
+      LLVMValueRef idx = lp_build_const_int32(gallivm, index);
+
+      *base_ptr = lp_build_array_get(gallivm,
+                     lp_jit_cs_context_resources(gallivm, iface->context_ptr),
+                     idx);
+      *size = lp_build_array_get(gallivm,
+                 lp_jit_cs_context_resource_sizes(gallivm, iface->context_ptr),
+                 idx);
+   }
+   else {
+      /* LOCAL and PRIVATE memory: every access is out of bounds */
+      *base_ptr = LLVMConstNull(
+         LLVMPointerType(LLVMInt8TypeInContext(gallivm->context), 0));
+      *size = lp_build_const_int32(gallivm, 0);
+   }
+}
+
+
+/**
+ * Translate a GLOBAL handle, see llvmpipe_set_global_binding().
+ * The slot index always fits LP_MAX_CS_GLOBALS, unbound slots have a size
+ * of zero.
+ */
+static LLVMValueRef
+cs_global_ptr(const struct lp_build_tgsi_cs_iface *cs_iface,
+              struct lp_build_tgsi_context *bld_base,
+              LLVMValueRef address,
+              LLVMValueRef *in_bounds)
+{
+   const struct lp_cs_iface *iface = (const struct lp_cs_iface *)cs_iface;
+   struct gallivm_state *gallivm = bld_base->base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMValueRef index, offset, base, size, end;
+
+   index = LLVMBuildLShr(builder, address,
+                         lp_build_const_int32(gallivm,
+                                              LP_CS_GLOBAL_OFFSET_BITS), "");
+   offset = LLVMBuildAnd(builder, address,
+                         lp_build_const_int32(gallivm,
+                            (1 << LP_CS_GLOBAL_OFFSET_BITS) - 1), "");
+
+   base = lp_build_array_get(gallivm,
+                             lp_jit_cs_context_globals(gallivm,
+                                                       iface->context_ptr),
+                             index);
+   size = lp_build_array_get(gallivm,
+                             lp_jit_cs_context_global_sizes(gallivm,
+                                                            iface->context_ptr),
+                             index);
+
+   /* The offset has only LP_CS_GLOBAL_OFFSET_BITS, so this cannot wrap */
+   end = LLVMBuildAdd(builder, offset, lp_build_const_int32(gallivm, 4), "");
+   *in_bounds = LLVMBuildICmp(builder, LLVMIntULE, end, size, "");
+
+   return LLVMBuildGEP(builder, base, &offset, 1, "");
+}
+
+
+/**
+ * Generate the function running one block of the kernel starting at pc.
+ */
+static struct lp_compute_shader_variant *
+generate_variant(struct llvmpipe_context *lp,
+                 struct lp_compute_shader *shader,
+                 unsigned pc)
+{
+   struct lp_compute_shader_variant *variant;
+   struct gallivm_state *gallivm;
+   LLVMBuilderRef builder;
+   struct lp_type type;
+   struct lp_build_context uint_bld;
+   struct lp_bld_tgsi_system_values system_values;
+   struct lp_cs_iface iface;
+   struct lp_build_for_loop_state loop_state;
+   struct lp_build_mask_context mask;
+   LLVMValueRef outputs[PIPE_MAX_SHADER_OUTPUTS][TGSI_NUM_CHANNELS];
+   LLVMValueRef lane_offsets[LP_MAX_VECTOR_LENGTH];
+   LLVMTypeRef int32_type;
+   LLVMTypeRef arg_types[4];
+   LLVMTypeRef func_type;
+   LLVMBasicBlockRef block;
+   LLVMValueRef context_ptr, block_size_ptr, grid_size_ptr;
+   LLVMValueRef consts_ptr, num_consts_ptr;
+   LLVMValueRef num_threads;
+   char func_name[64];
+   int64_t t0 = 0, t1;
+   unsigned i;
+
+   variant = CALLOC_STRUCT(lp_compute_shader_variant);
+   if (!variant)
+      return NULL;
+
+   variant->pc = pc;
+   variant->no = shader->variants_created++;
+
+   util_snprintf(func_name, sizeof(func_name), "cs%u_variant%u",
+                 shader->no, variant->no);
+
+   variant->gallivm = gallivm = gallivm_create(func_name, lp->context);
+   if (!variant->gallivm)
+      goto fail;
+
+   builder = gallivm->builder;
+
+   if (LP_DEBUG & DEBUG_COUNTERS) {
+      t0 = os_time_get();
+   }
+
+   lp_jit_init_cs_types(variant);
+
+   int32_type = LLVMInt32TypeInContext(gallivm->context);
+   arg_types[0] = variant->jit_context_ptr_type;       /* context */
+   arg_types[1] = int32_type;                          /* block_x */
+   arg_types[2] = int32_type;                          /* block_y */
+   arg_types[3] = int32_type;                          /* block_z */
+
+   func_type = LLVMFunctionType(LLVMVoidTypeInContext(gallivm->context),
+                                arg_types, Elements(arg_types), 0);
+
+   variant->function = LLVMAddFunction(gallivm->module, func_name, func_type);
+   if (!variant->function)
+      goto fail;
+
+   LLVMSetFunctionCallConv(variant->function, LLVMCCallConv);
+   LLVMAddAttribute(LLVMGetParam(variant->function, 0), LLVMNoAliasAttribute);
+
+   context_ptr = LLVMGetParam(variant->function, 0);
+   lp_build_name(context_ptr, "context");
+
+   block = LLVMAppendBasicBlockInContext(gallivm->context,
+                                         variant->function, "entry");
+   LLVMPositionBuilderAtEnd(builder, block);
+
+   type = lp_type_float_vec(32, lp_native_vector_width);
+   lp_build_context_init(&uint_bld, gallivm, lp_uint_type(type));
+
+   memset(&system_values, 0, sizeof system_values);
+   memset(outputs, 0, sizeof outputs);
+
+   block_size_ptr = lp_jit_cs_context_block_size(gallivm, context_ptr);
+   grid_size_ptr = lp_jit_cs_context_grid_size(gallivm, context_ptr);
+   for (i = 0; i < 3; i++) {
+      LLVMValueRef idx = lp_build_const_int32(gallivm, i);
+
+      system_values.block_id[i] = LLVMGetParam(variant->function, 1 + i);
+      system_values.block_size[i] =
+         lp_build_array_get(gallivm, block_size_ptr, idx);
+      system_values.grid_size[i] =
+         lp_build_array_get(gallivm, grid_size_ptr, idx);
+   }
+
+   num_threads = LLVMBuildMul(builder, system_values.block_size[0],
+                              system_values.block_size[1], "");
+   num_threads = LLVMBuildMul(builder, num_threads,
+                              system_values.block_size[2], "num_threads");
+
+   consts_ptr = lp_jit_cs_context_constants(gallivm, context_ptr);
+   num_consts_ptr = lp_jit_cs_context_num_constants(gallivm, context_ptr);
+
+   memset(&iface, 0, sizeof iface);
+   iface.base.pc = pc;
+   iface.base.fetch_resource = cs_fetch_resource;
+   iface.base.global_ptr = cs_global_ptr;
+   iface.context_ptr = context_ptr;
+
+   for (i = 0; i < type.length; i++) {
+      lane_offsets[i] = lp_build_const_int32(gallivm, i);
+   }
+
+   /*
+    * Loop over the invocations of the block, type.length at a time, with
+    * the linear invocation index decomposed into x, y and z.
+    */
+   lp_build_for_loop_begin(&loop_state, gallivm,
+                           lp_build_const_int32(gallivm, 0),
+                           LLVMIntULT, num_threads,
+                           lp_build_const_int32(gallivm, type.length));
+   {
+      LLVMValueRef linear, size_x, size_y, tmp, mask_val;
+
+      linear = lp_build_broadcast_scalar(&uint_bld, loop_state.counter);
+      linear = LLVMBuildAdd(builder, linear,
+                            LLVMConstVector(lane_offsets, type.length), "");
+
+      size_x = lp_build_broadcast_scalar(&uint_bld,
+                                         system_values.block_size[0]);
+      size_y = lp_build_broadcast_scalar(&uint_bld,
+                                         system_values.block_size[1]);
+
+      system_values.thread_id[0] = LLVMBuildURem(builder, linear, size_x, "");
+      tmp = LLVMBuildUDiv(builder, linear, size_x, "");
+      system_values.thread_id[1] = LLVMBuildURem(builder, tmp, size_y, "");
+      system_values.thread_id[2] = LLVMBuildUDiv(builder, tmp, size_y, "");
+
+      mask_val = lp_build_cmp(&uint_bld, PIPE_FUNC_LESS, linear,
+                              lp_build_broadcast_scalar(&uint_bld,
+                                                        num_threads));
+
+      lp_build_mask_begin(&mask, gallivm, type, mask_val);
+
+      lp_build_tgsi_soa(gallivm, shader->tokens, type, &mask,
+                        consts_ptr, num_consts_ptr, &system_values,
+                        NULL, outputs, context_ptr, NULL,
+                        NULL, &shader->info, NULL, &iface.base);
+
+      lp_build_mask_end(&mask);
+   }
+   lp_build_for_loop_end(&loop_state);
+
+   LLVMBuildRetVoid(builder);
+
+   gallivm_verify_function(gallivm, variant->function);
+
+   gallivm_compile_module(gallivm);
+
+   variant->jit_function = (lp_jit_cs_func)
+      gallivm_jit_function(gallivm, variant->function);
+   if (!variant->jit_function)
+      goto fail;
+
+   gallivm_free_ir(gallivm);
+
+   if (LP_DEBUG & DEBUG_COUNTERS) {
+      t1 = os_time_get();
+      LP_COUNT_ADD(llvm_compile_time, t1 - t0);
+      LP_COUNT_ADD(nr_llvm_compiles, 1);
+   }
+
+   return variant;
+
+fail:
+   if (variant->gallivm) {
+      gallivm_destroy(variant->gallivm);
+   }
+   FREE(variant);
+   return NULL;
+}
+
+
+/**
+ * Whether the shader uses atomic operations that lp_build_tgsi_soa() cannot
+ * emit with the LLVM version we are built against.
+ */
+static boolean
+uses_unsupported_atomics(const struct tgsi_shader_info *info)
+{
+#if HAVE_LLVM < 0x0305
+   static const unsigned atomics[] = {
+      TGSI_OPCODE_ATOMUADD,
+      TGSI_OPCODE_ATOMXCHG,
+      TGSI_OPCODE_ATOMAND,
+      TGSI_OPCODE_ATOMOR,
+      TGSI_OPCODE_ATOMXOR,
+      TGSI_OPCODE_ATOMUMIN,
+      TGSI_OPCODE_ATOMUMAX,
+      TGSI_OPCODE_ATOMIMIN,
+      TGSI_OPCODE_ATOMIMAX
+   };
+   unsigned i;
+
+   for (i = 0; i < ARRAY_SIZE(atomics); i++) {
+      if (info->opcode_count[atomics[i]])
+         return TRUE;
+   }
+#endif
+#if HAVE_LLVM < 0x0309
+   if (info->opcode_count[TGSI_OPCODE_ATOMCAS])
+      return TRUE;
+#endif
+   return FALSE;
+}
+
+
+static void *
+llvmpipe_create_compute_state(struct pipe_context *pipe,
+                              const struct pipe_compute_state *templ)
+{
+   struct lp_compute_shader *shader;
+   static unsigned cs_no = 0;
+
+   shader = CALLOC_STRUCT(lp_compute_shader);
+   if (!shader)
+      return NULL;
+
+   shader->tokens = tgsi_dup_tokens(templ->prog);
+   if (!shader->tokens) {
+      FREE(shader);
+      return NULL;
+   }
+
+   shader->no = cs_no++;
+   shader->req_input_mem = templ->req_input_mem;
+
+   tgsi_scan_shader(shader->tokens, &shader->info);
+
+   if (LP_DEBUG & DEBUG_TGSI) {
+      debug_printf("llvmpipe: Create compute shader #%u %p:\n",
+                   shader->no, (void *) shader);
+      tgsi_dump(shader->tokens, 0);
+   }
+
+   if (shader->info.file_count[TGSI_FILE_SAMPLER] ||
+       shader->info.file_count[TGSI_FILE_SAMPLER_VIEW] ||
+       shader->info.opcode_count[TGSI_OPCODE_BARRIER] ||
+       templ->req_local_mem ||
+       templ->req_private_mem ||
+       templ->req_input_mem > LP_MAX_CS_INPUT_SIZE) {
+      debug_printf("llvmpipe: unsupported compute shader "
+                   "(samplers, barriers or local/private memory)\n");
+      FREE((void *) shader->tokens);
+      FREE(shader);
+      return NULL;
+   }
+
+   if (uses_unsupported_atomics(&shader->info)) {
+      debug_printf("llvmpipe: unsupported compute shader "
+                   "(atomics need a newer LLVM)\n");
+      FREE((void *) shader->tokens);
+      FREE(shader);
+      return NULL;
+   }
+
+   return shader;
+}
+
+
+static void
+llvmpipe_bind_compute_state(struct pipe_context *pipe, void *cs)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+
+   llvmpipe->cs = (struct lp_compute_shader *) cs;
+}
+
+
+static void
+llvmpipe_delete_compute_state(struct pipe_context *pipe, void *cs)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   struct lp_compute_shader *shader = (struct lp_compute_shader *) cs;
+   struct lp_compute_shader_variant *variant, *next;
+
+   if (llvmpipe->cs == shader)
+      llvmpipe->cs = NULL;
+
+   /* Grids run synchronously, so nothing can still be using the code. */
+   for (variant = shader->variants; variant; variant = next) {
+      next = variant->next;
+      gallivm_destroy(variant->gallivm);
+      FREE(variant);
+   }
+
+   FREE((void *) shader->tokens);
+   FREE(shader);
+}
+
+
+static void
+llvmpipe_set_compute_resources(struct pipe_context *pipe,
+                               unsigned start, unsigned count,
+                               struct pipe_surface **resources)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   unsigned i;
+
+   assert(start + count <= Elements(llvmpipe->cs_resources));
+
+   for (i = 0; i < count; i++) {
+      pipe_surface_reference(&llvmpipe->cs_resources[start + i],
+                             resources ? resources[i] : NULL);
+   }
+}
+
+
+/**
+ * Global buffers are addressed with 32-bit handles: the slot the buffer is
+ * bound to in the upper bits, and the byte offset into it in the lower
+ * LP_CS_GLOBAL_OFFSET_BITS.
+ */
+static void
+llvmpipe_set_global_binding(struct pipe_context *pipe,
+                            unsigned first, unsigned count,
+                            struct pipe_resource **resources,
+                            uint32_t **handles)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   unsigned i;
+
+   assert(first + count <= Elements(llvmpipe->cs_globals));
+
+   for (i = 0; i < count; i++) {
+      const unsigned slot = first + i;
+
+      pipe_resource_reference(&llvmpipe->cs_globals[slot],
+                              resources ? resources[i] : NULL);
+
+      if (resources && resources[i] && handles) {
+         assert(*handles[i] < (1 << LP_CS_GLOBAL_OFFSET_BITS));
+         *handles[i] += slot << LP_CS_GLOBAL_OFFSET_BITS;
+      }
+   }
+}
+
+
+/**
+ * A grid being run by the rasterizer threads.
+ */
+struct lp_cs_job
+{
+   lp_jit_cs_func func;
+   struct lp_jit_cs_context jit_context;
+
+   /* The grid may have up to 65535^3 blocks, more than fit in 32 bits */
+   uint64_t num_blocks;
+   int64_t next_block;
+
+   uint8_t input[LP_MAX_CS_INPUT_SIZE];
+};
+
+
+static void
+lp_cs_job_run(void *data, unsigned thread_index)
+{
+   struct lp_cs_job *job = (struct lp_cs_job *) data;
+   const struct lp_jit_cs_context *ctx = &job->jit_context;
+   const uint64_t grid_x = ctx->grid_size[0];
+   const uint64_t grid_xy = grid_x * ctx->grid_size[1];
+
+   while (1) {
+      uint64_t block = p_atomic_inc_return(&job->next_block) - 1;
+
+      if (block >= job->num_blocks)
+         break;
+
+      job->func(ctx,
+                block % grid_x,
+                (block % grid_xy) / grid_x,
+                block / grid_xy);
+   }
+}
+
+
+static struct lp_compute_shader_variant *
+lookup_variant(struct llvmpipe_context *llvmpipe,
+               struct lp_compute_shader *shader,
+               unsigned pc)
+{
+   struct lp_compute_shader_variant *variant;
+
+   for (variant = shader->variants; variant; variant = variant->next) {
+      if (variant->pc == pc)
+         return variant;
+   }
+
+   variant = generate_variant(llvmpipe, shader, pc);
+   if (variant) {
+      variant->next = shader->variants;
+      shader->variants = variant;
+   }
+
+   return variant;
+}
+
+
+static void
+llvmpipe_launch_grid(struct pipe_context *pipe,
+                     const uint *block_layout, const uint *grid_layout,
+                     uint32_t pc, const void *input)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+   struct lp_compute_shader *shader = llvmpipe->cs;
+   struct lp_compute_shader_variant *variant;
+   struct lp_jit_cs_context *ctx;
+   struct lp_cs_job *job;
+   static const float fake_const_buf[4];
+   unsigned i;
+
+   if (!shader)
+      return;
+
+   if (!block_layout[0] || !block_layout[1] || !block_layout[2] ||
+       !grid_layout[0] || !grid_layout[1] || !grid_layout[2])
+      return;
+
+   assert(block_layout[0] * block_layout[1] * block_layout[2] <=
+          LP_MAX_CS_THREADS_PER_BLOCK);
+
+   variant = lookup_variant(llvmpipe, shader, pc);
+   if (!variant)
+      return;
+
+   job = CALLOC_STRUCT(lp_cs_job);
+   if (!job)
+      return;
+
+   job->func = variant->jit_function;
+   job->num_blocks = (uint64_t) grid_layout[0] * grid_layout[1] * grid_layout[2];
+   ctx = &job->jit_context;
+
+   for (i = 0; i < LP_MAX_TGSI_CONST_BUFFERS; i++) {
+      const struct pipe_constant_buffer *cb =
+         &llvmpipe->constants[PIPE_SHADER_COMPUTE][i];
+      const ubyte *data = cb->buffer ?
+         (const ubyte *) llvmpipe_resource_data(cb->buffer) :
+         (const ubyte *) cb->user_buffer;
+
+      if (data) {
+         ctx->constants[i] = (const float *) (data + cb->buffer_offset);
+         ctx->num_constants[i] = cb->buffer_size / (sizeof(float) * 4);
+      }
+      else {
+         ctx->constants[i] = fake_const_buf;
+         ctx->num_constants[i] = 0;
+      }
+   }
+
+   /* Unbound and texture resources are left with a size of zero, which
+    * makes every access to them out of bounds.
+    */
+   for (i = 0; i < LP_MAX_CS_RESOURCES; i++) {
+      struct pipe_surface *surf = llvmpipe->cs_resources[i];
+
+      if (surf && !llvmpipe_resource_is_texture(surf->texture)) {
+         const unsigned bpp = util_format_get_blocksize(surf->format);
+
+         ctx->resources[i] =
+            (uint8_t *) llvmpipe_resource_data(surf->texture) +
+            surf->u.buf.first_element * bpp;
+         ctx->resource_sizes[i] =
+            (surf->u.buf.last_element - surf->u.buf.first_element + 1) * bpp;
+      }
+   }
+
+   for (i = 0; i < LP_MAX_CS_GLOBALS; i++) {
+      if (llvmpipe->cs_globals[i]) {
+         ctx->globals[i] =
+            (uint8_t *) llvmpipe_resource_data(llvmpipe->cs_globals[i]);
+         ctx->global_sizes[i] = llvmpipe->cs_globals[i]->width0;
+      }
+   }
+
+   if (input && shader->req_input_mem) {
+      memcpy(job->input, input, shader->req_input_mem);
+      ctx->input_size = shader->req_input_mem;
+   }
+   ctx->input = job->input;
+
+   for (i = 0; i < 3; i++) {
+      ctx->block_size[i] = block_layout[i];
+      ctx->grid_size[i] = grid_layout[i];
+   }
+
+   /* Make any pending rendering land in the resources first, then keep
+    * the rasterizer threads to ourselves until the whole grid is done.
+    */
+   llvmpipe_flush(pipe, NULL, __FUNCTION__);
+
+   pipe_mutex_lock(screen->rast_mutex);
+   if (screen->last_fence) {
+      lp_fence_wait(screen->last_fence);
+   }
+   lp_rast_run_job(screen->rast, lp_cs_job_run, job);
+   pipe_mutex_unlock(screen->rast_mutex);
+
+   FREE(job);
+}
+
+
+void
+llvmpipe_init_compute_funcs(struct llvmpipe_context *llvmpipe)
+{
+   llvmpipe->pipe.create_compute_state = llvmpipe_create_compute_state;
+   llvmpipe->pipe.bind_compute_state = llvmpipe_bind_compute_state;
+   llvmpipe->pipe.delete_compute_state = llvmpipe_delete_compute_state;
+   llvmpipe->pipe.set_compute_resources = llvmpipe_set_compute_resources;
+   llvmpipe->pipe.set_global_binding = llvmpipe_set_global_binding;
+   llvmpipe->pipe.launch_grid = llvmpipe_launch_grid;
+}
@@ -0,0 +1,84 @@
+/**************************************************************************
+ *
+ * Copyright 2016 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#ifndef LP_STATE_CS_H_
+#define LP_STATE_CS_H_
+
+
+#include "pipe/p_compiler.h"
+#include "pipe/p_state.h"
+#include "tgsi/tgsi_scan.h" /* for tgsi_shader_info */
+#include "gallivm/lp_bld.h"
+#include "lp_jit.h"
+
+
+struct tgsi_token;
+struct lp_compute_shader;
+
+
+/**
+ * A compute shader compiled for one entry point.
+ *
+ * TGSI compute programs may hold several kernels, each one being a
+ * subroutine selected by the pc passed to launch_grid, so variants are
+ * keyed by that pc alone.
+ */
+struct lp_compute_shader_variant
+{
+   unsigned pc;
+
+   struct gallivm_state *gallivm;
+
+   LLVMTypeRef jit_context_ptr_type;
+
+   LLVMValueRef function;
+
+   /** Runs all the invocations of one block */
+   lp_jit_cs_func jit_function;
+
+   struct lp_compute_shader_variant *next;
+
+   unsigned no;
+};
+
+
+/** Subclass of pipe_compute_state */
+struct lp_compute_shader
+{
+   const struct tgsi_token *tokens;
+   struct tgsi_shader_info info;
+
+   unsigned req_input_mem;
+
+   struct lp_compute_shader_variant *variants;
+   unsigned variants_created;
+
+   unsigned no;
+};
+
+
+#endif /* LP_STATE_CS_H_ */
@@ -25,6 +25,7 @@
  * 
  **************************************************************************/
 
+#include "util/u_framebuffer.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "pipe/p_shader_tokens.h"
@@ -182,15 +183,24 @@ void llvmpipe_update_derived( struct llvmpipe_context *llvmpipe )
                           LP_NEW_RASTERIZER |
                           LP_NEW_SAMPLER |
                           LP_NEW_SAMPLER_VIEW |
-                          LP_NEW_OCCLUSION_QUERY))
+                          LP_NEW_OCCLUSION_QUERY |
+                          LP_NEW_TEX_CACHE_QUERY))
       llvmpipe_update_fs( llvmpipe );
 
-   if (llvmpipe->dirty & (LP_NEW_RASTERIZER)) {
+   if (llvmpipe->dirty & (LP_NEW_RASTERIZER |
+                          LP_NEW_FRAMEBUFFER)) {
+      unsigned nr_samples =
+         util_framebuffer_get_num_samples(&llvmpipe->framebuffer);
+      unsigned sample_mask =
+         llvmpipe->sample_mask & ((1 << nr_samples) - 1);
+      boolean multisample = nr_samples > 1 &&
+         (llvmpipe->rasterizer ? llvmpipe->rasterizer->multisample : FALSE);
       boolean discard =
-         (llvmpipe->sample_mask & 1) == 0 ||
+         sample_mask == 0 ||
          (llvmpipe->rasterizer ? llvmpipe->rasterizer->rasterizer_discard : FALSE);
 
       lp_setup_set_rasterizer_discard(llvmpipe->setup, discard);
+      lp_setup_set_multisample(llvmpipe->setup, multisample, sample_mask);
    }
 
    if (llvmpipe->dirty & (LP_NEW_FS |
@@ -63,10 +63,15 @@
 #include "util/u_memory.h"
 #include "util/u_pointer.h"
 #include "util/u_format.h"
+#include "util/u_framebuffer.h"
 #include "util/u_dump.h"
 #include "util/u_string.h"
 #include "util/simple_list.h"
 #include "util/u_dual_blend.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_hash.h"
+#include "util/u_hash_table.h"
+#include "os/os_thread.h"
 #include "os/os_time.h"
 #include "pipe/p_shader_tokens.h"
 #include "draw/draw_context.h"
@@ -101,18 +106,32 @@
 #include "lp_flush.h"
 #include "lp_state_fs.h"
 #include "lp_rast.h"
+#include "lp_screen.h"
 
 
 /** Fragment shader number (for debugging) */
 static unsigned fs_no = 0;
 
+/**
+ * Default vector width (in bits) of the generated fragment shader code.
+ * 0 picks 512 bits (a whole 4x4 stamp per vector) on AVX-512 capable
+ * CPUs, and the native vector width elsewhere.
+ */
+#ifndef LP_FS_VECTOR_WIDTH
+#define LP_FS_VECTOR_WIDTH 0
+#endif
+
+/** Vector width (in bits) of the generated fragment shader code */
+static unsigned fs_vector_width = 0;
+
 
 /**
  * Expand the relevant bits of mask_input to a n*4-dword mask for the
  * n*four pixels in n 2x2 quads.  This will set the n*four elements of the
  * quad mask vector to 0 or ~0.
  * Grouping is 01, 23 for 2 quad mode hence only 0 and 2 are valid
- * quad arguments with fs length 8.
+ * quad arguments with fs length 8, and 0123 for 4 quad mode (fs length 16)
+ * which only takes quad argument 0.
  *
  * \param first_quad  which quad(s) of the quad group to test, in [0,3]
  * \param mask_input  bitwise mask for the whole 4x4 stamp
@@ -238,8 +257,116 @@ lp_llvm_viewport(LLVMValueRef context_ptr,
 }
 
 
+/**
+ * Multisampling: test depth/stencil at each sample of the pixels still
+ * alive in 'mask', and reduce 'mask' to the pixels with a sample left.
+ *
+ * The per-sample coverage masks (num_loop masks per sample) in
+ * sample_mask_store are updated in place.  Samples of a pixel share the
+ * shader results; only depth is evaluated at the sample positions.
+ */
+static void
+generate_sample_depth_test(struct gallivm_state *gallivm,
+                           const struct lp_fragment_shader_variant_key *key,
+                           struct lp_type type,
+                           const struct util_format_description *zs_format_desc,
+                           unsigned depth_mode,
+                           struct lp_build_mask_context *mask,
+                           LLVMValueRef sample_mask_store,
+                           LLVMValueRef num_loop,
+                           LLVMValueRef loop_counter,
+                           LLVMValueRef *stencil_refs,
+                           LLVMValueRef z,
+                           boolean z_per_sample,
+                           LLVMValueRef dzdx,
+                           LLVMValueRef dzdy,
+                           LLVMValueRef facing,
+                           LLVMValueRef depth_ptr,
+                           LLVMValueRef depth_stride,
+                           LLVMValueRef depth_sample_stride)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_build_context f32_bld;
+   LLVMValueRef pixel_mask = lp_build_mask_value(mask);
+   LLVMValueRef covered = lp_build_zero(gallivm, lp_int_type(type));
+   unsigned s;
+
+   lp_build_context_init(&f32_bld, gallivm, type);
+
+   for (s = 0; s < LP_MAX_SAMPLES; s++) {
+      LLVMValueRef index, sample_mask_ptr, sample_mask;
+
+      index = LLVMBuildMul(builder, num_loop,
+                           lp_build_const_int32(gallivm, s), "");
+      index = LLVMBuildAdd(builder, index, loop_counter, "");
+      sample_mask_ptr = LLVMBuildGEP(builder, sample_mask_store,
+                                     &index, 1, "sample_mask_ptr");
+      sample_mask = LLVMBuildLoad(builder, sample_mask_ptr, "");
+      sample_mask = LLVMBuildAnd(builder, sample_mask, pixel_mask, "");
+
+      if (depth_mode & LATE_DEPTH_TEST) {
+         struct lp_build_mask_context sample_mask_ctx;
+         LLVMValueRef offset, sample_depth_ptr;
+         LLVMValueRef z_sample = z;
+         LLVMValueRef z_fb, s_fb, z_value, s_value;
+
+         if (z_per_sample) {
+            LLVMValueRef ox = lp_build_const_vec(gallivm, type,
+                  (double)lp_sample_pos[s][0] / LP_SAMPLE_POS_ONE);
+            LLVMValueRef oy = lp_build_const_vec(gallivm, type,
+                  (double)lp_sample_pos[s][1] / LP_SAMPLE_POS_ONE);
+            z_sample = lp_build_add(&f32_bld, z_sample,
+                                    lp_build_mul(&f32_bld, dzdx, ox));
+            z_sample = lp_build_add(&f32_bld, z_sample,
+                                    lp_build_mul(&f32_bld, dzdy, oy));
+         }
+
+         offset = LLVMBuildMul(builder, depth_sample_stride,
+                               lp_build_const_int32(gallivm, s), "");
+         sample_depth_ptr = LLVMBuildGEP(builder, depth_ptr, &offset, 1, "");
+
+         lp_build_mask_begin(&sample_mask_ctx, gallivm, type, sample_mask);
+
+         lp_build_depth_stencil_load_swizzled(gallivm, type,
+                                              zs_format_desc, key->resource_1d,
+                                              sample_depth_ptr, depth_stride,
+                                              &z_fb, &s_fb, loop_counter);
+         lp_build_depth_stencil_test(gallivm,
+                                     &key->depth,
+                                     key->stencil,
+                                     type,
+                                     zs_format_desc,
+                                     &sample_mask_ctx,
+                                     stencil_refs,
+                                     z_sample, z_fb, s_fb,
+                                     facing,
+                                     &z_value, &s_value,
+                                     FALSE);
+         if (depth_mode & LATE_DEPTH_WRITE) {
+            lp_build_depth_stencil_write_swizzled(gallivm, type,
+                                                  zs_format_desc, key->resource_1d,
+                                                  NULL, NULL, NULL, loop_counter,
+                                                  sample_depth_ptr, depth_stride,
+                                                  z_value, s_value);
+         }
+
+         sample_mask = lp_build_mask_end(&sample_mask_ctx);
+      }
+
+      LLVMBuildStore(builder, sample_mask, sample_mask_ptr);
+      covered = LLVMBuildOr(builder, covered, sample_mask, "");
+   }
+
+   lp_build_mask_update(mask, covered);
+}
+
+
 /**
  * Generate the fragment shader, depth/stencil test, and alpha tests.
+ *
+ * For multisampled variants sample_mask_store holds the coverage of each
+ * sample, which is updated with the depth/stencil test and the final pixel
+ * mask.
  */
 static void
 generate_fs_loop(struct gallivm_state *gallivm,
@@ -256,7 +383,11 @@ generate_fs_loop(struct gallivm_state *gallivm,
                  LLVMValueRef depth_ptr,
                  LLVMValueRef depth_stride,
                  LLVMValueRef facing,
-                 LLVMValueRef thread_data_ptr)
+                 LLVMValueRef thread_data_ptr,
+                 LLVMValueRef sample_mask_store,
+                 LLVMValueRef depth_sample_stride,
+                 LLVMValueRef dzdx,
+                 LLVMValueRef dzdy)
 {
    const struct util_format_description *zs_format_desc = NULL;
    const struct tgsi_token *tokens = shader->base.tokens;
@@ -325,6 +456,13 @@ generate_fs_loop(struct gallivm_state *gallivm,
                                         (key->stencil[1].enabled &&
                                          key->stencil[1].writemask))))
          depth_mode &= ~(LATE_DEPTH_WRITE | EARLY_DEPTH_WRITE);
+
+      /* Samples are tested once the final pixel mask is known */
+      if (key->multisample) {
+         depth_mode = LATE_DEPTH_TEST |
+            (depth_mode & (EARLY_DEPTH_WRITE | LATE_DEPTH_WRITE) ?
+             LATE_DEPTH_WRITE : 0);
+      }
    }
    else {
       depth_mode = 0;
@@ -422,7 +560,7 @@ generate_fs_loop(struct gallivm_state *gallivm,
                      consts_ptr, num_consts_ptr, &system_values,
                      interp->inputs,
                      outputs, context_ptr, thread_data_ptr,
-                     sampler, &shader->info.base, NULL);
+                     sampler, &shader->info.base, NULL, NULL);
 
    /* Alpha test */
    if (key->alpha.enabled) {
@@ -527,31 +665,46 @@ generate_fs_loop(struct gallivm_state *gallivm,
          stencil_refs[1] = stencil_refs[0];
       }
 
-      lp_build_depth_stencil_load_swizzled(gallivm, type,
-                                           zs_format_desc, key->resource_1d,
-                                           depth_ptr, depth_stride,
-                                           &z_fb, &s_fb, loop_state.counter);
-
-      lp_build_depth_stencil_test(gallivm,
-                                  &key->depth,
-                                  key->stencil,
-                                  type,
-                                  zs_format_desc,
-                                  &mask,
-                                  stencil_refs,
-                                  z, z_fb, s_fb,
-                                  facing,
-                                  &z_value, &s_value,
-                                  !simple_shader);
-      /* Late Z write */
-      if (depth_mode & LATE_DEPTH_WRITE) {
-         lp_build_depth_stencil_write_swizzled(gallivm, type,
-                                               zs_format_desc, key->resource_1d,
-                                               NULL, NULL, NULL, loop_state.counter,
-                                               depth_ptr, depth_stride,
-                                               z_value, s_value);
+      if (key->multisample) {
+         generate_sample_depth_test(gallivm, key, type, zs_format_desc,
+                                    depth_mode, &mask,
+                                    sample_mask_store, num_loop,
+                                    loop_state.counter,
+                                    stencil_refs,
+                                    z, !(pos0 != -1 && outputs[pos0][2]),
+                                    dzdx, dzdy,
+                                    facing,
+                                    depth_ptr, depth_stride,
+                                    depth_sample_stride);
+      }
+      else {
+         lp_build_depth_stencil_load_swizzled(gallivm, type,
+                                              zs_format_desc, key->resource_1d,
+                                              depth_ptr, depth_stride,
+                                              &z_fb, &s_fb, loop_state.counter);
+
+         lp_build_depth_stencil_test(gallivm,
+                                     &key->depth,
+                                     key->stencil,
+                                     type,
+                                     zs_format_desc,
+                                     &mask,
+                                     stencil_refs,
+                                     z, z_fb, s_fb,
+                                     facing,
+                                     &z_value, &s_value,
+                                     !simple_shader);
+         /* Late Z write */
+         if (depth_mode & LATE_DEPTH_WRITE) {
+            lp_build_depth_stencil_write_swizzled(gallivm, type,
+                                                  zs_format_desc, key->resource_1d,
+                                                  NULL, NULL, NULL, loop_state.counter,
+                                                  depth_ptr, depth_stride,
+                                                  z_value, s_value);
+         }
       }
    }
+
    else if ((depth_mode & EARLY_DEPTH_TEST) &&
             (depth_mode & LATE_DEPTH_WRITE))
    {
@@ -593,12 +746,43 @@ generate_fs_loop(struct gallivm_state *gallivm,
    if (key->occlusion_count) {
       LLVMValueRef counter = lp_jit_thread_data_counter(gallivm, thread_data_ptr);
       lp_build_name(counter, "counter");
-      lp_build_occlusion_count(gallivm, type,
-                               lp_build_mask_value(&mask), counter);
+      if (!key->multisample) {
+         lp_build_occlusion_count(gallivm, type,
+                                  lp_build_mask_value(&mask), counter);
+      }
    }
 
    mask_val = lp_build_mask_end(&mask);
    LLVMBuildStore(builder, mask_val, mask_ptr);
+
+   /*
+    * Apply the final pixel mask to the samples.  This is done after the
+    * mask context ended since the code above is skipped once no pixel is
+    * left.
+    */
+   if (key->multisample) {
+      unsigned s;
+
+      for (s = 0; s < LP_MAX_SAMPLES; s++) {
+         LLVMValueRef index, sample_mask_ptr, sample_mask;
+
+         index = LLVMBuildMul(builder, num_loop,
+                              lp_build_const_int32(gallivm, s), "");
+         index = LLVMBuildAdd(builder, index, loop_state.counter, "");
+         sample_mask_ptr = LLVMBuildGEP(builder, sample_mask_store,
+                                        &index, 1, "");
+         sample_mask = LLVMBuildLoad(builder, sample_mask_ptr, "");
+         sample_mask = LLVMBuildAnd(builder, sample_mask, mask_val, "");
+         LLVMBuildStore(builder, sample_mask, sample_mask_ptr);
+
+         if (key->occlusion_count) {
+            LLVMValueRef counter =
+               lp_jit_thread_data_counter(gallivm, thread_data_ptr);
+            lp_build_occlusion_count(gallivm, type, sample_mask, counter);
+         }
+      }
+   }
+
    lp_build_for_loop_end(&loop_state);
 }
 
@@ -2153,15 +2337,245 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
 }
 
 
+/**
+ * Whether to generate the fused rasterizer and shader function for small
+ * triangles (RAST_TRI_16) of a variant.
+ *
+ * Only worth it for variants which don't read the color buffer or which
+ * can reject fragments with an early depth test, and not in the quick
+ * unoptimized compile, which exists to keep the first draw fast; the
+ * rasterizer falls back to the per 4x4 block shader without it.
+ */
+static boolean
+use_fused_tri16(const struct lp_fragment_shader *shader,
+                const struct lp_fragment_shader_variant *variant)
+{
+   const struct lp_fragment_shader_variant_key *key = &variant->key;
+   const boolean early_depth =
+         key->depth.enabled &&
+         !shader->info.base.writes_z &&
+         !shader->info.base.writes_stencil &&
+         !shader->info.base.uses_kill &&
+         !key->alpha.enabled &&
+         !key->blend.alpha_to_coverage;
+
+   return !(LP_PERF & PERF_NO_FUSED_TRI) &&
+          !variant->gallivm->no_opt &&
+          (variant->opaque || early_depth) &&
+          !key->multisample &&
+          !key->resource_1d &&
+          key->nr_cbufs <= 1;
+}
+
+
+/**
+ * Loop over the 4x4 blocks of the 16x16 block of a fused triangle function.
+ */
+struct tri16_loop_state
+{
+   struct lp_build_for_loop_state loop;
+   struct lp_build_if_state ifthen;
+   LLVMValueRef count_var;   /**< number of blocks shaded */
+};
+
+
+/**
+ * Offset in bytes of the 4x4 block at ix, iy (in pixels) of a buffer.
+ */
+static LLVMValueRef
+tri16_block_offset(struct gallivm_state *gallivm,
+                   LLVMValueRef ix, LLVMValueRef iy,
+                   enum pipe_format format,
+                   LLVMValueRef stride)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMValueRef bytes =
+      lp_build_const_int32(gallivm, util_format_get_blocksize(format));
+
+   return LLVMBuildAdd(builder,
+                       LLVMBuildMul(builder, ix, bytes, ""),
+                       LLVMBuildMul(builder, iy, stride, ""),
+                       "block_offset");
+}
+
+
+/**
+ * Begin the loop over the 4x4 blocks of a fused triangle function.
+ *
+ * The three edge functions are evaluated at the pixels of each block, the
+ * same way as lp_rast_triangle_32_3_16() does.  The code which follows
+ * runs for each block with any pixel covered, with x, y, color_ptr_ptr and
+ * depth_ptr moved to the block and mask set to its coverage, so the shader
+ * and blending code is emitted unchanged inside the loop.
+ */
+static void
+begin_tri16_loop(struct gallivm_state *gallivm,
+                 const struct lp_fragment_shader_variant_key *key,
+                 struct tri16_loop_state *state,
+                 LLVMValueRef planes_ptr,
+                 LLVMValueRef block_mask,
+                 LLVMValueRef stride_ptr,
+                 LLVMValueRef depth_stride,
+                 LLVMValueRef *x,
+                 LLVMValueRef *y,
+                 LLVMValueRef *color_ptr_ptr,
+                 LLVMValueRef *depth_ptr,
+                 LLVMValueRef *mask)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef int32_type = LLVMInt32TypeInContext(gallivm->context);
+   LLVMTypeRef int8_ptr_type =
+      LLVMPointerType(LLVMInt8TypeInContext(gallivm->context), 0);
+   LLVMTypeRef color_ptr_type = LLVMGetElementType(LLVMTypeOf(*color_ptr_ptr));
+   LLVMValueRef zero = lp_build_const_int32(gallivm, 0);
+   LLVMValueRef one = lp_build_const_int32(gallivm, 1);
+   struct lp_build_context bld;
+   LLVMValueRef px[16], py[16];
+   LLVMValueRef dcdx[3], dcdy[3], c[3], step[3];
+   LLVMValueRef block, ix, iy, outside, covered, enabled, color_ptrs;
+   unsigned i, cbuf;
+
+   lp_build_context_init(&bld, gallivm, lp_type_int_vec(32, 32 * 16));
+
+   /* Pixel positions within a 4x4 block, in the order of the mask bits */
+   for (i = 0; i < 16; i++) {
+      px[i] = lp_build_const_int32(gallivm, i & 3);
+      py[i] = lp_build_const_int32(gallivm, i >> 2);
+   }
+
+   for (i = 0; i < 3; i++) {
+      c[i] = lp_build_pointer_get(builder, planes_ptr,
+                                  lp_build_const_int32(gallivm, 3 * i));
+      dcdx[i] = lp_build_pointer_get(builder, planes_ptr,
+                                     lp_build_const_int32(gallivm, 3 * i + 1));
+      dcdy[i] = lp_build_pointer_get(builder, planes_ptr,
+                                     lp_build_const_int32(gallivm, 3 * i + 2));
+
+      /* c - 1 < 0 is c <= 0, so the sign bit tells whether a pixel is out */
+      c[i] = LLVMBuildSub(builder, c[i], one, "");
+
+      step[i] = LLVMBuildSub(builder,
+                             LLVMBuildMul(builder,
+                                          lp_build_broadcast_scalar(&bld, dcdy[i]),
+                                          LLVMConstVector(py, 16), ""),
+                             LLVMBuildMul(builder,
+                                          lp_build_broadcast_scalar(&bld, dcdx[i]),
+                                          LLVMConstVector(px, 16), ""),
+                             "");
+   }
+
+   state->count_var = lp_build_alloca(gallivm, int32_type, "count");
+
+   lp_build_for_loop_begin(&state->loop, gallivm, zero, LLVMIntULT,
+                           lp_build_const_int32(gallivm, 16), one);
+
+   block = state->loop.counter;
+   ix = LLVMBuildShl(builder,
+                     LLVMBuildAnd(builder, block,
+                                  lp_build_const_int32(gallivm, 3), ""),
+                     lp_build_const_int32(gallivm, 2), "ix");
+   iy = LLVMBuildShl(builder,
+                     LLVMBuildLShr(builder, block,
+                                   lp_build_const_int32(gallivm, 2), ""),
+                     lp_build_const_int32(gallivm, 2), "iy");
+
+   outside = bld.zero;
+   for (i = 0; i < 3; i++) {
+      LLVMValueRef cb;
+
+      cb = LLVMBuildSub(builder, c[i],
+                        LLVMBuildMul(builder, dcdx[i], ix, ""), "");
+      cb = LLVMBuildAdd(builder, cb,
+                        LLVMBuildMul(builder, dcdy[i], iy, ""), "");
+      outside = LLVMBuildOr(builder, outside,
+                            LLVMBuildAdd(builder,
+                                         lp_build_broadcast_scalar(&bld, cb),
+                                         step[i], ""),
+                            "");
+   }
+
+   covered = LLVMBuildICmp(builder, LLVMIntSGE, outside, bld.zero, "");
+   covered = LLVMBuildBitCast(builder, covered,
+                              LLVMInt16TypeInContext(gallivm->context), "");
+   covered = LLVMBuildZExt(builder, covered, int32_type, "");
+
+   /* Blocks outside the tile */
+   enabled = LLVMBuildAnd(builder,
+                          LLVMBuildLShr(builder, block_mask, block, ""),
+                          one, "");
+   covered = LLVMBuildSelect(builder,
+                             LLVMBuildICmp(builder, LLVMIntNE, enabled, zero, ""),
+                             covered, zero, "covered");
+
+   lp_build_if(&state->ifthen, gallivm,
+               LLVMBuildICmp(builder, LLVMIntNE, covered, zero, ""));
+
+   *x = LLVMBuildAdd(builder, *x, ix, "");
+   *y = LLVMBuildAdd(builder, *y, iy, "");
+   *mask = covered;
+
+   color_ptrs = lp_build_array_alloca(gallivm, color_ptr_type,
+                                      lp_build_const_int32(gallivm,
+                                                           PIPE_MAX_COLOR_BUFS),
+                                      "block_color_ptrs");
+   for (cbuf = 0; cbuf < key->nr_cbufs; cbuf++) {
+      if (key->cbuf_format[cbuf] != PIPE_FORMAT_NONE) {
+         LLVMValueRef index = lp_build_const_int32(gallivm, cbuf);
+         LLVMValueRef stride = lp_build_pointer_get(builder, stride_ptr, index);
+         LLVMValueRef offset = tri16_block_offset(gallivm, ix, iy,
+                                                  key->cbuf_format[cbuf],
+                                                  stride);
+         LLVMValueRef ptr = lp_build_pointer_get(builder, *color_ptr_ptr, index);
+
+         ptr = LLVMBuildBitCast(builder, ptr, int8_ptr_type, "");
+         ptr = LLVMBuildGEP(builder, ptr, &offset, 1, "");
+         ptr = LLVMBuildBitCast(builder, ptr, color_ptr_type, "");
+         lp_build_pointer_set(builder, color_ptrs, index, ptr);
+      }
+   }
+   *color_ptr_ptr = color_ptrs;
+
+   if (key->zsbuf_format != PIPE_FORMAT_NONE) {
+      LLVMValueRef offset = tri16_block_offset(gallivm, ix, iy,
+                                               key->zsbuf_format,
+                                               depth_stride);
+      *depth_ptr = LLVMBuildGEP(builder, *depth_ptr, &offset, 1, "");
+   }
+
+   LLVMBuildStore(builder,
+                  LLVMBuildAdd(builder,
+                               LLVMBuildLoad(builder, state->count_var, ""),
+                               one, ""),
+                  state->count_var);
+}
+
+
+/**
+ * End the loop of a fused triangle function.
+ * \return the number of blocks shaded
+ */
+static LLVMValueRef
+end_tri16_loop(struct gallivm_state *gallivm,
+               struct tri16_loop_state *state)
+{
+   lp_build_endif(&state->ifthen);
+   lp_build_for_loop_end(&state->loop);
+
+   return LLVMBuildLoad(gallivm->builder, state->count_var, "count");
+}
+
+
 /**
  * Generate the runtime callable function for the whole fragment pipeline.
  * Note that the function which we generate operates on a block of 16
  * pixels at at time.  The block contains 2x2 quads.  Each quad contains
  * 2x2 pixels.
+ *
+ * With partial_mask == RAST_TRI_16 the function instead loops over the
+ * 4x4 blocks covered by a small triangle, see begin_tri16_loop().
  */
 static void
-generate_fragment(struct llvmpipe_context *lp,
-                  struct lp_fragment_shader *shader,
+generate_fragment(struct lp_fragment_shader *shader,
                   struct lp_fragment_shader_variant *variant,
                   unsigned partial_mask)
 {
@@ -2170,10 +2584,11 @@ generate_fragment(struct llvmpipe_context *lp,
    struct lp_shader_input inputs[PIPE_MAX_SHADER_INPUTS];
    char func_name[64];
    struct lp_type fs_type;
+   struct lp_type blend_fs_type;
    struct lp_type blend_type;
    LLVMTypeRef fs_elem_type;
    LLVMTypeRef blend_vec_type;
-   LLVMTypeRef arg_types[13];
+   LLVMTypeRef arg_types[14];
    LLVMTypeRef func_type;
    LLVMTypeRef int32_type = LLVMInt32TypeInContext(gallivm->context);
    LLVMTypeRef int8_type = LLVMInt8TypeInContext(gallivm->context);
@@ -2190,20 +2605,25 @@ generate_fragment(struct llvmpipe_context *lp,
    LLVMValueRef mask_input;
    LLVMValueRef thread_data_ptr;
    LLVMBasicBlockRef block;
+   struct tri16_loop_state tri16;
    LLVMBuilderRef builder;
    struct lp_build_sampler_soa *sampler;
    struct lp_build_interp_soa_context interp;
    LLVMValueRef fs_mask[16 / 4];
+   LLVMValueRef fs_sample_mask[LP_MAX_SAMPLES][16 / 4];
    LLVMValueRef fs_out_color[PIPE_MAX_COLOR_BUFS][TGSI_NUM_CHANNELS][16 / 4];
    LLVMValueRef function;
    LLVMValueRef facing;
    unsigned num_fs;
+   unsigned blend_num_fs;
    unsigned i;
    unsigned chan;
    unsigned cbuf;
    boolean cbuf0_write_all;
    const boolean dual_source_blend = key->blend.rt[0].blend_enable &&
                                      util_blend_state_is_dual(&key->blend, 0);
+   const boolean fused = partial_mask == RAST_TRI_16;
+   unsigned num_args = fused ? 14 : 13;
 
    assert(lp_native_vector_width / 32 >= 4);
 
@@ -2231,7 +2651,17 @@ generate_fragment(struct llvmpipe_context *lp,
    fs_type.sign = TRUE;          /* values are signed */
    fs_type.norm = FALSE;         /* values are not limited to [0,1] or [-1,1] */
    fs_type.width = 32;           /* 32-bit float */
-   fs_type.length = MIN2(lp_native_vector_width / 32, 16); /* n*4 elements per vector */
+   fs_type.length = MIN2(fs_vector_width / 32, 16); /* n*4 elements per vector */
+   /* 1d resources only have the upper half of the stamp */
+   if (key->resource_1d)
+      fs_type.length = MIN2(fs_type.length, 8);
+
+   /*
+    * Blending works on at most native vectors; wider shader outputs are
+    * split into several of these.
+    */
+   blend_fs_type = fs_type;
+   blend_fs_type.length = MIN2(lp_native_vector_width / 32, fs_type.length);
 
    memset(&blend_type, 0, sizeof blend_type);
    blend_type.floating = FALSE; /* values are integers */
@@ -2250,7 +2680,8 @@ generate_fragment(struct llvmpipe_context *lp,
    blend_vec_type = lp_build_vec_type(gallivm, blend_type);
 
    util_snprintf(func_name, sizeof(func_name), "fs%u_variant%u_%s",
-                 shader->no, variant->no, partial_mask ? "partial" : "whole");
+                 shader->no, variant->no,
+                 fused ? "tri16" : partial_mask ? "partial" : "whole");
 
    arg_types[0] = variant->jit_context_ptr_type;       /* context */
    arg_types[1] = int32_type;                          /* x */
@@ -2265,9 +2696,11 @@ generate_fragment(struct llvmpipe_context *lp,
    arg_types[10] = variant->jit_thread_data_ptr_type;  /* per thread data */
    arg_types[11] = LLVMPointerType(int32_type, 0);     /* stride */
    arg_types[12] = int32_type;                         /* depth_stride */
+   arg_types[13] = LLVMPointerType(int32_type, 0);     /* planes (tri16) */
 
-   func_type = LLVMFunctionType(LLVMVoidTypeInContext(gallivm->context),
-                                arg_types, Elements(arg_types), 0);
+   func_type = LLVMFunctionType(fused ? int32_type :
+                                LLVMVoidTypeInContext(gallivm->context),
+                                arg_types, num_args, 0);
 
    function = LLVMAddFunction(gallivm->module, func_name, func_type);
    LLVMSetFunctionCallConv(function, LLVMCCallConv);
@@ -2277,7 +2710,7 @@ generate_fragment(struct llvmpipe_context *lp,
    /* XXX: need to propagate noalias down into color param now we are
     * passing a pointer-to-pointer?
     */
-   for(i = 0; i < Elements(arg_types); ++i)
+   for(i = 0; i < num_args; ++i)
       if(LLVMGetTypeKind(arg_types[i]) == LLVMPointerTypeKind)
          LLVMAddAttribute(LLVMGetParam(function, i), LLVMNoAliasAttribute);
 
@@ -2317,6 +2750,15 @@ generate_fragment(struct llvmpipe_context *lp,
    assert(builder);
    LLVMPositionBuilderAtEnd(builder, block);
 
+   if (fused) {
+      LLVMValueRef planes_ptr = LLVMGetParam(function, 13);
+      lp_build_name(planes_ptr, "planes");
+
+      begin_tri16_loop(gallivm, key, &tri16, planes_ptr, mask_input,
+                       stride_ptr, depth_stride, &x, &y,
+                       &color_ptr_ptr, &depth_ptr, &mask_input);
+   }
+
    /* code generated texture sampling */
    sampler = lp_llvm_sampler_soa_create(key->state);
 
@@ -2324,13 +2766,17 @@ generate_fragment(struct llvmpipe_context *lp,
    /* for 1d resources only run "upper half" of stamp */
    if (key->resource_1d)
       num_fs /= 2;
+   blend_num_fs = num_fs * fs_type.length / blend_fs_type.length;
 
    {
       LLVMValueRef num_loop = lp_build_const_int32(gallivm, num_fs);
       LLVMTypeRef mask_type = lp_build_int_vec_type(gallivm, fs_type);
       LLVMValueRef mask_store = lp_build_array_alloca(gallivm, mask_type,
                                                       num_loop, "mask_store");
-      LLVMValueRef color_store[PIPE_MAX_COLOR_BUFS][TGSI_NUM_CHANNELS];
+      LLVMValueRef color_store[PIPE_MAX_COLOR_BUFS][TGSI_NUM_CHANNELS] = { { 0 } };
+      LLVMValueRef sample_mask_store = NULL;
+      LLVMValueRef depth_sample_stride = NULL;
+      LLVMValueRef dzdx = NULL, dzdy = NULL;
       boolean pixel_center_integer =
          shader->info.base.properties[TGSI_PROPERTY_FS_COORD_PIXEL_CENTER];
 
@@ -2364,6 +2810,64 @@ generate_fragment(struct llvmpipe_context *lp,
          LLVMBuildStore(builder, mask, mask_ptr);
       }
 
+      /*
+       * Multisampling: the coverage of each sample (16 bits per sample in
+       * thread_data->sample_mask) goes into a mask store of its own, mask_input
+       * has the pixels with any sample covered.
+       */
+      if (key->multisample) {
+         struct lp_build_context f32_bld;
+         LLVMValueRef sample_mask_input =
+            lp_jit_thread_data_sample_mask(gallivm, thread_data_ptr);
+         LLVMValueRef index = lp_build_const_int32(gallivm, 2);
+         unsigned s;
+
+         sample_mask_store =
+            lp_build_array_alloca(gallivm, mask_type,
+                                  lp_build_const_int32(gallivm,
+                                                       num_fs * LP_MAX_SAMPLES),
+                                  "sample_mask_store");
+
+         for (s = 0; s < LP_MAX_SAMPLES; s++) {
+            LLVMValueRef smask_input =
+               LLVMBuildLShr(builder, sample_mask_input,
+                             LLVMConstInt(LLVMInt64TypeInContext(gallivm->context),
+                                          16 * s, 0), "");
+            smask_input = LLVMBuildTrunc(builder, smask_input, int32_type, "");
+
+            for (i = 0; i < num_fs; i++) {
+               LLVMValueRef mask;
+               LLVMValueRef indexi = lp_build_const_int32(gallivm,
+                                                          s * num_fs + i);
+               LLVMValueRef mask_ptr = LLVMBuildGEP(builder, sample_mask_store,
+                                                    &indexi, 1, "");
+
+               if (partial_mask) {
+                  mask = generate_quad_mask(gallivm, fs_type,
+                                            i*fs_type.length/4, smask_input);
+               }
+               else {
+                  mask = lp_build_const_int_vec(gallivm, fs_type, ~0);
+               }
+               LLVMBuildStore(builder, mask, mask_ptr);
+            }
+         }
+
+         depth_sample_stride =
+            lp_jit_thread_data_depth_sample_stride(gallivm, thread_data_ptr);
+
+         /* depth slopes, for the depth at the sample positions */
+         lp_build_context_init(&f32_bld, gallivm, fs_type);
+         dzdx = LLVMBuildLoad(builder,
+                              LLVMBuildGEP(builder, dadx_ptr, &index, 1, ""),
+                              "dzdx");
+         dzdy = LLVMBuildLoad(builder,
+                              LLVMBuildGEP(builder, dady_ptr, &index, 1, ""),
+                              "dzdy");
+         dzdx = lp_build_broadcast_scalar(&f32_bld, dzdx);
+         dzdy = lp_build_broadcast_scalar(&f32_bld, dzdy);
+      }
+
       generate_fs_loop(gallivm,
                        shader, key,
                        builder,
@@ -2377,13 +2881,52 @@ generate_fragment(struct llvmpipe_context *lp,
                        depth_ptr,
                        depth_stride,
                        facing,
-                       thread_data_ptr);
+                       thread_data_ptr,
+                       sample_mask_store,
+                       depth_sample_stride,
+                       dzdx, dzdy);
 
-      for (i = 0; i < num_fs; i++) {
+      /*
+       * Reinterpret the mask and color stores as arrays of blend sized
+       * vectors, which is a no-op unless the shader ran wider than native.
+       */
+      if (blend_fs_type.length != fs_type.length) {
+         LLVMTypeRef blend_mask_ptr_type =
+            LLVMPointerType(lp_build_int_vec_type(gallivm, blend_fs_type), 0);
+         LLVMTypeRef blend_color_ptr_type =
+            LLVMPointerType(lp_build_vec_type(gallivm, blend_fs_type), 0);
+
+         mask_store = LLVMBuildBitCast(builder, mask_store,
+                                       blend_mask_ptr_type, "");
+         if (sample_mask_store) {
+            sample_mask_store = LLVMBuildBitCast(builder, sample_mask_store,
+                                                 blend_mask_ptr_type, "");
+         }
+         for (cbuf = 0; cbuf < PIPE_MAX_COLOR_BUFS; cbuf++) {
+            for (chan = 0; chan < TGSI_NUM_CHANNELS; ++chan) {
+               if (color_store[cbuf][chan]) {
+                  color_store[cbuf][chan] =
+                     LLVMBuildBitCast(builder, color_store[cbuf][chan],
+                                      blend_color_ptr_type, "");
+               }
+            }
+         }
+      }
+
+      for (i = 0; i < blend_num_fs; i++) {
          LLVMValueRef indexi = lp_build_const_int32(gallivm, i);
          LLVMValueRef ptr = LLVMBuildGEP(builder, mask_store,
                                          &indexi, 1, "");
          fs_mask[i] = LLVMBuildLoad(builder, ptr, "mask");
+         if (key->multisample) {
+            unsigned s;
+            for (s = 0; s < LP_MAX_SAMPLES; s++) {
+               LLVMValueRef indexs =
+                  lp_build_const_int32(gallivm, s * blend_num_fs + i);
+               ptr = LLVMBuildGEP(builder, sample_mask_store, &indexs, 1, "");
+               fs_sample_mask[s][i] = LLVMBuildLoad(builder, ptr, "sample_mask");
+            }
+         }
          /* This is fucked up need to reorganize things */
          for (cbuf = 0; cbuf < key->nr_cbufs; cbuf++) {
             for (chan = 0; chan < TGSI_NUM_CHANNELS; ++chan) {
@@ -2431,15 +2974,52 @@ generate_fragment(struct llvmpipe_context *lp,
                                 LLVMBuildGEP(builder, stride_ptr, &index, 1, ""),
                                 "");
 
-         generate_unswizzled_blend(gallivm, cbuf, variant,
-                                   key->cbuf_format[cbuf],
-                                   num_fs, fs_type, fs_mask, fs_out_color,
-                                   context_ptr, color_ptr, stride,
-                                   partial_mask, do_branch);
+         if (key->multisample) {
+            /* blend the shader colors into each sample with its coverage */
+            LLVMValueRef sample_stride =
+               lp_build_array_get(gallivm,
+                                  lp_jit_thread_data_color_sample_stride(gallivm,
+                                                                         thread_data_ptr),
+                                  index);
+            LLVMValueRef color_ptr_i8 =
+               LLVMBuildBitCast(builder, color_ptr,
+                                LLVMPointerType(int8_type, 0), "");
+            unsigned s;
+
+            for (s = 0; s < LP_MAX_SAMPLES; s++) {
+               LLVMValueRef offset = LLVMBuildMul(builder, sample_stride,
+                                                  lp_build_const_int32(gallivm, s),
+                                                  "");
+               LLVMValueRef sample_color_ptr =
+                  LLVMBuildGEP(builder, color_ptr_i8, &offset, 1, "");
+               sample_color_ptr = LLVMBuildBitCast(builder, sample_color_ptr,
+                                                   LLVMTypeOf(color_ptr), "");
+
+               generate_unswizzled_blend(gallivm, cbuf, variant,
+                                         key->cbuf_format[cbuf],
+                                         blend_num_fs, blend_fs_type,
+                                         fs_sample_mask[s], fs_out_color,
+                                         context_ptr, sample_color_ptr, stride,
+                                         partial_mask, do_branch);
+            }
+         }
+         else {
+            generate_unswizzled_blend(gallivm, cbuf, variant,
+                                      key->cbuf_format[cbuf],
+                                      blend_num_fs, blend_fs_type,
+                                      fs_mask, fs_out_color,
+                                      context_ptr, color_ptr, stride,
+                                      partial_mask, do_branch);
+         }
       }
    }
 
-   LLVMBuildRetVoid(builder);
+   if (fused) {
+      LLVMBuildRet(builder, end_tri16_loop(gallivm, &tri16));
+   }
+   else {
+      LLVMBuildRetVoid(builder);
+   }
 
    gallivm_verify_function(gallivm, function);
 }
@@ -2483,6 +3063,14 @@ dump_fs_variant_key(const struct lp_fragment_shader_variant_key *key)
       debug_printf("occlusion_count = 1\n");
    }
 
+   if (key->tex_cache_counters) {
+      debug_printf("tex_cache_counters = 1\n");
+   }
+
+   if (key->multisample) {
+      debug_printf("multisample = 1\n");
+   }
+
    if (key->blend.logicop_enable) {
       debug_printf("blend.logicop_func = %s\n", util_dump_logicop(key->blend.logicop_func, TRUE));
    }
@@ -2544,10 +3132,572 @@ lp_debug_fs_variant(const struct lp_fragment_shader_variant *variant)
    tgsi_dump(variant->shader->base.tokens, 0);
    dump_fs_variant_key(&variant->key);
    debug_printf("variant->opaque = %u\n", variant->opaque);
+   debug_printf("variant->zcull = 0x%x\n", variant->zcull);
    debug_printf("\n");
 }
 
 
+/**
+ * Generate and compile the code for a variant in variant->gallivm.
+ * \param jit_function  returns the compiled functions
+ * \param jit_tri16  returns the fused triangle function, or NULL
+ */
+static void
+compile_variant(struct lp_fragment_shader *shader,
+                struct lp_fragment_shader_variant *variant,
+                lp_jit_frag_func jit_function[2],
+                lp_jit_frag_tri16_func *jit_tri16)
+{
+   lp_jit_init_types(variant);
+
+   variant->gallivm->format_cache_counters = variant->key.tex_cache_counters;
+   
+   generate_fragment(shader, variant, RAST_EDGE_TEST);
+
+   if (variant->opaque) {
+      /* Specialized shader, which doesn't need to read the color buffer. */
+      generate_fragment(shader, variant, RAST_WHOLE);
+   }
+
+   if (use_fused_tri16(shader, variant)) {
+      generate_fragment(shader, variant, RAST_TRI_16);
+   }
+
+   /*
+    * Compile everything
+    */
+
+   gallivm_compile_module(variant->gallivm);
+
+   variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
+
+   jit_function[RAST_EDGE_TEST] = (lp_jit_frag_func)
+         gallivm_jit_function(variant->gallivm,
+                              variant->function[RAST_EDGE_TEST]);
+
+   if (variant->function[RAST_WHOLE]) {
+         jit_function[RAST_WHOLE] = (lp_jit_frag_func)
+               gallivm_jit_function(variant->gallivm,
+                                    variant->function[RAST_WHOLE]);
+   } else {
+      jit_function[RAST_WHOLE] = jit_function[RAST_EDGE_TEST];
+   }
+
+   *jit_tri16 = NULL;
+   if (variant->function[RAST_TRI_16]) {
+      *jit_tri16 = (lp_jit_frag_tri16_func)
+            gallivm_jit_function(variant->gallivm,
+                                 variant->function[RAST_TRI_16]);
+   }
+
+   gallivm_free_ir(variant->gallivm);
+}
+
+
+/**
+ * A request to compile the optimized code of a variant.
+ */
+struct lp_fs_compile_job
+{
+   struct lp_fs_code *code;
+
+   /* Private copies of what's needed to generate the code, as the shader
+    * and variant which requested it may be destroyed in the meantime.
+    */
+   struct lp_fragment_shader shader;
+   struct lp_fragment_shader_variant variant;
+
+   boolean running;
+   struct lp_fs_compile_job *next, *prev;
+};
+
+
+/**
+ * Screen-wide cache of fragment shader code.
+ *
+ * Identical variants, i.e. with the same tokens and key, of all contexts
+ * share their code, which is refcounted.  Code which is no longer used by
+ * any variant is kept around, in LRU order, until the cache exceeds its
+ * budget.
+ *
+ * New code is first compiled without optimizations, which is much quicker,
+ * so that drawing isn't stalled for long.  A pool of threads then compiles
+ * the optimized code in the background, which is swapped in when ready.
+ * Both are generated from the same key, so it doesn't matter which one the
+ * rasterizer threads happen to run in the meantime.
+ */
+struct lp_fs_cache
+{
+   pipe_mutex mutex;
+   pipe_condvar ready_cond;  /**< signalled when code got compiled */
+   pipe_condvar queue_cond;  /**< signalled when a job is queued */
+
+   struct util_hash_table *table;
+   struct lp_fs_code unused;  /**< code without references, in LRU order */
+   unsigned nr_code;
+   unsigned nr_instrs;
+   unsigned max_instrs;
+
+   struct lp_fs_compile_job queue;
+   boolean exit;
+
+   unsigned num_threads;
+   pipe_thread threads[LP_MAX_COMPILE_THREADS];
+};
+
+
+static unsigned
+fs_code_hash(void *key)
+{
+   const struct lp_fs_code *code = (const struct lp_fs_code *) key;
+
+   return code->hash;
+}
+
+
+static int
+fs_code_compare(void *key1, void *key2)
+{
+   const struct lp_fs_code *code1 = (const struct lp_fs_code *) key1;
+   const struct lp_fs_code *code2 = (const struct lp_fs_code *) key2;
+   unsigned num_tokens;
+
+   if (code1->hash != code2->hash ||
+       code1->key_size != code2->key_size ||
+       memcmp(&code1->key, &code2->key, code1->key_size) != 0)
+      return 1;
+
+   num_tokens = tgsi_num_tokens(code1->tokens);
+   if (num_tokens != tgsi_num_tokens(code2->tokens))
+      return 1;
+
+   return memcmp(code1->tokens, code2->tokens,
+                 num_tokens * sizeof code1->tokens[0]);
+}
+
+
+static void
+destroy_fs_code(struct lp_fs_code *code)
+{
+   if (code->gallivm) {
+      gallivm_destroy(code->gallivm);
+   }
+   if (code->opt_gallivm) {
+      gallivm_destroy(code->opt_gallivm);
+   }
+   FREE((void *) code->tokens);
+   FREE(code);
+}
+
+
+/**
+ * Free unused code, least recently used first, until the cache fits its
+ * budget again.  Called with the cache mutex held.
+ */
+static void
+evict_fs_code(struct lp_fs_cache *cache)
+{
+   struct lp_fs_code *code = last_elem(&cache->unused);
+
+   while (!at_end(&cache->unused, code) &&
+          (cache->nr_code > LP_MAX_SHADER_VARIANTS ||
+           cache->nr_instrs > cache->max_instrs)) {
+      struct lp_fs_code *prev = prev_elem(code);
+
+      if (code->job) {
+         if (code->job->running) {
+            /* Try again once it's done */
+            code = prev;
+            continue;
+         }
+         remove_from_list(code->job);
+         FREE(code->job);
+      }
+
+      remove_from_list(code);
+      util_hash_table_remove(cache->table, code);
+      cache->nr_code--;
+      cache->nr_instrs -= code->nr_instrs;
+      destroy_fs_code(code);
+
+      code = prev;
+   }
+}
+
+
+static PIPE_THREAD_ROUTINE(fs_compile_thread, init_data)
+{
+   struct lp_fs_cache *cache = (struct lp_fs_cache *) init_data;
+   LLVMContextRef context;
+
+   /* LLVM contexts can't be shared between threads */
+   context = LLVMContextCreate();
+
+   pipe_mutex_lock(cache->mutex);
+
+   while (!cache->exit) {
+      struct lp_fs_compile_job *job;
+      struct lp_fragment_shader_variant *variant;
+      struct lp_fs_code *code;
+      lp_jit_frag_func jit_function[2];
+      lp_jit_frag_tri16_func jit_tri16;
+      char module_name[64];
+
+      if (is_empty_list(&cache->queue)) {
+         pipe_condvar_wait(cache->queue_cond, cache->mutex);
+         continue;
+      }
+
+      job = first_elem(&cache->queue);
+      remove_from_list(job);
+      job->running = TRUE;
+
+      pipe_mutex_unlock(cache->mutex);
+
+      variant = &job->variant;
+
+      util_snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
+                    job->shader.no, variant->no);
+
+      variant->gallivm = context ? gallivm_create(module_name, context) : NULL;
+      if (variant->gallivm) {
+         compile_variant(&job->shader, variant, jit_function, &jit_tri16);
+      }
+
+      pipe_mutex_lock(cache->mutex);
+
+      code = job->code;
+      if (variant->gallivm) {
+         /*
+          * Swap in the optimized code.  The unoptimized code is kept until
+          * the code is destroyed, as scenes in flight may still use it.
+          */
+         code->opt_gallivm = variant->gallivm;
+         code->jit_function[RAST_EDGE_TEST] = jit_function[RAST_EDGE_TEST];
+         code->jit_function[RAST_WHOLE] = jit_function[RAST_WHOLE];
+         code->jit_tri16 = jit_tri16;
+      }
+      code->job = NULL;
+      FREE(job);
+
+      /* In case it was skipped while we were compiling */
+      evict_fs_code(cache);
+   }
+
+   pipe_mutex_unlock(cache->mutex);
+
+   if (context) {
+      LLVMContextDispose(context);
+   }
+
+   return 0;
+}
+
+
+/**
+ * Queue the compilation of the optimized code of a variant.  Called with
+ * the cache mutex held.  On failure the code just stays unoptimized.
+ */
+static void
+queue_fs_compile(struct lp_fs_cache *cache,
+                 struct lp_fs_code *code,
+                 const struct lp_fragment_shader *shader,
+                 const struct lp_fragment_shader_variant *variant)
+{
+   struct lp_fs_compile_job *job;
+
+   job = MALLOC_STRUCT(lp_fs_compile_job);
+   if (!job)
+      return;
+
+   job->code = code;
+   job->running = FALSE;
+
+   memcpy(&job->shader, shader, sizeof job->shader);
+   job->shader.base.tokens = code->tokens;
+
+   memcpy(&job->variant, variant, sizeof job->variant);
+   job->variant.shader = &job->shader;
+   job->variant.gallivm = NULL;
+   job->variant.jit_context_ptr_type = NULL;
+   job->variant.jit_thread_data_ptr_type = NULL;
+   job->variant.jit_linear_context_ptr_type = NULL;
+   job->variant.function[RAST_WHOLE] = NULL;
+   job->variant.function[RAST_EDGE_TEST] = NULL;
+   job->variant.function[RAST_TRI_16] = NULL;
+
+   code->job = job;
+   insert_at_tail(&cache->queue, job);
+   pipe_condvar_signal(cache->queue_cond);
+}
+
+
+/**
+ * Drop a variant's reference to its code.
+ */
+static void
+release_fs_code(struct llvmpipe_context *lp,
+                struct lp_fs_code *code)
+{
+   struct lp_fs_cache *cache = llvmpipe_screen(lp->pipe.screen)->fs_cache;
+
+   pipe_mutex_lock(cache->mutex);
+
+   assert(code->refcount);
+   if (--code->refcount == 0) {
+      if (code->gallivm) {
+         insert_at_head(&cache->unused, code);
+         evict_fs_code(cache);
+      }
+      else {
+         /* Failed to compile, not in the cache */
+         destroy_fs_code(code);
+      }
+   }
+
+   pipe_mutex_unlock(cache->mutex);
+}
+
+
+/**
+ * Get the code for a new variant from the screen's cache, compiling it if
+ * no identical variant was compiled before.
+ */
+static struct lp_fs_code *
+get_fs_code(struct llvmpipe_context *lp,
+            struct lp_fragment_shader *shader,
+            struct lp_fragment_shader_variant *variant)
+{
+   struct lp_fs_cache *cache = llvmpipe_screen(lp->pipe.screen)->fs_cache;
+   struct lp_fs_code *code, *cached;
+   lp_jit_frag_func jit_function[2];
+   lp_jit_frag_tri16_func jit_tri16 = NULL;
+   char module_name[64];
+   unsigned key_size = shader->variant_key_size;
+   unsigned tokens_size;
+
+   code = CALLOC_STRUCT(lp_fs_code);
+   if (!code)
+      return NULL;
+
+   tokens_size = tgsi_num_tokens(shader->base.tokens) *
+                 sizeof shader->base.tokens[0];
+
+   code->tokens = shader->base.tokens;
+   code->key_size = key_size;
+   memcpy(&code->key, &variant->key, key_size);
+   code->hash = util_hash_crc32(&code->key, key_size) ^
+                util_hash_crc32(code->tokens, tokens_size);
+
+   pipe_mutex_lock(cache->mutex);
+
+   cached = util_hash_table_get(cache->table, code);
+   if (cached) {
+      FREE(code);
+      code = cached;
+
+      if (code->refcount++ == 0) {
+         remove_from_list(code);
+      }
+
+      /* Another context may still be compiling it */
+      while (!code->ready) {
+         pipe_condvar_wait(cache->ready_cond, cache->mutex);
+      }
+
+      pipe_mutex_unlock(cache->mutex);
+
+      if (!code->gallivm) {
+         release_fs_code(lp, code);
+         return NULL;
+      }
+
+      variant->nr_instrs = code->nr_instrs;
+      return code;
+   }
+
+   code->tokens = tgsi_dup_tokens(shader->base.tokens);
+   code->refcount = 1;
+   if (code->tokens &&
+       util_hash_table_set(cache->table, code, code) == PIPE_OK) {
+      cache->nr_code++;
+   }
+   else {
+      pipe_mutex_unlock(cache->mutex);
+      FREE((void *) code->tokens);
+      FREE(code);
+      return NULL;
+   }
+
+   pipe_mutex_unlock(cache->mutex);
+
+   /*
+    * Compile the code.  When there are compiler threads, only quickly
+    * generate unoptimized code now, and let them compile the optimized code
+    * in the background.
+    */
+   util_snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
+                 shader->no, variant->no);
+
+   variant->gallivm = gallivm_create(module_name, lp->context);
+   if (variant->gallivm) {
+      variant->gallivm->no_opt = cache->num_threads > 0;
+      compile_variant(shader, variant, jit_function, &jit_tri16);
+   }
+
+   pipe_mutex_lock(cache->mutex);
+
+   if (variant->gallivm) {
+      code->gallivm = variant->gallivm;
+      code->jit_function[RAST_EDGE_TEST] = jit_function[RAST_EDGE_TEST];
+      code->jit_function[RAST_WHOLE] = jit_function[RAST_WHOLE];
+      code->jit_tri16 = jit_tri16;
+      code->nr_instrs = variant->nr_instrs;
+      cache->nr_instrs += code->nr_instrs;
+
+      if (cache->num_threads) {
+         queue_fs_compile(cache, code, shader, variant);
+      }
+   }
+   else {
+      /* Let others retry */
+      util_hash_table_remove(cache->table, code);
+      cache->nr_code--;
+   }
+
+   code->ready = TRUE;
+   pipe_condvar_broadcast(cache->ready_cond);
+
+   evict_fs_code(cache);
+
+   pipe_mutex_unlock(cache->mutex);
+
+   variant->gallivm = NULL;
+
+   if (!code->gallivm) {
+      release_fs_code(lp, code);
+      return NULL;
+   }
+
+   return code;
+}
+
+
+/**
+ * Create the screen's fragment shader code cache, and start the background
+ * compiler threads, if enabled.
+ *
+ * LP_NUM_COMPILE_THREADS sets the number of threads, zero meaning that
+ * optimized code is compiled synchronously, as needed.
+ * LP_SHADER_CACHE_SIZE sets the cache budget, in LLVM IR instructions.
+ */
+boolean
+llvmpipe_init_fs_cache(struct llvmpipe_screen *screen)
+{
+   struct lp_fs_cache *cache;
+   unsigned num_threads;
+   unsigned i;
+
+   cache = CALLOC_STRUCT(lp_fs_cache);
+   if (!cache)
+      return FALSE;
+
+   cache->table = util_hash_table_create(fs_code_hash, fs_code_compare);
+   if (!cache->table) {
+      FREE(cache);
+      return FALSE;
+   }
+
+   pipe_mutex_init(cache->mutex);
+   pipe_condvar_init(cache->ready_cond);
+   pipe_condvar_init(cache->queue_cond);
+   make_empty_list(&cache->unused);
+   make_empty_list(&cache->queue);
+
+   cache->max_instrs = debug_get_num_option("LP_SHADER_CACHE_SIZE",
+                                            LP_MAX_SHADER_INSTRUCTIONS);
+
+   if (!fs_vector_width) {
+      unsigned width = LP_FS_VECTOR_WIDTH;
+
+      if (!width) {
+         width = util_cpu_caps.has_avx512f ? 512 : lp_native_vector_width;
+      }
+      width = debug_get_num_option("LP_FS_VECTOR_WIDTH", width);
+      /* round down to 128, 256 or 512 bits */
+      width = MAX2(width, 128);
+      width = MIN2(width, 512);
+      fs_vector_width = 1 << util_logbase2(width);
+   }
+
+   screen->fs_cache = cache;
+
+   num_threads = util_cpu_caps.nr_cpus > 1 ? 2 : 0;
+   num_threads = debug_get_num_option("LP_NUM_COMPILE_THREADS", num_threads);
+   num_threads = MIN2(num_threads, LP_MAX_COMPILE_THREADS);
+
+   /* Don't bother when optimizations are disabled anyway */
+   if (gallivm_debug & GALLIVM_DEBUG_NO_OPT)
+      num_threads = 0;
+
+   for (i = 0; i < num_threads; i++) {
+      cache->threads[i] = pipe_thread_create(fs_compile_thread, cache);
+      if (!cache->threads[i])
+         break;
+   }
+   cache->num_threads = i;
+
+   return TRUE;
+}
+
+
+static enum pipe_error
+destroy_fs_code_cb(void *key, void *value, void *data)
+{
+   destroy_fs_code((struct lp_fs_code *) value);
+   return PIPE_OK;
+}
+
+
+/**
+ * Stop the background compiler threads and free all cached code.
+ */
+void
+llvmpipe_destroy_fs_cache(struct llvmpipe_screen *screen)
+{
+   struct lp_fs_cache *cache = screen->fs_cache;
+   unsigned i;
+
+   if (!cache)
+      return;
+
+   pipe_mutex_lock(cache->mutex);
+   while (!is_empty_list(&cache->queue)) {
+      struct lp_fs_compile_job *job = first_elem(&cache->queue);
+      remove_from_list(job);
+      job->code->job = NULL;
+      FREE(job);
+   }
+   cache->exit = TRUE;
+   pipe_condvar_broadcast(cache->queue_cond);
+   pipe_mutex_unlock(cache->mutex);
+
+   for (i = 0; i < cache->num_threads; i++) {
+      pipe_thread_wait(cache->threads[i]);
+   }
+
+   util_hash_table_foreach(cache->table, destroy_fs_code_cb, NULL);
+   util_hash_table_destroy(cache->table);
+
+   pipe_condvar_destroy(cache->queue_cond);
+   pipe_condvar_destroy(cache->ready_cond);
+   pipe_mutex_destroy(cache->mutex);
+   FREE(cache);
+
+   screen->fs_cache = NULL;
+}
+
+
 /**
  * Generate a new fragment shader variant from the shader code and
  * other state indicated by the key.
@@ -2560,21 +3710,11 @@ generate_variant(struct llvmpipe_context *lp,
    struct lp_fragment_shader_variant *variant;
    const struct util_format_description *cbuf0_format_desc;
    boolean fullcolormask;
-   char module_name[64];
 
    variant = CALLOC_STRUCT(lp_fragment_shader_variant);
    if(!variant)
       return NULL;
 
-   util_snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
-                 shader->no, shader->variants_created);
-
-   variant->gallivm = gallivm_create(module_name, lp->context);
-   if (!variant->gallivm) {
-      FREE(variant);
-      return NULL;
-   }
-
    variant->shader = shader;
    variant->list_item_global.base = variant;
    variant->list_item_local.base = variant;
@@ -2602,6 +3742,37 @@ generate_variant(struct llvmpipe_context *lp,
          !shader->info.base.uses_kill
       ? TRUE : FALSE;
 
+   /*
+    * Determine how the variant interacts with the hierarchical depth
+    * bounds of the rasterizer.  Culling is only valid when the depth test
+    * uses the interpolated depth, unclamped, and no other state depends on
+    * fragments failing it.  Writes with LESS/LEQUAL only lower the depth,
+    * so they never invalidate the bounds, even when culling is off.
+    */
+   variant->zcull = 0;
+   if (key->depth.enabled && key->zsbuf_format != PIPE_FORMAT_NONE) {
+      const unsigned func = key->depth.func;
+
+      if (func == PIPE_FUNC_LESS || func == PIPE_FUNC_LEQUAL) {
+         if (!key->stencil[0].enabled &&
+             !key->depth_clamp &&
+             !shader->info.base.writes_z) {
+            variant->zcull |= LP_ZCULL_TEST;
+            if (key->depth.writemask &&
+                !key->alpha.enabled &&
+                !key->blend.alpha_to_coverage &&
+                !shader->info.base.uses_kill) {
+               variant->zcull |= LP_ZCULL_UPDATE;
+            }
+         }
+      }
+      else if (key->depth.writemask &&
+               func != PIPE_FUNC_EQUAL &&
+               func != PIPE_FUNC_NEVER) {
+         variant->zcull |= LP_ZCULL_INVALIDATE;
+      }
+   }
+
    if ((shader->info.base.num_tokens <= 1) &&
        !key->depth.enabled && !key->stencil[0].enabled) {
       variant->ps_inv_multiplier = 0;
@@ -2613,42 +3784,12 @@ generate_variant(struct llvmpipe_context *lp,
       lp_debug_fs_variant(variant);
    }
 
-   lp_jit_init_types(variant);
-   
-   if (variant->jit_function[RAST_EDGE_TEST] == NULL)
-      generate_fragment(lp, shader, variant, RAST_EDGE_TEST);
-
-   if (variant->jit_function[RAST_WHOLE] == NULL) {
-      if (variant->opaque) {
-         /* Specialized shader, which doesn't need to read the color buffer. */
-         generate_fragment(lp, shader, variant, RAST_WHOLE);
-      }
-   }
-
-   /*
-    * Compile everything
-    */
-
-   gallivm_compile_module(variant->gallivm);
-
-   variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
-
-   if (variant->function[RAST_EDGE_TEST]) {
-      variant->jit_function[RAST_EDGE_TEST] = (lp_jit_frag_func)
-            gallivm_jit_function(variant->gallivm,
-                                 variant->function[RAST_EDGE_TEST]);
-   }
-
-   if (variant->function[RAST_WHOLE]) {
-         variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
-               gallivm_jit_function(variant->gallivm,
-                                    variant->function[RAST_WHOLE]);
-   } else if (!variant->jit_function[RAST_WHOLE]) {
-      variant->jit_function[RAST_WHOLE] = variant->jit_function[RAST_EDGE_TEST];
+   variant->code = get_fs_code(lp, shader, variant);
+   if (!variant->code) {
+      FREE(variant);
+      return NULL;
    }
 
-   gallivm_free_ir(variant->gallivm);
-
    return variant;
 }
 
@@ -2783,7 +3924,7 @@ llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
                    lp->nr_fs_variants);
    }
 
-   gallivm_destroy(variant->gallivm);
+   release_fs_code(lp, variant->code);
 
    /* remove from shader's list */
    remove_from_list(&variant->list_item_local);
@@ -2958,9 +4099,13 @@ make_variant_key(struct llvmpipe_context *lp,
    /* alpha.ref_value is passed in jit_context */
 
    key->flatshade = lp->rasterizer->flatshade;
+   key->multisample = util_framebuffer_get_num_samples(&lp->framebuffer) > 1;
    if (lp->active_occlusion_queries) {
       key->occlusion_count = TRUE;
    }
+   if (lp->active_tex_cache_queries || (LP_DEBUG & DEBUG_COUNTERS)) {
+      key->tex_cache_counters = TRUE;
+   }
 
    if (lp->framebuffer.nr_cbufs) {
       memcpy(&key->blend, lp->blend, sizeof key->blend);
@@ -3164,7 +4309,8 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
       }
 
       /*
-       * Generate the new variant.
+       * Generate the new variant, or reuse the code of an identical one
+       * from another context.
        */
       t0 = os_time_get();
       variant = generate_variant(lp, shader, &key);
@@ -40,11 +40,15 @@
 
 struct tgsi_token;
 struct lp_fragment_shader;
+struct lp_fs_compile_job;
+struct llvmpipe_screen;
 
 
 /** Indexes into jit_function[] array */
 #define RAST_WHOLE 0
 #define RAST_EDGE_TEST 1
+/** Index of the fused triangle function in lp_fragment_shader_variant::function[] */
+#define RAST_TRI_16 2
 
 
 struct lp_sampler_static_state
@@ -75,8 +79,10 @@ struct lp_fragment_shader_variant_key
    unsigned nr_sampler_views:8; /* actually derivable from just the shader */
    unsigned flatshade:1;
    unsigned occlusion_count:1;
+   unsigned tex_cache_counters:1;
    unsigned resource_1d:1;
    unsigned depth_clamp:1;
+   unsigned multisample:1;      /* framebuffer has LP_MAX_SAMPLES samples */
 
    enum pipe_format zsbuf_format;
    enum pipe_format cbuf_format[PIPE_MAX_COLOR_BUFS];
@@ -85,6 +91,40 @@ struct lp_fragment_shader_variant_key
 };
 
 
+/**
+ * Compiled code of a fragment shader variant.
+ *
+ * Identical variants of all contexts of a screen share the same code, which
+ * is looked up by shader tokens and variant key in the screen's cache.
+ */
+struct lp_fs_code
+{
+   lp_jit_frag_func jit_function[2];
+   /** Fused rasterizer and shader for small triangles, may be NULL */
+   lp_jit_frag_tri16_func jit_tri16;
+
+   /** Unoptimized code, or the only code if compiled synchronously */
+   struct gallivm_state *gallivm;
+   /** Optimized code, once compiled in the background */
+   struct gallivm_state *opt_gallivm;
+   struct lp_fs_compile_job *job;
+
+   /* Total number of LLVM instructions generated */
+   unsigned nr_instrs;
+
+   /* The following are protected by the cache mutex */
+   unsigned refcount;
+   boolean ready;
+   struct lp_fs_code *next, *prev;  /**< unused code list */
+
+   /* Cache key */
+   unsigned hash;
+   const struct tgsi_token *tokens;
+   unsigned key_size;
+   struct lp_fragment_shader_variant_key key;
+};
+
+
 /** doubly-linked list item */
 struct lp_fs_variant_list_item
 {
@@ -100,15 +140,20 @@ struct lp_fragment_shader_variant
    boolean opaque;
    uint8_t ps_inv_multiplier;
 
+   /** LP_ZCULL_x flags */
+   unsigned zcull;
+
+   /** Shared compiled code */
+   struct lp_fs_code *code;
+
+   /* Only used while generating code */
    struct gallivm_state *gallivm;
 
    LLVMTypeRef jit_context_ptr_type;
    LLVMTypeRef jit_thread_data_ptr_type;
    LLVMTypeRef jit_linear_context_ptr_type;
 
-   LLVMValueRef function[2];
-
-   lp_jit_frag_func jit_function[2];
+   LLVMValueRef function[3];
 
    /* Total number of LLVM instructions generated */
    unsigned nr_instrs;
@@ -153,5 +198,11 @@ llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
 boolean
 llvmpipe_rasterization_disabled(struct llvmpipe_context *lp);
 
+boolean
+llvmpipe_init_fs_cache(struct llvmpipe_screen *screen);
+
+void
+llvmpipe_destroy_fs_cache(struct llvmpipe_screen *screen);
+
 
 #endif /* LP_STATE_FS_H_ */
@@ -25,11 +25,19 @@
  * 
  **************************************************************************/
 
+#include "util/u_atomic.h"
+#include "util/u_format.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
 #include "util/u_rect.h"
 #include "util/u_surface.h"
+#include "os/os_thread.h"
 #include "lp_context.h"
+#include "lp_fence.h"
 #include "lp_flush.h"
 #include "lp_limits.h"
+#include "lp_rast.h"
+#include "lp_screen.h"
 #include "lp_surface.h"
 #include "lp_texture.h"
 #include "lp_query.h"
@@ -56,11 +64,272 @@ lp_resource_copy(struct pipe_context *pipe,
                            FALSE, /* do_not_block */
                            "blit src");
 
+   /*
+    * The samples of multisampled surfaces are stored as consecutive slices,
+    * so copying all of them is just a copy of that many slices.
+    */
+   if (src->nr_samples > 1 && dst->nr_samples == src->nr_samples) {
+      struct pipe_box box = *src_box;
+      assert(src_box->z == 0 && src_box->depth == 1 && dstz == 0);
+      box.depth = src->nr_samples;
+      util_resource_copy_region(pipe, dst, dst_level, dstx, dsty, dstz,
+                                src, src_level, &box);
+      return;
+   }
+
    util_resource_copy_region(pipe, dst, dst_level, dstx, dsty, dstz,
                              src, src_level, src_box);
 }
 
 
+/**
+ * Parameters of a multisample resolve, shared by all the rasterizer
+ * threads working on it.
+ */
+struct lp_resolve_job
+{
+   const struct util_format_description *src_desc;
+   const struct util_format_description *dst_desc;
+   const ubyte *src;       /**< first pixel of sample 0 */
+   ubyte *dst;             /**< first destination pixel */
+   unsigned src_stride;
+   unsigned src_sample_stride;
+   unsigned dst_stride;
+   unsigned width;
+   unsigned height;
+   unsigned band_rows;     /**< rows handed to a thread at a time */
+   unsigned num_bands;
+   int next_band;          /**< next band to be resolved */
+   boolean average;        /**< average samples, otherwise take sample 0 */
+};
+
+
+/**
+ * Resolve rows [y0, y1) of a resolve job.
+ */
+static void
+lp_resolve_rows(const struct lp_resolve_job *job, unsigned y0, unsigned y1)
+{
+   const unsigned src_bpp = job->src_desc->block.bits / 8;
+   float *accum = NULL;
+   float *tmp = NULL;
+   unsigned x, y, s, i;
+
+   if (!job->average) {
+      /* Integer and depth/stencil formats take the first sample */
+      for (y = y0; y < y1; y++) {
+         const ubyte *src = job->src + y * job->src_stride;
+         ubyte *dst = job->dst + y * job->dst_stride;
+         memcpy(dst, src, job->width * src_bpp);
+      }
+      return;
+   }
+
+   if (job->src_desc == job->dst_desc &&
+       util_format_is_rgba8_variant(job->src_desc)) {
+      /* Fast path: average each byte of the four samples */
+      const unsigned n = job->width * 4;
+      const unsigned ss = job->src_sample_stride;
+
+      STATIC_ASSERT(LP_MAX_SAMPLES == 4);
+
+      for (y = y0; y < y1; y++) {
+         const ubyte *src = job->src + y * job->src_stride;
+         ubyte *dst = job->dst + y * job->dst_stride;
+         for (i = 0; i < n; i++) {
+            dst[i] = (src[i] + src[i + ss] +
+                      src[i + 2 * ss] + src[i + 3 * ss] + 2) >> 2;
+         }
+      }
+      return;
+   }
+
+   accum = MALLOC(job->width * 4 * sizeof(float));
+   tmp = MALLOC(job->width * 4 * sizeof(float));
+   if (!accum || !tmp) {
+      FREE(accum);
+      FREE(tmp);
+      return;
+   }
+
+   for (y = y0; y < y1; y++) {
+      const ubyte *src = job->src + y * job->src_stride;
+      ubyte *dst = job->dst + y * job->dst_stride;
+
+      job->src_desc->unpack_rgba_float(accum, 0, src, 0, job->width, 1);
+      for (s = 1; s < LP_MAX_SAMPLES; s++) {
+         job->src_desc->unpack_rgba_float(tmp, 0,
+                                          src + s * job->src_sample_stride, 0,
+                                          job->width, 1);
+         for (x = 0; x < job->width * 4; x++) {
+            accum[x] += tmp[x];
+         }
+      }
+      for (x = 0; x < job->width * 4; x++) {
+         accum[x] *= 1.0f / LP_MAX_SAMPLES;
+      }
+      job->dst_desc->pack_rgba_float(dst, 0, accum, 0, job->width, 1);
+   }
+
+   FREE(accum);
+   FREE(tmp);
+}
+
+
+/**
+ * Resolve bands of rows until there are none left.  Run by each rasterizer
+ * thread, see lp_rast_run_job().
+ */
+static void
+lp_resolve_job_run(void *data, unsigned thread_index)
+{
+   struct lp_resolve_job *job = (struct lp_resolve_job *) data;
+
+   for (;;) {
+      unsigned band = p_atomic_inc_return(&job->next_band) - 1;
+      unsigned y0, y1;
+
+      if (band >= job->num_bands)
+         break;
+
+      y0 = band * job->band_rows;
+      y1 = MIN2(y0 + job->band_rows, job->height);
+      lp_resolve_rows(job, y0, y1);
+   }
+}
+
+
+/**
+ * Resolve a multisampled surface into a single sampled one, without
+ * scaling.  Color samples are averaged, integer and depth/stencil formats
+ * take the first sample.  Large surfaces are split into bands of rows
+ * which are resolved by the rasterizer threads.
+ *
+ * \return FALSE if the blit can't be done this way.
+ */
+static boolean
+lp_resolve_blit(struct pipe_context *pipe,
+                const struct pipe_blit_info *info)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+   struct pipe_resource *src = info->src.resource;
+   struct pipe_resource *dst = info->dst.resource;
+   const struct util_format_description *src_desc;
+   const struct util_format_description *dst_desc;
+   struct lp_resolve_job job;
+   struct pipe_box src_box = info->src.box;
+   struct pipe_box dst_box = info->dst.box;
+   const ubyte *src_map;
+   ubyte *dst_map;
+   boolean is_zs;
+
+   if (src->nr_samples != LP_MAX_SAMPLES ||
+       dst->nr_samples > 1 ||
+       src_box.width != dst_box.width ||
+       src_box.height != dst_box.height ||
+       src_box.width <= 0 || src_box.height <= 0 ||
+       src_box.depth != 1 || dst_box.depth != 1 ||
+       src_box.z != 0)
+      return FALSE;
+
+   src_desc = util_format_description(info->src.format);
+   dst_desc = util_format_description(info->dst.format);
+   is_zs = util_format_is_depth_or_stencil(info->src.format);
+
+   if (is_zs || util_format_is_depth_or_stencil(info->dst.format)) {
+      if (info->src.format != info->dst.format ||
+          (info->mask & PIPE_MASK_ZS) != util_format_get_mask(info->src.format))
+         return FALSE;
+   }
+   else if (src_desc->layout != UTIL_FORMAT_LAYOUT_PLAIN ||
+            dst_desc->layout != UTIL_FORMAT_LAYOUT_PLAIN ||
+            util_format_is_pure_integer(info->src.format) !=
+            util_format_is_pure_integer(info->dst.format) ||
+            (util_format_is_pure_integer(info->src.format) &&
+             info->src.format != info->dst.format) ||
+            !(info->mask & PIPE_MASK_RGBA))
+      return FALSE;
+
+   if (info->scissor_enable) {
+      int x0 = MAX2(dst_box.x, (int) info->scissor.minx);
+      int y0 = MAX2(dst_box.y, (int) info->scissor.miny);
+      int x1 = MIN2(dst_box.x + dst_box.width, (int) info->scissor.maxx);
+      int y1 = MIN2(dst_box.y + dst_box.height, (int) info->scissor.maxy);
+      if (x1 <= x0 || y1 <= y0)
+         return TRUE;
+      src_box.x += x0 - dst_box.x;
+      src_box.y += y0 - dst_box.y;
+      dst_box.x = x0;
+      dst_box.y = y0;
+      dst_box.width = x1 - x0;
+      dst_box.height = y1 - y0;
+   }
+
+   if (!llvmpipe_resource_untile(pipe, dst))
+      return FALSE;
+
+   llvmpipe_flush_resource(pipe, dst, info->dst.level,
+                           FALSE, /* read_only */
+                           TRUE, /* cpu_access */
+                           FALSE, /* do_not_block */
+                           "resolve dest");
+   llvmpipe_flush_resource(pipe, src, info->src.level,
+                           TRUE, /* read_only */
+                           TRUE, /* cpu_access */
+                           FALSE, /* do_not_block */
+                           "resolve src");
+
+   src_map = llvmpipe_resource_map(src, info->src.level, 0,
+                                   LP_TEX_USAGE_READ);
+   dst_map = llvmpipe_resource_map(dst, info->dst.level, dst_box.z,
+                                   LP_TEX_USAGE_READ_WRITE);
+   if (!src_map || !dst_map) {
+      if (src_map)
+         llvmpipe_resource_unmap(src, info->src.level, 0);
+      if (dst_map)
+         llvmpipe_resource_unmap(dst, info->dst.level, dst_box.z);
+      return FALSE;
+   }
+
+   job.src_desc = src_desc;
+   job.dst_desc = dst_desc;
+   job.src_stride = llvmpipe_resource_stride(src, info->src.level);
+   job.src_sample_stride = llvmpipe_layer_stride(src, info->src.level);
+   job.dst_stride = llvmpipe_resource_stride(dst, info->dst.level);
+   job.src = src_map + src_box.y * job.src_stride +
+             src_box.x * (src_desc->block.bits / 8);
+   job.dst = dst_map + dst_box.y * job.dst_stride +
+             dst_box.x * (dst_desc->block.bits / 8);
+   job.width = dst_box.width;
+   job.height = dst_box.height;
+   job.band_rows = TILE_SIZE;
+   job.num_bands = (job.height + job.band_rows - 1) / job.band_rows;
+   job.next_band = 0;
+   job.average = !is_zs && !util_format_is_pure_integer(info->src.format);
+
+   /* Only hand the work to the rasterizer threads when there is plenty of
+    * it, as that means waiting for them to finish any queued scene.
+    */
+   if (screen->num_threads > 1 &&
+       dst_box.width * dst_box.height >= 256 * 256) {
+      pipe_mutex_lock(screen->rast_mutex);
+      if (screen->last_fence) {
+         lp_fence_wait(screen->last_fence);
+      }
+      lp_rast_run_job(screen->rast, lp_resolve_job_run, &job);
+      pipe_mutex_unlock(screen->rast_mutex);
+   }
+   else {
+      lp_resolve_rows(&job, 0, job.height);
+   }
+
+   llvmpipe_resource_unmap(src, info->src.level, 0);
+   llvmpipe_resource_unmap(dst, info->dst.level, dst_box.z);
+
+   return TRUE;
+}
+
+
 static void lp_blit(struct pipe_context *pipe,
                     const struct pipe_blit_info *blit_info)
 {
@@ -70,12 +339,11 @@ static void lp_blit(struct pipe_context *pipe,
    if (blit_info->render_condition_enable && !llvmpipe_check_render_cond(lp))
       return;
 
+   /* Resolves the fast path can't do fall back to the blitter below */
    if (info.src.resource->nr_samples > 1 &&
        info.dst.resource->nr_samples <= 1 &&
-       !util_format_is_depth_or_stencil(info.src.resource->format) &&
-       !util_format_is_pure_integer(info.src.resource->format)) {
-      debug_printf("llvmpipe: color resolve unimplemented\n");
-      return;
+       lp_resolve_blit(pipe, &info)) {
+      return; /* done */
    }
 
    if (util_try_blit_via_copy_region(pipe, &info)) {
@@ -134,6 +402,10 @@ llvmpipe_create_surface(struct pipe_context *pipe,
    if (!(pt->bind & (PIPE_BIND_DEPTH_STENCIL | PIPE_BIND_RENDER_TARGET)))
       debug_printf("Illegal surface creation without bind flag\n");
 
+   /* Rendering and shader images need the texels in rows */
+   if (!llvmpipe_resource_untile(pipe, pt))
+      return NULL;
+
    ps = CALLOC_STRUCT(pipe_surface);
    if (ps) {
       pipe_reference_init(&ps->reference, 1);
@@ -295,9 +295,10 @@ unary_tests[] = {
  */
 static LLVMValueRef
 build_unary_test_func(struct gallivm_state *gallivm,
-                      const struct unary_test_t *test)
+                      const struct unary_test_t *test,
+                      unsigned length)
 {
-   struct lp_type type = lp_type_float_vec(32, lp_native_vector_width);
+   struct lp_type type = lp_type_float_vec(32, length * 32);
    LLVMContextRef context = gallivm->context;
    LLVMModuleRef module = gallivm->module;
    LLVMTypeRef vf32t = lp_build_vec_type(gallivm, type);
@@ -369,14 +370,14 @@ flush_denorm_to_zero(float val)
  * Test one LLVM unary arithmetic builder function.
  */
 static boolean
-test_unary(unsigned verbose, FILE *fp, const struct unary_test_t *test)
+test_unary(unsigned verbose, FILE *fp, const struct unary_test_t *test,
+           unsigned length)
 {
    struct gallivm_state *gallivm;
    LLVMValueRef test_func;
    unary_func_t test_func_jit;
    boolean success = TRUE;
    int i, j;
-   int length = lp_native_vector_width / 32;
    float *in, *out;
 
    in = align_malloc(length * 4, length * 4);
@@ -389,7 +390,7 @@ test_unary(unsigned verbose, FILE *fp, const struct unary_test_t *test)
 
    gallivm = gallivm_create("test_module", LLVMGetGlobalContext());
 
-   test_func = build_unary_test_func(gallivm, test);
+   test_func = build_unary_test_func(gallivm, test, length);
 
    gallivm_compile_module(gallivm);
 
@@ -428,8 +429,8 @@ test_unary(unsigned verbose, FILE *fp, const struct unary_test_t *test)
          }
 
          if (!pass || verbose) {
-            printf("%s(%.9g): ref = %.9g, out = %.9g, precision = %f bits, %s\n",
-                  test->name, in[i], ref, out[i], precision,
+            printf("%s x %u(%.9g): ref = %.9g, out = %.9g, precision = %f bits, %s\n",
+                  test->name, length, in[i], ref, out[i], precision,
                   pass ? "PASS" : "FAIL");
             fflush(stdout);
          }
@@ -456,7 +457,13 @@ test_all(unsigned verbose, FILE *fp)
    int i;
 
    for (i = 0; i < Elements(unary_tests); ++i) {
-      if (!test_unary(verbose, fp, &unary_tests[i])) {
+      if (!test_unary(verbose, fp, &unary_tests[i],
+                      lp_native_vector_width / 32)) {
+         success = FALSE;
+      }
+      /* the fragment shaders may run 16 wide, regardless of native width */
+      if (lp_native_vector_width != 512 &&
+          !test_unary(verbose, fp, &unary_tests[i], 16)) {
          success = FALSE;
       }
    }
@@ -173,6 +173,11 @@ test_format_float(unsigned verbose, FILE *fp,
          /* To ensure it's 16-byte aligned */
          memcpy(packed, test->packed, sizeof packed);
 
+         /* The cache is tagged by address, and packed is always the same */
+         if (cache_ptr) {
+            memset(cache_ptr->cache_tags, 0, sizeof cache_ptr->cache_tags);
+         }
+
          for (i = 0; i < desc->block.height; ++i) {
             for (j = 0; j < desc->block.width; ++j) {
                boolean match = TRUE;
@@ -269,6 +274,11 @@ test_format_unorm8(unsigned verbose, FILE *fp,
          /* Could skip this and use unaligned lp_build_fetch_rgba_aos */
          memcpy(packed, test->packed, sizeof packed);
 
+         /* The cache is tagged by address, and packed is always the same */
+         if (cache_ptr) {
+            memset(cache_ptr->cache_tags, 0, sizeof cache_ptr->cache_tags);
+         }
+
          for (i = 0; i < desc->block.height; ++i) {
             for (j = 0; j < desc->block.width; ++j) {
                boolean match;
@@ -355,6 +365,8 @@ test_all(unsigned verbose, FILE *fp)
 
 #if USE_TEXTURE_CACHE
    cache_ptr = align_malloc(sizeof(struct lp_build_format_cache), 16);
+   memset(cache_ptr, 0, sizeof *cache_ptr);
+   cache_ptr->cache_mask = LP_BUILD_FORMAT_CACHE_SIZE - 1;
 #endif
 
    for (format = 1; format < PIPE_FORMAT_COUNT; ++format) {
@@ -35,6 +35,7 @@
 #include "pipe/p_context.h"
 #include "pipe/p_defines.h"
 
+#include "util/u_atomic.h"
 #include "util/u_inlines.h"
 #include "util/u_cpu_detect.h"
 #include "util/u_format.h"
@@ -44,12 +45,15 @@
 #include "util/u_transfer.h"
 
 #include "lp_context.h"
+#include "lp_debug.h"
+#include "lp_fence.h"
 #include "lp_flush.h"
 #include "lp_screen.h"
 #include "lp_texture.h"
 #include "lp_setup.h"
 #include "lp_state.h"
 #include "lp_rast.h"
+#include "gallivm/lp_bld_sample.h"
 
 #include "state_tracker/sw_winsys.h"
 
@@ -60,6 +64,39 @@ static struct llvmpipe_resource resource_list;
 static unsigned id_counter = 0;
 
 
+/**
+ * Whether to store a new texture in LP_TEXTURE_TILE_SIZE square tiles,
+ * which keeps the texels of a filter footprint in as few cache lines as
+ * possible.
+ *
+ * Everything which touches texture memory directly (rendering, resolves,
+ * shader images) expects rows, but state trackers set the render target
+ * and depth/stencil bind flags on most textures just in case.  So textures
+ * which may be sampled from start out tiled, and are switched to rows by
+ * llvmpipe_resource_untile() the first time a surface is created for them.
+ * Transfers go through a linear copy.
+ */
+static boolean
+llvmpipe_resource_use_tiling(const struct pipe_resource *pt)
+{
+   const struct util_format_description *desc =
+      util_format_description(pt->format);
+
+   if (LP_PERF & PERF_NO_TEX_TILING)
+      return FALSE;
+
+   return (pt->bind & PIPE_BIND_SAMPLER_VIEW) &&
+          !(pt->bind & ~(PIPE_BIND_SAMPLER_VIEW |
+                         PIPE_BIND_RENDER_TARGET |
+                         PIPE_BIND_DEPTH_STENCIL)) &&
+          !llvmpipe_resource_is_1d(pt) &&
+          pt->nr_samples <= 1 &&
+          !(pt->flags & (PIPE_RESOURCE_FLAG_MAP_PERSISTENT |
+                         PIPE_RESOURCE_FLAG_MAP_COHERENT)) &&
+          desc->block.width == 1 && desc->block.height == 1;
+}
+
+
 /**
  * Conventional allocation path for non-display textures:
  * Compute strides and allocate data (unless asked not to).
@@ -84,13 +121,16 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
     * neither. In any case it can only affect compressed or 1d textures.
     */
    unsigned mip_align = MAX2(64, util_cpu_caps.cacheline);
+   boolean tiled = (pt->flags & LP_RESOURCE_FLAG_TILED) != 0;
 
    assert(LP_MAX_TEXTURE_2D_LEVELS <= LP_MAX_TEXTURE_LEVELS);
    assert(LP_MAX_TEXTURE_3D_LEVELS <= LP_MAX_TEXTURE_LEVELS);
+   STATIC_ASSERT(LP_TEXTURE_TILE_SIZE == LP_RASTER_BLOCK_SIZE);
 
    for (level = 0; level <= pt->last_level; level++) {
       uint64_t mipsize;
       unsigned align_x, align_y, nblocksx, nblocksy, block_size, num_slices;
+      unsigned num_rows;
 
       /* Row stride and image stride */
 
@@ -118,18 +158,28 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
                                           align(height, align_y));
       block_size = util_format_get_blocksize(pt->format);
 
-      if (util_format_is_compressed(pt->format))
+      if (util_format_is_compressed(pt->format)) {
          lpr->row_stride[level] = nblocksx * block_size;
-      else
+         num_rows = nblocksy;
+      }
+      else if (tiled) {
+         /* the row stride is the distance between rows of tiles */
+         lpr->row_stride[level] = align(nblocksx * block_size * LP_TEXTURE_TILE_SIZE,
+                                        util_cpu_caps.cacheline);
+         num_rows = nblocksy / LP_TEXTURE_TILE_SIZE;
+      }
+      else {
          lpr->row_stride[level] = align(nblocksx * block_size, util_cpu_caps.cacheline);
+         num_rows = nblocksy;
+      }
 
       /* if row_stride * height > LP_MAX_TEXTURE_SIZE */
-      if ((uint64_t)lpr->row_stride[level] * nblocksy > LP_MAX_TEXTURE_SIZE) {
+      if ((uint64_t)lpr->row_stride[level] * num_rows > LP_MAX_TEXTURE_SIZE) {
          /* image too large */
          goto fail;
       }
 
-      lpr->img_stride[level] = lpr->row_stride[level] * nblocksy;
+      lpr->img_stride[level] = lpr->row_stride[level] * num_rows;
 
       /* Number of 3D image slices, cube faces or texture array layers */
       if (lpr->base.target == PIPE_TEXTURE_CUBE) {
@@ -143,6 +193,9 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
                lpr->base.target == PIPE_TEXTURE_CUBE ||
                lpr->base.target == PIPE_TEXTURE_CUBE_ARRAY)
          num_slices = layers;
+      else if (pt->nr_samples > 1)
+         /* Multisampled surfaces keep each sample in its own slice */
+         num_slices = pt->nr_samples;
       else
          num_slices = 1;
 
@@ -262,6 +315,8 @@ llvmpipe_resource_create_front(struct pipe_screen *_screen,
       }
       else {
          /* texture map */
+         if (llvmpipe_resource_use_tiling(&lpr->base))
+            lpr->base.flags |= LP_RESOURCE_FLAG_TILED;
          if (!llvmpipe_texture_layout(screen, lpr, true))
             goto fail;
       }
@@ -310,6 +365,23 @@ llvmpipe_resource_create(struct pipe_screen *_screen,
    return llvmpipe_resource_create_front(_screen, templat, NULL);
 }
 
+/**
+ * Called before the data of a texture may change: the rasterizer threads
+ * cache decoded s3tc blocks by address, so those have to be thrown away.
+ */
+static void
+invalidate_texture_cache(struct pipe_resource *resource)
+{
+   const struct util_format_description *desc =
+      util_format_description(resource->format);
+
+   if (desc && desc->layout == UTIL_FORMAT_LAYOUT_S3TC) {
+      struct llvmpipe_screen *screen = llvmpipe_screen(resource->screen);
+      p_atomic_inc(&screen->tex_cache_generation);
+   }
+}
+
+
 static void
 llvmpipe_resource_destroy(struct pipe_screen *pscreen,
                           struct pipe_resource *pt)
@@ -323,6 +395,8 @@ llvmpipe_resource_destroy(struct pipe_screen *pscreen,
       winsys->displaytarget_destroy(winsys, lpr->dt);
    }
    else if (llvmpipe_resource_is_texture(pt)) {
+      invalidate_texture_cache(pt);
+
       /* free linear image data */
       if (lpr->tex_data) {
          align_free(lpr->tex_data);
@@ -362,6 +436,10 @@ llvmpipe_resource_map(struct pipe_resource *resource,
           tex_usage == LP_TEX_USAGE_READ_WRITE ||
           tex_usage == LP_TEX_USAGE_WRITE_ALL);
 
+   if (tex_usage != LP_TEX_USAGE_READ) {
+      invalidate_texture_cache(resource);
+   }
+
    if (lpr->dt) {
       /* display target */
       struct llvmpipe_screen *screen = llvmpipe_screen(resource->screen);
@@ -498,6 +576,129 @@ llvmpipe_resource_get_handle(struct pipe_screen *screen,
 }
 
 
+/**
+ * Copy a box of texels between a texture stored in tiles and a linear
+ * buffer.
+ */
+static void
+llvmpipe_copy_tiled_box(struct llvmpipe_resource *lpr,
+                        unsigned level,
+                        const struct pipe_box *box,
+                        ubyte *linear,
+                        unsigned stride,
+                        unsigned layer_stride,
+                        boolean to_tiled)
+{
+   const unsigned bpp = util_format_get_blocksize(lpr->base.format);
+   const unsigned tile_bytes = LP_TEXTURE_TILE_SIZE * LP_TEXTURE_TILE_SIZE * bpp;
+   int x, y, z;
+
+   for (z = 0; z < box->depth; z++) {
+      ubyte *image = llvmpipe_get_texture_image_address(lpr, box->z + z, level);
+
+      for (y = 0; y < box->height; y++) {
+         const unsigned ty = box->y + y;
+         ubyte *tiled_row = image +
+                            ty / LP_TEXTURE_TILE_SIZE * lpr->row_stride[level] +
+                            ty % LP_TEXTURE_TILE_SIZE * LP_TEXTURE_TILE_SIZE * bpp;
+         ubyte *linear_row = linear + z * layer_stride + y * stride;
+
+         for (x = 0; x < box->width; ) {
+            const unsigned tx = box->x + x;
+            const unsigned n = MIN2(LP_TEXTURE_TILE_SIZE - tx % LP_TEXTURE_TILE_SIZE,
+                                    (unsigned)(box->width - x));
+            ubyte *texel = tiled_row +
+                           tx / LP_TEXTURE_TILE_SIZE * tile_bytes +
+                           tx % LP_TEXTURE_TILE_SIZE * bpp;
+
+            if (to_tiled)
+               memcpy(texel, linear_row + x * bpp, n * bpp);
+            else
+               memcpy(linear_row + x * bpp, texel, n * bpp);
+            x += n;
+         }
+      }
+   }
+}
+
+
+/**
+ * Switch a texture stored in tiles to the linear layout, for the uses which
+ * access its memory directly.  This only happens once per texture, as it
+ * never goes back to tiles.
+ *
+ * \return FALSE if out of memory
+ */
+boolean
+llvmpipe_resource_untile(struct pipe_context *pipe,
+                         struct pipe_resource *resource)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+   struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
+   struct llvmpipe_resource linear;
+   unsigned level;
+
+   if (!(resource->flags & LP_RESOURCE_FLAG_TILED))
+      return TRUE;
+
+   /* Nothing may sample from the tiles while they are converted.  Scenes
+    * other contexts have yet to flush still get the old layout, they must
+    * be flushed first as for any other change to a shared texture.
+    */
+   for (level = 0; level <= resource->last_level; level++) {
+      llvmpipe_flush_resource(pipe, resource, level,
+                              FALSE, /* read_only */
+                              TRUE, /* cpu_access */
+                              FALSE, /* do_not_block */
+                              "untile");
+   }
+   pipe_mutex_lock(screen->rast_mutex);
+   if (screen->last_fence) {
+      lp_fence_wait(screen->last_fence);
+   }
+   pipe_mutex_unlock(screen->rast_mutex);
+
+   memset(&linear, 0, sizeof linear);
+   linear.base = *resource;
+   linear.base.flags &= ~LP_RESOURCE_FLAG_TILED;
+   if (!llvmpipe_texture_layout(screen, &linear, TRUE))
+      return FALSE;
+
+   for (level = 0; level <= resource->last_level; level++) {
+      struct pipe_box box;
+
+      box.x = 0;
+      box.y = 0;
+      box.z = 0;
+      box.width = u_minify(resource->width0, level);
+      box.height = u_minify(resource->height0, level);
+      if (resource->target == PIPE_TEXTURE_3D)
+         box.depth = u_minify(resource->depth0, level);
+      else
+         box.depth = resource->array_size;
+
+      llvmpipe_copy_tiled_box(lpr, level, &box,
+                              (ubyte *) linear.tex_data +
+                              linear.mip_offsets[level],
+                              linear.row_stride[level],
+                              linear.img_stride[level],
+                              FALSE);
+   }
+
+   align_free(lpr->tex_data);
+   lpr->tex_data = linear.tex_data;
+   memcpy(lpr->row_stride, linear.row_stride, sizeof lpr->row_stride);
+   memcpy(lpr->img_stride, linear.img_stride, sizeof lpr->img_stride);
+   memcpy(lpr->mip_offsets, linear.mip_offsets, sizeof lpr->mip_offsets);
+   resource->flags &= ~LP_RESOURCE_FLAG_TILED;
+
+   /* Make all contexts pick up the new layout of their sampler views */
+   screen->timestamp++;
+
+   return TRUE;
+}
+
+
 static void *
 llvmpipe_transfer_map( struct pipe_context *pipe,
                        struct pipe_resource *resource,
@@ -590,6 +791,34 @@ llvmpipe_transfer_map( struct pipe_context *pipe,
 
    format = lpr->base.format;
 
+   if (resource->flags & LP_RESOURCE_FLAG_TILED) {
+      /*
+       * Hand out a linear copy of the box, written back to the tiles
+       * when unmapping.
+       */
+      pt->stride = align(box->width * util_format_get_blocksize(format), 16);
+      pt->layer_stride = pt->stride * box->height;
+      lpt->staging = align_malloc(pt->layer_stride * box->depth, 16);
+      if (!lpt->staging) {
+         pipe_resource_reference(&pt->resource, NULL);
+         FREE(lpt);
+         *transfer = NULL;
+         return NULL;
+      }
+
+      if (!(usage & (PIPE_TRANSFER_DISCARD_RANGE |
+                     PIPE_TRANSFER_DISCARD_WHOLE_RESOURCE))) {
+         llvmpipe_copy_tiled_box(lpr, level, box, lpt->staging,
+                                 pt->stride, pt->layer_stride, FALSE);
+      }
+
+      if (usage & PIPE_TRANSFER_WRITE) {
+         screen->timestamp++;
+      }
+
+      return lpt->staging;
+   }
+
    map = llvmpipe_resource_map(resource,
                                level,
                                box->z,
@@ -617,15 +846,28 @@ static void
 llvmpipe_transfer_unmap(struct pipe_context *pipe,
                         struct pipe_transfer *transfer)
 {
+   struct llvmpipe_transfer *lpt = (struct llvmpipe_transfer *) transfer;
+
    assert(transfer->resource);
 
+   if (lpt->staging) {
+      if (transfer->usage & PIPE_TRANSFER_WRITE) {
+         llvmpipe_copy_tiled_box(llvmpipe_resource(transfer->resource),
+                                 transfer->level, &transfer->box,
+                                 lpt->staging, transfer->stride,
+                                 transfer->layer_stride, TRUE);
+      }
+      align_free(lpt->staging);
+   }
+
    llvmpipe_resource_unmap(transfer->resource,
                            transfer->level,
                            transfer->box.z);
 
    /* Effectively do the texture_update work here - if texture images
     * needed post-processing to put them into hardware layout, this is
-    * where it would happen.  For llvmpipe, nothing to do.
+    * where it would happen.  For llvmpipe, only tiled textures need that,
+    * which was done above.
     */
    assert (transfer->resource);
    pipe_resource_reference(&transfer->resource, NULL);
@@ -62,7 +62,10 @@ struct llvmpipe_resource
 
    /** Row stride in bytes */
    unsigned row_stride[LP_MAX_TEXTURE_LEVELS];
-   /** Image stride (for cube maps, array or 3D textures) in bytes */
+   /**
+    * Image stride (for cube maps, array or 3D textures) in bytes.
+    * This is also the stride between the samples of multisampled textures.
+    */
    unsigned img_stride[LP_MAX_TEXTURE_LEVELS];
    /** Offset to start of mipmap level, in bytes */
    unsigned mip_offsets[LP_MAX_TEXTURE_LEVELS];
@@ -102,6 +105,9 @@ struct llvmpipe_transfer
    struct pipe_transfer base;
 
    unsigned long offset;
+
+   /** Linear copy of the box, for textures stored in tiles */
+   ubyte *staging;
 };
 
 
@@ -220,6 +226,11 @@ llvmpipe_get_texture_image_address(struct llvmpipe_resource *lpr,
                                    unsigned face_slice, unsigned level);
 
 
+boolean
+llvmpipe_resource_untile(struct pipe_context *pipe,
+                         struct pipe_resource *resource);
+
+
 extern void
 llvmpipe_print_resources(void);
 
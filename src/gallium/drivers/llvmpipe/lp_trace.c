@@ -0,0 +1,209 @@
+/**************************************************************************
+ *
+ * Copyright 2016 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * \file
+ * Ring buffer of timing events, exported as Chrome trace JSON.
+ */
+
+#include <stdio.h>
+#include "util/u_atomic.h"
+#include "util/u_debug.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "os/os_time.h"
+#include "lp_limits.h"
+#include "lp_trace.h"
+
+
+struct lp_trace_event
+{
+   int64_t start;    /**< nanoseconds */
+   int64_t end;
+   unsigned type:8;
+   unsigned thread:8;
+   unsigned arg[3];
+};
+
+
+struct lp_trace
+{
+   const char *filename;
+   int64_t base;     /**< time of creation, the origin of the timeline */
+
+   struct lp_trace_event *events;
+   unsigned size;    /**< power of two */
+   unsigned count;   /**< events ever added, incremented atomically */
+};
+
+
+/**
+ * Create the trace of a screen, if LP_TRACE names a file to write it to.
+ * LP_TRACE_SIZE sets the number of most recent events kept.
+ */
+struct lp_trace *
+lp_trace_create(void)
+{
+   const char *filename = debug_get_option("LP_TRACE", NULL);
+   struct lp_trace *trace;
+   unsigned size;
+
+   if (!filename || !*filename)
+      return NULL;
+
+   size = debug_get_num_option("LP_TRACE_SIZE", 64 * 1024);
+   size = util_next_power_of_two(MAX2(size, 1024));
+
+   trace = CALLOC_STRUCT(lp_trace);
+   if (!trace)
+      return NULL;
+
+   trace->events = MALLOC(size * sizeof trace->events[0]);
+   if (!trace->events) {
+      FREE(trace);
+      return NULL;
+   }
+
+   trace->filename = filename;
+   trace->size = size;
+   trace->base = os_time_get_nano();
+
+   return trace;
+}
+
+
+/**
+ * Record an event.  May be called from any thread.
+ */
+void
+lp_trace_add(struct lp_trace *trace,
+             enum lp_trace_type type,
+             unsigned thread,
+             int64_t start, int64_t end,
+             unsigned arg0, unsigned arg1, unsigned arg2)
+{
+   unsigned index = p_atomic_inc_return(&trace->count) - 1;
+   struct lp_trace_event *event = &trace->events[index & (trace->size - 1)];
+
+   event->start = start;
+   event->end = end;
+   event->type = type;
+   event->thread = thread;
+   event->arg[0] = arg0;
+   event->arg[1] = arg1;
+   event->arg[2] = arg2;
+}
+
+
+static void
+write_event(FILE *f, const struct lp_trace *trace,
+            const struct lp_trace_event *event)
+{
+   const double ts = (event->start - trace->base) / 1000.0;
+   const double dur = (event->end - event->start) / 1000.0;
+
+   switch (event->type) {
+   case LP_TRACE_SETUP:
+      fprintf(f, "{\"name\":\"setup\",\"cat\":\"scene\",\"ph\":\"X\","
+              "\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+              "\"args\":{\"scene\":%u}}",
+              event->thread, ts, dur, event->arg[0]);
+      break;
+   case LP_TRACE_RASTERIZE:
+      fprintf(f, "{\"name\":\"rasterize\",\"cat\":\"scene\",\"ph\":\"X\","
+              "\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+              "\"args\":{\"scene\":%u,\"bins\":%u}}",
+              event->thread, ts, dur, event->arg[0], event->arg[1]);
+      break;
+   case LP_TRACE_BIN:
+      fprintf(f, "{\"name\":\"bin %u,%u\",\"cat\":\"bin\",\"ph\":\"X\","
+              "\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+              "\"args\":{\"commands\":%u}}",
+              event->arg[0], event->arg[1],
+              event->thread, ts, dur, event->arg[2]);
+      break;
+   case LP_TRACE_SHADE:
+      fprintf(f, "{\"name\":\"fs%u_variant%u\",\"cat\":\"shade\",\"ph\":\"X\","
+              "\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+              "\"args\":{\"commands\":%u}}",
+              event->arg[0], event->arg[1],
+              event->thread, ts, dur, event->arg[2]);
+      break;
+   case LP_TRACE_FRAME:
+      fprintf(f, "{\"name\":\"frame\",\"cat\":\"frame\",\"ph\":\"i\","
+              "\"s\":\"g\",\"pid\":1,\"tid\":%u,\"ts\":%.3f}",
+              event->thread, ts);
+      break;
+   default:
+      assert(0);
+      break;
+   }
+}
+
+
+/**
+ * Write the events still in the ring to the trace file, and free the
+ * trace.  All threads must be done adding events.
+ */
+void
+lp_trace_destroy(struct lp_trace *trace)
+{
+   unsigned first, i;
+   FILE *f;
+
+   if (!trace)
+      return;
+
+   f = fopen(trace->filename, "w");
+   if (f) {
+      fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+      /* name the timelines */
+      fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+              "\"tid\":%u,\"args\":{\"name\":\"setup\"}}",
+              LP_TRACE_SETUP_THREAD);
+      for (i = 0; i < LP_MAX_THREADS; i++) {
+         fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                 "\"tid\":%u,\"args\":{\"name\":\"rasterizer %u\"}}",
+                 i + 1, i);
+      }
+
+      first = trace->count > trace->size ? trace->count - trace->size : 0;
+      for (i = first; i != trace->count; i++) {
+         fprintf(f, ",\n");
+         write_event(f, trace, &trace->events[i & (trace->size - 1)]);
+      }
+
+      fprintf(f, "\n]}\n");
+      fclose(f);
+   }
+   else {
+      debug_printf("llvmpipe: failed to write trace to %s\n", trace->filename);
+   }
+
+   FREE(trace->events);
+   FREE(trace);
+}
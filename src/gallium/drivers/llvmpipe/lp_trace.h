@@ -0,0 +1,75 @@
+/**************************************************************************
+ *
+ * Copyright 2016 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Opt-in timeline of where the time of a frame goes: scene setup,
+ * rasterization per thread, bins and shading per fragment shader variant.
+ *
+ * Events are recorded into a ring buffer which keeps the most recent ones,
+ * and written as Chrome trace JSON (chrome://tracing, or Perfetto) to the
+ * file named by LP_TRACE when the screen is destroyed.
+ */
+
+#ifndef LP_TRACE_H
+#define LP_TRACE_H
+
+#include "pipe/p_compiler.h"
+
+
+enum lp_trace_type
+{
+   LP_TRACE_SETUP,      /**< binning of a scene, arg0 = scene */
+   LP_TRACE_RASTERIZE,  /**< a thread's share of a scene, arg0 = scene,
+                             arg1 = number of bins */
+   LP_TRACE_BIN,        /**< a bin, arg0/1 = tile position, arg2 = commands */
+   LP_TRACE_SHADE,      /**< commands of a bin using one shader variant,
+                             arg0 = shader, arg1 = variant, arg2 = commands */
+   LP_TRACE_FRAME       /**< instant, a frame was presented */
+};
+
+
+/** Timeline of the context thread, rasterizer thread i is i + 1 */
+#define LP_TRACE_SETUP_THREAD 0
+
+
+struct lp_trace;
+
+
+struct lp_trace *
+lp_trace_create(void);
+
+void
+lp_trace_destroy(struct lp_trace *trace);
+
+void
+lp_trace_add(struct lp_trace *trace,
+             enum lp_trace_type type,
+             unsigned thread,
+             int64_t start, int64_t end,
+             unsigned arg0, unsigned arg1, unsigned arg2);
+
+
+#endif /* LP_TRACE_H */
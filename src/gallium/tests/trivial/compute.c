@@ -38,6 +38,7 @@
 #include "util/u_sampler.h"
 #include "util/u_format.h"
 #include "tgsi/tgsi_text.h"
+#include "os/os_time.h"
 #include "pipe-loader/pipe_loader.h"
 
 #define MAX_RESOURCES 4
@@ -1572,6 +1573,61 @@ static void test_atom_race(struct context *ctx, bool global)
         destroy_prog(ctx);
 }
 
+static void test_throughput(struct context *ctx)
+{
+        const char *src = "COMP\n"
+                "DCL RES[0], BUFFER, RAW, WR\n"
+                "DCL SV[0], BLOCK_ID[0]\n"
+                "DCL SV[1], BLOCK_SIZE[0]\n"
+                "DCL SV[2], THREAD_ID[0]\n"
+                "DCL TEMP[0], LOCAL\n"
+                "DCL TEMP[1], LOCAL\n"
+                "IMM UINT32 { 4, 1, 0, 0 }\n"
+                "\n"
+                "    BGNSUB\n"
+                "       UMAD TEMP[0].x, SV[0], SV[1], SV[2]\n"
+                "       UMUL TEMP[0].x, TEMP[0], IMM[0]\n"
+                "       LOAD TEMP[1].x, RES[0], TEMP[0]\n"
+                "       UADD TEMP[1].x, TEMP[1], IMM[0].yyyy\n"
+                "       STORE RES[0].x, TEMP[0], TEMP[1]\n"
+                "       RET\n"
+                "    ENDSUB\n";
+        const unsigned block = 256, grid = 4096, iters = 64;
+        void init(void *p, int s, int x, int y) {
+                *(uint32_t *)p = 0;
+        }
+        void expect(void *p, int s, int x, int y) {
+                *(uint32_t *)p = iters;
+        }
+        int64_t start, end;
+        double secs;
+        unsigned i;
+
+        printf("- %s\n", __func__);
+
+        init_prog(ctx, 0, 0, 0, src, NULL);
+        init_tex(ctx, 0, PIPE_BUFFER, true, PIPE_FORMAT_R32_FLOAT,
+                 block * grid * 4, 0, init);
+        init_compute_resources(ctx, (int []) { 0, -1 });
+
+        start = os_time_get_nano();
+        for (i = 0; i < iters; i++)
+                launch_grid(ctx, (uint []){block, 1, 1},
+                            (uint []){grid, 1, 1}, 0, NULL);
+        ctx->pipe->flush(ctx->pipe, NULL, 0);
+        end = os_time_get_nano();
+
+        secs = (end - start) / 1e9;
+        printf("%u grids of %u invocations in %.3f s: %.1f Minvocations/s\n",
+               iters, block * grid, secs,
+               (double)iters * block * grid / secs / 1e6);
+
+        check_tex(ctx, 0, expect, NULL);
+        destroy_compute_resources(ctx);
+        destroy_tex(ctx);
+        destroy_prog(ctx);
+}
+
 int main(int argc, char *argv[])
 {
         struct context *ctx = CALLOC_STRUCT(context);
@@ -1614,6 +1670,8 @@ int main(int argc, char *argv[])
            test_atom_ops(ctx, false);
         if (tests & (1 << 16))
            test_atom_race(ctx, false);
+        if (tests & (1 << 17))
+           test_throughput(ctx);
 
         destroy_ctx(ctx);
 
@@ -0,0 +1,348 @@
+/**************************************************************************
+ *
+ * Copyright 2016 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Fill rate benchmark.
+ *
+ * Renders frames made of a few blended full screen triangles plus a cloud
+ * of small triangles crowded into one corner, which gives the rasterizer
+ * threads an uneven amount of work per tile.  Run it with different
+ * LP_NUM_THREADS (and LP_PIN_THREADS) values to see how throughput scales
+ * with the number of rasterizer threads.
+ *
+ * Usage: fill-rate [frames]
+ */
+
+#define WIDTH 2048
+#define HEIGHT 2048
+#define NEAR 30
+#define FAR 1000
+#define NUM_BIG_TRIS 8
+#define NUM_SMALL_TRIS 20000
+#define NUM_TRIS (NUM_BIG_TRIS + NUM_SMALL_TRIS)
+#define DEFAULT_FRAMES 50
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* pipe_*_state structs */
+#include "pipe/p_state.h"
+/* pipe_context */
+#include "pipe/p_context.h"
+/* pipe_screen */
+#include "pipe/p_screen.h"
+/* PIPE_* */
+#include "pipe/p_defines.h"
+/* TGSI_SEMANTIC_{POSITION|GENERIC} */
+#include "pipe/p_shader_tokens.h"
+/* pipe_buffer_* helpers */
+#include "util/u_inlines.h"
+
+/* constant state object helper */
+#include "cso_cache/cso_context.h"
+
+/* util_draw_vertex_buffer helper */
+#include "util/u_draw_quad.h"
+/* FREE & CALLOC_STRUCT */
+#include "util/u_memory.h"
+/* util_make_[fragment|vertex]_passthrough_shader */
+#include "util/u_simple_shaders.h"
+/* os_time_get_nano */
+#include "os/os_time.h"
+/* to get a hardware pipe driver */
+#include "pipe-loader/pipe_loader.h"
+
+struct program
+{
+	struct pipe_loader_device *dev;
+	struct pipe_screen *screen;
+	struct pipe_context *pipe;
+	struct cso_context *cso;
+
+	struct pipe_blend_state blend;
+	struct pipe_depth_stencil_alpha_state depthstencil;
+	struct pipe_rasterizer_state rasterizer;
+	struct pipe_viewport_state viewport;
+	struct pipe_framebuffer_state framebuffer;
+	struct pipe_vertex_element velem[2];
+
+	void *vs;
+	void *fs;
+
+	union pipe_color_union clear_color;
+
+	struct pipe_resource *vbuf;
+	struct pipe_resource *target;
+};
+
+static void set_vertex(float (*v)[2][4], float x, float y,
+		       float r, float g, float b)
+{
+	v[0][0][0] = x;
+	v[0][0][1] = y;
+	v[0][0][2] = 0.0f;
+	v[0][0][3] = 1.0f;
+	v[0][1][0] = r;
+	v[0][1][1] = g;
+	v[0][1][2] = b;
+	v[0][1][3] = 0.25f;
+}
+
+static void init_vertices(struct program *p)
+{
+	float (*vertices)[2][4];
+	unsigned size = NUM_TRIS * 3 * sizeof(*vertices);
+	unsigned i;
+
+	vertices = MALLOC(size);
+	assert(vertices);
+
+	/* large triangles covering the whole target */
+	for (i = 0; i < NUM_BIG_TRIS; i++) {
+		float c = (float)i / NUM_BIG_TRIS;
+		set_vertex(&vertices[i * 3 + 0], -1.0f, -1.0f, c, 0.0f, 0.0f);
+		set_vertex(&vertices[i * 3 + 1],  3.0f, -1.0f, 0.0f, c, 0.0f);
+		set_vertex(&vertices[i * 3 + 2], -1.0f,  3.0f, 0.0f, 0.0f, c);
+	}
+
+	/* small triangles, all in the bottom left eighth of the target */
+	srand(0);
+	for (i = NUM_BIG_TRIS; i < NUM_TRIS; i++) {
+		float x = -1.0f + 0.25f * rand() / RAND_MAX;
+		float y = -1.0f + 0.25f * rand() / RAND_MAX;
+		set_vertex(&vertices[i * 3 + 0], x, y, 1.0f, 0.0f, 0.0f);
+		set_vertex(&vertices[i * 3 + 1], x + 0.02f, y, 0.0f, 1.0f, 0.0f);
+		set_vertex(&vertices[i * 3 + 2], x, y + 0.02f, 0.0f, 0.0f, 1.0f);
+	}
+
+	p->vbuf = pipe_buffer_create(p->screen, PIPE_BIND_VERTEX_BUFFER,
+				     PIPE_USAGE_DEFAULT, size);
+	pipe_buffer_write(p->pipe, p->vbuf, 0, size, vertices);
+
+	FREE(vertices);
+}
+
+static void init_prog(struct program *p)
+{
+	struct pipe_surface surf_tmpl;
+	int ret;
+
+	/* find a hardware device */
+	ret = pipe_loader_probe(&p->dev, 1);
+	assert(ret);
+
+	/* init a pipe screen */
+	p->screen = pipe_loader_create_screen(p->dev);
+	assert(p->screen);
+
+	/* create the pipe driver context and cso context */
+	p->pipe = p->screen->context_create(p->screen, NULL, 0);
+	p->cso = cso_create_context(p->pipe);
+
+	/* set clear color */
+	p->clear_color.f[0] = 0.3;
+	p->clear_color.f[1] = 0.1;
+	p->clear_color.f[2] = 0.3;
+	p->clear_color.f[3] = 1.0;
+
+	init_vertices(p);
+
+	/* render target texture */
+	{
+		struct pipe_resource tmplt;
+		memset(&tmplt, 0, sizeof(tmplt));
+		tmplt.target = PIPE_TEXTURE_2D;
+		tmplt.format = PIPE_FORMAT_B8G8R8A8_UNORM; /* All drivers support this */
+		tmplt.width0 = WIDTH;
+		tmplt.height0 = HEIGHT;
+		tmplt.depth0 = 1;
+		tmplt.array_size = 1;
+		tmplt.last_level = 0;
+		tmplt.bind = PIPE_BIND_RENDER_TARGET;
+
+		p->target = p->screen->resource_create(p->screen, &tmplt);
+	}
+
+	/* alpha blending, so that no triangle hides the ones below it */
+	memset(&p->blend, 0, sizeof(p->blend));
+	p->blend.rt[0].blend_enable = 1;
+	p->blend.rt[0].rgb_func = PIPE_BLEND_ADD;
+	p->blend.rt[0].rgb_src_factor = PIPE_BLENDFACTOR_SRC_ALPHA;
+	p->blend.rt[0].rgb_dst_factor = PIPE_BLENDFACTOR_INV_SRC_ALPHA;
+	p->blend.rt[0].alpha_func = PIPE_BLEND_ADD;
+	p->blend.rt[0].alpha_src_factor = PIPE_BLENDFACTOR_ONE;
+	p->blend.rt[0].alpha_dst_factor = PIPE_BLENDFACTOR_ZERO;
+	p->blend.rt[0].colormask = PIPE_MASK_RGBA;
+
+	/* no-op depth/stencil/alpha */
+	memset(&p->depthstencil, 0, sizeof(p->depthstencil));
+
+	/* rasterizer */
+	memset(&p->rasterizer, 0, sizeof(p->rasterizer));
+	p->rasterizer.cull_face = PIPE_FACE_NONE;
+	p->rasterizer.half_pixel_center = 1;
+	p->rasterizer.bottom_edge_rule = 1;
+	p->rasterizer.depth_clip = 1;
+
+	surf_tmpl.format = PIPE_FORMAT_B8G8R8A8_UNORM;
+	surf_tmpl.u.tex.level = 0;
+	surf_tmpl.u.tex.first_layer = 0;
+	surf_tmpl.u.tex.last_layer = 0;
+	/* drawing destination */
+	memset(&p->framebuffer, 0, sizeof(p->framebuffer));
+	p->framebuffer.width = WIDTH;
+	p->framebuffer.height = HEIGHT;
+	p->framebuffer.nr_cbufs = 1;
+	p->framebuffer.cbufs[0] = p->pipe->create_surface(p->pipe, p->target, &surf_tmpl);
+
+	/* viewport, depth isn't really needed */
+	{
+		float half_width = (float)WIDTH / 2.0f;
+		float half_height = (float)HEIGHT / 2.0f;
+		float half_depth = ((float)FAR - (float)NEAR) / 2.0f;
+
+		p->viewport.scale[0] = half_width;
+		p->viewport.scale[1] = half_height;
+		p->viewport.scale[2] = half_depth;
+
+		p->viewport.translate[0] = half_width;
+		p->viewport.translate[1] = half_height;
+		p->viewport.translate[2] = half_depth + FAR;
+	}
+
+	/* vertex elements state */
+	memset(p->velem, 0, sizeof(p->velem));
+	p->velem[0].src_offset = 0 * 4 * sizeof(float); /* offset 0, first element */
+	p->velem[0].instance_divisor = 0;
+	p->velem[0].vertex_buffer_index = 0;
+	p->velem[0].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+
+	p->velem[1].src_offset = 1 * 4 * sizeof(float); /* offset 16, second element */
+	p->velem[1].instance_divisor = 0;
+	p->velem[1].vertex_buffer_index = 0;
+	p->velem[1].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+
+	/* vertex shader */
+	{
+			const uint semantic_names[] = { TGSI_SEMANTIC_POSITION,
+							TGSI_SEMANTIC_COLOR };
+			const uint semantic_indexes[] = { 0, 0 };
+			p->vs = util_make_vertex_passthrough_shader(p->pipe, 2, semantic_names, semantic_indexes, FALSE);
+	}
+
+	/* fragment shader */
+	p->fs = util_make_fragment_passthrough_shader(p->pipe,
+                    TGSI_SEMANTIC_COLOR, TGSI_INTERPOLATE_PERSPECTIVE, TRUE);
+}
+
+static void close_prog(struct program *p)
+{
+	cso_destroy_context(p->cso);
+
+	p->pipe->delete_vs_state(p->pipe, p->vs);
+	p->pipe->delete_fs_state(p->pipe, p->fs);
+
+	pipe_surface_reference(&p->framebuffer.cbufs[0], NULL);
+	pipe_resource_reference(&p->target, NULL);
+	pipe_resource_reference(&p->vbuf, NULL);
+
+	p->pipe->destroy(p->pipe);
+	p->screen->destroy(p->screen);
+	pipe_loader_release(&p->dev, 1);
+
+	FREE(p);
+}
+
+static void draw_frame(struct program *p)
+{
+	struct pipe_fence_handle *fence = NULL;
+
+	/* set the render target */
+	cso_set_framebuffer(p->cso, &p->framebuffer);
+
+	/* clear the render target */
+	p->pipe->clear(p->pipe, PIPE_CLEAR_COLOR, &p->clear_color, 0, 0);
+
+	/* set misc state we care about */
+	cso_set_blend(p->cso, &p->blend);
+	cso_set_depth_stencil_alpha(p->cso, &p->depthstencil);
+	cso_set_rasterizer(p->cso, &p->rasterizer);
+	cso_set_viewport(p->cso, &p->viewport);
+
+	/* shaders */
+	cso_set_fragment_shader_handle(p->cso, p->fs);
+	cso_set_vertex_shader_handle(p->cso, p->vs);
+
+	/* vertex element data */
+	cso_set_vertex_elements(p->cso, 2, p->velem);
+
+	util_draw_vertex_buffer(p->pipe, p->cso,
+	                        p->vbuf, 0, 0,
+	                        PIPE_PRIM_TRIANGLES,
+	                        NUM_TRIS * 3, /* verts */
+	                        2);           /* attribs/vert */
+
+	/* wait for the rasterizer to be done with the frame */
+	p->pipe->flush(p->pipe, &fence, 0);
+	p->screen->fence_finish(p->screen, fence, PIPE_TIMEOUT_INFINITE);
+	p->screen->fence_reference(p->screen, &fence, NULL);
+}
+
+int main(int argc, char** argv)
+{
+	struct program *p = CALLOC_STRUCT(program);
+	unsigned frames = argc > 1 ? atoi(argv[1]) : DEFAULT_FRAMES;
+	struct pipe_query *q;
+	union pipe_query_result pixels;
+	int64_t start, end;
+	double secs;
+	unsigned i;
+
+	init_prog(p);
+
+	/* warm up, compiles the shader variants and counts the pixels
+	 * rasterized per frame, small triangles included; the frames are
+	 * identical so the timed loop itself runs without the query */
+	q = p->pipe->create_query(p->pipe, PIPE_QUERY_OCCLUSION_COUNTER, 0);
+	p->pipe->begin_query(p->pipe, q);
+	draw_frame(p);
+	p->pipe->end_query(p->pipe, q);
+	p->pipe->get_query_result(p->pipe, q, TRUE, &pixels);
+	p->pipe->destroy_query(p->pipe, q);
+
+	start = os_time_get_nano();
+	for (i = 0; i < frames; i++)
+		draw_frame(p);
+	end = os_time_get_nano();
+
+	secs = (end - start) / 1e9;
+	printf("%u frames in %.3f s: %.2f frames/s, %.1f Mpixels/s\n",
+	       frames, secs, frames / secs,
+	       (double)frames * pixels.u64 / secs / 1e6);
+
+	close_prog(p);
+
+	return 0;
+}
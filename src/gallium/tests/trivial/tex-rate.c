@@ -0,0 +1,386 @@
+/**************************************************************************
+ *
+ * Copyright 2016 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Texture sampling benchmark.
+ *
+ * Draws a bilinearly filtered texture over the whole target, rotated by
+ * 90 degrees so that neighboring pixels walk down the columns of the
+ * texture.  Both textures are created with the sampler view and render
+ * target bind flags, like state trackers create most textures, but only
+ * the second one is then bound as a render target.  llvmpipe keeps the
+ * first in 4x4 texel tiles and switches the second to rows when it is
+ * bound, so the two rates compare the layouts (LP_PERF=no_tex_tiling
+ * stores both in rows).
+ *
+ * Usage: tex-rate [frames]
+ */
+
+#define WIDTH 1024
+#define HEIGHT 1024
+#define TEX_SIZE 2048
+#define DEFAULT_FRAMES 50
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* pipe_*_state structs */
+#include "pipe/p_state.h"
+/* pipe_context */
+#include "pipe/p_context.h"
+/* pipe_screen */
+#include "pipe/p_screen.h"
+/* PIPE_* */
+#include "pipe/p_defines.h"
+/* TGSI_SEMANTIC_{POSITION|GENERIC} */
+#include "pipe/p_shader_tokens.h"
+/* pipe_buffer_* helpers */
+#include "util/u_inlines.h"
+
+/* constant state object helper */
+#include "cso_cache/cso_context.h"
+
+/* u_box_origin_2d */
+#include "util/u_box.h"
+/* u_sampler_view_default_template */
+#include "util/u_sampler.h"
+/* u_surface_default_template */
+#include "util/u_surface.h"
+/* util_draw_vertex_buffer helper */
+#include "util/u_draw_quad.h"
+/* FREE & CALLOC_STRUCT */
+#include "util/u_memory.h"
+/* util_make_[fragment|vertex]_passthrough_shader */
+#include "util/u_simple_shaders.h"
+/* os_time_get_nano */
+#include "os/os_time.h"
+/* to get a hardware pipe driver */
+#include "pipe-loader/pipe_loader.h"
+
+struct program
+{
+	struct pipe_loader_device *dev;
+	struct pipe_screen *screen;
+	struct pipe_context *pipe;
+	struct cso_context *cso;
+
+	struct pipe_blend_state blend;
+	struct pipe_depth_stencil_alpha_state depthstencil;
+	struct pipe_rasterizer_state rasterizer;
+	struct pipe_sampler_state sampler;
+	struct pipe_viewport_state viewport;
+	struct pipe_framebuffer_state framebuffer;
+	struct pipe_vertex_element velem[2];
+
+	void *vs;
+	void *fs;
+
+	struct pipe_resource *vbuf;
+	struct pipe_resource *target;
+	struct pipe_resource *tex[2];
+	struct pipe_sampler_view *view[2];
+};
+
+static const char *layout_names[2] = {
+	"never rendered to",
+	"rendered to"
+};
+
+static void init_texture(struct program *p, unsigned i, boolean render)
+{
+	struct pipe_resource tmplt;
+	struct pipe_sampler_view v_tmplt;
+	struct pipe_transfer *t;
+	struct pipe_box box;
+	uint8_t *map;
+	unsigned x, y;
+
+	memset(&tmplt, 0, sizeof(tmplt));
+	tmplt.target = PIPE_TEXTURE_2D;
+	tmplt.format = PIPE_FORMAT_B8G8R8A8_UNORM; /* All drivers support this */
+	tmplt.width0 = TEX_SIZE;
+	tmplt.height0 = TEX_SIZE;
+	tmplt.depth0 = 1;
+	tmplt.array_size = 1;
+	tmplt.last_level = 0;
+	tmplt.bind = PIPE_BIND_SAMPLER_VIEW | PIPE_BIND_RENDER_TARGET;
+
+	p->tex[i] = p->screen->resource_create(p->screen, &tmplt);
+
+	u_box_origin_2d(TEX_SIZE, TEX_SIZE, &box);
+	map = p->pipe->transfer_map(p->pipe, p->tex[i], 0,
+				    PIPE_TRANSFER_WRITE |
+				    PIPE_TRANSFER_DISCARD_WHOLE_RESOURCE,
+				    &box, &t);
+
+	srand(0);
+	for (y = 0; y < TEX_SIZE; y++) {
+		uint32_t *row = (uint32_t *)(map + y * t->stride);
+		for (x = 0; x < TEX_SIZE; x++)
+			row[x] = 0xff000000 | (rand() & 0xffffff);
+	}
+
+	p->pipe->transfer_unmap(p->pipe, t);
+
+	if (render) {
+		struct pipe_surface surf_tmpl, *surf;
+
+		u_surface_default_template(&surf_tmpl, p->tex[i]);
+		surf = p->pipe->create_surface(p->pipe, p->tex[i], &surf_tmpl);
+		pipe_surface_reference(&surf, NULL);
+	}
+
+	u_sampler_view_default_template(&v_tmplt, p->tex[i], p->tex[i]->format);
+	p->view[i] = p->pipe->create_sampler_view(p->pipe, p->tex[i], &v_tmplt);
+}
+
+static void init_prog(struct program *p)
+{
+	struct pipe_surface surf_tmpl;
+	int ret;
+
+	/* find a hardware device */
+	ret = pipe_loader_probe(&p->dev, 1);
+	assert(ret);
+
+	/* init a pipe screen */
+	p->screen = pipe_loader_create_screen(p->dev);
+	assert(p->screen);
+
+	/* create the pipe driver context and cso context */
+	p->pipe = p->screen->context_create(p->screen, NULL, 0);
+	p->cso = cso_create_context(p->pipe);
+
+	/* full screen quad, texture rotated by 90 degrees */
+	{
+		float vertices[4][2][4] = {
+			{
+				{ -1.0f, -1.0f, 0.0f, 1.0f },
+				{  1.0f,  0.0f, 0.0f, 1.0f }
+			},
+			{
+				{  1.0f, -1.0f, 0.0f, 1.0f },
+				{  1.0f,  1.0f, 0.0f, 1.0f }
+			},
+			{
+				{  1.0f,  1.0f, 0.0f, 1.0f },
+				{  0.0f,  1.0f, 0.0f, 1.0f }
+			},
+			{
+				{ -1.0f,  1.0f, 0.0f, 1.0f },
+				{  0.0f,  0.0f, 0.0f, 1.0f }
+			}
+		};
+
+		p->vbuf = pipe_buffer_create(p->screen, PIPE_BIND_VERTEX_BUFFER,
+					     PIPE_USAGE_DEFAULT, sizeof(vertices));
+		pipe_buffer_write(p->pipe, p->vbuf, 0, sizeof(vertices), vertices);
+	}
+
+	/* render target texture */
+	{
+		struct pipe_resource tmplt;
+		memset(&tmplt, 0, sizeof(tmplt));
+		tmplt.target = PIPE_TEXTURE_2D;
+		tmplt.format = PIPE_FORMAT_B8G8R8A8_UNORM; /* All drivers support this */
+		tmplt.width0 = WIDTH;
+		tmplt.height0 = HEIGHT;
+		tmplt.depth0 = 1;
+		tmplt.array_size = 1;
+		tmplt.last_level = 0;
+		tmplt.bind = PIPE_BIND_RENDER_TARGET;
+
+		p->target = p->screen->resource_create(p->screen, &tmplt);
+	}
+
+	/* the same texture in the two layouts */
+	init_texture(p, 0, FALSE);
+	init_texture(p, 1, TRUE);
+
+	/* disabled blending/masking */
+	memset(&p->blend, 0, sizeof(p->blend));
+	p->blend.rt[0].colormask = PIPE_MASK_RGBA;
+
+	/* no-op depth/stencil/alpha */
+	memset(&p->depthstencil, 0, sizeof(p->depthstencil));
+
+	/* rasterizer */
+	memset(&p->rasterizer, 0, sizeof(p->rasterizer));
+	p->rasterizer.cull_face = PIPE_FACE_NONE;
+	p->rasterizer.half_pixel_center = 1;
+	p->rasterizer.bottom_edge_rule = 1;
+	p->rasterizer.depth_clip = 1;
+
+	/* bilinear sampler */
+	memset(&p->sampler, 0, sizeof(p->sampler));
+	p->sampler.wrap_s = PIPE_TEX_WRAP_REPEAT;
+	p->sampler.wrap_t = PIPE_TEX_WRAP_REPEAT;
+	p->sampler.wrap_r = PIPE_TEX_WRAP_REPEAT;
+	p->sampler.min_mip_filter = PIPE_TEX_MIPFILTER_NONE;
+	p->sampler.min_img_filter = PIPE_TEX_FILTER_LINEAR;
+	p->sampler.mag_img_filter = PIPE_TEX_FILTER_LINEAR;
+	p->sampler.normalized_coords = 1;
+
+	surf_tmpl.format = PIPE_FORMAT_B8G8R8A8_UNORM;
+	surf_tmpl.u.tex.level = 0;
+	surf_tmpl.u.tex.first_layer = 0;
+	surf_tmpl.u.tex.last_layer = 0;
+	/* drawing destination */
+	memset(&p->framebuffer, 0, sizeof(p->framebuffer));
+	p->framebuffer.width = WIDTH;
+	p->framebuffer.height = HEIGHT;
+	p->framebuffer.nr_cbufs = 1;
+	p->framebuffer.cbufs[0] = p->pipe->create_surface(p->pipe, p->target, &surf_tmpl);
+
+	/* viewport, depth isn't really needed */
+	{
+		float half_width = (float)WIDTH / 2.0f;
+		float half_height = (float)HEIGHT / 2.0f;
+
+		p->viewport.scale[0] = half_width;
+		p->viewport.scale[1] = half_height;
+		p->viewport.scale[2] = 1.0f;
+
+		p->viewport.translate[0] = half_width;
+		p->viewport.translate[1] = half_height;
+		p->viewport.translate[2] = 0.0f;
+	}
+
+	/* vertex elements state */
+	memset(p->velem, 0, sizeof(p->velem));
+	p->velem[0].src_offset = 0 * 4 * sizeof(float); /* offset 0, first element */
+	p->velem[0].instance_divisor = 0;
+	p->velem[0].vertex_buffer_index = 0;
+	p->velem[0].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+
+	p->velem[1].src_offset = 1 * 4 * sizeof(float); /* offset 16, second element */
+	p->velem[1].instance_divisor = 0;
+	p->velem[1].vertex_buffer_index = 0;
+	p->velem[1].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+
+	/* vertex shader */
+	{
+		const uint semantic_names[] = { TGSI_SEMANTIC_POSITION,
+		                                TGSI_SEMANTIC_GENERIC };
+		const uint semantic_indexes[] = { 0, 0 };
+		p->vs = util_make_vertex_passthrough_shader(p->pipe, 2, semantic_names, semantic_indexes, FALSE);
+	}
+
+	/* fragment shader */
+	p->fs = util_make_fragment_tex_shader(p->pipe, TGSI_TEXTURE_2D,
+	                                      TGSI_INTERPOLATE_LINEAR,
+	                                      TGSI_RETURN_TYPE_FLOAT);
+}
+
+static void close_prog(struct program *p)
+{
+	unsigned i;
+
+	cso_destroy_context(p->cso);
+
+	p->pipe->delete_vs_state(p->pipe, p->vs);
+	p->pipe->delete_fs_state(p->pipe, p->fs);
+
+	pipe_surface_reference(&p->framebuffer.cbufs[0], NULL);
+	for (i = 0; i < 2; i++) {
+		pipe_sampler_view_reference(&p->view[i], NULL);
+		pipe_resource_reference(&p->tex[i], NULL);
+	}
+	pipe_resource_reference(&p->target, NULL);
+	pipe_resource_reference(&p->vbuf, NULL);
+
+	p->pipe->destroy(p->pipe);
+	p->screen->destroy(p->screen);
+	pipe_loader_release(&p->dev, 1);
+
+	FREE(p);
+}
+
+static void draw_frame(struct program *p, unsigned i)
+{
+	const struct pipe_sampler_state *samplers[] = {&p->sampler};
+	struct pipe_fence_handle *fence = NULL;
+
+	/* set the render target */
+	cso_set_framebuffer(p->cso, &p->framebuffer);
+
+	/* set misc state we care about */
+	cso_set_blend(p->cso, &p->blend);
+	cso_set_depth_stencil_alpha(p->cso, &p->depthstencil);
+	cso_set_rasterizer(p->cso, &p->rasterizer);
+	cso_set_viewport(p->cso, &p->viewport);
+
+	/* sampler and texture */
+	cso_set_samplers(p->cso, PIPE_SHADER_FRAGMENT, 1, samplers);
+	cso_set_sampler_views(p->cso, PIPE_SHADER_FRAGMENT, 1, &p->view[i]);
+
+	/* shaders */
+	cso_set_fragment_shader_handle(p->cso, p->fs);
+	cso_set_vertex_shader_handle(p->cso, p->vs);
+
+	/* vertex element data */
+	cso_set_vertex_elements(p->cso, 2, p->velem);
+
+	util_draw_vertex_buffer(p->pipe, p->cso,
+	                        p->vbuf, 0, 0,
+	                        PIPE_PRIM_QUADS,
+	                        4,  /* verts */
+	                        2); /* attribs/vert */
+
+	/* wait for the rasterizer to be done with the frame */
+	p->pipe->flush(p->pipe, &fence, 0);
+	p->screen->fence_finish(p->screen, fence, PIPE_TIMEOUT_INFINITE);
+	p->screen->fence_reference(p->screen, &fence, NULL);
+}
+
+int main(int argc, char** argv)
+{
+	struct program *p = CALLOC_STRUCT(program);
+	unsigned frames = argc > 1 ? atoi(argv[1]) : DEFAULT_FRAMES;
+	int64_t start, end;
+	double secs;
+	unsigned i, j;
+
+	init_prog(p);
+
+	for (i = 0; i < 2; i++) {
+		/* warm up, compiles the shader variants */
+		draw_frame(p, i);
+
+		start = os_time_get_nano();
+		for (j = 0; j < frames; j++)
+			draw_frame(p, i);
+		end = os_time_get_nano();
+
+		secs = (end - start) / 1e9;
+		printf("%s: %u frames in %.3f s, %.1f Mtexels/s\n",
+		       layout_names[i], frames, secs,
+		       (double)frames * WIDTH * HEIGHT / secs / 1e6);
+	}
+
+	close_prog(p);
+
+	return 0;
+}
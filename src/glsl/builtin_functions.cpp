@@ -39,7 +39,9 @@
  *
  *    The builtin_builder::create_builtins() function contains lists of all
  *    built-in function signatures, where they're available, what types they
- *    take, and so on.
+ *    take, and so on.  It is run once to record the names of all built-in
+ *    functions, and again each time a function is first looked up, to
+ *    generate the signatures of only that function.
  *
  * 4. Implementations of built-in function signatures
  *
@@ -57,6 +59,8 @@
 #include <stdio.h>
 #include "main/core.h" /* for struct gl_shader */
 #include "main/shaderobj.h"
+#include "util/hash_table.h"
+#include "util/set.h"
 #include "ir_builder.h"
 #include "glsl_parser_extras.h"
 #include "program/prog_instruction.h"
@@ -495,8 +499,10 @@ namespace {
  * builtin_builder: A singleton object representing the core of the built-in
  * function module.
  *
- * It generates IR for every built-in function signature, and organizes them
- * into functions.
+ * It generates IR for the built-in function signatures, and organizes them
+ * into functions.  Since a shader only uses a handful of the several hundred
+ * built-in functions, the IR for a function is only generated the first time
+ * it is looked up.
  */
 class builtin_builder {
 public:
@@ -507,19 +513,35 @@ public:
    void release();
    ir_function_signature *find(_mesa_glsl_parse_state *state,
                                const char *name, exec_list *actual_parameters);
+   ir_function *get_function(const char *name);
 
    /**
-    * A shader to hold all the built-in signatures; created by this module.
+    * A shader to hold the built-in signatures; created by this module.
     *
-    * This includes signatures for every built-in, regardless of version or
-    * enabled extensions.  The availability predicate associated with each
-    * signature allows matching_signature() to filter out the irrelevant ones.
+    * This includes signatures for every built-in function that has been
+    * looked up so far, regardless of version or enabled extensions.  The
+    * availability predicate associated with each signature allows
+    * matching_signature() to filter out the irrelevant ones.
     */
    gl_shader *shader;
 
 private:
    void *mem_ctx;
 
+   /**
+    * Names of the built-in functions whose IR has not been generated yet,
+    * or NULL while the intrinsics are created.
+    */
+   struct set *pending;
+
+   /**
+    * Name of the function create_builtins() is generating, or NULL when it
+    * only records the names of the built-in functions in \c pending.
+    */
+   const char *generating;
+
+   bool want_function(const char *name);
+
    /** Global variables used by built-in functions. */
    ir_variable *gl_ModelViewProjectionMatrix;
    ir_variable *gl_Vertex;
@@ -831,6 +853,8 @@ private:
  */
 builtin_builder::builtin_builder()
    : shader(NULL),
+     pending(NULL),
+     generating(NULL),
      gl_ModelViewProjectionMatrix(NULL),
      gl_Vertex(NULL)
 {
@@ -855,7 +879,7 @@ builtin_builder::find(_mesa_glsl_parse_state *state,
     */
    state->uses_builtin_functions = true;
 
-   ir_function *f = shader->symbols->get_function(name);
+   ir_function *f = get_function(name);
    if (f == NULL)
       return NULL;
 
@@ -867,6 +891,45 @@ builtin_builder::find(_mesa_glsl_parse_state *state,
    return sig;
 }
 
+/**
+ * Look up the built-in function called \c name, generating its signatures
+ * if this is the first time it is asked for.
+ */
+ir_function *
+builtin_builder::get_function(const char *name)
+{
+   struct set_entry *entry = _mesa_set_search(pending, name);
+
+   if (entry != NULL) {
+      _mesa_set_remove(pending, entry);
+
+      generating = name;
+      create_builtins();
+      generating = NULL;
+   }
+
+   return shader->symbols->get_function(name);
+}
+
+/**
+ * Decide whether create_builtins() should generate the signatures of the
+ * function called \c name.
+ */
+bool
+builtin_builder::want_function(const char *name)
+{
+   /* The intrinsics are always generated up front. */
+   if (pending == NULL)
+      return true;
+
+   if (generating == NULL) {
+      _mesa_set_add(pending, name);
+      return false;
+   }
+
+   return strcmp(name, generating) == 0;
+}
+
 void
 builtin_builder::initialize()
 {
@@ -877,6 +940,12 @@ builtin_builder::initialize()
    mem_ctx = ralloc_context(NULL);
    create_shader();
    create_intrinsics();
+
+   /* Only record which built-in functions exist; their IR is generated by
+    * get_function() when they are first used.
+    */
+   pending = _mesa_set_create(mem_ctx, _mesa_key_hash_string,
+                              _mesa_key_string_equal);
    create_builtins();
 }
 
@@ -885,6 +954,7 @@ builtin_builder::release()
 {
    ralloc_free(mem_ctx);
    mem_ctx = NULL;
+   pending = NULL;
 
    ralloc_free(shader);
    shader = NULL;
@@ -1014,6 +1084,16 @@ builtin_builder::create_intrinsics()
 void
 builtin_builder::create_builtins()
 {
+   /* Skip building the signatures of functions other than the one being
+    * generated.  The arguments, which build the IR, are only evaluated if
+    * want_function() returns true.
+    */
+#define add_function(NAME, ...)                 \
+   do {                                         \
+      if (want_function(NAME))                  \
+         add_function(NAME, __VA_ARGS__);       \
+   } while (0)
+
 #define F(NAME)                                 \
    add_function(#NAME,                          \
                 _##NAME(glsl_type::float_type), \
@@ -2834,6 +2914,7 @@ builtin_builder::create_builtins()
 #undef FIUD
 #undef FIUBD
 #undef FIU2_MIXED
+#undef add_function
 }
 
 void
@@ -2905,6 +2986,9 @@ builtin_builder::add_image_function(const char *name,
       glsl_type::uimage2DMSArray_type
    };
 
+   if (!want_function(name))
+      return;
+
    ir_function *f = new(mem_ctx) ir_function(name);
 
    for (unsigned i = 0; i < ARRAY_SIZE(types); ++i) {
@@ -5434,11 +5518,18 @@ _mesa_glsl_find_builtin_function_by_name(const char *name)
 {
    ir_function *f;
    mtx_lock(&builtins_lock);
-   f = builtins.shader->symbols->get_function(name);
+   f = builtins.get_function(name);
    mtx_unlock(&builtins_lock);
    return f;
 }
 
+/**
+ * Get the shader holding the built-in functions.
+ *
+ * Its symbol table grows as built-in functions are generated on first use,
+ * so functions must be looked up through
+ * _mesa_glsl_find_builtin_function_by_name() rather than directly.
+ */
 gl_shader *
 _mesa_glsl_get_builtin_function_shader()
 {
@@ -34,7 +34,9 @@
 #include "glsl_parser_extras.h"
 #include "glsl_parser.h"
 #include "ir_optimization.h"
+#include "ir_pass_tracker.h"
 #include "loop_analysis.h"
+#include "shader_cache.h"
 
 /**
  * Format a short human-readable description of the given GLSL version.
@@ -1747,20 +1749,64 @@ set_shader_inout_layout(struct gl_shader *shader,
    }
 }
 
+/**
+ * Create a new symbol table that contains only the variables and functions
+ * that exist in the shader's IR.  The symbol table will be used later during
+ * linking.
+ *
+ * We don't have to worry about types or interface-types here because those
+ * are fly-weights that are looked up by glsl_type.
+ */
+static void
+init_shader_symbols(struct gl_shader *shader)
+{
+   shader->symbols = new(shader->ir) glsl_symbol_table;
+
+   foreach_in_list (ir_instruction, ir, shader->ir) {
+      switch (ir->ir_type) {
+      case ir_type_function:
+         shader->symbols->add_function((ir_function *) ir);
+         break;
+      case ir_type_variable: {
+         ir_variable *const var = (ir_variable *) ir;
+
+         if (var->data.mode != ir_var_temporary)
+            shader->symbols->add_variable(var);
+         break;
+      }
+      default:
+         break;
+      }
+   }
+}
+
 extern "C" {
 
 void
 _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader,
                           bool dump_ast, bool dump_hir)
 {
-   struct _mesa_glsl_parse_state *state =
-      new(shader) _mesa_glsl_parse_state(ctx, shader->Stage, shader);
+   struct _mesa_glsl_parse_state *state;
    const char *source = shader->Source;
+   unsigned char cache_key[SHADER_CACHE_KEY_SIZE];
+   bool use_cache;
 
    if (ctx->Const.GenerateTemporaryNames)
       (void) p_atomic_cmpxchg(&ir_variable::temporaries_allocate_names,
                               false, true);
 
+   /* Dumping requires going through all the compilation steps. */
+   use_cache = !dump_ast && !dump_hir &&
+               _mesa_glsl_shader_cache_key(ctx, shader, cache_key);
+
+   if (use_cache && _mesa_glsl_shader_cache_load(shader, cache_key)) {
+      init_shader_symbols(shader);
+      _mesa_glsl_initialize_derived_variables(shader);
+      return;
+   }
+
+   state = new(shader) _mesa_glsl_parse_state(ctx, shader->Stage, shader);
+
    state->error = glcpp_preprocess(state, &source, &state->info_log,
                              &ctx->Extensions, ctx);
 
@@ -1800,8 +1846,9 @@ _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader,
       /* Do some optimization at compile time to reduce shader IR size
        * and reduce later work if the same shader is linked multiple times
        */
+      ir_pass_tracker tracker;
       while (do_common_optimization(shader->ir, false, false, options,
-                                    ctx->Const.NativeIntegers))
+                                    ctx->Const.NativeIntegers, &tracker))
          ;
 
       validate_ir_tree(shader->ir);
@@ -1833,7 +1880,6 @@ _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader,
    if (!state->error)
       set_shader_inout_layout(shader, state);
 
-   shader->symbols = new(shader->ir) glsl_symbol_table;
    shader->CompileStatus = !state->error;
    shader->InfoLog = state->info_log;
    shader->Version = state->language_version;
@@ -1843,32 +1889,17 @@ _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader,
    /* Retain any live IR, but trash the rest. */
    reparent_ir(shader->ir, shader->ir);
 
-   /* Destroy the symbol table.  Create a new symbol table that contains only
-    * the variables and functions that still exist in the IR.  The symbol
-    * table will be used later during linking.
-    *
-    * There must NOT be any freed objects still referenced by the symbol
-    * table.  That could cause the linker to dereference freed memory.
-    *
-    * We don't have to worry about types or interface-types here because those
-    * are fly-weights that are looked up by glsl_type.
+   /* Replace the symbol table.  There must NOT be any freed objects still
+    * referenced by the symbol table.  That could cause the linker to
+    * dereference freed memory.
     */
-   foreach_in_list (ir_instruction, ir, shader->ir) {
-      switch (ir->ir_type) {
-      case ir_type_function:
-         shader->symbols->add_function((ir_function *) ir);
-         break;
-      case ir_type_variable: {
-         ir_variable *const var = (ir_variable *) ir;
+   init_shader_symbols(shader);
 
-         if (var->data.mode != ir_var_temporary)
-            shader->symbols->add_variable(var);
-         break;
-      }
-      default:
-         break;
-      }
-   }
+   /* Cache the shader before adding the derived variables, since loading it
+    * adds them again.
+    */
+   if (use_cache && shader->CompileStatus)
+      _mesa_glsl_shader_cache_store(shader, cache_key);
 
    _mesa_glsl_initialize_derived_variables(shader);
 
@@ -1877,6 +1908,22 @@ _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader,
 }
 
 } /* extern "C" */
+
+static bool
+do_loop_unrolling(exec_list *ir, const struct gl_shader_compiler_options *options)
+{
+   bool progress = false;
+
+   loop_state *ls = analyze_loop_variables(ir);
+   if (ls->loop_found) {
+      progress = set_loop_controls(ir, ls) || progress;
+      progress = unroll_loops(ir, ls, options) || progress;
+   }
+   delete ls;
+
+   return progress;
+}
+
 /**
  * Do the set of common optimizations passes
  *
@@ -1894,65 +1941,82 @@ _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader,
  *                                    unrolled.  Setting to 0 disables loop
  *                                    unrolling.
  * \param options                     The driver's preferred shader options.
+ * \param tracker                     Progress of earlier calls in the same
+ *                                    optimization loop, used to skip passes
+ *                                    that have nothing left to do.  May be
+ *                                    NULL.
  */
 bool
 do_common_optimization(exec_list *ir, bool linked,
 		       bool uniform_locations_assigned,
                        const struct gl_shader_compiler_options *options,
-                       bool native_integers)
+                       bool native_integers,
+                       ir_pass_tracker *tracker)
 {
+   ir_pass_tracker local_tracker;
    GLboolean progress = GL_FALSE;
 
-   progress = lower_instructions(ir, SUB_TO_ADD_NEG) || progress;
+   if (tracker == NULL)
+      tracker = &local_tracker;
+
+   /* OPT_NEEDS() is for passes that can only make progress when the IR
+    * contains one of the ir_pass_tracker::NEEDS_* kinds of instruction.
+    */
+#define OPT_NEEDS(NEEDS, PASS, ...) do {                                \
+      ir_pass_tracker::pass *p = tracker->begin(#PASS, ir, NEEDS);       \
+      if (p != NULL)                                                     \
+         progress = tracker->end(p, PASS(__VA_ARGS__)) || progress;      \
+   } while (0)
+#define OPT(PASS, ...) OPT_NEEDS(0, PASS, __VA_ARGS__)
+
+   OPT(lower_instructions, ir, SUB_TO_ADD_NEG);
 
    if (linked) {
-      progress = do_function_inlining(ir) || progress;
-      progress = do_dead_functions(ir) || progress;
-      progress = do_structure_splitting(ir) || progress;
+      OPT_NEEDS(ir_pass_tracker::NEEDS_CALLS, do_function_inlining, ir);
+      OPT_NEEDS(ir_pass_tracker::NEEDS_FUNCTIONS, do_dead_functions, ir);
+      OPT(do_structure_splitting, ir);
    }
-   progress = do_if_simplification(ir) || progress;
-   progress = opt_flatten_nested_if_blocks(ir) || progress;
-   progress = opt_conditional_discard(ir) || progress;
-   progress = do_copy_propagation(ir) || progress;
-   progress = do_copy_propagation_elements(ir) || progress;
+   OPT(do_if_simplification, ir);
+   OPT(opt_flatten_nested_if_blocks, ir);
+   OPT_NEEDS(ir_pass_tracker::NEEDS_DISCARDS, opt_conditional_discard, ir);
+   OPT(do_copy_propagation, ir);
+   OPT(do_copy_propagation_elements, ir);
 
    if (options->OptimizeForAOS && !linked)
-      progress = opt_flip_matrices(ir) || progress;
+      OPT(opt_flip_matrices, ir);
 
    if (linked && options->OptimizeForAOS) {
-      progress = do_vectorize(ir) || progress;
+      OPT(do_vectorize, ir);
    }
 
    if (linked)
-      progress = do_dead_code(ir, uniform_locations_assigned) || progress;
+      OPT(do_dead_code, ir, uniform_locations_assigned);
    else
-      progress = do_dead_code_unlinked(ir) || progress;
-   progress = do_dead_code_local(ir) || progress;
-   progress = do_tree_grafting(ir) || progress;
-   progress = do_constant_propagation(ir) || progress;
+      OPT(do_dead_code_unlinked, ir);
+   OPT(do_dead_code_local, ir);
+   OPT(do_tree_grafting, ir);
+   OPT(do_constant_propagation, ir);
    if (linked)
-      progress = do_constant_variable(ir) || progress;
+      OPT(do_constant_variable, ir);
    else
-      progress = do_constant_variable_unlinked(ir) || progress;
-   progress = do_constant_folding(ir) || progress;
-   progress = do_minmax_prune(ir) || progress;
-   progress = do_rebalance_tree(ir) || progress;
-   progress = do_algebraic(ir, native_integers, options) || progress;
-   progress = do_lower_jumps(ir) || progress;
-   progress = do_vec_index_to_swizzle(ir) || progress;
-   progress = lower_vector_insert(ir, false) || progress;
-   progress = do_swizzle_swizzle(ir) || progress;
-   progress = do_noop_swizzle(ir) || progress;
-
-   progress = optimize_split_arrays(ir, linked) || progress;
-   progress = optimize_redundant_jumps(ir) || progress;
-
-   loop_state *ls = analyze_loop_variables(ir);
-   if (ls->loop_found) {
-      progress = set_loop_controls(ir, ls) || progress;
-      progress = unroll_loops(ir, ls, options) || progress;
-   }
-   delete ls;
+      OPT(do_constant_variable_unlinked, ir);
+   OPT(do_constant_folding, ir);
+   OPT(do_minmax_prune, ir);
+   OPT(do_rebalance_tree, ir);
+   OPT(do_algebraic, ir, native_integers, options);
+   OPT_NEEDS(ir_pass_tracker::NEEDS_JUMPS, do_lower_jumps, ir);
+   OPT(do_vec_index_to_swizzle, ir);
+   OPT(lower_vector_insert, ir, false);
+   OPT(do_swizzle_swizzle, ir);
+   OPT(do_noop_swizzle, ir);
+
+   OPT(optimize_split_arrays, ir, linked);
+   OPT_NEEDS(ir_pass_tracker::NEEDS_JUMPS, optimize_redundant_jumps, ir);
+
+   OPT_NEEDS(ir_pass_tracker::NEEDS_LOOPS, do_loop_unrolling, ir, options);
+
+#undef OPT
+#undef OPT_NEEDS
 
    return progress;
 }
@@ -72,10 +72,13 @@ enum lower_packing_builtins_op {
    LOWER_PACK_USE_BFE                   = 0x2000,
 };
 
+class ir_pass_tracker;
+
 bool do_common_optimization(exec_list *ir, bool linked,
 			    bool uniform_locations_assigned,
                             const struct gl_shader_compiler_options *options,
-                            bool native_integers);
+                            bool native_integers,
+                            ir_pass_tracker *tracker = NULL);
 
 bool do_rebalance_tree(exec_list *instructions);
 bool do_algebraic(exec_list *instructions, bool native_integers,
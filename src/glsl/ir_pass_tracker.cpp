@@ -0,0 +1,221 @@
+/*
+ * Copyright © 2016 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \file ir_pass_tracker.cpp
+ *
+ * Skipping of optimization passes that are known to make no progress, and
+ * per-pass statistics.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "ir.h"
+#include "ir_pass_tracker.h"
+#include "util/debug.h"
+#include "util/ralloc.h"
+
+static int64_t
+get_time_ns(void)
+{
+#ifdef _WIN32
+   static LARGE_INTEGER frequency;
+   LARGE_INTEGER counter;
+
+   if (!frequency.QuadPart)
+      QueryPerformanceFrequency(&frequency);
+   QueryPerformanceCounter(&counter);
+   return counter.QuadPart * 1000000000 / frequency.QuadPart;
+#else
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/**
+ * Return the NEEDS_* flags for the instructions in \c list.
+ */
+static unsigned
+find_instructions(exec_list *list)
+{
+   unsigned found = 0;
+
+   foreach_in_list(ir_instruction, ir, list) {
+      switch (ir->ir_type) {
+      case ir_type_function: {
+         ir_function *f = (ir_function *) ir;
+
+         if (strcmp(f->name, "main") != 0)
+            found |= ir_pass_tracker::NEEDS_FUNCTIONS;
+         found |= find_instructions(&f->signatures);
+         break;
+      }
+      case ir_type_function_signature:
+         found |= find_instructions(&((ir_function_signature *) ir)->body);
+         break;
+      case ir_type_if:
+         found |= find_instructions(&((ir_if *) ir)->then_instructions);
+         found |= find_instructions(&((ir_if *) ir)->else_instructions);
+         break;
+      case ir_type_loop:
+         found |= ir_pass_tracker::NEEDS_LOOPS;
+         found |= find_instructions(&((ir_loop *) ir)->body_instructions);
+         break;
+      case ir_type_call:
+         found |= ir_pass_tracker::NEEDS_CALLS;
+         break;
+      case ir_type_loop_jump:
+      case ir_type_return:
+         found |= ir_pass_tracker::NEEDS_JUMPS;
+         break;
+      case ir_type_discard:
+         found |= ir_pass_tracker::NEEDS_DISCARDS;
+         break;
+      default:
+         break;
+      }
+   }
+
+   return found;
+}
+
+ir_pass_tracker::ir_pass_tracker()
+   : generation(1), present(0), present_generation(0),
+     passes(NULL), num_passes(0), start_ns(0)
+{
+   this->stats = env_var_as_boolean("MESA_GLSL_OPT_STATS", false);
+}
+
+ir_pass_tracker::~ir_pass_tracker()
+{
+   if (this->stats)
+      print_stats();
+
+   ralloc_free(this->passes);
+}
+
+ir_pass_tracker::pass *
+ir_pass_tracker::begin(const char *name, exec_list *ir, unsigned needs)
+{
+   pass *p = NULL;
+
+   /* There are only a few dozen passes, and the names are usually string
+    * literals, so a linear search comparing pointers first is plenty.
+    */
+   for (unsigned i = 0; i < this->num_passes; i++) {
+      if (this->passes[i].name == name ||
+          strcmp(this->passes[i].name, name) == 0) {
+         p = &this->passes[i];
+         break;
+      }
+   }
+
+   if (p == NULL) {
+      this->passes = reralloc(NULL, this->passes, pass, this->num_passes + 1);
+      p = &this->passes[this->num_passes++];
+      memset(p, 0, sizeof(*p));
+      p->name = name;
+   }
+
+   if (p->clean_generation == this->generation) {
+      p->skips++;
+      return NULL;
+   }
+
+   if (needs && ir) {
+      if (this->present_generation != this->generation) {
+         this->present = find_instructions(ir);
+         this->present_generation = this->generation;
+      }
+
+      if ((this->present & needs) == 0) {
+         p->skips++;
+         return NULL;
+      }
+   }
+
+   p->runs++;
+   if (this->stats)
+      this->start_ns = get_time_ns();
+
+   return p;
+}
+
+bool
+ir_pass_tracker::end(pass *p, bool progress)
+{
+   if (this->stats)
+      p->time_ns += get_time_ns() - this->start_ns;
+
+   if (progress) {
+      p->progress++;
+
+      /* The pass itself may find more to do in what it just changed. */
+      p->clean_generation = 0;
+      this->generation++;
+   } else {
+      p->clean_generation = this->generation;
+   }
+
+   return progress;
+}
+
+bool
+ir_pass_tracker::note_progress(bool progress)
+{
+   if (progress)
+      this->generation++;
+
+   return progress;
+}
+
+void
+ir_pass_tracker::print_stats() const
+{
+   int64_t total_ns = 0;
+
+   if (this->num_passes == 0)
+      return;
+
+   fprintf(stderr, "GLSL IR optimization passes:\n");
+   fprintf(stderr, "  %-32s %6s %8s %9s %10s\n",
+           "pass", "runs", "skipped", "progress", "time (us)");
+
+   for (unsigned i = 0; i < this->num_passes; i++) {
+      const pass *p = &this->passes[i];
+
+      fprintf(stderr, "  %-32s %6u %8u %9u %10.1f\n",
+              p->name, p->runs, p->skips, p->progress, p->time_ns / 1000.0);
+      total_ns += p->time_ns;
+   }
+
+   fprintf(stderr, "  %-32s %6s %8s %9s %10.1f\n",
+           "total", "", "", "", total_ns / 1000.0);
+}
@@ -0,0 +1,140 @@
+/* -*- c++ -*- */
+/*
+ * Copyright © 2016 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+#ifndef IR_PASS_TRACKER_H
+#define IR_PASS_TRACKER_H
+
+#include <stdint.h>
+
+struct exec_list;
+
+/**
+ * Keeps track of which optimization passes made progress, so that passes
+ * which would find nothing to do are not run again.
+ *
+ * A counter is bumped whenever a pass changes the IR.  A pass that made no
+ * progress is remembered as clean at the current count, and is skipped until
+ * some other pass changes the IR.  This relies on passes being deterministic
+ * and on every change to the IR being reported, so passes run between the
+ * tracked ones have to go through note_progress().
+ *
+ * That alone only saves work once a round of passes made no progress at
+ * all.  Passes that can only do something when the IR contains a particular
+ * kind of instruction, such as function inlining needing a call or loop
+ * unrolling needing a loop, say so when they are looked up, and are skipped
+ * in every round when there is no such instruction.  Which kinds of
+ * instruction are present is found by walking the instruction lists, without
+ * looking into expressions, at most once per change to the IR.
+ *
+ * A tracker is meant to live for a whole optimization loop, such as
+ *
+ *    ir_pass_tracker tracker;
+ *    while (do_common_optimization(ir, ..., &tracker))
+ *       ;
+ *
+ * in which the last round, which only confirms that nothing changes any
+ * more, then only runs the passes the previous round did not already
+ * check.
+ *
+ * When MESA_GLSL_OPT_STATS is set, the number of runs, skipped runs and
+ * runs that made progress, and the time spent in each pass, are printed to
+ * stderr when the tracker is destroyed.
+ */
+class ir_pass_tracker {
+public:
+   ir_pass_tracker();
+   ~ir_pass_tracker();
+
+   struct pass;
+
+   /**
+    * Kinds of instruction a pass can need to find anything to do.
+    */
+   enum {
+      NEEDS_CALLS     = 1 << 0,
+      NEEDS_LOOPS     = 1 << 1,
+      /** \c break, \c continue or \c return */
+      NEEDS_JUMPS     = 1 << 2,
+      NEEDS_DISCARDS  = 1 << 3,
+      /** Functions other than \c main */
+      NEEDS_FUNCTIONS = 1 << 4,
+   };
+
+   /**
+    * Look up the pass called \c name, which is about to be run on \c ir.
+    *
+    * \param needs  NEEDS_* flags for the instructions the pass looks for.
+    *               The pass is skipped when \c ir contains none of them.
+    *
+    * \return NULL if the pass can be skipped, otherwise the pass, which
+    * must then be run and handed to end().
+    */
+   pass *begin(const char *name, exec_list *ir = NULL, unsigned needs = 0);
+
+   /**
+    * Record the result of running a pass returned by begin().
+    *
+    * \return \c progress
+    */
+   bool end(pass *p, bool progress);
+
+   /**
+    * Record the result of a pass run outside of the tracker.
+    *
+    * \return \c progress
+    */
+   bool note_progress(bool progress);
+
+   struct pass {
+      const char *name;
+
+      /** Value of generation when the pass last made no progress, or 0 */
+      unsigned clean_generation;
+
+      unsigned runs;
+      unsigned skips;
+      unsigned progress;
+      int64_t time_ns;
+   };
+
+private:
+   /** Bumped every time the IR changes */
+   unsigned generation;
+
+   /** NEEDS_* flags for the instructions in the IR at present_generation */
+   unsigned present;
+   unsigned present_generation;
+
+   /** Passes in the order they were first run */
+   pass *passes;
+   unsigned num_passes;
+
+   bool stats;
+   int64_t start_ns;
+
+   void print_stats() const;
+};
+
+#endif /* IR_PASS_TRACKER_H */
@@ -0,0 +1,1156 @@
+/*
+ * Copyright © 2016 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \file ir_serialize.cpp
+ *
+ * Binary serialization of GLSL IR to and from a \c blob.
+ *
+ * The stream starts with the number of types, variables, functions and
+ * signatures it contains, followed by a table of all top-level functions
+ * and their signatures, so that calls can refer to a signature before the
+ * function defining it has been read.  Then comes the instruction list
+ * itself, where every node is a \c ir_node_type tag followed by its
+ * operands.
+ *
+ * Types and variables are described the first time they are seen and
+ * referred to by index afterwards.  Since indices are handed out in stream
+ * order, a reader seeing the next unused index knows that a description
+ * follows.  Built-in types are stored as an index into the list of
+ * built-in type flyweights, everything else structurally, so that reading
+ * goes through the usual \c glsl_type::get_*_instance() lookups.
+ *
+ * Calls to built-in functions that have not been linked in yet refer to a
+ * signature of the built-in function shader, which is stored as the name
+ * of the function and the position of the signature in it.
+ */
+
+#include "ir_serialize.h"
+#include "glsl_types.h"
+#include "main/macros.h"
+#include "util/hash_table.h"
+
+namespace {
+
+/** Tag of a NULL node, written in place of an \c ir_node_type */
+const uint32_t ir_serialize_null = ir_type_max + 1;
+
+/** Signature reference to a signature of the built-in function shader */
+const uint32_t ir_serialize_builtin_signature = ~0u;
+
+uint32_t
+pack_swizzle_mask(ir_swizzle_mask mask)
+{
+   return mask.x |
+          mask.y << 2 |
+          mask.z << 4 |
+          mask.w << 6 |
+          mask.num_components << 8 |
+          mask.has_duplicates << 11;
+}
+
+ir_swizzle_mask
+unpack_swizzle_mask(uint32_t bits)
+{
+   ir_swizzle_mask mask;
+
+   mask.x = bits & 0x3;
+   mask.y = (bits >> 2) & 0x3;
+   mask.z = (bits >> 4) & 0x3;
+   mask.w = (bits >> 6) & 0x3;
+   mask.num_components = (bits >> 8) & 0x7;
+   mask.has_duplicates = (bits >> 11) & 0x1;
+
+   return mask;
+}
+
+/**
+ * Number of bytes of \c ir_constant::value used by a scalar, vector or
+ * matrix constant of the given type.
+ */
+size_t
+constant_data_size(const glsl_type *type)
+{
+   switch (type->base_type) {
+   case GLSL_TYPE_DOUBLE:
+      return type->components() * sizeof(double);
+   case GLSL_TYPE_BOOL:
+      return type->components() * sizeof(bool);
+   default:
+      return type->components() * sizeof(unsigned);
+   }
+}
+
+
+class ir_serializer {
+public:
+   ir_serializer(struct blob *blob);
+   ~ir_serializer();
+
+   void write_ir(exec_list *instructions);
+
+   bool failed;
+
+private:
+   void write_functions(exec_list *instructions);
+   void write_list(exec_list *list);
+   void write_node(ir_instruction *ir);
+
+   void write_uint32(uint32_t value);
+   void write_string(const char *str);
+   void write_bytes(const void *bytes, size_t size);
+
+   void write_type(const glsl_type *type);
+   void write_variable(ir_variable *var);
+   void write_constant(ir_constant *c);
+   void write_signature_ref(ir_function_signature *sig);
+   void write_builtin_ref(const ir_function_signature *sig);
+
+   struct blob *blob;
+
+   /** Offset of the table sizes reserved by write_ir() */
+   size_t header_offset;
+
+   /** Maps of already written objects to their indices */
+   struct hash_table *types;
+   struct hash_table *variables;
+   struct hash_table *functions;
+   struct hash_table *signatures;
+
+   unsigned num_types;
+   unsigned num_variables;
+   unsigned num_functions;
+   unsigned num_signatures;
+};
+
+ir_serializer::ir_serializer(struct blob *blob)
+   : failed(false), blob(blob), header_offset(0),
+     num_types(0), num_variables(0), num_functions(0), num_signatures(0)
+{
+   this->types = _mesa_hash_table_create(NULL, _mesa_hash_pointer,
+                                         _mesa_key_pointer_equal);
+   this->variables = _mesa_hash_table_create(NULL, _mesa_hash_pointer,
+                                             _mesa_key_pointer_equal);
+   this->functions = _mesa_hash_table_create(NULL, _mesa_hash_pointer,
+                                             _mesa_key_pointer_equal);
+   this->signatures = _mesa_hash_table_create(NULL, _mesa_hash_pointer,
+                                              _mesa_key_pointer_equal);
+}
+
+ir_serializer::~ir_serializer()
+{
+   _mesa_hash_table_destroy(this->types, NULL);
+   _mesa_hash_table_destroy(this->variables, NULL);
+   _mesa_hash_table_destroy(this->functions, NULL);
+   _mesa_hash_table_destroy(this->signatures, NULL);
+}
+
+void
+ir_serializer::write_uint32(uint32_t value)
+{
+   if (!blob_write_uint32(this->blob, value))
+      this->failed = true;
+}
+
+void
+ir_serializer::write_string(const char *str)
+{
+   if (!blob_write_string(this->blob, str))
+      this->failed = true;
+}
+
+void
+ir_serializer::write_bytes(const void *bytes, size_t size)
+{
+   if (!blob_write_bytes(this->blob, bytes, size))
+      this->failed = true;
+}
+
+void
+ir_serializer::write_ir(exec_list *instructions)
+{
+   /* Reserve room for the table sizes, which are only known once everything
+    * has been written.
+    */
+   this->header_offset = ALIGN(this->blob->size, sizeof(uint32_t));
+   for (unsigned i = 0; i < 4; i++)
+      write_uint32(0);
+
+   write_functions(instructions);
+   write_list(instructions);
+
+   if (!this->failed) {
+      blob_overwrite_uint32(this->blob, this->header_offset,
+                            this->num_types);
+      blob_overwrite_uint32(this->blob, this->header_offset + 4,
+                            this->num_variables);
+      blob_overwrite_uint32(this->blob, this->header_offset + 8,
+                            this->num_functions);
+      blob_overwrite_uint32(this->blob, this->header_offset + 12,
+                            this->num_signatures);
+   }
+}
+
+void
+ir_serializer::write_type(const glsl_type *type)
+{
+   struct hash_entry *entry = _mesa_hash_table_search(this->types, type);
+   if (entry) {
+      write_uint32((uintptr_t) entry->data);
+      return;
+   }
+
+   write_uint32(this->num_types);
+   _mesa_hash_table_insert(this->types, type,
+                           (void *) (uintptr_t) this->num_types++);
+
+   if (!_mesa_glsl_encode_type(this->blob, type))
+      this->failed = true;
+}
+
+void
+ir_serializer::write_variable(ir_variable *var)
+{
+   struct hash_entry *entry = _mesa_hash_table_search(this->variables, var);
+   if (entry) {
+      write_uint32((uintptr_t) entry->data);
+      return;
+   }
+
+   write_uint32(this->num_variables);
+   _mesa_hash_table_insert(this->variables, var,
+                           (void *) (uintptr_t) this->num_variables++);
+
+   write_type(var->type);
+
+   /* Anonymous temporaries share a static name, which is not written. */
+   const bool has_name = var->name != NULL && var->is_name_ralloced();
+   write_uint32(has_name);
+   if (has_name)
+      write_string(var->name);
+
+   write_bytes(&var->data, sizeof(var->data));
+
+   const glsl_type *interface_type = var->get_interface_type();
+   write_uint32(interface_type != NULL);
+   if (interface_type != NULL) {
+      write_type(interface_type);
+      if (var->is_interface_instance()) {
+         write_bytes(var->get_max_ifc_array_access(),
+                     interface_type->length * sizeof(unsigned));
+      }
+   }
+
+   const unsigned num_state_slots = var->get_num_state_slots();
+   write_uint32(num_state_slots);
+   if (num_state_slots > 0) {
+      write_bytes(var->get_state_slots(),
+                  num_state_slots * sizeof(ir_state_slot));
+   }
+
+   write_node(var->constant_value);
+   write_node(var->constant_initializer);
+}
+
+void
+ir_serializer::write_constant(ir_constant *c)
+{
+   write_type(c->type);
+
+   if (c->type->is_array()) {
+      for (unsigned i = 0; i < c->type->length; i++)
+         write_constant(c->array_elements[i]);
+   } else if (c->type->is_record()) {
+      foreach_in_list(ir_constant, field, &c->components)
+         write_constant(field);
+   } else {
+      write_bytes(&c->value, constant_data_size(c->type));
+   }
+}
+
+/**
+ * Write the name of a built-in function and the position of \c sig among
+ * its signatures in the built-in function shader.
+ */
+void
+ir_serializer::write_builtin_ref(const ir_function_signature *sig)
+{
+   unsigned index = 0;
+
+   foreach_in_list(const ir_function_signature, s,
+                   &sig->function()->signatures) {
+      if (s == sig) {
+         write_string(sig->function_name());
+         write_uint32(index);
+         return;
+      }
+      index++;
+   }
+
+   this->failed = true;
+}
+
+void
+ir_serializer::write_signature_ref(ir_function_signature *sig)
+{
+   struct hash_entry *entry = _mesa_hash_table_search(this->signatures, sig);
+   if (entry) {
+      write_uint32((uintptr_t) entry->data);
+      return;
+   }
+
+   /* Anything not defined in this shader has to be a built-in. */
+   if (!sig->is_builtin()) {
+      this->failed = true;
+      return;
+   }
+
+   write_uint32(ir_serialize_builtin_signature);
+   write_builtin_ref(sig);
+}
+
+/**
+ * Write the table of all top-level functions and their signatures.
+ *
+ * Signatures of built-ins are written along with a reference to the
+ * corresponding signature of the built-in function shader, so that they
+ * can be recreated as proper built-in prototypes or definitions.
+ */
+void
+ir_serializer::write_functions(exec_list *instructions)
+{
+   foreach_in_list(ir_instruction, ir, instructions) {
+      ir_function *f = ir->as_function();
+      if (f == NULL)
+         continue;
+
+      _mesa_hash_table_insert(this->functions, f,
+                              (void *) (uintptr_t) this->num_functions++);
+
+      write_string(f->name);
+      write_uint32(f->is_subroutine);
+      write_uint32(f->subroutine_index);
+      write_uint32(f->num_subroutine_types);
+      for (int i = 0; i < f->num_subroutine_types; i++)
+         write_type(f->subroutine_types[i]);
+
+      write_uint32(f->signatures.length());
+      foreach_in_list(ir_function_signature, sig, &f->signatures) {
+         _mesa_hash_table_insert(this->signatures, sig,
+                                 (void *) (uintptr_t) this->num_signatures++);
+
+         write_type(sig->return_type);
+         write_uint32(sig->is_defined);
+         write_uint32(sig->is_intrinsic);
+
+         write_uint32(sig->is_builtin());
+         if (sig->is_builtin()) {
+            _mesa_glsl_initialize_builtin_functions();
+            ir_function *builtin =
+               _mesa_glsl_find_builtin_function_by_name(f->name);
+            ir_function_signature *origin = builtin == NULL ? NULL :
+               builtin->exact_matching_signature(NULL, &sig->parameters);
+
+            if (origin == NULL) {
+               this->failed = true;
+               return;
+            }
+            write_builtin_ref(origin);
+         }
+
+         write_uint32(sig->parameters.length());
+         foreach_in_list(ir_variable, param, &sig->parameters)
+            write_variable(param);
+      }
+   }
+}
+
+void
+ir_serializer::write_list(exec_list *list)
+{
+   write_uint32(list->length());
+   foreach_in_list(ir_instruction, ir, list)
+      write_node(ir);
+}
+
+void
+ir_serializer::write_node(ir_instruction *ir)
+{
+   if (ir == NULL) {
+      write_uint32(ir_serialize_null);
+      return;
+   }
+
+   write_uint32(ir->ir_type);
+
+   switch (ir->ir_type) {
+   case ir_type_dereference_array: {
+      ir_dereference_array *deref = (ir_dereference_array *) ir;
+      write_node(deref->array);
+      write_node(deref->array_index);
+      break;
+   }
+   case ir_type_dereference_record: {
+      ir_dereference_record *deref = (ir_dereference_record *) ir;
+      write_node(deref->record);
+      write_string(deref->field);
+      break;
+   }
+   case ir_type_dereference_variable:
+      write_variable(((ir_dereference_variable *) ir)->var);
+      break;
+   case ir_type_constant:
+      write_constant((ir_constant *) ir);
+      break;
+   case ir_type_expression: {
+      ir_expression *expr = (ir_expression *) ir;
+      write_uint32(expr->operation);
+      write_type(expr->type);
+      for (unsigned i = 0; i < ARRAY_SIZE(expr->operands); i++)
+         write_node(expr->operands[i]);
+      break;
+   }
+   case ir_type_swizzle: {
+      ir_swizzle *swiz = (ir_swizzle *) ir;
+      write_node(swiz->val);
+      write_uint32(pack_swizzle_mask(swiz->mask));
+      break;
+   }
+   case ir_type_texture: {
+      ir_texture *tex = (ir_texture *) ir;
+      write_uint32(tex->op);
+      write_type(tex->type);
+      write_node(tex->sampler);
+      write_node(tex->coordinate);
+      write_node(tex->projector);
+      write_node(tex->shadow_comparitor);
+      write_node(tex->offset);
+      /* Covers all members of the union, which is zeroed when unused. */
+      write_node(tex->lod_info.grad.dPdx);
+      write_node(tex->lod_info.grad.dPdy);
+      break;
+   }
+   case ir_type_variable:
+      write_variable((ir_variable *) ir);
+      break;
+   case ir_type_assignment: {
+      ir_assignment *assign = (ir_assignment *) ir;
+      write_node(assign->lhs);
+      write_node(assign->rhs);
+      write_node(assign->condition);
+      write_uint32(assign->write_mask);
+      break;
+   }
+   case ir_type_call: {
+      ir_call *call = (ir_call *) ir;
+      write_signature_ref(call->callee);
+      write_node(call->return_deref);
+      write_list(&call->actual_parameters);
+      write_uint32(call->use_builtin);
+      write_uint32(call->sub_var != NULL);
+      if (call->sub_var != NULL)
+         write_variable(call->sub_var);
+      write_node(call->array_idx);
+      break;
+   }
+   case ir_type_function: {
+      struct hash_entry *entry = _mesa_hash_table_search(this->functions, ir);
+      if (entry == NULL) {
+         this->failed = true;
+         break;
+      }
+
+      ir_function *f = (ir_function *) ir;
+      write_uint32((uintptr_t) entry->data);
+      foreach_in_list(ir_function_signature, sig, &f->signatures)
+         write_list(&sig->body);
+      break;
+   }
+   case ir_type_if: {
+      ir_if *iif = (ir_if *) ir;
+      write_node(iif->condition);
+      write_list(&iif->then_instructions);
+      write_list(&iif->else_instructions);
+      break;
+   }
+   case ir_type_loop:
+      write_list(&((ir_loop *) ir)->body_instructions);
+      break;
+   case ir_type_loop_jump:
+      write_uint32(((ir_loop_jump *) ir)->mode);
+      break;
+   case ir_type_return:
+      write_node(((ir_return *) ir)->value);
+      break;
+   case ir_type_discard:
+      write_node(((ir_discard *) ir)->condition);
+      break;
+   case ir_type_emit_vertex:
+      write_node(((ir_emit_vertex *) ir)->stream);
+      break;
+   case ir_type_end_primitive:
+      write_node(((ir_end_primitive *) ir)->stream);
+      break;
+   case ir_type_barrier:
+      break;
+   default:
+      /* Signatures only appear inside functions, and error values never
+       * survive a successful compile.
+       */
+      this->failed = true;
+      break;
+   }
+}
+
+
+class ir_deserializer {
+public:
+   ir_deserializer(struct blob_reader *blob, void *mem_ctx);
+   ~ir_deserializer();
+
+   void read_ir(exec_list *instructions);
+
+   bool failed;
+
+private:
+   void read_header();
+   void read_functions();
+   void read_list(exec_list *list);
+   ir_instruction *read_node();
+   bool fail();
+   unsigned read_count(size_t min_item_size);
+
+   const glsl_type *read_type();
+   ir_variable *read_variable();
+   ir_constant *read_constant();
+   ir_rvalue *read_rvalue();
+   ir_function_signature *read_signature_ref();
+   ir_function_signature *read_builtin_ref();
+
+   struct blob_reader *blob;
+   void *mem_ctx;
+
+   /** Context of the tables below */
+   void *tables_ctx;
+
+   const glsl_type **types;
+   ir_variable **variables;
+   ir_function **functions;
+   ir_function_signature **signatures;
+
+   /** Table sizes, as given in the header */
+   unsigned max_types;
+   unsigned max_variables;
+   unsigned max_functions;
+   unsigned max_signatures;
+
+   /** Number of table entries read so far */
+   unsigned num_types;
+   unsigned num_variables;
+   unsigned num_functions;
+   unsigned num_signatures;
+};
+
+ir_deserializer::ir_deserializer(struct blob_reader *blob, void *mem_ctx)
+   : failed(false), blob(blob), mem_ctx(mem_ctx),
+     types(NULL), variables(NULL), functions(NULL), signatures(NULL),
+     max_types(0), max_variables(0), max_functions(0), max_signatures(0),
+     num_types(0), num_variables(0), num_functions(0), num_signatures(0)
+{
+   this->tables_ctx = ralloc_context(NULL);
+}
+
+ir_deserializer::~ir_deserializer()
+{
+   ralloc_free(this->tables_ctx);
+}
+
+bool
+ir_deserializer::fail()
+{
+   this->failed = true;
+   return false;
+}
+
+/**
+ * Read the number of items that follow, making sure it is plausible given
+ * the number of bytes left, so a corrupt blob can't make us allocate huge
+ * tables.
+ */
+unsigned
+ir_deserializer::read_count(size_t min_item_size)
+{
+   const uint32_t count = blob_read_uint32(this->blob);
+
+   if (count > (size_t) (this->blob->end - this->blob->current) /
+               min_item_size) {
+      fail();
+      return 0;
+   }
+
+   return count;
+}
+
+void
+ir_deserializer::read_ir(exec_list *instructions)
+{
+   read_header();
+   if (!this->failed)
+      read_functions();
+   if (!this->failed)
+      read_list(instructions);
+}
+
+void
+ir_deserializer::read_header()
+{
+   this->max_types = read_count(sizeof(uint32_t));
+   this->max_variables = read_count(sizeof(uint32_t));
+   this->max_functions = read_count(sizeof(uint32_t));
+   this->max_signatures = read_count(sizeof(uint32_t));
+   if (this->failed)
+      return;
+
+   this->types = rzalloc_array(this->tables_ctx, const glsl_type *,
+                               this->max_types);
+   this->variables = rzalloc_array(this->tables_ctx, ir_variable *,
+                                   this->max_variables);
+   this->functions = rzalloc_array(this->tables_ctx, ir_function *,
+                                   this->max_functions);
+   this->signatures = rzalloc_array(this->tables_ctx, ir_function_signature *,
+                                    this->max_signatures);
+}
+
+const glsl_type *
+ir_deserializer::read_type()
+{
+   const uint32_t index = blob_read_uint32(this->blob);
+
+   if (index < this->num_types)
+      return this->types[index];
+
+   if (index != this->num_types || index >= this->max_types) {
+      fail();
+      return NULL;
+   }
+   this->num_types++;
+
+   const glsl_type *type = _mesa_glsl_decode_type(this->blob);
+   if (type == NULL)
+      fail();
+
+   this->types[index] = type;
+   return type;
+}
+
+ir_variable *
+ir_deserializer::read_variable()
+{
+   const uint32_t index = blob_read_uint32(this->blob);
+
+   if (index < this->num_variables)
+      return this->variables[index];
+
+   if (index != this->num_variables || index >= this->max_variables) {
+      fail();
+      return NULL;
+   }
+   this->num_variables++;
+
+   const glsl_type *type = read_type();
+   const char *name = NULL;
+   if (blob_read_uint32(this->blob))
+      name = blob_read_string(this->blob);
+
+   ir_variable::ir_variable_data data;
+   blob_copy_bytes(this->blob, (uint8_t *) &data, sizeof(data));
+
+   if (type == NULL || this->blob->overrun || data.mode >= ir_var_mode_count) {
+      fail();
+      return NULL;
+   }
+
+   /* Only temporaries and parameters may be unnamed. */
+   if (name == NULL && data.mode != ir_var_temporary &&
+       data.mode != ir_var_function_in && data.mode != ir_var_function_out &&
+       data.mode != ir_var_function_inout) {
+      fail();
+      return NULL;
+   }
+
+   ir_variable *var = new(this->mem_ctx)
+      ir_variable(type, name, (ir_variable_mode) data.mode);
+
+   memcpy(&var->data, &data, sizeof(data));
+   var->set_num_state_slots(0);
+
+   this->variables[index] = var;
+
+   if (blob_read_uint32(this->blob)) {
+      const glsl_type *interface_type = read_type();
+      if (interface_type == NULL) {
+         fail();
+         return NULL;
+      }
+
+      /* The constructor already set the interface type of interface block
+       * instances, which the linker may have since replaced with a
+       * compatible one.
+       */
+      const glsl_type *initial_type = var->get_interface_type();
+      if (initial_type == NULL) {
+         var->init_interface_type(interface_type);
+      } else if (initial_type != interface_type) {
+         if (initial_type->length != interface_type->length) {
+            fail();
+            return NULL;
+         }
+         var->change_interface_type(interface_type);
+      }
+
+      if (var->is_interface_instance()) {
+         blob_copy_bytes(this->blob,
+                         (uint8_t *) var->get_max_ifc_array_access(),
+                         interface_type->length * sizeof(unsigned));
+      }
+   }
+
+   const unsigned num_state_slots = read_count(sizeof(ir_state_slot));
+   if (num_state_slots > 0) {
+      if (var->is_interface_instance()) {
+         fail();
+         return NULL;
+      }
+
+      ir_state_slot *slots = var->allocate_state_slots(num_state_slots);
+      blob_copy_bytes(this->blob, (uint8_t *) slots,
+                      num_state_slots * sizeof(ir_state_slot));
+   }
+
+   ir_rvalue *value = read_rvalue();
+   ir_rvalue *initializer = read_rvalue();
+   if ((value != NULL && value->as_constant() == NULL) ||
+       (initializer != NULL && initializer->as_constant() == NULL)) {
+      fail();
+      return NULL;
+   }
+
+   var->constant_value = (ir_constant *) value;
+   var->constant_initializer = (ir_constant *) initializer;
+
+   return var;
+}
+
+ir_constant *
+ir_deserializer::read_constant()
+{
+   const glsl_type *type = read_type();
+   if (type == NULL)
+      return NULL;
+
+   if (type->is_array() || type->is_record()) {
+      exec_list values;
+
+      for (unsigned i = 0; i < type->length; i++) {
+         ir_constant *value = read_constant();
+         if (value == NULL)
+            return NULL;
+
+         values.push_tail(value);
+      }
+
+      return new(this->mem_ctx) ir_constant(type, &values);
+   }
+
+   if (!type->is_numeric() && !type->is_boolean()) {
+      fail();
+      return NULL;
+   }
+
+   ir_constant_data data;
+   memset(&data, 0, sizeof(data));
+   blob_copy_bytes(this->blob, (uint8_t *) &data, constant_data_size(type));
+   if (this->blob->overrun) {
+      fail();
+      return NULL;
+   }
+
+   return new(this->mem_ctx) ir_constant(type, &data);
+}
+
+ir_function_signature *
+ir_deserializer::read_builtin_ref()
+{
+   const char *name = blob_read_string(this->blob);
+   const uint32_t index = blob_read_uint32(this->blob);
+
+   if (name == NULL) {
+      fail();
+      return NULL;
+   }
+
+   _mesa_glsl_initialize_builtin_functions();
+   ir_function *f = _mesa_glsl_find_builtin_function_by_name(name);
+
+   if (f != NULL) {
+      unsigned i = 0;
+      foreach_in_list(ir_function_signature, sig, &f->signatures) {
+         if (i++ == index)
+            return sig;
+      }
+   }
+
+   fail();
+   return NULL;
+}
+
+ir_function_signature *
+ir_deserializer::read_signature_ref()
+{
+   const uint32_t index = blob_read_uint32(this->blob);
+
+   if (index == ir_serialize_builtin_signature)
+      return read_builtin_ref();
+
+   if (index >= this->num_signatures) {
+      fail();
+      return NULL;
+   }
+
+   return this->signatures[index];
+}
+
+void
+ir_deserializer::read_functions()
+{
+   for (unsigned i = 0; i < this->max_functions && !this->failed; i++) {
+      const char *name = blob_read_string(this->blob);
+      if (name == NULL) {
+         fail();
+         return;
+      }
+
+      ir_function *f = new(this->mem_ctx) ir_function(name);
+      f->is_subroutine = blob_read_uint32(this->blob);
+      f->subroutine_index = blob_read_uint32(this->blob);
+      f->num_subroutine_types = read_count(sizeof(uint32_t));
+      if (f->num_subroutine_types > 0) {
+         f->subroutine_types = ralloc_array(f, const struct glsl_type *,
+                                            f->num_subroutine_types);
+         for (int j = 0; j < f->num_subroutine_types; j++)
+            f->subroutine_types[j] = read_type();
+      }
+
+      this->functions[this->num_functions++] = f;
+
+      const unsigned num_signatures = read_count(5 * sizeof(uint32_t));
+      for (unsigned j = 0; j < num_signatures && !this->failed; j++) {
+         const glsl_type *return_type = read_type();
+         const bool is_defined = blob_read_uint32(this->blob);
+         const bool is_intrinsic = blob_read_uint32(this->blob);
+         ir_function_signature *origin = NULL;
+         exec_list parameters;
+
+         if (blob_read_uint32(this->blob))
+            origin = read_builtin_ref();
+
+         const unsigned num_parameters = read_count(sizeof(uint32_t));
+         for (unsigned k = 0; k < num_parameters && !this->failed; k++) {
+            ir_variable *param = read_variable();
+            if (param != NULL)
+               parameters.push_tail(param);
+         }
+
+         if (this->failed || return_type == NULL ||
+             this->num_signatures >= this->max_signatures) {
+            fail();
+            return;
+         }
+
+         /* Built-in signatures are recreated from the built-in function
+          * shader, which is the only way to get their availability
+          * predicate right.
+          */
+         ir_function_signature *sig;
+         if (origin != NULL) {
+            sig = origin->clone_prototype(this->mem_ctx, NULL);
+            sig->replace_parameters(&parameters);
+         } else {
+            sig = new(this->mem_ctx) ir_function_signature(return_type);
+            parameters.move_nodes_to(&sig->parameters);
+         }
+
+         sig->is_defined = is_defined;
+         sig->is_intrinsic = is_intrinsic;
+         f->add_signature(sig);
+
+         this->signatures[this->num_signatures++] = sig;
+      }
+   }
+}
+
+void
+ir_deserializer::read_list(exec_list *list)
+{
+   const unsigned length = read_count(sizeof(uint32_t));
+
+   for (unsigned i = 0; i < length && !this->failed; i++) {
+      ir_instruction *ir = read_node();
+      if (ir == NULL) {
+         fail();
+         return;
+      }
+
+      list->push_tail(ir);
+   }
+}
+
+/**
+ * Read a node that has to be an rvalue, or NULL.
+ */
+ir_rvalue *
+ir_deserializer::read_rvalue()
+{
+   ir_instruction *ir = read_node();
+
+   if (ir != NULL && ir->as_rvalue() == NULL) {
+      fail();
+      return NULL;
+   }
+
+   return (ir_rvalue *) ir;
+}
+
+ir_instruction *
+ir_deserializer::read_node()
+{
+   const uint32_t tag = blob_read_uint32(this->blob);
+
+   if (this->failed || this->blob->overrun)
+      return NULL;
+
+   switch (tag) {
+   case ir_serialize_null:
+      return NULL;
+
+   case ir_type_dereference_array: {
+      ir_rvalue *array = read_rvalue();
+      ir_rvalue *index = read_rvalue();
+      if (array == NULL || index == NULL)
+         break;
+      return new(this->mem_ctx) ir_dereference_array(array, index);
+   }
+   case ir_type_dereference_record: {
+      ir_rvalue *record = read_rvalue();
+      const char *field = blob_read_string(this->blob);
+      if (record == NULL || field == NULL)
+         break;
+      return new(this->mem_ctx) ir_dereference_record(record, field);
+   }
+   case ir_type_dereference_variable: {
+      ir_variable *var = read_variable();
+      if (var == NULL)
+         break;
+      return new(this->mem_ctx) ir_dereference_variable(var);
+   }
+   case ir_type_constant:
+      return read_constant();
+   case ir_type_expression: {
+      const uint32_t operation = blob_read_uint32(this->blob);
+      const glsl_type *type = read_type();
+      ir_rvalue *operands[4];
+
+      for (unsigned i = 0; i < ARRAY_SIZE(operands); i++)
+         operands[i] = read_rvalue();
+
+      if (type == NULL || operation > ir_last_opcode || this->failed ||
+          this->blob->overrun)
+         break;
+
+      const unsigned num_operands =
+         ir_expression::get_num_operands((ir_expression_operation) operation);
+      for (unsigned i = 0; i < ARRAY_SIZE(operands); i++) {
+         if ((operands[i] != NULL) != (i < num_operands))
+            fail();
+      }
+      if (this->failed)
+         break;
+      return new(this->mem_ctx) ir_expression(operation, type,
+                                              operands[0], operands[1],
+                                              operands[2], operands[3]);
+   }
+   case ir_type_swizzle: {
+      ir_rvalue *val = read_rvalue();
+      const uint32_t mask = blob_read_uint32(this->blob);
+      if (val == NULL || this->blob->overrun)
+         break;
+      return new(this->mem_ctx) ir_swizzle(val, unpack_swizzle_mask(mask));
+   }
+   case ir_type_texture: {
+      const uint32_t op = blob_read_uint32(this->blob);
+      const glsl_type *type = read_type();
+      ir_rvalue *sampler = read_rvalue();
+      if (type == NULL || op > ir_samples_identical ||
+          sampler == NULL || sampler->as_dereference() == NULL)
+         break;
+
+      ir_texture *tex = new(this->mem_ctx) ir_texture((ir_texture_opcode) op);
+      tex->set_sampler(sampler->as_dereference(), type);
+      tex->coordinate = read_rvalue();
+      tex->projector = read_rvalue();
+      tex->shadow_comparitor = read_rvalue();
+      tex->offset = read_rvalue();
+      tex->lod_info.grad.dPdx = read_rvalue();
+      tex->lod_info.grad.dPdy = read_rvalue();
+      return tex;
+   }
+   case ir_type_variable:
+      return read_variable();
+   case ir_type_assignment: {
+      ir_rvalue *lhs = read_rvalue();
+      ir_rvalue *rhs = read_rvalue();
+      ir_rvalue *condition = read_rvalue();
+      const uint32_t write_mask = blob_read_uint32(this->blob);
+      if (lhs == NULL || lhs->as_dereference() == NULL || rhs == NULL ||
+          write_mask > 0xf || this->blob->overrun)
+         break;
+
+      /* The constructor asserts that vector write masks match the rhs. */
+      if (lhs->type->is_scalar() || lhs->type->is_vector()) {
+         unsigned components = 0;
+         for (unsigned i = 0; i < 4; i++) {
+            if (write_mask & (1 << i))
+               components++;
+         }
+         if (components != rhs->type->vector_elements)
+            break;
+      }
+      return new(this->mem_ctx) ir_assignment(lhs->as_dereference(), rhs,
+                                              condition, write_mask);
+   }
+   case ir_type_call: {
+      ir_function_signature *callee = read_signature_ref();
+      ir_rvalue *return_deref = read_rvalue();
+      exec_list parameters;
+      read_list(&parameters);
+      const bool use_builtin = blob_read_uint32(this->blob);
+      ir_variable *sub_var = NULL;
+      if (blob_read_uint32(this->blob))
+         sub_var = read_variable();
+      ir_rvalue *array_idx = read_rvalue();
+
+      if (callee == NULL || this->failed || this->blob->overrun ||
+          (return_deref != NULL &&
+           return_deref->as_dereference_variable() == NULL))
+         break;
+
+      ir_call *call = new(this->mem_ctx)
+         ir_call(callee, (ir_dereference_variable *) return_deref,
+                 &parameters, sub_var, array_idx);
+      call->use_builtin = use_builtin;
+      return call;
+   }
+   case ir_type_function: {
+      const uint32_t index = blob_read_uint32(this->blob);
+      if (index >= this->num_functions)
+         break;
+
+      ir_function *f = this->functions[index];
+      foreach_in_list(ir_function_signature, sig, &f->signatures)
+         read_list(&sig->body);
+      return f;
+   }
+   case ir_type_if: {
+      ir_rvalue *condition = read_rvalue();
+      if (condition == NULL)
+         break;
+
+      ir_if *iif = new(this->mem_ctx) ir_if(condition);
+      read_list(&iif->then_instructions);
+      read_list(&iif->else_instructions);
+      return iif;
+   }
+   case ir_type_loop: {
+      ir_loop *loop = new(this->mem_ctx) ir_loop();
+      read_list(&loop->body_instructions);
+      return loop;
+   }
+   case ir_type_loop_jump: {
+      const uint32_t mode = blob_read_uint32(this->blob);
+      if (mode > ir_loop_jump::jump_continue)
+         break;
+      return new(this->mem_ctx) ir_loop_jump((ir_loop_jump::jump_mode) mode);
+   }
+   case ir_type_return:
+      return new(this->mem_ctx) ir_return(read_rvalue());
+   case ir_type_discard:
+      return new(this->mem_ctx) ir_discard(read_rvalue());
+   case ir_type_emit_vertex: {
+      ir_rvalue *stream = read_rvalue();
+      if (stream == NULL)
+         break;
+      return new(this->mem_ctx) ir_emit_vertex(stream);
+   }
+   case ir_type_end_primitive: {
+      ir_rvalue *stream = read_rvalue();
+      if (stream == NULL)
+         break;
+      return new(this->mem_ctx) ir_end_primitive(stream);
+   }
+   case ir_type_barrier:
+      return new(this->mem_ctx) ir_barrier();
+   default:
+      break;
+   }
+
+   fail();
+   return NULL;
+}
+
+} /* anonymous namespace */
+
+
+bool
+_mesa_glsl_serialize_ir(struct blob *blob, exec_list *instructions)
+{
+   ir_serializer s(blob);
+
+   s.write_ir(instructions);
+
+   return !s.failed;
+}
+
+bool
+_mesa_glsl_deserialize_ir(struct blob_reader *blob, void *mem_ctx,
+                          exec_list *instructions)
+{
+   ir_deserializer d(blob, mem_ctx);
+   exec_list list;
+
+   d.read_ir(&list);
+   if (d.failed || blob->overrun)
+      return false;
+
+   instructions->append_list(&list);
+   return true;
+}
@@ -0,0 +1,65 @@
+/* -*- c++ -*- */
+/*
+ * Copyright © 2016 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+#ifndef IR_SERIALIZE_H
+#define IR_SERIALIZE_H
+
+#include "ir.h"
+#include "blob.h"
+
+/**
+ * Write a list of IR instructions to a blob.
+ *
+ * The list is expected to be a whole shader: every \c ir_function must be at
+ * the top level, and calls may only target signatures in the list or in the
+ * built-in function shader.  Types, variables and signatures are written
+ * once and referred to by index afterwards.
+ *
+ * The encoding is only meant to be read back by the same build of Mesa.
+ *
+ * \return false if the IR could not be serialized.
+ */
+bool
+_mesa_glsl_serialize_ir(struct blob *blob, exec_list *instructions);
+
+/**
+ * Read back a list of IR instructions written by _mesa_glsl_serialize_ir().
+ *
+ * The new instructions are allocated out of \c mem_ctx and appended to
+ * \c instructions.
+ *
+ * Truncated blobs and out-of-range indices, counts and tags are detected,
+ * but the contents are otherwise trusted to be well-formed IR.  Callers
+ * reading from storage that may be corrupted need to checksum it, like the
+ * shader cache does.
+ *
+ * \return false if the blob is truncated or malformed, in which case
+ * \c instructions is left untouched.
+ */
+bool
+_mesa_glsl_deserialize_ir(struct blob_reader *blob, void *mem_ctx,
+                          exec_list *instructions);
+
+#endif /* IR_SERIALIZE_H */
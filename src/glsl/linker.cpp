@@ -75,6 +75,7 @@
 #include "linker.h"
 #include "link_varyings.h"
 #include "ir_optimization.h"
+#include "ir_pass_tracker.h"
 #include "ir_rvalue_visitor.h"
 #include "ir_uniform.h"
 
@@ -4352,9 +4353,10 @@ link_shaders(struct gl_context *ctx, struct gl_shader_program *prog)
          lower_tess_level(prog->_LinkedShaders[i]);
       }
 
+      ir_pass_tracker tracker;
       while (do_common_optimization(prog->_LinkedShaders[i]->ir, true, false,
                                     &ctx->Const.ShaderCompilerOptions[i],
-                                    ctx->Const.NativeIntegers))
+                                    ctx->Const.NativeIntegers, &tracker))
 	 ;
 
       lower_const_arrays_to_uniforms(prog->_LinkedShaders[i]->ir);
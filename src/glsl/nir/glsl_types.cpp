@@ -26,6 +26,7 @@
 #include "glsl_parser_extras.h"
 #include "glsl_types.h"
 #include "util/hash_table.h"
+#include "blob.h"
 
 
 mtx_t glsl_type::mutex = _MTX_INITIALIZER_NP;
@@ -1748,3 +1749,168 @@ glsl_type::coordinate_components() const
 
 #include "builtin_type_macros.h"
 /** @} */
+
+
+/** How a type is described by _mesa_glsl_encode_type() */
+enum type_encoding {
+   type_encoding_builtin,
+   type_encoding_array,
+   type_encoding_record,
+   type_encoding_interface,
+   type_encoding_subroutine,
+};
+
+/** Every built-in type flyweight, in a fixed order */
+static const glsl_type *const *const builtin_types[] = {
+#define DECL_TYPE(NAME, ...) &glsl_type::NAME##_type,
+#define STRUCT_TYPE(NAME) &glsl_type::struct_##NAME##_type,
+#include "builtin_type_macros.h"
+#undef DECL_TYPE
+#undef STRUCT_TYPE
+};
+
+static uint32_t
+pack_struct_field(const glsl_struct_field *field)
+{
+   return field->interpolation |
+          field->centroid << 2 |
+          field->sample << 3 |
+          field->matrix_layout << 4 |
+          field->patch << 6 |
+          field->precision << 7 |
+          field->image_read_only << 9 |
+          field->image_write_only << 10 |
+          field->image_coherent << 11 |
+          field->image_volatile << 12 |
+          field->image_restrict << 13;
+}
+
+static void
+unpack_struct_field(glsl_struct_field *field, uint32_t bits)
+{
+   field->interpolation = bits & 0x3;
+   field->centroid = (bits >> 2) & 0x1;
+   field->sample = (bits >> 3) & 0x1;
+   field->matrix_layout = (bits >> 4) & 0x3;
+   field->patch = (bits >> 6) & 0x1;
+   field->precision = (bits >> 7) & 0x3;
+   field->image_read_only = (bits >> 9) & 0x1;
+   field->image_write_only = (bits >> 10) & 0x1;
+   field->image_coherent = (bits >> 11) & 0x1;
+   field->image_volatile = (bits >> 12) & 0x1;
+   field->image_restrict = (bits >> 13) & 0x1;
+}
+
+bool
+_mesa_glsl_encode_type(struct blob *blob, const struct glsl_type *type)
+{
+   bool ok = true;
+
+   for (unsigned i = 0; i < ARRAY_SIZE(builtin_types); i++) {
+      if (*builtin_types[i] == type) {
+         return blob_write_uint32(blob, type_encoding_builtin) &&
+                blob_write_uint32(blob, i);
+      }
+   }
+
+   switch (type->base_type) {
+   case GLSL_TYPE_ARRAY:
+      return blob_write_uint32(blob, type_encoding_array) &&
+             blob_write_uint32(blob, type->length) &&
+             _mesa_glsl_encode_type(blob, type->fields.array);
+   case GLSL_TYPE_STRUCT:
+   case GLSL_TYPE_INTERFACE:
+      ok = blob_write_uint32(blob, type->is_record() ? type_encoding_record
+                                                     : type_encoding_interface) &&
+           blob_write_string(blob, type->name) &&
+           blob_write_uint32(blob, type->interface_packing) &&
+           blob_write_uint32(blob, type->length);
+
+      for (unsigned i = 0; ok && i < type->length; i++) {
+         const glsl_struct_field *field = &type->fields.structure[i];
+
+         ok = _mesa_glsl_encode_type(blob, field->type) &&
+              blob_write_string(blob, field->name) &&
+              blob_write_uint32(blob, field->location) &&
+              blob_write_uint32(blob, pack_struct_field(field));
+      }
+      return ok;
+   case GLSL_TYPE_SUBROUTINE:
+      return blob_write_uint32(blob, type_encoding_subroutine) &&
+             blob_write_string(blob, type->name);
+   default:
+      /* All other types are built-in flyweights. */
+      return false;
+   }
+}
+
+const struct glsl_type *
+_mesa_glsl_decode_type(struct blob_reader *blob)
+{
+   const uint32_t encoding = blob_read_uint32(blob);
+
+   switch (encoding) {
+   case type_encoding_builtin: {
+      const uint32_t i = blob_read_uint32(blob);
+      if (blob->overrun || i >= ARRAY_SIZE(builtin_types))
+         return NULL;
+      return *builtin_types[i];
+   }
+   case type_encoding_array: {
+      const unsigned length = blob_read_uint32(blob);
+      const glsl_type *element = _mesa_glsl_decode_type(blob);
+      if (element == NULL)
+         return NULL;
+      return glsl_type::get_array_instance(element, length);
+   }
+   case type_encoding_record:
+   case type_encoding_interface: {
+      const char *name = blob_read_string(blob);
+      const unsigned packing = blob_read_uint32(blob);
+      const unsigned length = blob_read_uint32(blob);
+
+      /* Each field takes at least four words, so a corrupt length can't
+       * make us allocate more than the blob would hold.
+       */
+      if (name == NULL || blob->overrun ||
+          length > (size_t) (blob->end - blob->current) / 16)
+         return NULL;
+
+      glsl_struct_field *fields = ralloc_array(NULL, glsl_struct_field, length);
+      const glsl_type *type = NULL;
+      unsigned i;
+
+      for (i = 0; i < length; i++) {
+         fields[i].type = _mesa_glsl_decode_type(blob);
+         fields[i].name = blob_read_string(blob);
+         fields[i].location = blob_read_uint32(blob);
+         unpack_struct_field(&fields[i], blob_read_uint32(blob));
+
+         if (fields[i].type == NULL || fields[i].name == NULL ||
+             blob->overrun)
+            break;
+      }
+
+      if (i == length) {
+         if (encoding == type_encoding_record) {
+            type = glsl_type::get_record_instance(fields, length, name);
+         } else {
+            type = glsl_type::get_interface_instance(fields, length,
+                                                     (glsl_interface_packing) packing,
+                                                     name);
+         }
+      }
+
+      ralloc_free(fields);
+      return type;
+   }
+   case type_encoding_subroutine: {
+      const char *name = blob_read_string(blob);
+      if (name == NULL)
+         return NULL;
+      return glsl_type::get_subroutine_instance(name);
+   }
+   default:
+      return NULL;
+   }
+}
@@ -28,6 +28,7 @@
 
 #include <string.h>
 #include <assert.h>
+#include <stdbool.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -35,6 +36,9 @@ extern "C" {
 
 struct _mesa_glsl_parse_state;
 struct glsl_symbol_table;
+struct glsl_type;
+struct blob;
+struct blob_reader;
 
 extern void
 _mesa_glsl_initialize_types(struct _mesa_glsl_parse_state *state);
@@ -42,6 +46,24 @@ _mesa_glsl_initialize_types(struct _mesa_glsl_parse_state *state);
 extern void
 _mesa_glsl_release_types(void);
 
+/**
+ * Write a self-contained description of \c type to a blob.
+ *
+ * Built-in types are written as an index, and arrays, records, interfaces
+ * and subroutines are described recursively so that reading them back
+ * finds the same flyweight.
+ */
+extern bool
+_mesa_glsl_encode_type(struct blob *blob, const struct glsl_type *type);
+
+/**
+ * Read back a type written by _mesa_glsl_encode_type().
+ *
+ * \return NULL if the blob is truncated or malformed.
+ */
+extern const struct glsl_type *
+_mesa_glsl_decode_type(struct blob_reader *blob);
+
 #ifdef __cplusplus
 }
 #endif
@@ -46,6 +46,8 @@ extern "C" {
 
 struct gl_program;
 struct gl_shader_program;
+struct blob;
+struct blob_reader;
 
 #define NIR_FALSE 0u
 #define NIR_TRUE (~0u)
@@ -1924,6 +1926,11 @@ void nir_print_instr(const nir_instr *instr, FILE *fp);
 
 nir_shader * nir_shader_clone(void *mem_ctx, const nir_shader *s);
 
+bool nir_serialize(struct blob *blob, const nir_shader *s);
+nir_shader *nir_deserialize(void *mem_ctx,
+                            const nir_shader_compiler_options *options,
+                            struct blob_reader *blob);
+
 #ifdef DEBUG
 void nir_validate_shader(nir_shader *shader);
 void nir_metadata_set_validation_flag(nir_shader *shader);
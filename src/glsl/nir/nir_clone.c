@@ -639,6 +639,12 @@ nir_shader_clone(void *mem_ctx, const nir_shader *s)
    clone_var_list(&state, &ns->globals,  &s->globals);
    clone_var_list(&state, &ns->system_values, &s->system_values);
 
+   /* Global registers have to be cloned before the function_impls that use
+    * them.
+    */
+   clone_reg_list(&state, &ns->registers, &s->registers);
+   ns->reg_alloc = s->reg_alloc;
+
    /* Go through and clone functions and overloads */
    foreach_list_typed(nir_function, fxn, node, &s->functions)
       clone_function(&state, fxn, ns);
@@ -650,12 +656,10 @@ nir_shader_clone(void *mem_ctx, const nir_shader *s)
     */
    nir_foreach_overload(s, fo) {
       nir_function_overload *nfo = lookup_ptr(&state, fo);
-      clone_function_impl(&state, fo->impl, nfo);
+      if (fo->impl)
+         clone_function_impl(&state, fo->impl, nfo);
    }
 
-   clone_reg_list(&state, &ns->registers, &s->registers);
-   ns->reg_alloc = s->reg_alloc;
-
    ns->info = s->info;
    ns->info.name = ralloc_strdup(ns, ns->info.name);
    if (ns->info.label)
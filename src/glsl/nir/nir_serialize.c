@@ -0,0 +1,1245 @@
+/*
+ * Copyright © 2016 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "nir.h"
+#include "nir_control_flow_private.h"
+#include "blob.h"
+#include "main/macros.h"
+
+/* The serialized form follows the walk nir_shader_clone() does, so that
+ * reading it back builds the shader in the same order and every SSA def
+ * gets the same index as it would in a clone.
+ *
+ * Variables, registers, SSA defs, overloads and blocks share one index
+ * space.  An object's index is written where it is defined and wherever it
+ * is used.  Phi sources are the only uses that can come before the
+ * definition, so the writer hands out indices on first sight and the reader
+ * resolves phi sources once the whole function_impl has been read, just like
+ * clone_function_impl() does.
+ *
+ * Types have an index space of their own: the first time a type is written
+ * its index is followed by _mesa_glsl_encode_type().
+ */
+
+typedef enum {
+   object_none = 0,
+   object_variable,
+   object_register,
+   object_ssa_def,
+   object_overload,
+   object_block,
+} object_kind;
+
+typedef struct {
+   struct blob *blob;
+
+   /* maps object ptr -> index + 1: */
+   struct hash_table *objects;
+   uint32_t num_objects;
+
+   /* maps glsl_type ptr -> index + 1: */
+   struct hash_table *types;
+   uint32_t num_types;
+
+   bool failed;
+} write_ctx;
+
+typedef struct {
+   struct blob_reader *blob;
+
+   void **objects;
+   object_kind *kinds;
+   uint32_t num_objects;
+
+   const struct glsl_type **types;
+   uint32_t num_types;
+   uint32_t max_types;
+
+   /* List of phi sources whose block and SSA def are still indices. */
+   struct list_head phi_srcs;
+
+   /* new shader object, used as memctx for just about everything else: */
+   nir_shader *ns;
+
+   bool failed;
+} read_ctx;
+
+static uint32_t
+lookup_index(struct hash_table *table, uint32_t *count, const void *ptr,
+             bool *is_new)
+{
+   struct hash_entry *entry = _mesa_hash_table_search(table, ptr);
+
+   *is_new = entry == NULL;
+   if (entry)
+      return (uint32_t) (uintptr_t) entry->data - 1;
+
+   _mesa_hash_table_insert(table, ptr, (void *) (uintptr_t) ++(*count));
+   return *count - 1;
+}
+
+static void
+write_uint32(write_ctx *ctx, uint32_t value)
+{
+   if (!blob_write_uint32(ctx->blob, value))
+      ctx->failed = true;
+}
+
+static void
+write_bytes(write_ctx *ctx, const void *bytes, size_t size)
+{
+   if (!blob_write_bytes(ctx->blob, bytes, size))
+      ctx->failed = true;
+}
+
+static void
+write_string(write_ctx *ctx, const char *str)
+{
+   write_uint32(ctx, str != NULL);
+   if (str && !blob_write_string(ctx->blob, str))
+      ctx->failed = true;
+}
+
+static void
+write_object(write_ctx *ctx, const void *ptr)
+{
+   bool is_new;
+   write_uint32(ctx, lookup_index(ctx->objects, &ctx->num_objects, ptr,
+                                  &is_new));
+}
+
+static void
+write_type(write_ctx *ctx, const struct glsl_type *type)
+{
+   bool is_new;
+   write_uint32(ctx, lookup_index(ctx->types, &ctx->num_types, type,
+                                  &is_new));
+   if (is_new && !_mesa_glsl_encode_type(ctx->blob, type))
+      ctx->failed = true;
+}
+
+static void
+write_nullable_type(write_ctx *ctx, const struct glsl_type *type)
+{
+   write_uint32(ctx, type != NULL);
+   if (type)
+      write_type(ctx, type);
+}
+
+static void
+fail(read_ctx *ctx)
+{
+   ctx->failed = true;
+}
+
+static uint32_t
+read_uint32(read_ctx *ctx)
+{
+   uint32_t value = blob_read_uint32(ctx->blob);
+   if (ctx->blob->overrun)
+      fail(ctx);
+   return value;
+}
+
+/* Read a count of items each taking at least min_item_size bytes, so that
+ * a corrupt count can't make us allocate more than the blob would hold.
+ */
+static unsigned
+read_count(read_ctx *ctx, size_t min_item_size)
+{
+   uint32_t count = read_uint32(ctx);
+   if (count > (size_t) (ctx->blob->end - ctx->blob->current) / min_item_size) {
+      fail(ctx);
+      return 0;
+   }
+   return count;
+}
+
+static void
+read_bytes(read_ctx *ctx, void *dest, size_t size)
+{
+   blob_copy_bytes(ctx->blob, dest, size);
+   if (ctx->blob->overrun)
+      fail(ctx);
+}
+
+/* The string points into the blob, so callers need to copy it. */
+static const char *
+read_string(read_ctx *ctx)
+{
+   const char *str;
+
+   if (!read_uint32(ctx))
+      return NULL;
+
+   str = blob_read_string(ctx->blob);
+   if (str == NULL)
+      fail(ctx);
+   return str;
+}
+
+static void
+read_object_def(read_ctx *ctx, void *obj, object_kind kind)
+{
+   uint32_t idx = read_uint32(ctx);
+
+   if (ctx->failed || idx >= ctx->num_objects ||
+       ctx->kinds[idx] != object_none) {
+      fail(ctx);
+      return;
+   }
+
+   ctx->objects[idx] = obj;
+   ctx->kinds[idx] = kind;
+}
+
+static void *
+lookup_object(read_ctx *ctx, uint32_t idx, object_kind kind)
+{
+   if (ctx->failed || idx >= ctx->num_objects || ctx->kinds[idx] != kind) {
+      fail(ctx);
+      return NULL;
+   }
+   return ctx->objects[idx];
+}
+
+static void *
+read_object(read_ctx *ctx, object_kind kind)
+{
+   return lookup_object(ctx, read_uint32(ctx), kind);
+}
+
+static const struct glsl_type *
+read_type(read_ctx *ctx)
+{
+   uint32_t idx = read_uint32(ctx);
+
+   if (ctx->failed)
+      return NULL;
+
+   if (idx < ctx->num_types)
+      return ctx->types[idx];
+
+   if (idx != ctx->num_types || idx >= ctx->max_types) {
+      fail(ctx);
+      return NULL;
+   }
+
+   ctx->types[idx] = _mesa_glsl_decode_type(ctx->blob);
+   if (ctx->types[idx] == NULL) {
+      fail(ctx);
+      return NULL;
+   }
+   return ctx->types[ctx->num_types++];
+}
+
+static const struct glsl_type *
+read_nullable_type(read_ctx *ctx)
+{
+   if (!read_uint32(ctx))
+      return NULL;
+   return read_type(ctx);
+}
+
+static void
+write_constant(write_ctx *ctx, const nir_constant *c)
+{
+   write_bytes(ctx, &c->value, sizeof(c->value));
+   write_uint32(ctx, c->num_elements);
+   for (unsigned i = 0; i < c->num_elements; i++)
+      write_constant(ctx, c->elements[i]);
+}
+
+static nir_constant *
+read_constant(read_ctx *ctx, nir_variable *nvar)
+{
+   nir_constant *c = ralloc(nvar, nir_constant);
+
+   read_bytes(ctx, &c->value, sizeof(c->value));
+   c->num_elements = read_count(ctx, sizeof(c->value) + sizeof(uint32_t));
+   c->elements = ralloc_array(nvar, nir_constant *, c->num_elements);
+   for (unsigned i = 0; i < c->num_elements; i++) {
+      if (ctx->failed) {
+         c->num_elements = i;
+         break;
+      }
+      c->elements[i] = read_constant(ctx, nvar);
+   }
+
+   return c;
+}
+
+static void
+write_variable(write_ctx *ctx, const nir_variable *var)
+{
+   write_object(ctx, var);
+   write_type(ctx, var->type);
+   write_string(ctx, var->name);
+   write_bytes(ctx, &var->data, sizeof(var->data));
+   write_uint32(ctx, var->num_state_slots);
+   write_bytes(ctx, var->state_slots,
+               var->num_state_slots * sizeof(nir_state_slot));
+   write_uint32(ctx, var->constant_initializer != NULL);
+   if (var->constant_initializer)
+      write_constant(ctx, var->constant_initializer);
+   write_nullable_type(ctx, var->interface_type);
+}
+
+static nir_variable *
+read_variable(read_ctx *ctx)
+{
+   nir_variable *var = rzalloc(ctx->ns, nir_variable);
+   read_object_def(ctx, var, object_variable);
+
+   var->type = read_type(ctx);
+   var->name = ralloc_strdup(var, read_string(ctx));
+   read_bytes(ctx, &var->data, sizeof(var->data));
+   var->num_state_slots = read_count(ctx, sizeof(nir_state_slot));
+   var->state_slots = ralloc_array(var, nir_state_slot, var->num_state_slots);
+   read_bytes(ctx, var->state_slots,
+              var->num_state_slots * sizeof(nir_state_slot));
+   if (read_uint32(ctx))
+      var->constant_initializer = read_constant(ctx, var);
+   var->interface_type = read_nullable_type(ctx);
+
+   return var;
+}
+
+static void
+write_var_list(write_ctx *ctx, const struct exec_list *list)
+{
+   write_uint32(ctx, exec_list_length(list));
+   foreach_list_typed(nir_variable, var, node, list)
+      write_variable(ctx, var);
+}
+
+static void
+read_var_list(read_ctx *ctx, struct exec_list *dst)
+{
+   unsigned length = read_count(ctx, sizeof(uint32_t));
+
+   exec_list_make_empty(dst);
+   for (unsigned i = 0; i < length && !ctx->failed; i++) {
+      nir_variable *var = read_variable(ctx);
+      exec_list_push_tail(dst, &var->node);
+   }
+}
+
+static void
+write_register(write_ctx *ctx, const nir_register *reg)
+{
+   write_object(ctx, reg);
+   write_uint32(ctx, reg->num_components);
+   write_uint32(ctx, reg->num_array_elems);
+   write_uint32(ctx, reg->index);
+   write_string(ctx, reg->name);
+   write_uint32(ctx, reg->is_global);
+   write_uint32(ctx, reg->is_packed);
+}
+
+static nir_register *
+read_register(read_ctx *ctx)
+{
+   nir_register *reg = ralloc(ctx->ns, nir_register);
+   read_object_def(ctx, reg, object_register);
+
+   reg->num_components = read_uint32(ctx);
+   reg->num_array_elems = read_uint32(ctx);
+   reg->index = read_uint32(ctx);
+   reg->name = ralloc_strdup(reg, read_string(ctx));
+   reg->is_global = read_uint32(ctx);
+   reg->is_packed = read_uint32(ctx);
+
+   /* reconstructing uses/defs/if_uses handled by nir_instr_insert() */
+   list_inithead(&reg->uses);
+   list_inithead(&reg->defs);
+   list_inithead(&reg->if_uses);
+
+   return reg;
+}
+
+static void
+write_reg_list(write_ctx *ctx, const struct exec_list *list)
+{
+   write_uint32(ctx, exec_list_length(list));
+   foreach_list_typed(nir_register, reg, node, list)
+      write_register(ctx, reg);
+}
+
+static void
+read_reg_list(read_ctx *ctx, struct exec_list *dst)
+{
+   unsigned length = read_count(ctx, sizeof(uint32_t));
+
+   exec_list_make_empty(dst);
+   for (unsigned i = 0; i < length && !ctx->failed; i++) {
+      nir_register *reg = read_register(ctx);
+      exec_list_push_tail(dst, &reg->node);
+   }
+}
+
+static void
+write_src(write_ctx *ctx, const nir_src *src)
+{
+   write_uint32(ctx, src->is_ssa);
+   if (src->is_ssa) {
+      write_object(ctx, src->ssa);
+   } else {
+      write_object(ctx, src->reg.reg);
+      write_uint32(ctx, src->reg.base_offset);
+      write_uint32(ctx, src->reg.indirect != NULL);
+      if (src->reg.indirect)
+         write_src(ctx, src->reg.indirect);
+   }
+}
+
+static void
+read_src(read_ctx *ctx, void *ninstr_or_if, nir_src *src)
+{
+   src->is_ssa = read_uint32(ctx);
+   if (src->is_ssa) {
+      src->ssa = read_object(ctx, object_ssa_def);
+   } else {
+      src->reg.reg = read_object(ctx, object_register);
+      src->reg.base_offset = read_uint32(ctx);
+      if (read_uint32(ctx) && !ctx->failed) {
+         src->reg.indirect = ralloc(ninstr_or_if, nir_src);
+         read_src(ctx, ninstr_or_if, src->reg.indirect);
+      }
+   }
+}
+
+static void
+write_dest(write_ctx *ctx, const nir_dest *dst)
+{
+   write_uint32(ctx, dst->is_ssa);
+   if (dst->is_ssa) {
+      write_uint32(ctx, dst->ssa.num_components);
+      write_string(ctx, dst->ssa.name);
+      write_object(ctx, &dst->ssa);
+   } else {
+      write_object(ctx, dst->reg.reg);
+      write_uint32(ctx, dst->reg.base_offset);
+      write_uint32(ctx, dst->reg.indirect != NULL);
+      if (dst->reg.indirect)
+         write_src(ctx, dst->reg.indirect);
+   }
+}
+
+static void
+read_dest(read_ctx *ctx, nir_instr *ninstr, nir_dest *dst)
+{
+   dst->is_ssa = read_uint32(ctx);
+   if (dst->is_ssa) {
+      unsigned num_components = read_uint32(ctx);
+      char *name = ralloc_strdup(ninstr, read_string(ctx));
+
+      nir_ssa_dest_init(ninstr, dst, num_components, name);
+      read_object_def(ctx, &dst->ssa, object_ssa_def);
+   } else {
+      dst->reg.reg = read_object(ctx, object_register);
+      dst->reg.base_offset = read_uint32(ctx);
+      if (read_uint32(ctx) && !ctx->failed) {
+         dst->reg.indirect = ralloc(ninstr, nir_src);
+         read_src(ctx, ninstr, dst->reg.indirect);
+      }
+   }
+}
+
+static void
+write_deref_chain(write_ctx *ctx, const nir_deref *deref)
+{
+   for (; deref; deref = deref->child) {
+      write_uint32(ctx, deref->deref_type);
+      write_type(ctx, deref->type);
+
+      switch (deref->deref_type) {
+      case nir_deref_type_array: {
+         const nir_deref_array *darr = nir_deref_as_array(deref);
+         write_uint32(ctx, darr->deref_array_type);
+         write_uint32(ctx, darr->base_offset);
+         if (darr->deref_array_type == nir_deref_array_type_indirect)
+            write_src(ctx, &darr->indirect);
+         break;
+      }
+      case nir_deref_type_struct:
+         write_uint32(ctx, nir_deref_as_struct(deref)->index);
+         break;
+      default:
+         unreachable("bad deref type");
+      }
+   }
+
+   /* A deref_var can only head the chain, so it marks the end. */
+   write_uint32(ctx, nir_deref_type_var);
+}
+
+static void
+read_deref_chain(read_ctx *ctx, nir_instr *ninstr, nir_deref *parent)
+{
+   while (!ctx->failed) {
+      nir_deref_type deref_type = read_uint32(ctx);
+      const struct glsl_type *type;
+      nir_deref *deref;
+
+      if (deref_type == nir_deref_type_var)
+         return;
+
+      type = read_type(ctx);
+
+      switch (deref_type) {
+      case nir_deref_type_array: {
+         nir_deref_array *darr = nir_deref_array_create(parent);
+         darr->deref_array_type = read_uint32(ctx);
+         darr->base_offset = read_uint32(ctx);
+         if (darr->deref_array_type == nir_deref_array_type_indirect)
+            read_src(ctx, ninstr, &darr->indirect);
+         else if (darr->deref_array_type != nir_deref_array_type_direct &&
+                  darr->deref_array_type != nir_deref_array_type_wildcard)
+            fail(ctx);
+         deref = &darr->deref;
+         break;
+      }
+      case nir_deref_type_struct:
+         deref = &nir_deref_struct_create(parent, read_uint32(ctx))->deref;
+         break;
+      default:
+         fail(ctx);
+         return;
+      }
+
+      deref->type = type;
+      parent->child = deref;
+      parent = deref;
+   }
+}
+
+static void
+write_deref_var(write_ctx *ctx, const nir_deref_var *dvar)
+{
+   write_object(ctx, dvar->var);
+   write_deref_chain(ctx, dvar->deref.child);
+}
+
+static nir_deref_var *
+read_deref_var(read_ctx *ctx, nir_instr *ninstr)
+{
+   nir_variable *var = read_object(ctx, object_variable);
+   nir_deref_var *dvar;
+
+   if (var == NULL)
+      return NULL;
+
+   dvar = nir_deref_var_create(ninstr, var);
+   read_deref_chain(ctx, ninstr, &dvar->deref);
+
+   return dvar;
+}
+
+static void
+write_alu(write_ctx *ctx, const nir_alu_instr *alu)
+{
+   write_uint32(ctx, alu->op);
+   write_dest(ctx, &alu->dest.dest);
+   write_uint32(ctx, alu->dest.saturate);
+   write_uint32(ctx, alu->dest.write_mask);
+
+   for (unsigned i = 0; i < nir_op_infos[alu->op].num_inputs; i++) {
+      write_src(ctx, &alu->src[i].src);
+      write_uint32(ctx, alu->src[i].negate);
+      write_uint32(ctx, alu->src[i].abs);
+      write_bytes(ctx, alu->src[i].swizzle, sizeof(alu->src[i].swizzle));
+   }
+}
+
+static nir_alu_instr *
+read_alu(read_ctx *ctx)
+{
+   nir_op op = read_uint32(ctx);
+   nir_alu_instr *alu;
+
+   if (ctx->failed || op >= nir_num_opcodes) {
+      fail(ctx);
+      return NULL;
+   }
+
+   alu = nir_alu_instr_create(ctx->ns, op);
+
+   read_dest(ctx, &alu->instr, &alu->dest.dest);
+   alu->dest.saturate = read_uint32(ctx);
+   alu->dest.write_mask = read_uint32(ctx);
+
+   for (unsigned i = 0; i < nir_op_infos[op].num_inputs; i++) {
+      read_src(ctx, &alu->instr, &alu->src[i].src);
+      alu->src[i].negate = read_uint32(ctx);
+      alu->src[i].abs = read_uint32(ctx);
+      read_bytes(ctx, alu->src[i].swizzle, sizeof(alu->src[i].swizzle));
+   }
+
+   return alu;
+}
+
+static void
+write_intrinsic(write_ctx *ctx, const nir_intrinsic_instr *itr)
+{
+   const nir_intrinsic_info *info = &nir_intrinsic_infos[itr->intrinsic];
+
+   write_uint32(ctx, itr->intrinsic);
+   if (info->has_dest)
+      write_dest(ctx, &itr->dest);
+   write_uint32(ctx, itr->num_components);
+   write_bytes(ctx, itr->const_index, sizeof(itr->const_index));
+
+   for (unsigned i = 0; i < info->num_variables; i++)
+      write_deref_var(ctx, itr->variables[i]);
+
+   for (unsigned i = 0; i < info->num_srcs; i++)
+      write_src(ctx, &itr->src[i]);
+}
+
+static nir_intrinsic_instr *
+read_intrinsic(read_ctx *ctx)
+{
+   nir_intrinsic_op op = read_uint32(ctx);
+   const nir_intrinsic_info *info;
+   nir_intrinsic_instr *itr;
+
+   if (ctx->failed || op >= nir_num_intrinsics) {
+      fail(ctx);
+      return NULL;
+   }
+
+   info = &nir_intrinsic_infos[op];
+   itr = nir_intrinsic_instr_create(ctx->ns, op);
+
+   if (info->has_dest)
+      read_dest(ctx, &itr->instr, &itr->dest);
+   itr->num_components = read_uint32(ctx);
+   read_bytes(ctx, itr->const_index, sizeof(itr->const_index));
+
+   for (unsigned i = 0; i < info->num_variables; i++)
+      itr->variables[i] = read_deref_var(ctx, &itr->instr);
+
+   for (unsigned i = 0; i < info->num_srcs; i++)
+      read_src(ctx, &itr->instr, &itr->src[i]);
+
+   return itr;
+}
+
+static void
+write_load_const(write_ctx *ctx, const nir_load_const_instr *lc)
+{
+   write_uint32(ctx, lc->def.num_components);
+   write_bytes(ctx, &lc->value, sizeof(lc->value));
+   write_object(ctx, &lc->def);
+}
+
+static nir_load_const_instr *
+read_load_const(read_ctx *ctx)
+{
+   nir_load_const_instr *lc =
+      nir_load_const_instr_create(ctx->ns, read_uint32(ctx));
+
+   read_bytes(ctx, &lc->value, sizeof(lc->value));
+   read_object_def(ctx, &lc->def, object_ssa_def);
+
+   return lc;
+}
+
+static void
+write_ssa_undef(write_ctx *ctx, const nir_ssa_undef_instr *undef)
+{
+   write_uint32(ctx, undef->def.num_components);
+   write_object(ctx, &undef->def);
+}
+
+static nir_ssa_undef_instr *
+read_ssa_undef(read_ctx *ctx)
+{
+   nir_ssa_undef_instr *undef =
+      nir_ssa_undef_instr_create(ctx->ns, read_uint32(ctx));
+
+   read_object_def(ctx, &undef->def, object_ssa_def);
+
+   return undef;
+}
+
+static void
+write_tex(write_ctx *ctx, const nir_tex_instr *tex)
+{
+   write_uint32(ctx, tex->num_srcs);
+   write_uint32(ctx, tex->sampler_dim);
+   write_uint32(ctx, tex->dest_type);
+   write_uint32(ctx, tex->op);
+   write_dest(ctx, &tex->dest);
+   for (unsigned i = 0; i < tex->num_srcs; i++) {
+      write_uint32(ctx, tex->src[i].src_type);
+      write_src(ctx, &tex->src[i].src);
+   }
+   write_uint32(ctx, tex->coord_components);
+   write_uint32(ctx, tex->is_array);
+   write_uint32(ctx, tex->is_shadow);
+   write_uint32(ctx, tex->is_new_style_shadow);
+   write_bytes(ctx, tex->const_offset, sizeof(tex->const_offset));
+   write_uint32(ctx, tex->component);
+   write_uint32(ctx, tex->sampler_index);
+   write_uint32(ctx, tex->sampler_array_size);
+   write_uint32(ctx, tex->sampler != NULL);
+   if (tex->sampler)
+      write_deref_var(ctx, tex->sampler);
+}
+
+static nir_tex_instr *
+read_tex(read_ctx *ctx)
+{
+   nir_tex_instr *tex =
+      nir_tex_instr_create(ctx->ns, read_count(ctx, 2 * sizeof(uint32_t)));
+
+   tex->sampler_dim = read_uint32(ctx);
+   tex->dest_type = read_uint32(ctx);
+   tex->op = read_uint32(ctx);
+   read_dest(ctx, &tex->instr, &tex->dest);
+   for (unsigned i = 0; i < tex->num_srcs; i++) {
+      tex->src[i].src_type = read_uint32(ctx);
+      if (tex->src[i].src_type >= nir_num_tex_src_types)
+         fail(ctx);
+      read_src(ctx, &tex->instr, &tex->src[i].src);
+   }
+   tex->coord_components = read_uint32(ctx);
+   tex->is_array = read_uint32(ctx);
+   tex->is_shadow = read_uint32(ctx);
+   tex->is_new_style_shadow = read_uint32(ctx);
+   read_bytes(ctx, tex->const_offset, sizeof(tex->const_offset));
+   tex->component = read_uint32(ctx);
+   tex->sampler_index = read_uint32(ctx);
+   tex->sampler_array_size = read_uint32(ctx);
+   if (read_uint32(ctx))
+      tex->sampler = read_deref_var(ctx, &tex->instr);
+
+   return tex;
+}
+
+static void
+write_phi(write_ctx *ctx, const nir_phi_instr *phi)
+{
+   write_dest(ctx, &phi->dest);
+   write_uint32(ctx, exec_list_length(&phi->srcs));
+
+   nir_foreach_phi_src(phi, src) {
+      /* Phis only exist in SSA form. */
+      if (!src->src.is_ssa)
+         ctx->failed = true;
+
+      write_object(ctx, src->pred);
+      write_object(ctx, src->src.ssa);
+   }
+}
+
+static void
+read_phi(read_ctx *ctx, nir_block *blk)
+{
+   nir_phi_instr *phi = nir_phi_instr_create(ctx->ns);
+   unsigned num_srcs;
+
+   read_dest(ctx, &phi->instr, &phi->dest);
+   if (ctx->failed)
+      return;
+
+   /* As in clone_phi(), insert the phi before setting up its sources, which
+    * may refer to blocks and SSA defs we haven't read yet.  They are stashed
+    * as indices and resolved at the end of read_function_impl().
+    */
+   nir_instr_insert_after_block(blk, &phi->instr);
+
+   num_srcs = read_count(ctx, 2 * sizeof(uint32_t));
+   for (unsigned i = 0; i < num_srcs && !ctx->failed; i++) {
+      nir_phi_src *src = ralloc(phi, nir_phi_src);
+
+      src->pred = (nir_block *) (uintptr_t) read_uint32(ctx);
+      src->src = NIR_SRC_INIT;
+      src->src.is_ssa = true;
+      src->src.ssa = (nir_ssa_def *) (uintptr_t) read_uint32(ctx);
+      src->src.parent_instr = &phi->instr;
+
+      list_add(&src->src.use_link, &ctx->phi_srcs);
+      exec_list_push_tail(&phi->srcs, &src->node);
+   }
+}
+
+static void
+write_call(write_ctx *ctx, const nir_call_instr *call)
+{
+   write_object(ctx, call->callee);
+
+   for (unsigned i = 0; i < call->num_params; i++)
+      write_deref_var(ctx, call->params[i]);
+
+   write_uint32(ctx, call->return_deref != NULL);
+   if (call->return_deref)
+      write_deref_var(ctx, call->return_deref);
+}
+
+static nir_call_instr *
+read_call(read_ctx *ctx)
+{
+   nir_function_overload *callee = read_object(ctx, object_overload);
+   nir_call_instr *call;
+
+   if (callee == NULL)
+      return NULL;
+
+   call = nir_call_instr_create(ctx->ns, callee);
+
+   for (unsigned i = 0; i < call->num_params; i++)
+      call->params[i] = read_deref_var(ctx, &call->instr);
+
+   if (read_uint32(ctx))
+      call->return_deref = read_deref_var(ctx, &call->instr);
+
+   return call;
+}
+
+static void
+write_instr(write_ctx *ctx, const nir_instr *instr)
+{
+   write_uint32(ctx, instr->type);
+
+   switch (instr->type) {
+   case nir_instr_type_alu:
+      write_alu(ctx, nir_instr_as_alu(instr));
+      break;
+   case nir_instr_type_intrinsic:
+      write_intrinsic(ctx, nir_instr_as_intrinsic(instr));
+      break;
+   case nir_instr_type_load_const:
+      write_load_const(ctx, nir_instr_as_load_const(instr));
+      break;
+   case nir_instr_type_ssa_undef:
+      write_ssa_undef(ctx, nir_instr_as_ssa_undef(instr));
+      break;
+   case nir_instr_type_tex:
+      write_tex(ctx, nir_instr_as_tex(instr));
+      break;
+   case nir_instr_type_phi:
+      write_phi(ctx, nir_instr_as_phi(instr));
+      break;
+   case nir_instr_type_jump:
+      write_uint32(ctx, nir_instr_as_jump(instr)->type);
+      break;
+   case nir_instr_type_call:
+      write_call(ctx, nir_instr_as_call(instr));
+      break;
+   case nir_instr_type_parallel_copy:
+      unreachable("Cannot serialize parallel copies");
+   default:
+      unreachable("bad instr type");
+   }
+}
+
+static void
+read_instr(read_ctx *ctx, nir_block *blk)
+{
+   nir_instr_type type = read_uint32(ctx);
+   nir_instr *instr = NULL;
+
+   if (ctx->failed)
+      return;
+
+   switch (type) {
+   case nir_instr_type_alu: {
+      nir_alu_instr *alu = read_alu(ctx);
+      instr = alu ? &alu->instr : NULL;
+      break;
+   }
+   case nir_instr_type_intrinsic: {
+      nir_intrinsic_instr *itr = read_intrinsic(ctx);
+      instr = itr ? &itr->instr : NULL;
+      break;
+   }
+   case nir_instr_type_load_const:
+      instr = &read_load_const(ctx)->instr;
+      break;
+   case nir_instr_type_ssa_undef:
+      instr = &read_ssa_undef(ctx)->instr;
+      break;
+   case nir_instr_type_tex:
+      instr = &read_tex(ctx)->instr;
+      break;
+   case nir_instr_type_phi:
+      read_phi(ctx, blk);
+      return;
+   case nir_instr_type_jump: {
+      nir_jump_type jump_type = read_uint32(ctx);
+      if (jump_type > nir_jump_continue) {
+         fail(ctx);
+         return;
+      }
+      instr = &nir_jump_instr_create(ctx->ns, jump_type)->instr;
+      break;
+   }
+   case nir_instr_type_call: {
+      nir_call_instr *call = read_call(ctx);
+      instr = call ? &call->instr : NULL;
+      break;
+   }
+   default:
+      fail(ctx);
+      return;
+   }
+
+   /* Inserting hooks the sources up to their defs, so it mustn't happen
+    * with any of them missing.
+    */
+   if (!ctx->failed)
+      nir_instr_insert_after_block(blk, instr);
+}
+
+static void
+write_block(write_ctx *ctx, const nir_block *blk)
+{
+   write_object(ctx, blk);
+   write_uint32(ctx, exec_list_length(&blk->instr_list));
+   nir_foreach_instr(blk, instr)
+      write_instr(ctx, instr);
+}
+
+static void
+read_block(read_ctx *ctx, struct exec_list *cf_list)
+{
+   /* Don't actually create a new block.  Just use the one from the tail of
+    * the list, as clone_block() does.
+    */
+   nir_block *blk =
+      exec_node_data(nir_block, exec_list_get_tail(cf_list), cf_node.node);
+   unsigned num_instrs;
+
+   read_object_def(ctx, blk, object_block);
+   num_instrs = read_count(ctx, sizeof(uint32_t));
+   for (unsigned i = 0; i < num_instrs && !ctx->failed; i++)
+      read_instr(ctx, blk);
+}
+
+static void write_cf_list(write_ctx *ctx, const struct exec_list *list);
+static void read_cf_list(read_ctx *ctx, struct exec_list *dst);
+
+static void
+write_cf_list(write_ctx *ctx, const struct exec_list *list)
+{
+   write_uint32(ctx, exec_list_length(list));
+   foreach_list_typed(nir_cf_node, cf, node, list) {
+      write_uint32(ctx, cf->type);
+      switch (cf->type) {
+      case nir_cf_node_block:
+         write_block(ctx, nir_cf_node_as_block(cf));
+         break;
+      case nir_cf_node_if: {
+         const nir_if *nif = nir_cf_node_as_if(cf);
+         write_src(ctx, &nif->condition);
+         write_cf_list(ctx, &nif->then_list);
+         write_cf_list(ctx, &nif->else_list);
+         break;
+      }
+      case nir_cf_node_loop:
+         write_cf_list(ctx, &nir_cf_node_as_loop(cf)->body);
+         break;
+      default:
+         unreachable("bad cf type");
+      }
+   }
+}
+
+static void
+read_cf_list(read_ctx *ctx, struct exec_list *dst)
+{
+   unsigned length = read_count(ctx, sizeof(uint32_t));
+
+   /* Blocks and control flow alternate, starting and ending with a block;
+    * anything else would break the assumption that the tail of dst is the
+    * block to read into.
+    */
+   if ((length & 1) == 0)
+      fail(ctx);
+
+   for (unsigned i = 0; i < length && !ctx->failed; i++) {
+      nir_cf_node_type type = read_uint32(ctx);
+
+      if ((type == nir_cf_node_block) != (i % 2 == 0)) {
+         fail(ctx);
+         return;
+      }
+
+      switch (type) {
+      case nir_cf_node_block:
+         read_block(ctx, dst);
+         break;
+      case nir_cf_node_if: {
+         nir_if *nif = nir_if_create(ctx->ns);
+         read_src(ctx, nif, &nif->condition);
+         if (ctx->failed)
+            return;
+         nir_cf_node_insert_end(dst, &nif->cf_node);
+         read_cf_list(ctx, &nif->then_list);
+         read_cf_list(ctx, &nif->else_list);
+         break;
+      }
+      case nir_cf_node_loop: {
+         nir_loop *loop = nir_loop_create(ctx->ns);
+         nir_cf_node_insert_end(dst, &loop->cf_node);
+         read_cf_list(ctx, &loop->body);
+         break;
+      }
+      default:
+         fail(ctx);
+         return;
+      }
+   }
+}
+
+static void
+write_function_impl(write_ctx *ctx, const nir_function_impl *fi)
+{
+   write_var_list(ctx, &fi->locals);
+   write_reg_list(ctx, &fi->registers);
+   write_uint32(ctx, fi->reg_alloc);
+
+   write_uint32(ctx, fi->num_params);
+   for (unsigned i = 0; i < fi->num_params; i++)
+      write_object(ctx, fi->params[i]);
+
+   write_uint32(ctx, fi->return_var != NULL);
+   if (fi->return_var)
+      write_object(ctx, fi->return_var);
+
+   write_cf_list(ctx, &fi->body);
+}
+
+static void
+read_function_impl(read_ctx *ctx, nir_function_impl *fi)
+{
+   read_var_list(ctx, &fi->locals);
+   read_reg_list(ctx, &fi->registers);
+   fi->reg_alloc = read_uint32(ctx);
+
+   fi->num_params = read_count(ctx, sizeof(uint32_t));
+   fi->params = ralloc_array(ctx->ns, nir_variable *, fi->num_params);
+   for (unsigned i = 0; i < fi->num_params; i++)
+      fi->params[i] = read_object(ctx, object_variable);
+
+   if (read_uint32(ctx))
+      fi->return_var = read_object(ctx, object_variable);
+
+   assert(list_empty(&ctx->phi_srcs));
+
+   read_cf_list(ctx, &fi->body);
+
+   if (ctx->failed)
+      return;
+
+   /* Now that every block and SSA def of the impl exists, resolve the phi
+    * sources like clone_function_impl() does.
+    */
+   list_for_each_entry_safe(nir_phi_src, src, &ctx->phi_srcs, src.use_link) {
+      src->pred = lookup_object(ctx, (uintptr_t) src->pred, object_block);
+      src->src.ssa = lookup_object(ctx, (uintptr_t) src->src.ssa,
+                                   object_ssa_def);
+      if (ctx->failed)
+         return;
+
+      /* Remove from this list and place in the uses of the SSA def */
+      list_del(&src->src.use_link);
+      list_addtail(&src->src.use_link, &src->src.ssa->uses);
+   }
+   assert(list_empty(&ctx->phi_srcs));
+
+   fi->valid_metadata = 0;
+}
+
+static void
+write_function(write_ctx *ctx, const nir_function *fxn)
+{
+   write_string(ctx, fxn->name);
+   write_uint32(ctx, exec_list_length(&fxn->overload_list));
+
+   foreach_list_typed(nir_function_overload, fo, node, &fxn->overload_list) {
+      write_object(ctx, fo);
+      write_uint32(ctx, fo->num_params);
+      for (unsigned i = 0; i < fo->num_params; i++) {
+         write_uint32(ctx, fo->params[i].param_type);
+         write_type(ctx, fo->params[i].type);
+      }
+      write_nullable_type(ctx, fo->return_type);
+      write_uint32(ctx, fo->impl != NULL);
+   }
+}
+
+static void
+read_function(read_ctx *ctx)
+{
+   nir_function *fxn = nir_function_create(ctx->ns, read_string(ctx));
+   unsigned num_overloads = read_count(ctx, sizeof(uint32_t));
+
+   for (unsigned i = 0; i < num_overloads && !ctx->failed; i++) {
+      nir_function_overload *fo = nir_function_overload_create(fxn);
+      read_object_def(ctx, fo, object_overload);
+
+      fo->num_params = read_count(ctx, 2 * sizeof(uint32_t));
+      fo->params = ralloc_array(ctx->ns, nir_parameter, fo->num_params);
+      for (unsigned j = 0; j < fo->num_params; j++) {
+         fo->params[j].param_type = read_uint32(ctx);
+         fo->params[j].type = read_type(ctx);
+      }
+      fo->return_type = read_nullable_type(ctx);
+
+      /* The body is read in a second pass, once every overload a call
+       * could refer to exists.
+       */
+      if (read_uint32(ctx))
+         nir_function_impl_create(fo);
+   }
+}
+
+bool
+nir_serialize(struct blob *blob, const nir_shader *s)
+{
+   write_ctx ctx;
+   struct nir_shader_info info = s->info;
+   size_t header_offset = ALIGN(blob->size, sizeof(uint32_t));
+
+   ctx.blob = blob;
+   ctx.objects = _mesa_hash_table_create(NULL, _mesa_hash_pointer,
+                                         _mesa_key_pointer_equal);
+   ctx.num_objects = 0;
+   ctx.types = _mesa_hash_table_create(NULL, _mesa_hash_pointer,
+                                       _mesa_key_pointer_equal);
+   ctx.num_types = 0;
+   ctx.failed = false;
+
+   /* Object and type counts, filled in at the end. */
+   write_uint32(&ctx, 0);
+   write_uint32(&ctx, 0);
+
+   info.name = NULL;
+   info.label = NULL;
+   write_bytes(&ctx, &info, sizeof(info));
+   write_string(&ctx, s->info.name);
+   write_string(&ctx, s->info.label);
+
+   write_uint32(&ctx, s->stage);
+   write_uint32(&ctx, s->reg_alloc);
+   write_uint32(&ctx, s->num_inputs);
+   write_uint32(&ctx, s->num_uniforms);
+   write_uint32(&ctx, s->num_outputs);
+
+   write_var_list(&ctx, &s->uniforms);
+   write_var_list(&ctx, &s->inputs);
+   write_var_list(&ctx, &s->outputs);
+   write_var_list(&ctx, &s->globals);
+   write_var_list(&ctx, &s->system_values);
+
+   /* Unlike clone, global registers go first so that the impls can refer
+    * to them.
+    */
+   write_reg_list(&ctx, &s->registers);
+
+   write_uint32(&ctx, exec_list_length(&s->functions));
+   foreach_list_typed(nir_function, fxn, node, &s->functions)
+      write_function(&ctx, fxn);
+
+   nir_foreach_overload(s, fo) {
+      if (fo->impl)
+         write_function_impl(&ctx, fo->impl);
+   }
+
+   if (!ctx.failed) {
+      blob_overwrite_uint32(blob, header_offset, ctx.num_objects);
+      blob_overwrite_uint32(blob, header_offset + 4, ctx.num_types);
+   }
+
+   _mesa_hash_table_destroy(ctx.objects, NULL);
+   _mesa_hash_table_destroy(ctx.types, NULL);
+
+   return !ctx.failed;
+}
+
+nir_shader *
+nir_deserialize(void *mem_ctx, const nir_shader_compiler_options *options,
+                struct blob_reader *blob)
+{
+   read_ctx ctx;
+   void *tables_ctx = ralloc_context(NULL);
+   unsigned num_functions;
+   nir_shader *ns;
+
+   ctx.blob = blob;
+   ctx.failed = false;
+   list_inithead(&ctx.phi_srcs);
+
+   ctx.num_objects = read_count(&ctx, sizeof(uint32_t));
+   ctx.max_types = read_count(&ctx, 2 * sizeof(uint32_t));
+   ctx.num_types = 0;
+   ctx.objects = ralloc_array(tables_ctx, void *, ctx.num_objects);
+   ctx.kinds = rzalloc_array(tables_ctx, object_kind, ctx.num_objects);
+   ctx.types = ralloc_array(tables_ctx, const struct glsl_type *,
+                            ctx.max_types);
+
+   ns = nir_shader_create(mem_ctx, MESA_SHADER_VERTEX, options);
+   ctx.ns = ns;
+
+   read_bytes(&ctx, &ns->info, sizeof(ns->info));
+   ns->info.name = ralloc_strdup(ns, read_string(&ctx));
+   ns->info.label = ralloc_strdup(ns, read_string(&ctx));
+
+   ns->stage = read_uint32(&ctx);
+   ns->reg_alloc = read_uint32(&ctx);
+   ns->num_inputs = read_uint32(&ctx);
+   ns->num_uniforms = read_uint32(&ctx);
+   ns->num_outputs = read_uint32(&ctx);
+
+   read_var_list(&ctx, &ns->uniforms);
+   read_var_list(&ctx, &ns->inputs);
+   read_var_list(&ctx, &ns->outputs);
+   read_var_list(&ctx, &ns->globals);
+   read_var_list(&ctx, &ns->system_values);
+
+   read_reg_list(&ctx, &ns->registers);
+
+   num_functions = read_count(&ctx, 2 * sizeof(uint32_t));
+   for (unsigned i = 0; i < num_functions && !ctx.failed; i++)
+      read_function(&ctx);
+
+   nir_foreach_overload(ns, fo) {
+      if (ctx.failed)
+         break;
+      if (fo->impl)
+         read_function_impl(&ctx, fo->impl);
+   }
+
+   ralloc_free(tables_ctx);
+
+   if (ctx.failed || ns->stage >= MESA_SHADER_STAGES) {
+      ralloc_free(ns);
+      return NULL;
+   }
+
+   return ns;
+}
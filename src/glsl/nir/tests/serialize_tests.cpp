@@ -0,0 +1,439 @@
+/*
+ * Copyright © 2016 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <string>
+#include "nir.h"
+#include "nir_builder.h"
+#include "glsl_types.h"
+#include "blob.h"
+#include "program/prog_instruction.h"
+
+class nir_serialize_test : public ::testing::Test {
+protected:
+   nir_serialize_test();
+   ~nir_serialize_test();
+
+   nir_shader *round_trip(nir_shader *s);
+   void check_reserialize(nir_shader *s);
+   void check_round_trip();
+
+   nir_builder b;
+   nir_shader *shader;
+   nir_function_impl *impl;
+   struct blob *blob;
+
+   /* The shader read back by check_round_trip() */
+   nir_shader *copy;
+};
+
+static const nir_shader_compiler_options options = { };
+
+nir_serialize_test::nir_serialize_test()
+{
+   shader = nir_shader_create(NULL, MESA_SHADER_FRAGMENT, &options);
+   shader->info.name = ralloc_strdup(shader, "test");
+   nir_function *func = nir_function_create(shader, "main");
+   nir_function_overload *overload = nir_function_overload_create(func);
+   impl = nir_function_impl_create(overload);
+
+   nir_builder_init(&b, impl);
+   b.cursor = nir_after_cf_list(&impl->body);
+
+   blob = blob_create(shader);
+   copy = NULL;
+}
+
+nir_serialize_test::~nir_serialize_test()
+{
+   ralloc_free(shader);
+}
+
+static std::string
+print_shader(nir_shader *s)
+{
+   FILE *fp = tmpfile();
+   nir_print_shader(s, fp);
+
+   std::string str(ftell(fp), '\0');
+   rewind(fp);
+   EXPECT_EQ(str.size(), fread(&str[0], 1, str.size(), fp));
+   fclose(fp);
+
+   return str;
+}
+
+/**
+ * Serialize \c s and read it back, checking that all of the blob is used.
+ */
+nir_shader *
+nir_serialize_test::round_trip(nir_shader *s)
+{
+   struct blob_reader reader;
+
+   EXPECT_TRUE(nir_serialize(blob, s));
+
+   blob_reader_init(&reader, blob->data, blob->size);
+   nir_shader *copy = nir_deserialize(shader, &options, &reader);
+
+   EXPECT_TRUE(copy != NULL);
+   EXPECT_FALSE(reader.overrun);
+   EXPECT_EQ(reader.end, reader.current);
+
+   return copy;
+}
+
+/**
+ * Check that \c s serializes to the same bytes as the shader it was read
+ * from.
+ */
+void
+nir_serialize_test::check_reserialize(nir_shader *s)
+{
+   struct blob *again = blob_create(shader);
+
+   ASSERT_TRUE(nir_serialize(again, s));
+   ASSERT_EQ(blob->size, again->size);
+   EXPECT_EQ(0, memcmp(blob->data, again->data, blob->size));
+}
+
+/**
+ * Check that reading back the shader gives exactly what nir_shader_clone()
+ * does, and that it serializes to the same bytes again.
+ */
+void
+nir_serialize_test::check_round_trip()
+{
+   nir_validate_shader(shader);
+
+   copy = round_trip(shader);
+   ASSERT_TRUE(copy != NULL);
+   nir_validate_shader(copy);
+
+   EXPECT_EQ(print_shader(nir_shader_clone(shader, shader)),
+             print_shader(copy));
+
+   check_reserialize(copy);
+}
+
+TEST_F(nir_serialize_test, empty)
+{
+   check_round_trip();
+}
+
+TEST_F(nir_serialize_test, variables)
+{
+   const glsl_struct_field fields[] = {
+      glsl_struct_field(glsl_type::vec4_type, "position"),
+      glsl_struct_field(glsl_type::get_array_instance(glsl_type::float_type, 3),
+                        "weights"),
+   };
+   const glsl_type *s_type = glsl_type::get_record_instance(fields, 2, "S");
+
+   nir_variable *in = nir_variable_create(shader, nir_var_shader_in,
+                                          glsl_type::vec4_type, "in");
+   in->data.location = VARYING_SLOT_VAR0;
+   in->data.driver_location = 1;
+
+   nir_variable *out = nir_variable_create(shader, nir_var_shader_out,
+                                           glsl_type::float_type, "out");
+   out->data.location = FRAG_RESULT_DATA0;
+
+   nir_variable *s = nir_variable_create(shader, nir_var_uniform, s_type, "s");
+   s->num_state_slots = 1;
+   s->state_slots = ralloc_array(s, nir_state_slot, 1);
+   memset(s->state_slots, 0, sizeof(nir_state_slot));
+   s->state_slots[0].tokens[0] = 7;
+   s->state_slots[0].swizzle = SWIZZLE_XYZW;
+
+   nir_variable *scale = nir_variable_create(shader, nir_var_global,
+                                             glsl_type::float_type, "scale");
+   scale->constant_initializer = rzalloc(scale, nir_constant);
+   scale->constant_initializer->value.f[0] = 2.0f;
+   scale->data.has_initializer = true;
+
+   nir_variable_create(shader, nir_var_system_value, glsl_type::int_type,
+                       "gl_SampleID")->data.location = SYSTEM_VALUE_SAMPLE_ID;
+
+   nir_variable *tmp = nir_local_variable_create(impl, glsl_type::float_type,
+                                                 "tmp");
+
+   /* tmp = scale * s.weights[int(in.x)]; out = tmp; */
+   nir_intrinsic_instr *load =
+      nir_intrinsic_instr_create(shader, nir_intrinsic_load_var);
+   load->num_components = 1;
+   load->variables[0] = nir_deref_var_create(load, s);
+   nir_deref_struct *dstr = nir_deref_struct_create(load->variables[0], 1);
+   dstr->deref.type = fields[1].type;
+   load->variables[0]->deref.child = &dstr->deref;
+   nir_deref_array *darr = nir_deref_array_create(dstr);
+   darr->deref.type = glsl_type::float_type;
+   darr->deref_array_type = nir_deref_array_type_indirect;
+   darr->indirect = nir_src_for_ssa(nir_f2i(&b, nir_channel(&b, nir_load_var(&b, in), 0)));
+   dstr->deref.child = &darr->deref;
+   nir_ssa_dest_init(&load->instr, &load->dest, 1, "weight");
+   nir_builder_instr_insert(&b, &load->instr);
+
+   nir_store_var(&b, tmp, nir_fmul(&b, nir_load_var(&b, scale),
+                                   &load->dest.ssa));
+   nir_store_var(&b, out, nir_load_var(&b, tmp));
+
+   check_round_trip();
+}
+
+TEST_F(nir_serialize_test, registers)
+{
+   nir_register *global = nir_global_reg_create(shader);
+   global->num_components = 4;
+   global->num_array_elems = 2;
+   global->name = ralloc_strdup(global, "global");
+
+   nir_register *local = nir_local_reg_create(impl);
+   local->num_components = 4;
+
+   nir_ssa_def *value = nir_imm_vec4(&b, 1.0f, -2.0f, 3.0f, -4.0f);
+   nir_ssa_def *index = nir_imm_int(&b, 1);
+
+   /* local.xz = sat(-|value.yx|) */
+   nir_alu_instr *mov = nir_alu_instr_create(shader, nir_op_fmov);
+   mov->src[0].src = nir_src_for_ssa(value);
+   mov->src[0].negate = true;
+   mov->src[0].abs = true;
+   mov->src[0].swizzle[0] = 1;
+   mov->src[0].swizzle[2] = 0;
+   mov->dest.dest = nir_dest_for_reg(local);
+   mov->dest.saturate = true;
+   mov->dest.write_mask = 0x5;
+   nir_builder_instr_insert(&b, &mov->instr);
+
+   /* global[1 + index] = local */
+   nir_alu_instr *store = nir_alu_instr_create(shader, nir_op_fmov);
+   store->src[0].src = nir_src_for_reg(local);
+   store->dest.dest = nir_dest_for_reg(global);
+   store->dest.dest.reg.base_offset = 1;
+   store->dest.dest.reg.indirect = ralloc(store, nir_src);
+   *store->dest.dest.reg.indirect = nir_src_for_ssa(index);
+   store->dest.write_mask = 0xf;
+   nir_builder_instr_insert(&b, &store->instr);
+
+   nir_ssa_undef_instr *undef = nir_ssa_undef_instr_create(shader, 2);
+   nir_builder_instr_insert(&b, &undef->instr);
+
+   check_round_trip();
+}
+
+TEST_F(nir_serialize_test, control_flow)
+{
+   nir_variable *in = nir_variable_create(shader, nir_var_shader_in,
+                                          glsl_type::float_type, "in");
+   nir_variable *out = nir_variable_create(shader, nir_var_shader_out,
+                                           glsl_type::float_type, "out");
+   nir_variable *sum = nir_local_variable_create(impl, glsl_type::float_type,
+                                                 "sum");
+
+   /* sum = 0;
+    * while (true) {
+    *    if (sum > in) break; else sum = sum + 1;
+    *    if (sum == 4) continue;
+    *    sum = sum * 2;
+    * }
+    * out = sum;
+    */
+   nir_store_var(&b, sum, nir_imm_float(&b, 0.0f));
+
+   nir_loop *loop = nir_loop_create(shader);
+   nir_builder_cf_insert(&b, &loop->cf_node);
+   b.cursor = nir_after_cf_list(&loop->body);
+
+   nir_if *nif = nir_if_create(shader);
+   nif->condition = nir_src_for_ssa(nir_flt(&b, nir_load_var(&b, in),
+                                            nir_load_var(&b, sum)));
+   nir_builder_cf_insert(&b, &nif->cf_node);
+
+   b.cursor = nir_after_cf_list(&nif->then_list);
+   nir_builder_instr_insert(&b, &nir_jump_instr_create(shader, nir_jump_break)->instr);
+
+   b.cursor = nir_after_cf_list(&nif->else_list);
+   nir_store_var(&b, sum, nir_fadd(&b, nir_load_var(&b, sum),
+                                   nir_imm_float(&b, 1.0f)));
+
+   b.cursor = nir_after_cf_node(&nif->cf_node);
+   nif = nir_if_create(shader);
+   nif->condition = nir_src_for_ssa(nir_feq(&b, nir_load_var(&b, sum),
+                                            nir_imm_float(&b, 4.0f)));
+   nir_builder_cf_insert(&b, &nif->cf_node);
+
+   b.cursor = nir_after_cf_list(&nif->then_list);
+   nir_builder_instr_insert(&b, &nir_jump_instr_create(shader, nir_jump_continue)->instr);
+
+   b.cursor = nir_after_cf_node(&nif->cf_node);
+   nir_store_var(&b, sum, nir_fmul(&b, nir_load_var(&b, sum),
+                                   nir_imm_float(&b, 2.0f)));
+
+   b.cursor = nir_after_cf_node(&loop->cf_node);
+   nir_store_var(&b, out, nir_load_var(&b, sum));
+
+   /* Turn sum into phis, some of whose sources come after them. */
+   nir_lower_vars_to_ssa(shader);
+
+   check_round_trip();
+}
+
+TEST_F(nir_serialize_test, textures)
+{
+   nir_variable *sampler = nir_variable_create(shader, nir_var_uniform,
+                                               glsl_type::sampler2DShadow_type,
+                                               "shadow");
+   nir_ssa_def *coord = nir_imm_vec4(&b, 0.5f, 0.25f, 1.0f, 0.0f);
+
+   nir_tex_instr *tex = nir_tex_instr_create(shader, 2);
+   tex->op = nir_texop_txl;
+   tex->sampler_dim = GLSL_SAMPLER_DIM_2D;
+   tex->dest_type = nir_type_float;
+   tex->coord_components = 2;
+   tex->is_shadow = true;
+   tex->is_new_style_shadow = true;
+   tex->const_offset[0] = -1;
+   tex->src[0].src_type = nir_tex_src_coord;
+   tex->src[0].src = nir_src_for_ssa(coord);
+   tex->src[1].src_type = nir_tex_src_comparitor;
+   tex->src[1].src = nir_src_for_ssa(nir_channel(&b, coord, 2));
+   tex->sampler = nir_deref_var_create(tex, sampler);
+   nir_ssa_dest_init(&tex->instr, &tex->dest, 1, NULL);
+   nir_builder_instr_insert(&b, &tex->instr);
+
+   /* A lowered one, which only has a sampler index. */
+   tex = nir_tex_instr_create(shader, 0);
+   tex->op = nir_texop_txs;
+   tex->sampler_dim = GLSL_SAMPLER_DIM_3D;
+   tex->dest_type = nir_type_int;
+   tex->sampler_index = 3;
+   tex->sampler_array_size = 4;
+   nir_ssa_dest_init(&tex->instr, &tex->dest, 3, NULL);
+   nir_builder_instr_insert(&b, &tex->instr);
+
+   check_round_trip();
+}
+
+TEST_F(nir_serialize_test, calls)
+{
+   /* float add(in float x, out float y); with its body after main */
+   nir_function *add = nir_function_create(shader, "add");
+   nir_function_overload *add_fo = nir_function_overload_create(add);
+   add_fo->num_params = 2;
+   add_fo->params = ralloc_array(shader, nir_parameter, 2);
+   add_fo->params[0].param_type = nir_parameter_in;
+   add_fo->params[0].type = glsl_type::float_type;
+   add_fo->params[1].param_type = nir_parameter_out;
+   add_fo->params[1].type = glsl_type::float_type;
+   add_fo->return_type = glsl_type::float_type;
+
+   /* A declaration without a body. */
+   nir_function_overload *decl = nir_function_overload_create(add);
+   decl->return_type = glsl_type::void_type;
+
+   nir_function_impl *add_impl = nir_function_impl_create(add_fo);
+   nir_variable *x = nir_local_variable_create(add_impl, glsl_type::float_type, "x");
+   nir_variable *y = nir_local_variable_create(add_impl, glsl_type::float_type, "y");
+   nir_variable *ret = nir_local_variable_create(add_impl, glsl_type::float_type, "ret");
+
+   add_impl->num_params = 2;
+   add_impl->params = ralloc_array(shader, nir_variable *, 2);
+   add_impl->params[0] = x;
+   add_impl->params[1] = y;
+   add_impl->return_var = ret;
+
+   nir_builder add_b;
+   nir_builder_init(&add_b, add_impl);
+   add_b.cursor = nir_after_cf_list(&add_impl->body);
+   nir_store_var(&add_b, y, nir_fadd(&add_b, nir_load_var(&add_b, x),
+                                     nir_imm_float(&add_b, 1.0f)));
+   nir_store_var(&add_b, ret, nir_load_var(&add_b, y));
+
+   nir_variable *a = nir_local_variable_create(impl, glsl_type::float_type, "a");
+   nir_variable *r = nir_local_variable_create(impl, glsl_type::float_type, "r");
+
+   nir_call_instr *call = nir_call_instr_create(shader, add_fo);
+   call->params[0] = nir_deref_var_create(call, a);
+   call->params[1] = nir_deref_var_create(call, a);
+   call->return_deref = nir_deref_var_create(call, r);
+   nir_builder_instr_insert(&b, &call->instr);
+
+   /* nir_print can't print the params of an impl, so compare what the
+    * overloads and impls look like instead.
+    */
+   nir_validate_shader(shader);
+   copy = round_trip(shader);
+   ASSERT_TRUE(copy != NULL);
+   nir_validate_shader(copy);
+   check_reserialize(copy);
+
+   nir_function *copy_add =
+      exec_node_data(nir_function, exec_list_get_tail(&copy->functions), node);
+   EXPECT_STREQ("add", copy_add->name);
+   EXPECT_EQ(2u, exec_list_length(&copy_add->overload_list));
+   nir_function_overload *copy_fo = nir_function_first_overload(copy_add);
+   ASSERT_EQ(2u, copy_fo->num_params);
+   EXPECT_EQ(nir_parameter_out, copy_fo->params[1].param_type);
+   EXPECT_EQ(glsl_type::float_type, copy_fo->return_type);
+   ASSERT_TRUE(copy_fo->impl != NULL);
+   ASSERT_EQ(2u, copy_fo->impl->num_params);
+   EXPECT_STREQ("y", copy_fo->impl->params[1]->name);
+   EXPECT_STREQ("ret", copy_fo->impl->return_var->name);
+
+   nir_function_overload *copy_decl =
+      exec_node_data(nir_function_overload,
+                     exec_list_get_tail(&copy_add->overload_list), node);
+   EXPECT_TRUE(copy_decl->impl == NULL);
+   EXPECT_EQ(glsl_type::void_type, copy_decl->return_type);
+
+   nir_function *copy_main =
+      exec_node_data(nir_function, exec_list_get_head(&copy->functions), node);
+   nir_block *block = nir_start_block(nir_function_first_overload(copy_main)->impl);
+   nir_foreach_instr(block, instr) {
+      if (instr->type == nir_instr_type_call) {
+         EXPECT_EQ(copy_fo, nir_instr_as_call(instr)->callee);
+      }
+   }
+}
+
+TEST_F(nir_serialize_test, truncated)
+{
+   nir_variable *out = nir_variable_create(shader, nir_var_shader_out,
+                                           glsl_type::vec4_type, "out");
+   nir_register *reg = nir_local_reg_create(impl);
+   reg->num_components = 1;
+
+   nir_loop *loop = nir_loop_create(shader);
+   nir_builder_cf_insert(&b, &loop->cf_node);
+   b.cursor = nir_after_cf_list(&loop->body);
+   nir_store_var(&b, out, nir_imm_vec4(&b, 1.0f, 2.0f, 3.0f, 4.0f));
+   nir_builder_instr_insert(&b, &nir_jump_instr_create(shader, nir_jump_break)->instr);
+
+   ASSERT_TRUE(nir_serialize(blob, shader));
+
+   for (size_t size = 0; size < blob->size; size++) {
+      struct blob_reader reader;
+      blob_reader_init(&reader, blob->data, size);
+      EXPECT_TRUE(nir_deserialize(shader, &options, &reader) == NULL) << size;
+   }
+}
@@ -0,0 +1,339 @@
+/*
+ * Copyright © 2016 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \file shader_cache.cpp
+ *
+ * On-disk cache of compiled GLSL shaders.
+ *
+ * When MESA_GLSL_CACHE_DIR is set, the IR that _mesa_glsl_compile_shader()
+ * produces (after preprocessing, parsing, ast_to_hir and the compile-time
+ * optimization loop) is written to a file in that directory, named after a
+ * SHA-1 of the source and of everything in the context that can influence
+ * compilation.  Later compiles of the same shader, in this process or
+ * another one, read the IR back instead.
+ *
+ * Only the result of compiling is cached: a linked program holds uniform
+ * storage, resource lists and driver objects that point into its IR and
+ * into the context, so glLinkProgram still runs the linker, but on shaders
+ * that no longer need to be parsed or optimized.
+ *
+ * Each file holds a small header with the key and a SHA-1 of the payload,
+ * so truncated or stale files are simply ignored.  Files are written to a
+ * temporary name and renamed, so concurrent processes never see partially
+ * written entries.
+ */
+
+#include <stdio.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "shader_cache.h"
+#include "ir.h"
+#include "ir_serialize.h"
+#include "blob.h"
+#include "util/mesa-sha1.h"
+
+/** Bump whenever the file or IR serialization format changes */
+#define SHADER_CACHE_VERSION 1
+
+#define SHADER_CACHE_MAGIC 0x43534c47 /* "GLSC" */
+
+#ifdef HAVE_SHA1
+
+static const char *
+get_cache_dir(void)
+{
+   return getenv("MESA_GLSL_CACHE_DIR");
+}
+
+static char *
+get_cache_path(void *mem_ctx, const unsigned char key[SHADER_CACHE_KEY_SIZE])
+{
+   char sha1_str[41];
+
+   _mesa_sha1_format(sha1_str, key);
+   return ralloc_asprintf(mem_ctx, "%s/%s.ir", get_cache_dir(), sha1_str);
+}
+
+
+bool
+_mesa_glsl_shader_cache_key(struct gl_context *ctx,
+                            const struct gl_shader *shader,
+                            unsigned char key[SHADER_CACHE_KEY_SIZE])
+{
+   struct mesa_sha1 *sha1;
+   struct gl_constants *consts;
+   struct gl_extensions extensions;
+   const unsigned version = SHADER_CACHE_VERSION;
+   const unsigned pointer_size = sizeof(void *);
+   /* The IR layout may change between builds of the same release. */
+   static const char build[] = PACKAGE_VERSION " " __DATE__ " " __TIME__;
+
+   if (get_cache_dir() == NULL || shader->Source == NULL)
+      return false;
+
+   sha1 = _mesa_sha1_init();
+   if (!sha1)
+      return false;
+
+   /* Leave out pointers, which differ from run to run. */
+   consts = (struct gl_constants *) malloc(sizeof(*consts));
+   if (!consts) {
+      _mesa_sha1_final(sha1, key);
+      return false;
+   }
+   memcpy(consts, &ctx->Const, sizeof(*consts));
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++)
+      consts->ShaderCompilerOptions[i].NirOptions = NULL;
+
+   memcpy(&extensions, &ctx->Extensions, sizeof(extensions));
+   extensions.String = NULL;
+
+   _mesa_sha1_update(sha1, &version, sizeof(version));
+   _mesa_sha1_update(sha1, build, sizeof(build));
+   _mesa_sha1_update(sha1, &pointer_size, sizeof(pointer_size));
+   _mesa_sha1_update(sha1, &ctx->API, sizeof(ctx->API));
+   _mesa_sha1_update(sha1, &ctx->Version, sizeof(ctx->Version));
+   _mesa_sha1_update(sha1, consts, sizeof(*consts));
+   _mesa_sha1_update(sha1, &extensions, sizeof(extensions));
+   _mesa_sha1_update(sha1, &shader->Stage, sizeof(shader->Stage));
+   _mesa_sha1_update(sha1, shader->Source, strlen(shader->Source));
+   _mesa_sha1_final(sha1, key);
+
+   free(consts);
+   return true;
+}
+
+
+/**
+ * Write everything _mesa_glsl_compile_shader() sets, but the IR.
+ */
+static void
+write_shader_state(struct blob *blob, const struct gl_shader *shader)
+{
+   blob_write_uint32(blob, shader->Version);
+   blob_write_uint32(blob, shader->IsES);
+   blob_write_uint32(blob, shader->uses_builtin_functions);
+   blob_write_string(blob, shader->InfoLog ? shader->InfoLog : "");
+
+   blob_write_uint32(blob, shader->TessCtrl.VerticesOut);
+   blob_write_uint32(blob, shader->TessEval.PrimitiveMode);
+   blob_write_uint32(blob, shader->TessEval.Spacing);
+   blob_write_uint32(blob, shader->TessEval.VertexOrder);
+   blob_write_uint32(blob, shader->TessEval.PointMode);
+   blob_write_uint32(blob, shader->Geom.VerticesOut);
+   blob_write_uint32(blob, shader->Geom.Invocations);
+   blob_write_uint32(blob, shader->Geom.InputType);
+   blob_write_uint32(blob, shader->Geom.OutputType);
+   for (unsigned i = 0; i < 3; i++)
+      blob_write_uint32(blob, shader->Comp.LocalSize[i]);
+
+   blob_write_uint32(blob, shader->redeclares_gl_fragcoord);
+   blob_write_uint32(blob, shader->uses_gl_fragcoord);
+   blob_write_uint32(blob, shader->pixel_center_integer);
+   blob_write_uint32(blob, shader->origin_upper_left);
+   blob_write_uint32(blob, shader->ARB_fragment_coord_conventions_enable);
+   blob_write_uint32(blob, shader->EarlyFragmentTests);
+}
+
+static void
+read_shader_state(struct blob_reader *blob, struct gl_shader *shader)
+{
+   shader->Version = blob_read_uint32(blob);
+   shader->IsES = blob_read_uint32(blob);
+   shader->uses_builtin_functions = blob_read_uint32(blob);
+
+   ralloc_free(shader->InfoLog);
+   shader->InfoLog = ralloc_strdup(shader, blob_read_string(blob));
+
+   shader->TessCtrl.VerticesOut = blob_read_uint32(blob);
+   shader->TessEval.PrimitiveMode = blob_read_uint32(blob);
+   shader->TessEval.Spacing = blob_read_uint32(blob);
+   shader->TessEval.VertexOrder = blob_read_uint32(blob);
+   shader->TessEval.PointMode = blob_read_uint32(blob);
+   shader->Geom.VerticesOut = blob_read_uint32(blob);
+   shader->Geom.Invocations = blob_read_uint32(blob);
+   shader->Geom.InputType = blob_read_uint32(blob);
+   shader->Geom.OutputType = blob_read_uint32(blob);
+   for (unsigned i = 0; i < 3; i++)
+      shader->Comp.LocalSize[i] = blob_read_uint32(blob);
+
+   shader->redeclares_gl_fragcoord = blob_read_uint32(blob);
+   shader->uses_gl_fragcoord = blob_read_uint32(blob);
+   shader->pixel_center_integer = blob_read_uint32(blob);
+   shader->origin_upper_left = blob_read_uint32(blob);
+   shader->ARB_fragment_coord_conventions_enable = blob_read_uint32(blob);
+   shader->EarlyFragmentTests = blob_read_uint32(blob);
+}
+
+
+bool
+_mesa_glsl_shader_cache_load(struct gl_shader *shader,
+                             const unsigned char key[SHADER_CACHE_KEY_SIZE])
+{
+   void *mem_ctx = ralloc_context(NULL);
+   unsigned char file_key[SHADER_CACHE_KEY_SIZE];
+   unsigned char checksum[20], payload_checksum[20];
+   struct blob_reader file, payload;
+   uint8_t *data = NULL;
+   exec_list *ir = NULL;
+   bool found = false;
+   long size;
+   FILE *f;
+
+   f = fopen(get_cache_path(mem_ctx, key), "rb");
+   if (!f)
+      goto done;
+
+   fseek(f, 0, SEEK_END);
+   size = ftell(f);
+   rewind(f);
+
+   data = (uint8_t *) malloc(size > 0 ? size : 1);
+   if (!data || size <= 0 || fread(data, 1, size, f) != (size_t) size) {
+      fclose(f);
+      goto done;
+   }
+   fclose(f);
+
+   blob_reader_init(&file, data, size);
+   if (blob_read_uint32(&file) != SHADER_CACHE_MAGIC ||
+       blob_read_uint32(&file) != SHADER_CACHE_VERSION)
+      goto done;
+
+   blob_copy_bytes(&file, file_key, sizeof(file_key));
+   blob_copy_bytes(&file, checksum, sizeof(checksum));
+   if (file.overrun || memcmp(file_key, key, sizeof(file_key)) != 0)
+      goto done;
+
+   /* Padding */
+   blob_read_uint64(&file);
+   if (file.overrun)
+      goto done;
+
+   blob_reader_init(&payload, file.current, file.end - file.current);
+   _mesa_sha1_compute(payload.data, payload.end - payload.data,
+                      payload_checksum);
+   if (memcmp(checksum, payload_checksum, sizeof(checksum)) != 0)
+      goto done;
+
+   ir = new(shader) exec_list;
+   if (!_mesa_glsl_deserialize_ir(&payload, ir, ir)) {
+      ralloc_free(ir);
+      goto done;
+   }
+
+   ralloc_free(shader->ir);
+   shader->ir = ir;
+   read_shader_state(&payload, shader);
+   shader->CompileStatus = GL_TRUE;
+   found = true;
+
+done:
+   free(data);
+   ralloc_free(mem_ctx);
+   return found;
+}
+
+
+void
+_mesa_glsl_shader_cache_store(struct gl_shader *shader,
+                              const unsigned char key[SHADER_CACHE_KEY_SIZE])
+{
+   void *mem_ctx = ralloc_context(NULL);
+   struct blob *payload = blob_create(mem_ctx);
+   struct blob *file = blob_create(mem_ctx);
+   unsigned char checksum[20];
+   const char *path, *tmp_path;
+   bool ok;
+   FILE *f;
+
+   if (!payload || !file ||
+       !_mesa_glsl_serialize_ir(payload, shader->ir))
+      goto done;
+
+   write_shader_state(payload, shader);
+   _mesa_sha1_compute(payload->data, payload->size, checksum);
+
+   blob_write_uint32(file, SHADER_CACHE_MAGIC);
+   blob_write_uint32(file, SHADER_CACHE_VERSION);
+   blob_write_bytes(file, key, SHADER_CACHE_KEY_SIZE);
+   blob_write_bytes(file, checksum, sizeof(checksum));
+   /* Keep the payload 8-byte aligned within the file. */
+   blob_write_uint64(file, 0);
+   if (!blob_write_bytes(file, payload->data, payload->size))
+      goto done;
+
+#ifdef _WIN32
+   _mkdir(get_cache_dir());
+#else
+   mkdir(get_cache_dir(), 0755);
+#endif
+
+   path = get_cache_path(mem_ctx, key);
+   tmp_path = ralloc_asprintf(mem_ctx, "%s.%d.tmp", path, (int) getpid());
+
+   f = fopen(tmp_path, "wb");
+   if (!f)
+      goto done;
+
+   ok = fwrite(file->data, 1, file->size, f) == file->size;
+   ok = fclose(f) == 0 && ok;
+
+   if (!ok || rename(tmp_path, path) != 0)
+      remove(tmp_path);
+
+done:
+   ralloc_free(mem_ctx);
+}
+
+#else /* HAVE_SHA1 */
+
+bool
+_mesa_glsl_shader_cache_key(struct gl_context *ctx,
+                            const struct gl_shader *shader,
+                            unsigned char key[SHADER_CACHE_KEY_SIZE])
+{
+   return false;
+}
+
+bool
+_mesa_glsl_shader_cache_load(struct gl_shader *shader,
+                             const unsigned char key[SHADER_CACHE_KEY_SIZE])
+{
+   return false;
+}
+
+void
+_mesa_glsl_shader_cache_store(struct gl_shader *shader,
+                              const unsigned char key[SHADER_CACHE_KEY_SIZE])
+{
+}
+
+#endif /* HAVE_SHA1 */
@@ -0,0 +1,65 @@
+/* -*- c++ -*- */
+/*
+ * Copyright © 2016 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+
+#include "main/mtypes.h"
+
+/** Size of a shader cache key, which is a SHA-1 */
+#define SHADER_CACHE_KEY_SIZE 20
+
+/**
+ * Compute the key under which the compiled form of \c shader is cached.
+ *
+ * \return false if the cache is disabled, in which case the other
+ * functions must not be called.
+ */
+bool
+_mesa_glsl_shader_cache_key(struct gl_context *ctx,
+                            const struct gl_shader *shader,
+                            unsigned char key[SHADER_CACHE_KEY_SIZE]);
+
+/**
+ * Restore a successfully compiled shader from the cache.
+ *
+ * This sets the IR, the info log and everything else a compile would, but
+ * the symbol table, which the caller has to rebuild from the IR.
+ *
+ * \return false if the shader was not found, in which case \c shader is
+ * left untouched.
+ */
+bool
+_mesa_glsl_shader_cache_load(struct gl_shader *shader,
+                             const unsigned char key[SHADER_CACHE_KEY_SIZE]);
+
+/**
+ * Add a successfully compiled shader to the cache.
+ */
+void
+_mesa_glsl_shader_cache_store(struct gl_shader *shader,
+                              const unsigned char key[SHADER_CACHE_KEY_SIZE]);
+
+#endif /* SHADER_CACHE_H */
@@ -39,6 +39,7 @@
 #include <string.h>
 
 #include "test_optpass.h"
+#include "test_startup.h"
 
 /**
  * Print proper usage and exit with failure.
@@ -50,6 +51,7 @@ usage_fail(const char *name)
    printf("\n");
    printf("Possible commands are:\n");
    printf("  optpass: test an optimization pass in isolation\n");
+   printf("  startup: time the compilation of the first shader\n");
    exit(EXIT_FAILURE);
 }
 
@@ -69,6 +71,8 @@ int main(int argc, char **argv)
    const char *command = extract_command_from_argv(&argc, argv);
    if (strcmp(command, "optpass") == 0) {
       return test_optpass(argc, argv);
+   } else if (strcmp(command, "startup") == 0) {
+      return test_startup(argc, argv);
    } else {
       usage_fail(argv[0]);
    }
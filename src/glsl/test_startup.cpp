@@ -0,0 +1,308 @@
+/*
+ * Copyright © 2016 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \file test_startup.cpp
+ *
+ * Standalone benchmark for the cost of compiling the first shader.
+ *
+ * This file provides the "startup" command for the standalone glsl_test
+ * app.  It compiles the GLSL read from stdin a number of times in a fresh
+ * process and reports how long the first compile took, which includes
+ * setting up the types and the built-in functions, next to the average of
+ * the following compiles.
+ *
+ * With --threads, it then also compiles and links programs on several
+ * threads at once.  Each thread compiles a second shader calling a built-in
+ * function no other thread uses, so that built-in functions are generated
+ * while other threads link against the built-in shader.
+ */
+
+#include <string>
+#include <iostream>
+#include <sstream>
+#include <getopt.h>
+#include <time.h>
+
+#include "c11/threads.h"
+#include "ast.h"
+#include "program.h"
+#include "standalone_scaffolding.h"
+#include "program/hash_table.h"
+
+using namespace std;
+
+static string read_stdin_to_eof()
+{
+   stringbuf sb;
+   cin.get(sb, '\0');
+   return sb.str();
+}
+
+static double
+get_time_ms()
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/**
+ * Compile \c source as a new shader, and return the time it took in
+ * milliseconds, or a negative value if compilation failed.
+ */
+static double
+compile(struct gl_context *ctx, int shader_type, const char *source)
+{
+   struct gl_shader *shader = rzalloc(NULL, struct gl_shader);
+   shader->Type = shader_type;
+   shader->Stage = _mesa_shader_enum_to_shader_stage(shader_type);
+   shader->Source = source;
+
+   double start = get_time_ms();
+   _mesa_glsl_compile_shader(ctx, shader, false, false);
+   double time = get_time_ms() - start;
+
+   if (!shader->CompileStatus) {
+      printf("*** compilation failed:\n%s", shader->InfoLog);
+      time = -1.0;
+   }
+
+   ralloc_free(shader);
+   return time;
+}
+
+/** Built-in functions called by the extra shader of each thread. */
+static const char *const thread_builtins[] = {
+   "sin", "cos", "tan", "asin", "acos", "atan", "exp", "log",
+   "exp2", "log2", "sqrt", "inversesqrt", "floor", "ceil", "fract", "sign",
+};
+
+struct thread_data {
+   const char *source;
+   int shader_type;
+   int iterations;
+   unsigned index;
+   bool success;
+};
+
+static bool
+add_shader(struct gl_context *ctx, struct gl_shader_program *prog,
+           int shader_type, const char *source)
+{
+   struct gl_shader *shader = rzalloc(prog, struct gl_shader);
+   shader->Type = shader_type;
+   shader->Stage = _mesa_shader_enum_to_shader_stage(shader_type);
+   shader->Source = source;
+
+   prog->Shaders = reralloc(prog, prog->Shaders, struct gl_shader *,
+                            prog->NumShaders + 1);
+   prog->Shaders[prog->NumShaders++] = shader;
+
+   _mesa_glsl_compile_shader(ctx, shader, false, false);
+   if (!shader->CompileStatus) {
+      printf("*** compilation failed:\n%s", shader->InfoLog);
+      return false;
+   }
+
+   return true;
+}
+
+/**
+ * Compile and link the input shader together with a shader calling one of
+ * \c thread_builtins, \c iterations times.
+ */
+static int
+compile_and_link_thread(void *data)
+{
+   struct thread_data *td = (struct thread_data *) data;
+   const char *builtin =
+      thread_builtins[td->index % ARRAY_SIZE(thread_builtins)];
+
+   struct gl_context local_ctx;
+   struct gl_context *ctx = &local_ctx;
+   initialize_context_to_defaults(ctx, API_OPENGL_COMPAT);
+
+   ctx->Driver.NewShader = _mesa_new_shader;
+
+   td->success = true;
+
+   for (int i = 0; i < td->iterations && td->success; i++) {
+      struct gl_shader_program *prog = rzalloc(NULL, struct gl_shader_program);
+      prog->InfoLog = ralloc_strdup(prog, "");
+      prog->AttributeBindings = new string_to_uint_map;
+      prog->FragDataBindings = new string_to_uint_map;
+      prog->FragDataIndexBindings = new string_to_uint_map;
+
+      char *helper = ralloc_asprintf(prog,
+                                     "float helper(float x)\n"
+                                     "{\n"
+                                     "   return %s(x);\n"
+                                     "}\n", builtin);
+
+      td->success = add_shader(ctx, prog, td->shader_type, td->source) &&
+                    add_shader(ctx, prog, td->shader_type, helper);
+
+      if (td->success) {
+         _mesa_clear_shader_program_data(prog);
+         link_shaders(ctx, prog);
+
+         if (!prog->LinkStatus) {
+            printf("*** linking failed:\n%s", prog->InfoLog);
+            td->success = false;
+         }
+      }
+
+      for (unsigned j = 0; j < MESA_SHADER_STAGES; j++)
+         ralloc_free(prog->_LinkedShaders[j]);
+
+      delete prog->AttributeBindings;
+      delete prog->FragDataBindings;
+      delete prog->FragDataIndexBindings;
+      ralloc_free(prog);
+   }
+
+   return 0;
+}
+
+/**
+ * Compile and link on \c num_threads threads at once, and return the time
+ * it took in milliseconds, or a negative value if anything failed.
+ */
+static double
+compile_and_link_threaded(int shader_type, const char *source,
+                          int num_threads, int iterations)
+{
+   thrd_t *threads = new thrd_t[num_threads];
+   struct thread_data *data = new thread_data[num_threads];
+   bool success = true;
+   int started = 0;
+
+   double start = get_time_ms();
+
+   for (int i = 0; i < num_threads; i++) {
+      data[i].source = source;
+      data[i].shader_type = shader_type;
+      data[i].iterations = iterations;
+      data[i].index = i;
+      data[i].success = false;
+
+      if (thrd_create(&threads[i], compile_and_link_thread,
+                      &data[i]) != thrd_success) {
+         success = false;
+         break;
+      }
+      started++;
+   }
+
+   for (int i = 0; i < started; i++) {
+      thrd_join(threads[i], NULL);
+      success = success && data[i].success;
+   }
+
+   double time = get_time_ms() - start;
+
+   delete [] threads;
+   delete [] data;
+
+   return success ? time : -1.0;
+}
+
+int test_startup(int argc, char **argv)
+{
+   int shader_type = GL_FRAGMENT_SHADER;
+   int iterations = 10;
+   int num_threads = 0;
+
+   const struct option startup_opts[] = {
+      { "vertex-shader", no_argument, &shader_type, GL_VERTEX_SHADER },
+      { "fragment-shader", no_argument, &shader_type, GL_FRAGMENT_SHADER },
+      { "iterations", required_argument, NULL, 'i' },
+      { "threads", required_argument, NULL, 't' },
+      { NULL, 0, NULL, 0 }
+   };
+
+   int idx = 0;
+   int c;
+   while ((c = getopt_long(argc, argv, "", startup_opts, &idx)) != -1) {
+      if (c == 'i' && atoi(optarg) > 0) {
+         iterations = atoi(optarg);
+      } else if (c == 't' && atoi(optarg) > 0) {
+         num_threads = atoi(optarg);
+      } else if (c != 0) {
+         printf("*** usage: %s startup <options> < shader\n", argv[0]);
+         printf("\n");
+         printf("Possible options are:\n");
+         printf("  --vertex-shader: compile a vertex shader\n");
+         printf("  --fragment-shader: compile a fragment shader (the default)\n");
+         printf("  --iterations=<n>: number of compiles (default 10)\n");
+         printf("  --threads=<n>: also compile and link on n threads at once\n");
+         printf("\n");
+         printf("MESA_GLSL_CACHE_DIR should be unset, or all but the first\n");
+         printf("compile are served from the shader cache.\n");
+         exit(EXIT_FAILURE);
+      }
+   }
+
+   struct gl_context local_ctx;
+   struct gl_context *ctx = &local_ctx;
+   initialize_context_to_defaults(ctx, API_OPENGL_COMPAT);
+
+   ctx->Driver.NewShader = _mesa_new_shader;
+
+   string input = read_stdin_to_eof();
+
+   double first = compile(ctx, shader_type, input.c_str());
+   if (first < 0.0)
+      return EXIT_FAILURE;
+
+   double total = 0.0;
+   for (int i = 1; i < iterations; i++) {
+      double time = compile(ctx, shader_type, input.c_str());
+      if (time < 0.0)
+         return EXIT_FAILURE;
+      total += time;
+   }
+
+   printf("first compile:      %8.3f ms\n", first);
+   if (iterations > 1) {
+      printf("subsequent compile: %8.3f ms (average of %d)\n",
+             total / (iterations - 1), iterations - 1);
+   }
+
+   if (num_threads > 0) {
+      double time = compile_and_link_threaded(shader_type, input.c_str(),
+                                              num_threads, iterations);
+      if (time < 0.0)
+         return EXIT_FAILURE;
+
+      printf("threaded compile and link: %8.3f ms (%d threads, %d each)\n",
+             time, num_threads, iterations);
+   }
+
+   _mesa_glsl_release_types();
+   _mesa_glsl_release_builtin_functions();
+
+   return EXIT_SUCCESS;
+}
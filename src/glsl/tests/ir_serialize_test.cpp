@@ -0,0 +1,569 @@
+/*
+ * Copyright © 2016 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include "main/compiler.h"
+#include "main/mtypes.h"
+#include "main/macros.h"
+#include "ir.h"
+#include "ir_builder.h"
+#include "ir_serialize.h"
+#include "program/prog_instruction.h"
+
+using namespace ir_builder;
+
+class ir_serialize_test : public ::testing::Test {
+public:
+   virtual void SetUp();
+   virtual void TearDown();
+
+   void build_shader();
+   void round_trip();
+   ir_variable *find_variable(exec_list *list, const char *name);
+
+   void *mem_ctx;
+
+   /** IR being serialized */
+   exec_list ir;
+
+   /** IR read back by round_trip() */
+   exec_list copy;
+
+   struct blob *blob;
+};
+
+void
+ir_serialize_test::SetUp()
+{
+   this->mem_ctx = ralloc_context(NULL);
+   this->ir.make_empty();
+   this->copy.make_empty();
+   this->blob = blob_create(this->mem_ctx);
+}
+
+void
+ir_serialize_test::TearDown()
+{
+   ralloc_free(this->mem_ctx);
+   this->mem_ctx = NULL;
+}
+
+/**
+ * Serialize \c ir, read it back into \c copy and check that the copy
+ * serializes to exactly the same bytes.
+ */
+void
+ir_serialize_test::round_trip()
+{
+   struct blob_reader reader;
+
+   ASSERT_TRUE(_mesa_glsl_serialize_ir(this->blob, &this->ir));
+
+   blob_reader_init(&reader, this->blob->data, this->blob->size);
+   ASSERT_TRUE(_mesa_glsl_deserialize_ir(&reader, this->mem_ctx, &this->copy));
+   EXPECT_EQ(reader.end, reader.current);
+
+   validate_ir_tree(&this->copy);
+
+   struct blob *again = blob_create(this->mem_ctx);
+   ASSERT_TRUE(_mesa_glsl_serialize_ir(again, &this->copy));
+   ASSERT_EQ(this->blob->size, again->size);
+   EXPECT_EQ(0, memcmp(this->blob->data, again->data, again->size));
+}
+
+/**
+ * Build a shader made of two functions using every kind of instruction
+ * that can appear in a function body.
+ */
+void
+ir_serialize_test::build_shader()
+{
+   ir_variable *const u =
+      new(mem_ctx) ir_variable(glsl_type::vec4_type, "u", ir_var_uniform);
+   ir_variable *const color =
+      new(mem_ctx) ir_variable(glsl_type::vec4_type, "color",
+                               ir_var_shader_out);
+   this->ir.push_tail(u);
+   this->ir.push_tail(color);
+
+   /* float twice(float x) { return x * 2.0; } */
+   ir_function *const twice = new(mem_ctx) ir_function("twice");
+   ir_function_signature *const twice_sig =
+      new(mem_ctx) ir_function_signature(glsl_type::float_type);
+   ir_variable *const x =
+      new(mem_ctx) ir_variable(glsl_type::float_type, "x", ir_var_function_in);
+   twice_sig->parameters.push_tail(x);
+   twice_sig->body.push_tail(ret(mul(x, new(mem_ctx) ir_constant(2.0f))));
+   twice_sig->is_defined = true;
+   twice->add_signature(twice_sig);
+
+   /* Put main() first so that the call refers to a later function. */
+   ir_function *const main_f = new(mem_ctx) ir_function("main");
+   ir_function_signature *const main_sig =
+      new(mem_ctx) ir_function_signature(glsl_type::void_type);
+   main_sig->is_defined = true;
+   main_f->add_signature(main_sig);
+   this->ir.push_tail(main_f);
+   this->ir.push_tail(twice);
+
+   ir_factory body(&main_sig->body, mem_ctx);
+
+   ir_variable *const t = body.make_temp(glsl_type::float_type, "t");
+   ir_variable *const i = body.make_temp(glsl_type::int_type, "i");
+
+   exec_list actual_parameters;
+   actual_parameters.push_tail(swizzle_x(u));
+   body.emit(new(mem_ctx) ir_call(twice_sig,
+                                  new(mem_ctx) ir_dereference_variable(t),
+                                  &actual_parameters));
+
+   ir_if *const discard_if =
+      new(mem_ctx) ir_if(less(t, new(mem_ctx) ir_constant(0.0f)));
+   discard_if->then_instructions.push_tail(new(mem_ctx) ir_discard());
+   discard_if->else_instructions.push_tail(assign(color, swizzle_xy(u), WRITEMASK_XY));
+   body.emit(discard_if);
+
+   body.emit(assign(i, new(mem_ctx) ir_constant(0)));
+   ir_loop *const loop = new(mem_ctx) ir_loop();
+   ir_if *const break_if =
+      new(mem_ctx) ir_if(gequal(i, new(mem_ctx) ir_constant(4)));
+   break_if->then_instructions.push_tail(
+      new(mem_ctx) ir_loop_jump(ir_loop_jump::jump_break));
+   loop->body_instructions.push_tail(break_if);
+   loop->body_instructions.push_tail(
+      assign(i, add(i, new(mem_ctx) ir_constant(1))));
+   loop->body_instructions.push_tail(
+      new(mem_ctx) ir_loop_jump(ir_loop_jump::jump_continue));
+   body.emit(loop);
+
+   body.emit(assign(color, add(u, swizzle_xxxx(t)),
+                    equal(i, new(mem_ctx) ir_constant(4)), WRITEMASK_XYZW));
+   body.emit(new(mem_ctx) ir_emit_vertex(new(mem_ctx) ir_constant(1)));
+   body.emit(new(mem_ctx) ir_end_primitive(new(mem_ctx) ir_constant(1)));
+   body.emit(new(mem_ctx) ir_barrier());
+   body.emit(new(mem_ctx) ir_return());
+}
+
+ir_variable *
+ir_serialize_test::find_variable(exec_list *list, const char *name)
+{
+   foreach_in_list(ir_instruction, ir, list) {
+      ir_variable *const var = ir->as_variable();
+
+      if (var != NULL && var->name != NULL && strcmp(var->name, name) == 0)
+         return var;
+   }
+
+   return NULL;
+}
+
+TEST_F(ir_serialize_test, empty)
+{
+   round_trip();
+
+   EXPECT_TRUE(this->copy.is_empty());
+}
+
+TEST_F(ir_serialize_test, appends_to_list)
+{
+   ir_variable *const existing =
+      new(mem_ctx) ir_variable(glsl_type::int_type, "existing", ir_var_auto);
+   this->copy.push_tail(existing);
+
+   this->ir.push_tail(new(mem_ctx) ir_variable(glsl_type::float_type, "f",
+                                               ir_var_auto));
+
+   struct blob_reader reader;
+
+   ASSERT_TRUE(_mesa_glsl_serialize_ir(this->blob, &this->ir));
+   blob_reader_init(&reader, this->blob->data, this->blob->size);
+   ASSERT_TRUE(_mesa_glsl_deserialize_ir(&reader, this->mem_ctx, &this->copy));
+
+   EXPECT_EQ(2u, this->copy.length());
+   EXPECT_EQ(existing, this->copy.get_head());
+   EXPECT_NE((void *) NULL, find_variable(&this->copy, "f"));
+}
+
+TEST_F(ir_serialize_test, types)
+{
+   const glsl_struct_field record_fields[] = {
+      glsl_struct_field(glsl_type::vec4_type, "a"),
+      glsl_struct_field(glsl_type::get_array_instance(glsl_type::float_type, 3),
+                        "b"),
+   };
+   const glsl_type *const record =
+      glsl_type::get_record_instance(record_fields, ARRAY_SIZE(record_fields),
+                                     "S");
+   const glsl_type *const record_array =
+      glsl_type::get_array_instance(record, 2);
+
+   glsl_struct_field block_fields[] = {
+      glsl_struct_field(glsl_type::mat4_type, "m"),
+      glsl_struct_field(record, "s"),
+   };
+   block_fields[0].matrix_layout = GLSL_MATRIX_LAYOUT_ROW_MAJOR;
+   const glsl_type *const block =
+      glsl_type::get_interface_instance(block_fields, ARRAY_SIZE(block_fields),
+                                        GLSL_INTERFACE_PACKING_STD140,
+                                        "Block");
+
+   const glsl_type *const subroutine =
+      glsl_type::get_subroutine_instance("subroutine_type");
+
+   const glsl_type *const types[] = {
+      glsl_type::dmat3x2_type,
+      glsl_type::sampler2DArrayShadow_type,
+      glsl_type::struct_gl_DepthRangeParameters_type,
+      record,
+      record_array,
+      block,
+      subroutine,
+   };
+
+   for (unsigned i = 0; i < ARRAY_SIZE(types); i++) {
+      char name[8];
+
+      snprintf(name, sizeof(name), "v%u", i);
+      this->ir.push_tail(new(mem_ctx) ir_variable(types[i], name,
+                                                  ir_var_auto));
+   }
+
+   round_trip();
+
+   unsigned i = 0;
+   foreach_in_list(ir_variable, var, &this->copy) {
+      ASSERT_LT(i, ARRAY_SIZE(types));
+      EXPECT_EQ(types[i], var->type);
+      i++;
+   }
+   EXPECT_EQ(ARRAY_SIZE(types), i);
+}
+
+TEST_F(ir_serialize_test, variables)
+{
+   ir_variable *const u =
+      new(mem_ctx) ir_variable(glsl_type::vec4_type, "u", ir_var_uniform);
+   u->data.explicit_location = true;
+   u->data.location = 3;
+   u->data.precision = GLSL_PRECISION_HIGH;
+   this->ir.push_tail(u);
+
+   ir_variable *const in =
+      new(mem_ctx) ir_variable(glsl_type::vec2_type, "in", ir_var_shader_in);
+   in->data.interpolation = INTERP_QUALIFIER_FLAT;
+   in->data.centroid = true;
+   in->data.max_array_access = 7;
+   this->ir.push_tail(in);
+
+   ir_variable *const mvp =
+      new(mem_ctx) ir_variable(glsl_type::mat4_type, "gl_ModelViewMatrix",
+                               ir_var_uniform);
+   ir_state_slot *const slots = mvp->allocate_state_slots(4);
+   for (unsigned i = 0; i < 4; i++) {
+      for (unsigned j = 0; j < ARRAY_SIZE(slots[i].tokens); j++)
+         slots[i].tokens[j] = i * 10 + j;
+      slots[i].swizzle = SWIZZLE_XYZW;
+   }
+   this->ir.push_tail(mvp);
+
+   ir_variable *const c =
+      new(mem_ctx) ir_variable(glsl_type::float_type, "c", ir_var_auto);
+   c->data.read_only = true;
+   c->data.has_initializer = true;
+   c->constant_value = new(mem_ctx) ir_constant(2.5f);
+   c->constant_initializer = new(mem_ctx) ir_constant(2.5f);
+   this->ir.push_tail(c);
+
+   const glsl_struct_field block_fields[] = {
+      glsl_struct_field(glsl_type::vec4_type, "a"),
+      glsl_struct_field(glsl_type::get_array_instance(glsl_type::vec4_type, 0),
+                        "b"),
+   };
+   const glsl_type *const block =
+      glsl_type::get_interface_instance(block_fields, ARRAY_SIZE(block_fields),
+                                        GLSL_INTERFACE_PACKING_STD140,
+                                        "Block");
+   ir_variable *const instance =
+      new(mem_ctx) ir_variable(block, "instance", ir_var_uniform);
+   instance->get_max_ifc_array_access()[1] = 5;
+   this->ir.push_tail(instance);
+
+   ir_variable *const member =
+      new(mem_ctx) ir_variable(glsl_type::vec4_type, "a", ir_var_uniform);
+   member->init_interface_type(block);
+   this->ir.push_tail(member);
+
+   ir_variable *const temp =
+      new(mem_ctx) ir_variable(glsl_type::int_type, "temp", ir_var_temporary);
+   this->ir.push_tail(temp);
+
+   round_trip();
+
+   ASSERT_EQ(7u, this->copy.length());
+
+   ir_variable *const u_copy = find_variable(&this->copy, "u");
+   ASSERT_NE((void *) NULL, u_copy);
+   EXPECT_NE(u, u_copy);
+   EXPECT_EQ(ir_var_uniform, u_copy->data.mode);
+   EXPECT_TRUE(u_copy->data.explicit_location);
+   EXPECT_EQ(3, u_copy->data.location);
+   EXPECT_EQ(GLSL_PRECISION_HIGH, u_copy->data.precision);
+
+   ir_variable *const in_copy = find_variable(&this->copy, "in");
+   ASSERT_NE((void *) NULL, in_copy);
+   EXPECT_EQ(ir_var_shader_in, in_copy->data.mode);
+   EXPECT_EQ(INTERP_QUALIFIER_FLAT, in_copy->data.interpolation);
+   EXPECT_TRUE(in_copy->data.centroid);
+   EXPECT_EQ(7u, in_copy->data.max_array_access);
+
+   ir_variable *const mvp_copy =
+      find_variable(&this->copy, "gl_ModelViewMatrix");
+   ASSERT_NE((void *) NULL, mvp_copy);
+   ASSERT_EQ(4u, mvp_copy->get_num_state_slots());
+   EXPECT_EQ(0, memcmp(slots, mvp_copy->get_state_slots(),
+                       4 * sizeof(ir_state_slot)));
+
+   ir_variable *const c_copy = find_variable(&this->copy, "c");
+   ASSERT_NE((void *) NULL, c_copy);
+   ASSERT_NE((void *) NULL, c_copy->constant_value);
+   ASSERT_NE((void *) NULL, c_copy->constant_initializer);
+   EXPECT_TRUE(c_copy->constant_value->has_value(c->constant_value));
+   EXPECT_TRUE(c_copy->constant_initializer->has_value(c->constant_initializer));
+   EXPECT_TRUE(c_copy->data.read_only);
+
+   ir_variable *const instance_copy = find_variable(&this->copy, "instance");
+   ASSERT_NE((void *) NULL, instance_copy);
+   EXPECT_EQ(block, instance_copy->get_interface_type());
+   EXPECT_EQ(0u, instance_copy->get_max_ifc_array_access()[0]);
+   EXPECT_EQ(5u, instance_copy->get_max_ifc_array_access()[1]);
+
+   ir_variable *const member_copy = find_variable(&this->copy, "a");
+   ASSERT_NE((void *) NULL, member_copy);
+   EXPECT_EQ(block, member_copy->get_interface_type());
+   EXPECT_FALSE(member_copy->is_interface_instance());
+
+   ir_variable *const temp_copy =
+      ((ir_instruction *) this->copy.get_tail())->as_variable();
+   ASSERT_NE((void *) NULL, temp_copy);
+   EXPECT_EQ(ir_var_temporary, temp_copy->data.mode);
+   EXPECT_STREQ(temp->name, temp_copy->name);
+}
+
+TEST_F(ir_serialize_test, constants)
+{
+   const glsl_struct_field fields[] = {
+      glsl_struct_field(glsl_type::ivec2_type, "i"),
+      glsl_struct_field(glsl_type::bool_type, "b"),
+   };
+   const glsl_type *const record =
+      glsl_type::get_record_instance(fields, ARRAY_SIZE(fields), "C");
+
+   exec_list record_values;
+   record_values.push_tail(new(mem_ctx) ir_constant(-3, 2));
+   record_values.push_tail(new(mem_ctx) ir_constant(true));
+
+   exec_list array_values;
+   array_values.push_tail(new(mem_ctx) ir_constant(1.0f, 3));
+   array_values.push_tail(new(mem_ctx) ir_constant(-2.0f, 3));
+
+   ir_constant_data matrix_data;
+   for (unsigned i = 0; i < 16; i++)
+      matrix_data.f[i] = i * 0.25f;
+
+   ir_constant *const constants[] = {
+      new(mem_ctx) ir_constant(3.5f),
+      new(mem_ctx) ir_constant(-7, 4),
+      new(mem_ctx) ir_constant(0xdeadbeefu, 3),
+      new(mem_ctx) ir_constant(false, 2),
+      new(mem_ctx) ir_constant(1.0 / 3.0, 2),
+      new(mem_ctx) ir_constant(glsl_type::mat4_type, &matrix_data),
+      new(mem_ctx) ir_constant(record, &record_values),
+      new(mem_ctx) ir_constant(glsl_type::get_array_instance(glsl_type::vec3_type,
+                                                             2),
+                               &array_values),
+   };
+
+   for (unsigned i = 0; i < ARRAY_SIZE(constants); i++) {
+      char name[8];
+
+      snprintf(name, sizeof(name), "c%u", i);
+      ir_variable *const var =
+         new(mem_ctx) ir_variable(constants[i]->type, name, ir_var_auto);
+      this->ir.push_tail(var);
+      this->ir.push_tail(assign(var, constants[i]));
+   }
+
+   round_trip();
+
+   unsigned i = 0;
+   foreach_in_list(ir_instruction, ir, &this->copy) {
+      ir_assignment *const assign = ir->as_assignment();
+      if (assign == NULL)
+         continue;
+
+      ASSERT_LT(i, ARRAY_SIZE(constants));
+      ir_constant *const c = assign->rhs->as_constant();
+      ASSERT_NE((void *) NULL, c);
+      EXPECT_EQ(constants[i]->type, c->type);
+      EXPECT_TRUE(c->has_value(constants[i]));
+      i++;
+   }
+   EXPECT_EQ(ARRAY_SIZE(constants), i);
+}
+
+TEST_F(ir_serialize_test, functions_and_control_flow)
+{
+   build_shader();
+   round_trip();
+
+   ASSERT_EQ(4u, this->copy.length());
+
+   ir_function *const main_copy =
+      ((ir_instruction *) this->copy.get_head()->next->next)->as_function();
+   ir_function *const twice_copy =
+      ((ir_instruction *) this->copy.get_tail())->as_function();
+   ASSERT_NE((void *) NULL, main_copy);
+   ASSERT_NE((void *) NULL, twice_copy);
+   EXPECT_STREQ("main", main_copy->name);
+   EXPECT_STREQ("twice", twice_copy->name);
+
+   ir_function_signature *const twice_sig_copy =
+      (ir_function_signature *) twice_copy->signatures.get_head();
+   EXPECT_TRUE(twice_sig_copy->is_defined);
+   EXPECT_EQ(glsl_type::float_type, twice_sig_copy->return_type);
+   ASSERT_EQ(1u, twice_sig_copy->parameters.length());
+   EXPECT_STREQ("x",
+                ((ir_variable *) twice_sig_copy->parameters.get_head())->name);
+
+   ir_function_signature *const main_sig_copy =
+      (ir_function_signature *) main_copy->signatures.get_head();
+   ir_function *const main_f =
+      ((ir_instruction *) this->ir.get_head()->next->next)->as_function();
+   ir_function_signature *const main_sig =
+      (ir_function_signature *) main_f->signatures.get_head();
+   ASSERT_EQ(main_sig->body.length(), main_sig_copy->body.length());
+
+   ir_call *call = NULL;
+   foreach_in_list(ir_instruction, ir, &main_sig_copy->body) {
+      call = ir->as_call();
+      if (call != NULL)
+         break;
+   }
+   ASSERT_NE((void *) NULL, call);
+   EXPECT_EQ(twice_sig_copy, call->callee);
+   EXPECT_EQ(1u, call->actual_parameters.length());
+}
+
+TEST_F(ir_serialize_test, textures)
+{
+   ir_variable *const tex =
+      new(mem_ctx) ir_variable(glsl_type::sampler2D_type, "tex",
+                               ir_var_uniform);
+   ir_variable *const coord =
+      new(mem_ctx) ir_variable(glsl_type::vec2_type, "coord",
+                               ir_var_shader_in);
+   ir_variable *const color =
+      new(mem_ctx) ir_variable(glsl_type::vec4_type, "color",
+                               ir_var_shader_out);
+   this->ir.push_tail(tex);
+   this->ir.push_tail(coord);
+   this->ir.push_tail(color);
+
+   ir_texture *const tex_op = new(mem_ctx) ir_texture(ir_tex);
+   tex_op->set_sampler(new(mem_ctx) ir_dereference_variable(tex),
+                       glsl_type::vec4_type);
+   tex_op->coordinate = new(mem_ctx) ir_dereference_variable(coord);
+   tex_op->offset = new(mem_ctx) ir_constant(1, 2);
+   this->ir.push_tail(assign(color, tex_op));
+
+   ir_texture *const txd = new(mem_ctx) ir_texture(ir_txd);
+   txd->set_sampler(new(mem_ctx) ir_dereference_variable(tex),
+                    glsl_type::vec4_type);
+   txd->coordinate = new(mem_ctx) ir_dereference_variable(coord);
+   txd->lod_info.grad.dPdx = new(mem_ctx) ir_constant(0.5f, 2);
+   txd->lod_info.grad.dPdy = new(mem_ctx) ir_constant(0.25f, 2);
+   this->ir.push_tail(assign(color, txd));
+
+   round_trip();
+
+   ir_assignment *const tex_assign =
+      ((ir_instruction *) this->copy.get_tail()->prev)->as_assignment();
+   ir_assignment *const txd_assign =
+      ((ir_instruction *) this->copy.get_tail())->as_assignment();
+   ASSERT_NE((void *) NULL, tex_assign);
+   ASSERT_NE((void *) NULL, txd_assign);
+
+   ir_texture *const tex_copy = tex_assign->rhs->as_texture();
+   ASSERT_NE((void *) NULL, tex_copy);
+   EXPECT_EQ(ir_tex, tex_copy->op);
+   EXPECT_EQ(glsl_type::vec4_type, tex_copy->type);
+   ASSERT_NE((void *) NULL, tex_copy->offset);
+   EXPECT_TRUE(tex_copy->offset->as_constant()->has_value(
+                  tex_op->offset->as_constant()));
+   EXPECT_EQ((void *) NULL, tex_copy->lod_info.grad.dPdx);
+
+   ir_texture *const txd_copy = txd_assign->rhs->as_texture();
+   ASSERT_NE((void *) NULL, txd_copy);
+   EXPECT_EQ(ir_txd, txd_copy->op);
+   ASSERT_NE((void *) NULL, txd_copy->lod_info.grad.dPdx);
+   ASSERT_NE((void *) NULL, txd_copy->lod_info.grad.dPdy);
+   EXPECT_TRUE(txd_copy->lod_info.grad.dPdy->as_constant()->has_value(
+                  txd->lod_info.grad.dPdy->as_constant()));
+}
+
+TEST_F(ir_serialize_test, truncated)
+{
+   build_shader();
+
+   ASSERT_TRUE(_mesa_glsl_serialize_ir(this->blob, &this->ir));
+
+   for (size_t size = 0; size < this->blob->size; size++) {
+      struct blob_reader reader;
+
+      blob_reader_init(&reader, this->blob->data, size);
+      EXPECT_FALSE(_mesa_glsl_deserialize_ir(&reader, this->mem_ctx,
+                                             &this->copy));
+      EXPECT_TRUE(this->copy.is_empty());
+   }
+}
+
+TEST_F(ir_serialize_test, undefined_callee)
+{
+   ir_function *const f = new(mem_ctx) ir_function("f");
+   ir_function_signature *const sig =
+      new(mem_ctx) ir_function_signature(glsl_type::void_type);
+   f->add_signature(sig);
+
+   ir_function *const main_f = new(mem_ctx) ir_function("main");
+   ir_function_signature *const main_sig =
+      new(mem_ctx) ir_function_signature(glsl_type::void_type);
+   main_sig->is_defined = true;
+   main_f->add_signature(main_sig);
+   this->ir.push_tail(main_f);
+
+   /* f is neither part of the IR nor a built-in. */
+   exec_list actual_parameters;
+   main_sig->body.push_tail(new(mem_ctx) ir_call(sig, NULL,
+                                                 &actual_parameters));
+
+   EXPECT_FALSE(_mesa_glsl_serialize_ir(this->blob, &this->ir));
+}
@@ -0,0 +1,193 @@
+/*
+ * Copyright © 2016 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include "ir.h"
+#include "ir_pass_tracker.h"
+
+/**
+ * \file pass_tracker_test.cpp
+ *
+ * Test which passes ir_pass_tracker decides can be skipped.
+ */
+
+/**
+ * Run a fake pass that reports \c progress, and return whether it ran.
+ */
+static bool
+run(ir_pass_tracker &tracker, const char *name, bool progress,
+    exec_list *ir = NULL, unsigned needs = 0)
+{
+   ir_pass_tracker::pass *p = tracker.begin(name, ir, needs);
+
+   if (p == NULL)
+      return false;
+
+   tracker.end(p, progress);
+   return true;
+}
+
+TEST(pass_tracker, first_run)
+{
+   ir_pass_tracker tracker;
+
+   EXPECT_TRUE(run(tracker, "a", false));
+   EXPECT_TRUE(run(tracker, "b", false));
+}
+
+TEST(pass_tracker, skip_without_progress)
+{
+   ir_pass_tracker tracker;
+
+   EXPECT_TRUE(run(tracker, "a", false));
+   EXPECT_TRUE(run(tracker, "b", false));
+
+   /* Nothing changed since either pass found nothing to do. */
+   EXPECT_FALSE(run(tracker, "a", false));
+   EXPECT_FALSE(run(tracker, "b", false));
+}
+
+TEST(pass_tracker, rerun_after_other_progress)
+{
+   ir_pass_tracker tracker;
+
+   EXPECT_TRUE(run(tracker, "a", false));
+   EXPECT_TRUE(run(tracker, "b", true));
+
+   EXPECT_TRUE(run(tracker, "a", false));
+   EXPECT_TRUE(run(tracker, "b", false));
+
+   EXPECT_FALSE(run(tracker, "a", false));
+   EXPECT_FALSE(run(tracker, "b", false));
+}
+
+TEST(pass_tracker, rerun_after_own_progress)
+{
+   ir_pass_tracker tracker;
+
+   EXPECT_TRUE(run(tracker, "a", true));
+   EXPECT_TRUE(run(tracker, "a", true));
+   EXPECT_TRUE(run(tracker, "a", false));
+   EXPECT_FALSE(run(tracker, "a", false));
+}
+
+TEST(pass_tracker, note_progress)
+{
+   ir_pass_tracker tracker;
+
+   EXPECT_TRUE(run(tracker, "a", false));
+
+   EXPECT_FALSE(tracker.note_progress(false));
+   EXPECT_FALSE(run(tracker, "a", false));
+
+   EXPECT_TRUE(tracker.note_progress(true));
+   EXPECT_TRUE(run(tracker, "a", false));
+}
+
+TEST(pass_tracker, names_are_compared_by_value)
+{
+   ir_pass_tracker tracker;
+   char name[] = "a";
+
+   EXPECT_TRUE(run(tracker, "a", false));
+   EXPECT_FALSE(run(tracker, name, false));
+}
+
+class pass_tracker_needs : public ::testing::Test {
+public:
+   virtual void SetUp();
+   virtual void TearDown();
+
+   void *mem_ctx;
+   exec_list ir;
+   ir_function_signature *main_sig;
+};
+
+void
+pass_tracker_needs::SetUp()
+{
+   this->mem_ctx = ralloc_context(NULL);
+   this->ir.make_empty();
+
+   ir_function *main_f = new(mem_ctx) ir_function("main");
+   this->main_sig = new(mem_ctx) ir_function_signature(glsl_type::void_type);
+   main_f->add_signature(this->main_sig);
+   this->ir.push_tail(main_f);
+}
+
+void
+pass_tracker_needs::TearDown()
+{
+   ralloc_free(this->mem_ctx);
+   this->mem_ctx = NULL;
+}
+
+TEST_F(pass_tracker_needs, skip_without_needed_instructions)
+{
+   ir_pass_tracker tracker;
+
+   EXPECT_FALSE(run(tracker, "a", false, &ir, ir_pass_tracker::NEEDS_LOOPS));
+   EXPECT_FALSE(run(tracker, "b", false, &ir,
+                    ir_pass_tracker::NEEDS_CALLS |
+                    ir_pass_tracker::NEEDS_FUNCTIONS));
+   EXPECT_TRUE(run(tracker, "c", false, &ir, 0));
+}
+
+TEST_F(pass_tracker_needs, nested_instructions)
+{
+   ir_pass_tracker tracker;
+   ir_if *iff = new(mem_ctx) ir_if(new(mem_ctx) ir_constant(true));
+   ir_loop *loop = new(mem_ctx) ir_loop();
+
+   loop->body_instructions.push_tail(new(mem_ctx) ir_discard());
+   iff->else_instructions.push_tail(loop);
+   main_sig->body.push_tail(iff);
+
+   EXPECT_TRUE(run(tracker, "a", false, &ir, ir_pass_tracker::NEEDS_LOOPS));
+   EXPECT_TRUE(run(tracker, "b", false, &ir,
+                   ir_pass_tracker::NEEDS_DISCARDS));
+   EXPECT_FALSE(run(tracker, "c", false, &ir, ir_pass_tracker::NEEDS_JUMPS));
+}
+
+TEST_F(pass_tracker_needs, other_functions)
+{
+   ir_pass_tracker tracker;
+   ir_function *f = new(mem_ctx) ir_function("f");
+
+   f->add_signature(new(mem_ctx) ir_function_signature(glsl_type::void_type));
+   ir.push_tail(f);
+
+   EXPECT_TRUE(run(tracker, "a", false, &ir,
+                   ir_pass_tracker::NEEDS_FUNCTIONS));
+}
+
+TEST_F(pass_tracker_needs, look_again_after_progress)
+{
+   ir_pass_tracker tracker;
+
+   EXPECT_FALSE(run(tracker, "a", false, &ir, ir_pass_tracker::NEEDS_LOOPS));
+
+   main_sig->body.push_tail(new(mem_ctx) ir_loop());
+   EXPECT_TRUE(run(tracker, "b", true));
+
+   EXPECT_TRUE(run(tracker, "a", false, &ir, ir_pass_tracker::NEEDS_LOOPS));
+}
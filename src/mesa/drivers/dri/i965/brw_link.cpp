@@ -27,6 +27,7 @@
 #include "brw_nir.h"
 #include "brw_program.h"
 #include "glsl/ir_optimization.h"
+#include "glsl/ir_pass_tracker.h"
 #include "glsl/glsl_parser_extras.h"
 #include "program/program.h"
 #include "main/shaderapi.h"
@@ -160,23 +161,25 @@ process_glsl_ir(gl_shader_stage stage,
                  _mesa_shader_stage_to_abbrev(shader->Stage));
    }
 
+   ir_pass_tracker tracker;
    bool progress;
    do {
       progress = false;
 
       if (compiler->scalar_stage[shader->Stage]) {
-         brw_do_channel_expressions(shader->ir);
-         brw_do_vector_splitting(shader->ir);
+         tracker.note_progress(brw_do_channel_expressions(shader->ir));
+         tracker.note_progress(brw_do_vector_splitting(shader->ir));
       }
 
-      progress = do_lower_jumps(shader->ir, true, true,
+      progress = tracker.note_progress(do_lower_jumps(shader->ir, true, true,
                                 true, /* main return */
                                 false, /* continue */
                                 false /* loops */
-                                ) || progress;
+                                )) || progress;
 
       progress = do_common_optimization(shader->ir, true, true,
-                                        options, ctx->Const.NativeIntegers) || progress;
+                                        options, ctx->Const.NativeIntegers,
+                                        &tracker) || progress;
    } while (progress);
 
    validate_ir_tree(shader->ir);
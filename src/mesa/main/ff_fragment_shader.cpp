@@ -38,6 +38,7 @@
 #include "main/uniforms.h"
 #include "glsl/ir_builder.h"
 #include "glsl/ir_optimization.h"
+#include "glsl/ir_pass_tracker.h"
 #include "glsl/glsl_parser_extras.h"
 #include "glsl/glsl_symbol_table.h"
 #include "glsl/nir/glsl_types.h"
@@ -1249,8 +1250,9 @@ create_new_program(struct gl_context *ctx, struct state_key *key)
    const struct gl_shader_compiler_options *options =
       &ctx->Const.ShaderCompilerOptions[MESA_SHADER_FRAGMENT];
 
+   ir_pass_tracker tracker;
    while (do_common_optimization(p.shader->ir, false, false, options,
-                                 ctx->Const.NativeIntegers))
+                                 ctx->Const.NativeIntegers, &tracker))
       ;
    reparent_ir(p.shader->ir, p.shader->ir);
 
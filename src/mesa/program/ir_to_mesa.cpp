@@ -40,6 +40,7 @@
 #include "glsl/ir_expression_flattening.h"
 #include "glsl/ir_visitor.h"
 #include "glsl/ir_optimization.h"
+#include "glsl/ir_pass_tracker.h"
 #include "glsl/ir_uniform.h"
 #include "glsl/glsl_parser_extras.h"
 #include "glsl/nir/glsl_types.h"
@@ -2887,46 +2888,49 @@ _mesa_ir_link_shader(struct gl_context *ctx, struct gl_shader_program *prog)
       const struct gl_shader_compiler_options *options =
             &ctx->Const.ShaderCompilerOptions[prog->_LinkedShaders[i]->Stage];
 
+      ir_pass_tracker tracker;
       do {
 	 progress = false;
 
 	 /* Lowering */
-	 do_mat_op_to_vec(ir);
-	 lower_instructions(ir, (MOD_TO_FLOOR | DIV_TO_MUL_RCP | EXP_TO_EXP2
-				 | LOG_TO_LOG2 | INT_DIV_TO_MUL_RCP
-				 | ((options->EmitNoPow) ? POW_TO_EXP2 : 0)));
+	 tracker.note_progress(do_mat_op_to_vec(ir));
+	 tracker.note_progress(
+	    lower_instructions(ir, (MOD_TO_FLOOR | DIV_TO_MUL_RCP | EXP_TO_EXP2
+				    | LOG_TO_LOG2 | INT_DIV_TO_MUL_RCP
+				    | ((options->EmitNoPow) ? POW_TO_EXP2 : 0))));
 
-	 progress = do_lower_jumps(ir, true, true, options->EmitNoMainReturn, options->EmitNoCont, options->EmitNoLoops) || progress;
+	 progress = tracker.note_progress(do_lower_jumps(ir, true, true, options->EmitNoMainReturn, options->EmitNoCont, options->EmitNoLoops)) || progress;
 
 	 progress = do_common_optimization(ir, true, true,
-                                           options, ctx->Const.NativeIntegers)
+                                           options, ctx->Const.NativeIntegers,
+                                           &tracker)
 	   || progress;
 
-	 progress = lower_quadop_vector(ir, true) || progress;
+	 progress = tracker.note_progress(lower_quadop_vector(ir, true)) || progress;
 
 	 if (options->MaxIfDepth == 0)
-	    progress = lower_discard(ir) || progress;
+	    progress = tracker.note_progress(lower_discard(ir)) || progress;
 
-	 progress = lower_if_to_cond_assign(ir, options->MaxIfDepth) || progress;
+	 progress = tracker.note_progress(lower_if_to_cond_assign(ir, options->MaxIfDepth)) || progress;
 
 	 if (options->EmitNoNoise)
-	    progress = lower_noise(ir) || progress;
+	    progress = tracker.note_progress(lower_noise(ir)) || progress;
 
 	 /* If there are forms of indirect addressing that the driver
 	  * cannot handle, perform the lowering pass.
 	  */
 	 if (options->EmitNoIndirectInput || options->EmitNoIndirectOutput
 	     || options->EmitNoIndirectTemp || options->EmitNoIndirectUniform)
-	   progress =
+	   progress = tracker.note_progress(
 	     lower_variable_index_to_cond_assign(prog->_LinkedShaders[i]->Stage, ir,
 						 options->EmitNoIndirectInput,
 						 options->EmitNoIndirectOutput,
 						 options->EmitNoIndirectTemp,
-						 options->EmitNoIndirectUniform)
+						 options->EmitNoIndirectUniform))
 	     || progress;
 
-	 progress = do_vec_index_to_cond_assign(ir) || progress;
-         progress = lower_vector_insert(ir, true) || progress;
+	 progress = tracker.note_progress(do_vec_index_to_cond_assign(ir)) || progress;
+         progress = tracker.note_progress(lower_vector_insert(ir, true)) || progress;
       } while (progress);
 
       validate_ir_tree(ir);
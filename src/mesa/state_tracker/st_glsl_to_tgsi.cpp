@@ -34,6 +34,7 @@
 
 #include "glsl_parser_extras.h"
 #include "ir_optimization.h"
+#include "ir_pass_tracker.h"
 
 #include "main/errors.h"
 #include "main/shaderobj.h"
@@ -5835,16 +5836,17 @@ st_link_shader(struct gl_context *ctx, struct gl_shader_program *prog)
          lower_discard(ir);
       }
 
+      ir_pass_tracker tracker;
       do {
          progress = false;
 
-         progress = do_lower_jumps(ir, true, true, options->EmitNoMainReturn, options->EmitNoCont, options->EmitNoLoops) || progress;
+         progress = tracker.note_progress(do_lower_jumps(ir, true, true, options->EmitNoMainReturn, options->EmitNoCont, options->EmitNoLoops)) || progress;
 
          progress = do_common_optimization(ir, true, true, options,
-                                           ctx->Const.NativeIntegers)
+                                           ctx->Const.NativeIntegers, &tracker)
            || progress;
 
-         progress = lower_if_to_cond_assign(ir, options->MaxIfDepth) || progress;
+         progress = tracker.note_progress(lower_if_to_cond_assign(ir, options->MaxIfDepth)) || progress;
 
       } while (progress);
 